@@ -6,6 +6,7 @@
 #define FUNC_IS_MACRO 1
 
 #include <stdio.h>
+#include <stdlib.h>
 
 /** Locator structure.
  *
@@ -39,6 +40,7 @@ typedef struct {
 		char *str; ///< String value for `LIT_STRING`.
 		unsigned long *buf; ///< Buffer value for `LIT_BUFFER`; points to. (char *)(buf + 1) points to the first byte in the buffer. There are *buf bytes starting there. See also LENGTH_OF and BYTES_OF.
 	};
+	sol_object_t *obj; ///< The constant object evaluating this literal yields, created on first evaluation (or NULL).
 } lit_node;
 
 /** Returns the length (as an unsigned long) of the buffer in bytes, not including the length itself. */
@@ -266,7 +268,7 @@ typedef enum {
 #define NEW_ST() malloc(sizeof(stmt_node))
 #define NEW_EX() malloc(sizeof(expr_node))
 #define SET_LOC(node, l) do { (node)->loc.line = (l).first_line; (node)->loc.col = (l).first_column; } while(0)
-#define NEW(arg) malloc(sizeof(arg))
+#define NEW(arg) calloc(1, sizeof(arg))
 #define MAKE_REF_BINOP(nd, tp, name, val) nd = NEW_EX(); \
 	nd->type = EX_BINOP; \
 	nd->binop = NEW(binop_node); \
@@ -328,7 +330,8 @@ void pl_free(paramlist_node *);
 
 void st_print(sol_state_t *, stmt_node *);
 void ex_print(sol_state_t *, expr_node *);
-void ob_print(sol_object_t *);
+void ob_print(sol_state_t *, sol_object_t *);
+void ob_printf(sol_state_t *, const char *, ...);
 
 sol_object_t *sol_eval(sol_state_t *, expr_node *);
 void sol_exec(sol_state_t *, stmt_node *);
@@ -25,5 +25,16 @@ gcc -c $CFLAGS gc.c
 gcc -c $CFLAGS object.c
 gcc -c $CFLAGS state.c
 gcc -c $CFLAGS builtins.c
+gcc -c $CFLAGS format.c
+gcc -c $CFLAGS search.c
+gcc -c $CFLAGS sort.c
+gcc -c $CFLAGS iter.c
+gcc -c $CFLAGS typedarray.c
+gcc -c $CFLAGS pack.c
+gcc -c $CFLAGS net.c
+gcc -c $CFLAGS event.c
+gcc -c $CFLAGS http.c
+gcc -c $CFLAGS json.c
+gcc -c $CFLAGS marshal.c
 gcc -c $CFLAGS solrun.c
 gcc $CFLAGS *.o -o sol -lm -ldl
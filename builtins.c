@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <ctype.h>
 #include <stdint.h>
 #include <dlfcn.h>
 #ifndef NO_READLINE
@@ -10,7 +11,11 @@
 #include <readline/history.h>
 #endif
 #include <termios.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ast.h"
 #include "dsl/dsl.h"
 
@@ -18,20 +23,6 @@
 
 #define STDIO_CHUNK_SIZE 4096
 
-static char *_itoa(int i) {
-	int n = 33;
-	char *s = malloc(n);
-	snprintf(s, n, "%d", i);
-	return s;
-}
-
-static char *_ftoa(double f) {
-	int n = 65;
-	char *s = malloc(n);
-	snprintf(s, n, "%f", f);
-	return s;
-}
-
 sol_object_t *sol_f_not_impl(sol_state_t *state, sol_object_t *args) {
 	char buffer[64];
 	snprintf(buffer, 64, "Undefined method (%s on %s)", state->calling_meth, state->calling_type);
@@ -71,7 +62,15 @@ sol_object_t *sol_f_default_tobuffer(sol_state_t *state, sol_object_t *args) {
 sol_object_t *sol_f_tbang(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1);
 	int refa = a->refcnt, refb = b->refcnt;
-	sol_object_t c = *b;
+	sol_object_t c;
+	// Containers carry a collector header, so they can only trade places with
+	// each other.
+	if(sol_is_container(a) != sol_is_container(b)) {
+		sol_obj_free(a);
+		sol_obj_free(b);
+		return sol_set_error_string(state, "Swap container with non-container");
+	}
+	c = *b;
 	*b = *a;
 	*a = c;
 	b->refcnt = refa;
@@ -109,6 +108,19 @@ sol_object_t *sol_f_tostring(sol_state_t *state, sol_object_t *args) {
 	return res;
 }
 
+sol_object_t *sol_f_format(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *fmt = sol_list_get_index(state, args, 0), *str = NULL, *res;
+	if(sol_is_buffer(fmt) && fmt->mem->sz >= 0) {
+		res = sol_format(state, fmt->mem->buffer, fmt->mem->sz, fmt->mem->flags & SOL_BUF_IMMUTABLE, args, 1);
+	} else {
+		str = sol_is_string(fmt) ? sol_incref(fmt) : sol_cast_string(state, fmt);
+		res = sol_format(state, str->str, str->slen, 0, args, 1);
+	}
+	sol_obj_free(fmt);
+	sol_obj_free(str);
+	return res;
+}
+
 sol_object_t *sol_f_tobuffer(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *obj = sol_list_get_index(state, args, 0);
 	sol_object_t *res = CALL_METHOD(state, obj, tobuffer, args);
@@ -195,97 +207,116 @@ int test_seen(sol_object_t *obj) {
 	return 0;
 }
 
-void ob_print(sol_object_t *obj) {
-	sol_object_t *cur;
+// Prints through io.stdout (and so its write buffer), or straight to the
+// process's stdout if io.stdout isn't a stream.
+void ob_printf(sol_state_t *state, const char *fmt, ...) {
+	va_list va;
+	va_start(va, fmt);
+	if(sol_is_stream(state->_stdout)) {
+		sol_stream_vprintf(state, state->_stdout, fmt, va);
+	} else {
+		vprintf(fmt, va);
+	}
+	va_end(va);
+}
+
+void ob_print(sol_state_t *state, sol_object_t *obj) {
+	sol_object_t *cur, *key, *val;
 	dsl_seq_iter *iter;
+	size_t pos;
 	int i;
 	if(test_seen(obj)) {
 		return;
 	}
 	switch(obj->type) {
 		case SOL_SINGLET:
-			printf("%s", obj->str);
+			ob_printf(state, "%s", obj->str);
 			break;
 
 		case SOL_INTEGER:
-			printf("%ld", obj->ival);
+			ob_printf(state, "%ld", obj->ival);
 			break;
 
 		case SOL_FLOAT:
-			printf("%f", obj->fval);
+			ob_printf(state, "%f", obj->fval);
 			break;
 
 		case SOL_STRING:
-			printf("\"%s\"", obj->str);
+			ob_printf(state, "\"%s\"", obj->str);
 			break;
 
 		case SOL_LIST:
-			printf("[");
+			ob_printf(state, "[");
 			iter = dsl_new_seq_iter(obj->seq);
 			while(!dsl_seq_iter_is_invalid(iter)) {
-				ob_print(dsl_seq_iter_at(iter));
-				printf(", ");
+				ob_print(state, dsl_seq_iter_at(iter));
+				ob_printf(state, ", ");
 				dsl_seq_iter_next(iter);
 			}
 			dsl_free_seq_iter(iter);
-			printf("]");
+			ob_printf(state, "]");
 			break;
 
 		case SOL_MCELL:
-			printf("<<");
-			ob_print(obj->key);
-			printf("=");
-			ob_print(obj->val);
-			printf(">>");
+			ob_printf(state, "<<");
+			ob_print(state, obj->key);
+			ob_printf(state, "=");
+			ob_print(state, obj->val);
+			ob_printf(state, ">>");
 
 		case SOL_MAP:
-			printf("{");
-			iter = dsl_new_seq_iter(obj->seq);
-			while(!dsl_seq_iter_is_invalid(iter)) {
-				printf("[");
-				ob_print(AS_OBJ(dsl_seq_iter_at(iter))->key);
-				printf("] = ");
-				ob_print(AS_OBJ(dsl_seq_iter_at(iter))->val);
-				printf(", ");
-				dsl_seq_iter_next(iter);
+			ob_printf(state, "{");
+			pos = 0;
+			while(sol_map_next(NULL, obj, &pos, &key, &val)) {
+				ob_printf(state, "[");
+				ob_print(state, key);
+				ob_printf(state, "] = ");
+				ob_print(state, val);
+				ob_printf(state, ", ");
 			}
-			dsl_free_seq_iter(iter);
-			printf("}");
+			ob_printf(state, "}");
 			break;
 
 		case SOL_FUNCTION:
-			if(obj->fname) {
-				printf("<Function %s>", obj->fname);
+			if(obj->fn->fname) {
+				ob_printf(state, "<Function %s>", obj->fn->fname);
 			} else {
-				printf("<Function>");
+				ob_printf(state, "<Function>");
 			}
 			break;
 
 		case SOL_CFUNCTION:
-			printf("<CFunction>");
+			ob_printf(state, "<CFunction>");
 			break;
 
 		case SOL_STMT:
-			st_print(NULL, obj->node); //TODO: FIXME
+			st_print(state, obj->node);
 			break;
 
 		case SOL_EXPR:
-			ex_print(NULL, obj->node); //TODO: FIXME
+			ex_print(state, obj->node);
 			break;
 
 		case SOL_BUFFER:
 			/*
-			if(obj->sz == -1) {
-				printf("<Buffer @%p>", obj->buffer);
+			if(obj->mem->sz == -1) {
+				printf("<Buffer @%p>", obj->mem->buffer);
 			} else {
-				printf("<Buffer @%p size %ld>", obj->buffer, obj->sz);
+				printf("<Buffer @%p size %ld>", obj->mem->buffer, obj->mem->sz);
 			}
 			*/
-			fwrite(obj->buffer, sizeof(char), obj->sz, stdout);
+			if(obj->mem->sz < 0) {
+				break;
+			}
+			if(sol_is_stream(state->_stdout)) {
+				sol_stream_fwrite(state, state->_stdout, obj->mem->buffer, sizeof(char), obj->mem->sz);
+			} else {
+				fwrite(obj->mem->buffer, sizeof(char), obj->mem->sz, stdout);
+			}
 			break;
 
 		case SOL_CDATA:
-			printf("<CData>");
+			ob_printf(state, "<CData>");
 			break;
 
 			/*default:
@@ -297,18 +328,20 @@ void ob_print(sol_object_t *obj) {
 
 sol_object_t *sol_f_prepr(sol_state_t *state, sol_object_t *args) {
 	int i, sz = sol_list_len(state, args);
-	sol_object_t *obj, *str;
+	sol_object_t *obj, *str, *repr;
 	seen = dsl_seq_new_array(NULL, NULL);
 	for(i = 0; i < sz; i++) {
 		obj = sol_list_get_index(state, args, i);
-		str = sol_cast_repr(state, obj);
+		repr = sol_cast_repr(state, obj);
+		str = sol_cast_string(state, repr);
+		sol_obj_free(repr);
 		sol_printf(state, "%s", str->str);
 		sol_printf(state, " ");
 		sol_obj_free(obj);
 		sol_obj_free(str);
 	}
 	sol_printf(state, "\n");
-	printf("\n");
+	sol_printf(state, "\n");
 	dsl_free_seq(seen);
 	seen = NULL;
 	return sol_incref(state->None);
@@ -316,17 +349,16 @@ sol_object_t *sol_f_prepr(sol_state_t *state, sol_object_t *args) {
 
 sol_object_t *sol_f_print(sol_state_t *state, sol_object_t *args) {
 	int i, sz = sol_list_len(state, args);
-	sol_object_t *obj, *str;
+	sol_object_t *obj, *out = sol_get_stdout(state);
 	seen = dsl_seq_new_array(NULL, NULL);
 	for(i = 0; i < sz; i++) {
 		obj = sol_list_get_index(state, args, i);
-		str = sol_cast_string(state, obj);
-		sol_printf(state, "%s", str->str);
-		sol_printf(state, " ");
+		sol_stream_write_obj(state, out, obj);
+		sol_stream_fputc(state, out, ' ');
 		sol_obj_free(obj);
-		sol_obj_free(str);
 	}
-	sol_printf(state, "\n");
+	sol_stream_fputc(state, out, '\n');
+	sol_obj_free(out);
 	dsl_free_seq(seen);
 	seen = NULL;
 	return sol_incref(state->None);
@@ -446,8 +478,8 @@ sol_object_t *sol_f_parse(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *prg = sol_list_get_index(state, args, 0), *prgstr;
 	stmt_node *program;
 	if(sol_is_buffer(prg)) {
-		if(prg->sz >= 0) {
-			program = sol_compile_buffer(prg->buffer, prg->sz);
+		if(prg->mem->sz >= 0) {
+			program = sol_compile_buffer(prg->mem->buffer, prg->mem->sz);
 		} else {
 			sol_obj_free(prg);
 			return sol_set_error_string(state, "parse unsized buffer");
@@ -501,14 +533,14 @@ sol_object_t *sol_f_chr(sol_state_t *state, sol_object_t *args) {
 
 sol_object_t *sol_f_debug_getref(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *obj = sol_list_get_index(state, args, 0);
-	sol_object_t *res = sol_new_int(state, obj->refcnt - 2); // NB: We grabbed a reference, and there's one in the arglist, so account for them.
+	sol_object_t *res = sol_new_int(state, obj->refcnt - 3); // NB: We grabbed a reference, and there's one in each of the caller's arglist and ours (sliced from it), so account for them.
 	sol_obj_free(obj);
 	return res;
 }
 
 sol_object_t *sol_f_debug_setref(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *obj = sol_list_get_index(state, args, 0), *cnt = sol_list_get_index(state, args, 1);
-	obj->refcnt = sol_cast_int(state, cnt)->ival + 2; // NB: As above.
+	obj->refcnt = sol_cast_int(state, cnt)->ival + 3; // NB: As above.
 	sol_obj_free(cnt);
 	sol_obj_free(obj);
 	return sol_incref(state->None);
@@ -516,7 +548,7 @@ sol_object_t *sol_f_debug_setref(sol_state_t *state, sol_object_t *args) {
 
 sol_object_t *sol_f_debug_closure(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *func = sol_list_get_index(state, args, 0);
-	sol_object_t *res = sol_incref(func->closure);
+	sol_object_t *res = sol_incref(func->fn->closure);
 	sol_obj_free(func);
 	return res;
 }
@@ -571,6 +603,37 @@ sol_object_t *sol_f_debug_fnstack(sol_state_t *state, sol_object_t *args) {
 	return sol_incref(state->fnstack);
 }
 
+sol_object_t *sol_f_debug_gc_collect(sol_state_t *state, sol_object_t *args) {
+	return sol_new_int(state, sol_gc_collect(state));
+}
+
+sol_object_t *sol_f_debug_gc_stats(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *res = sol_new_map(state);
+	sol_map_borrow_name(state, res, "collections", sol_new_int(state, state->gc_collections));
+	sol_map_borrow_name(state, res, "collected", sol_new_int(state, state->gc_collected));
+	sol_map_borrow_name(state, res, "live", sol_new_int(state, state->gc_live));
+	sol_map_borrow_name(state, res, "pending", sol_new_int(state, state->gc_count));
+	sol_map_borrow_name(state, res, "threshold", sol_new_int(state, state->gc_threshold));
+	return res;
+}
+
+sol_object_t *sol_f_debug_gc_threshold(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *res = sol_new_int(state, state->gc_threshold), *arg, *iarg;
+	if(sol_list_len(state, args) > 0) {
+		arg = sol_list_get_index(state, args, 0);
+		iarg = sol_cast_int(state, arg);
+		sol_obj_free(arg);
+		if(iarg->ival < 0) {
+			sol_obj_free(iarg);
+			sol_obj_free(res);
+			return sol_set_error_string(state, "Set negative GC threshold");
+		}
+		state->gc_threshold = iarg->ival;
+		sol_obj_free(iarg);
+	}
+	return res;
+}
+
 #ifndef NO_READLINE
 sol_object_t *sol_f_readline_readline(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *obj, *objstr, *res;
@@ -618,15 +681,15 @@ sol_object_t *sol_f_iter_str(sol_state_t *state, sol_object_t *args) {
 		max = sol_new_int(state, strlen(obj->str));
 		sol_map_set_name(state, local, "sz", max);
 	}
-	if(((size_t) index->buffer) >= max->ival) {
+	if(((size_t) index->mem->buffer) >= max->ival) {
 		sol_obj_free(index);
 		sol_obj_free(obj);
 		sol_obj_free(local);
 		return sol_incref(state->None);
 	}
-	temp[0] = obj->str[((size_t) index->buffer)];
+	temp[0] = obj->str[((size_t) index->mem->buffer)];
 	res = sol_new_string(state, temp);
-	index->buffer = (void *) ((size_t) index->buffer + 1);
+	index->mem->buffer = (void *) ((size_t) index->mem->buffer + 1);
 	sol_obj_free(index);
 	sol_obj_free(local);
 	sol_obj_free(obj);
@@ -640,18 +703,18 @@ sol_object_t *sol_f_iter_buffer(sol_state_t *state, sol_object_t *args) {
 		sol_obj_free(idx);
 		sol_obj_free(sz);
 		idx = sol_new_buffer(state, (void *) 0, sizeof(void *), OWN_NONE, NULL, NULL);
-		sz = sol_new_int(state, obj->sz);
+		sz = sol_new_int(state, obj->mem->sz);
 		sol_map_set_name(state, local, "idx", idx);
 		sol_map_set_name(state, local, "sz", sz);
 	}
-	if(((size_t) idx->buffer) >= sz->ival) {
+	if(((size_t) idx->mem->buffer) >= sz->ival) {
 		sol_obj_free(idx);
 		sol_obj_free(sz);
 		sol_obj_free(local);
 		return sol_incref(state->None);
 	}
-	res = sol_new_buffer(state, ((char *) obj->buffer) + ((size_t) idx->buffer), 1, OWN_NONE, NULL, NULL);
-	idx->buffer = (void *) ((size_t) idx->buffer + 1);
+	res = sol_new_buffer(state, ((char *) obj->mem->buffer) + ((size_t) idx->mem->buffer), 1, OWN_NONE, NULL, NULL);
+	idx->mem->buffer = (void *) ((size_t) idx->mem->buffer + 1);
 	sol_obj_free(idx);
 	sol_obj_free(sz);
 	sol_obj_free(local);
@@ -667,41 +730,110 @@ sol_object_t *sol_f_iter_list(sol_state_t *state, sol_object_t *args) {
 		sol_map_set_name(state, local, "idx", index);
 		sol_obj_free(index);
 	}
-	if(dsl_seq_iter_is_invalid(index->buffer)) {
+	if(dsl_seq_iter_is_invalid(index->mem->buffer)) {
 		sol_obj_free(index);
 		sol_obj_free(obj);
 		sol_obj_free(local);
 		return sol_incref(state->None);
 	}
-	res = sol_incref(AS_OBJ(dsl_seq_iter_at(index->buffer)));
-	dsl_seq_iter_next(index->buffer);
+	res = sol_incref(AS_OBJ(dsl_seq_iter_at(index->mem->buffer)));
+	dsl_seq_iter_next(index->mem->buffer);
 	sol_obj_free(local);
 	sol_obj_free(obj);
 	return res;
 }
 
-sol_object_t *sol_f_iter_map(sol_state_t *state, sol_object_t *args) {
+sol_object_t *sol_f_iter_stream(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *res = sol_stream_readline(state, stream);
+	sol_obj_free(stream);
+	return res;
+}
+
+sol_object_t *sol_f_iter_keys(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *obj = sol_list_get_index(state, args, 0), *local = sol_list_get_index(state, args, 1);
-	sol_object_t *index = sol_map_get_name(state, local, "idx"), *res;
+	sol_object_t *index = sol_map_get_name(state, local, "idx"), *key, *res;
+	size_t pos;
 	if(sol_is_none(state, index)) {
 		sol_obj_free(index);
-		index = sol_new_buffer(state, dsl_new_seq_iter(obj->seq), sizeof(dsl_seq_iter), OWN_CALLF, _sol_freef_seq_iter, NULL);
+		index = sol_new_buffer(state, (void *) 0, sizeof(void *), OWN_NONE, NULL, NULL);
 		sol_map_set_name(state, local, "idx", index);
-		sol_obj_free(index);
 	}
-	if(dsl_seq_iter_is_invalid(index->buffer)) {
+	pos = (size_t) index->mem->buffer;
+	if(!sol_map_next(state, obj, &pos, &key, NULL)) {
 		sol_obj_free(index);
 		sol_obj_free(obj);
 		sol_obj_free(local);
 		return sol_incref(state->None);
 	}
-	res = sol_incref(AS_OBJ(dsl_seq_iter_at(index->buffer))->key);
-	dsl_seq_iter_next(index->buffer);
+	res = sol_incref(key);
+	index->mem->buffer = (void *) pos;
+	sol_obj_free(index);
 	sol_obj_free(local);
 	sol_obj_free(obj);
 	return res;
 }
 
+// Implements iter.map(func, iterable) and iter.filter(func, iterable).
+static sol_object_t *_sol_iter_func(sol_state_t *state, sol_object_t *args, sol_iterkind_t kind) {
+	sol_object_t *func = sol_list_get_index(state, args, 0), *srcs = sol_list_sublist(state, args, 1), *res;
+	if(!func->ops->call || func->ops->call == sol_f_not_impl || sol_list_len(state, srcs) != 1) {
+		sol_obj_free(func);
+		sol_obj_free(srcs);
+		return sol_set_error_string(state, "Iterate with non-callable or without one iterable");
+	}
+	res = sol_new_iter(state, kind, func, srcs, 0);
+	sol_obj_free(func);
+	sol_obj_free(srcs);
+	return res;
+}
+
+// Implements iter.enumerate(iterable, start = 0) and iter.take(iterable, n).
+static sol_object_t *_sol_iter_count(sol_state_t *state, sol_object_t *args, sol_iterkind_t kind) {
+	sol_object_t *count = sol_list_get_index(state, args, 1), *icount, *srcs = sol_new_list(state), *src = sol_list_get_index(state, args, 0), *res;
+	long n = 0;
+	if(!sol_is_none(state, count)) {
+		icount = sol_cast_int(state, count);
+		n = icount->ival;
+		sol_obj_free(icount);
+	}
+	sol_list_insert(state, srcs, 0, src);
+	res = sol_new_iter(state, kind, NULL, srcs, n);
+	sol_obj_free(count);
+	sol_obj_free(src);
+	sol_obj_free(srcs);
+	return res;
+}
+
+sol_object_t *sol_f_iter_map(sol_state_t *state, sol_object_t *args) {
+	return _sol_iter_func(state, args, SOL_IT_MAP);
+}
+
+sol_object_t *sol_f_iter_filter(sol_state_t *state, sol_object_t *args) {
+	return _sol_iter_func(state, args, SOL_IT_FILTER);
+}
+
+sol_object_t *sol_f_iter_zip(sol_state_t *state, sol_object_t *args) {
+	return sol_new_iter(state, SOL_IT_ZIP, NULL, args, 0);
+}
+
+sol_object_t *sol_f_iter_enumerate(sol_state_t *state, sol_object_t *args) {
+	return _sol_iter_count(state, args, SOL_IT_ENUMERATE);
+}
+
+sol_object_t *sol_f_iter_take(sol_state_t *state, sol_object_t *args) {
+	return _sol_iter_count(state, args, SOL_IT_TAKE);
+}
+
+sol_object_t *sol_f_iter_chain(sol_state_t *state, sol_object_t *args) {
+	return sol_new_iter(state, SOL_IT_CHAIN, NULL, args, 0);
+}
+
+sol_object_t *sol_f_iter_collect(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *obj = sol_list_get_index(state, args, 0), *res = sol_iter_collect(state, obj);
+	sol_obj_free(obj);
+	return res;
+}
+
 sol_object_t *sol_f_ast_print(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *obj = sol_list_get_index(state, args, 0);
 	if(sol_is_aststmt(obj)) {
@@ -912,11 +1044,10 @@ sol_object_t *sol_f_int_tofloat(sol_state_t *state, sol_object_t *args) {
 }
 
 sol_object_t *sol_f_int_tostring(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *a = sol_list_get_index(state, args, 0);
-	char *s = _itoa(a->ival);
-	sol_object_t *res = sol_new_string(state, s);
+	sol_object_t *a = sol_list_get_index(state, args, 0), *res;
+	char *s = malloc(SOL_FORMAT_SIZE);
+	res = sol_new_string_owned(state, s, s ? sol_format_int(s, a->ival) : 0);
 	sol_obj_free(a);
-	free(s);
 	return res;
 }
 
@@ -1016,11 +1147,10 @@ sol_object_t *sol_f_float_tofloat(sol_state_t *state, sol_object_t *args) {
 }
 
 sol_object_t *sol_f_float_tostring(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *a = sol_list_get_index(state, args, 0);
-	char *s = _ftoa(a->fval);
-	sol_object_t *res = sol_new_string(state, s);
+	sol_object_t *a = sol_list_get_index(state, args, 0), *res;
+	char *s = malloc(SOL_FORMAT_SIZE);
+	res = sol_new_string_owned(state, s, s ? sol_format_float(s, a->fval) : 0);
 	sol_obj_free(a);
-	free(s);
 	return res;
 }
 
@@ -1039,18 +1169,10 @@ sol_object_t *sol_f_str_add(sol_state_t *state, sol_object_t *args) {
 
 sol_object_t *sol_f_str_mul(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1), *bint = sol_cast_int(state, b);
-	int n = strlen(a->str) * bint->ival + 1;
-	char *s = malloc(n);
-	int i;
-	s[0] = '\0';
-	for(i = 0; i < b->ival; i++) {
-		strncat(s, a->str, n);
-	}
-	sol_object_t *res = sol_new_string(state, s);
+	sol_object_t *res = sol_string_repeat(state, a, bint->ival);
 	sol_obj_free(a);
 	sol_obj_free(b);
 	sol_obj_free(bint);
-	free(s);
 	if(sol_has_error(state)) {
 		sol_obj_free(res);
 		return sol_incref(state->None);
@@ -1078,7 +1200,7 @@ sol_object_t *sol_f_str_cmp(sol_state_t *state, sol_object_t *args) {
 
 sol_object_t *sol_f_str_len(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *a = sol_list_get_index(state, args, 0);
-	sol_object_t *res = sol_new_int(state, strlen(a->str));
+	sol_object_t *res = sol_new_int(state, a->slen);
 	sol_obj_free(a);
 	return res;
 }
@@ -1093,7 +1215,7 @@ sol_object_t *sol_f_str_index(sol_state_t *state, sol_object_t *args) {
 		return res;
 	}
 	idx = sol_cast_int(state, key);
-	if(idx->ival >= 0 && idx->ival < strlen(str->str)) {
+	if(idx->ival >= 0 && idx->ival < str->slen) {
 		buf[0] = str->str[idx->ival];
 	}
 	sol_obj_free(str);
@@ -1193,37 +1315,125 @@ sol_object_t *sol_f_str_sub(sol_state_t *state, sol_object_t *args) {
 	return sol_new_string(state, s);
 }
 
-sol_object_t *sol_f_str_split(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *str = sol_list_get_index(state, args, 0), *tok = sol_list_get_index(state, args, 1), *stok = sol_cast_string(state, tok);
-	sol_object_t *res = sol_new_list(state), *opart;
-	char *s = strdup(str->str);
-	char *part = strtok(s, stok->str);
-	sol_obj_free(tok);
-	sol_obj_free(str);
-	if(!part) {
-		sol_obj_free(res);
-		sol_obj_free(stok);
-		return sol_incref(state->None);
+/* The string and buffer search methods share these helpers; they differ only
+ * in how a split part is made from its source. */
+
+typedef sol_object_t *(*_sol_part_t)(sol_state_t *, sol_object_t *, size_t, size_t);
+
+static sol_object_t *_sol_str_part(sol_state_t *state, sol_object_t *str, size_t off, size_t len) {
+	return sol_new_string_len(state, str->str + off, len);
+}
+
+static sol_object_t *_sol_buffer_part(sol_state_t *state, sol_object_t *buf, size_t off, size_t len) {
+	return sol_buffer_slice(state, buf, off, len);
+}
+
+// Gets the bytes to search for from a string or sized buffer, or else from
+// its cast to a string, which is left in *tmp to be freed.
+static void _sol_search_arg(sol_state_t *state, sol_object_t *obj, sol_object_t **tmp, const char **s, size_t *len) {
+	*tmp = NULL;
+	if(sol_is_buffer(obj) && obj->mem->sz >= 0) {
+		*s = obj->mem->buffer;
+		*len = obj->mem->sz;
+		return;
+	}
+	if(!sol_is_string(obj)) {
+		obj = *tmp = sol_cast_string(state, obj);
+	}
+	*s = obj->str;
+	*len = obj->slen;
+}
+
+// Implements split(sep = None, max = None) on the len bytes at data, which
+// belong to src. Without a separator, splits on runs of whitespace.
+static sol_object_t *_sol_split(sol_state_t *state, sol_object_t *args, sol_object_t *src, const char *data, size_t len, _sol_part_t part) {
+	sol_object_t *sep = sol_list_get_index(state, args, 1), *max = sol_list_get_index(state, args, 2), *tmp = NULL, *imax, *res, *item;
+	const char *cur = data, *end = data + len, *next, *s = NULL;
+	size_t slen = 0;
+	long n = 0, limit = -1;
+	if(!sol_is_none(state, max)) {
+		imax = sol_cast_int(state, max);
+		limit = imax->ival;
+		sol_obj_free(imax);
+	}
+	sol_obj_free(max);
+	if(!sol_is_none(state, sep)) {
+		_sol_search_arg(state, sep, &tmp, &s, &slen);
+		if(!slen) {
+			sol_obj_free(sep);
+			sol_obj_free(tmp);
+			return sol_set_error_string(state, "Split with empty separator");
+		}
 	}
-	opart = sol_new_string(state, part);
-	sol_list_insert(state, res, 0, opart);
-	sol_obj_free(opart);
-	while(part = strtok(NULL, stok->str)) {
-		opart = sol_new_string(state, part);
-		sol_list_insert(state, res, sol_list_len(state, res), opart);
-		sol_obj_free(opart);
+	res = sol_new_list(state);
+	if(s) {
+		while((limit < 0 || n < limit) && (next = sol_memfind(cur, end - cur, s, slen))) {
+			item = part(state, src, cur - data, next - cur);
+			sol_list_insert(state, res, n++, item);
+			sol_obj_free(item);
+			cur = next + slen;
+		}
+		item = part(state, src, cur - data, end - cur);
+		sol_list_insert(state, res, n, item);
+		sol_obj_free(item);
+	} else {
+		while(1) {
+			while(cur < end && isspace((unsigned char) *cur)) {
+				cur++;
+			}
+			if(cur == end) {
+				break;
+			}
+			next = end;
+			if(limit < 0 || n < limit) {
+				for(next = cur; next < end && !isspace((unsigned char) *next); next++);
+			}
+			item = part(state, src, cur - data, next - cur);
+			sol_list_insert(state, res, n++, item);
+			sol_obj_free(item);
+			cur = next;
+		}
+	}
+	sol_obj_free(sep);
+	sol_obj_free(tmp);
+	return res;
+}
+
+// Implements find(sub) (or, if count is set, count(sub)) on the len bytes at data.
+static sol_object_t *_sol_search(sol_state_t *state, sol_object_t *args, const char *data, size_t len, int count) {
+	sol_object_t *sub = sol_list_get_index(state, args, 1), *tmp, *res;
+	const char *s, *ptr;
+	size_t slen;
+	_sol_search_arg(state, sub, &tmp, &s, &slen);
+	if(count) {
+		res = sol_new_int(state, sol_memcount(data, len, s, slen));
+	} else {
+		ptr = sol_memfind(data, len, s, slen);
+		res = sol_new_int(state, ptr ? ptr - data : -1);
 	}
-	sol_obj_free(stok);
+	sol_obj_free(sub);
+	sol_obj_free(tmp);
+	return res;
+}
+
+sol_object_t *sol_f_str_split(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *str = sol_list_get_index(state, args, 0);
+	sol_object_t *res = _sol_split(state, args, str, str->str, str->slen, _sol_str_part);
+	sol_obj_free(str);
 	return res;
 }
 
 sol_object_t *sol_f_str_find(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *str = sol_list_get_index(state, args, 0), *substr = sol_list_get_index(state, args, 1), *ssubstr = sol_cast_string(state, substr);
-	char *ptr = strstr(str->str, ssubstr->str);
-	sol_object_t *res = sol_new_int(state, ptr ? ptr - str->str : -1);
+	sol_object_t *str = sol_list_get_index(state, args, 0);
+	sol_object_t *res = _sol_search(state, args, str->str, str->slen, 0);
+	sol_obj_free(str);
+	return res;
+}
+
+sol_object_t *sol_f_str_count(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *str = sol_list_get_index(state, args, 0);
+	sol_object_t *res = _sol_search(state, args, str->str, str->slen, 1);
 	sol_obj_free(str);
-	sol_obj_free(substr);
-	sol_obj_free(ssubstr);
 	return res;
 }
 
@@ -1243,23 +1453,16 @@ sol_object_t *sol_f_list_add(sol_state_t *state, sol_object_t *args) {
 
 sol_object_t *sol_f_list_mul(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1), *bint = sol_cast_int(state, b), *ls;
-	int i;
 	if(sol_has_error(state)) {
 		sol_obj_free(a);
 		sol_obj_free(b);
 		sol_obj_free(bint);
 		return sol_incref(state->None);
 	}
-	ls = sol_new_list(state);
-	for(i = 0; i < b->ival; i++) {
-		sol_list_append(state, ls, a);
-		if(sol_has_error(state)) {
-			sol_obj_free(a);
-			sol_obj_free(b);
-			sol_obj_free(bint);
-			return sol_incref(state->None);
-		}
-	}
+	ls = sol_list_repeat(state, a, bint->ival);
+	sol_obj_free(a);
+	sol_obj_free(b);
+	sol_obj_free(bint);
 	return ls;
 }
 
@@ -1485,6 +1688,15 @@ sol_object_t *sol_f_list_reduce(sol_state_t *state, sol_object_t *args) {
 	return val;
 }
 
+sol_object_t *sol_f_list_sort(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *list = sol_list_get_index(state, args, 0), *key = sol_list_get_index(state, args, 1), *cmp = sol_list_get_index(state, args, 2);
+	sol_list_sort(state, list, sol_is_none(state, key) ? NULL : key, sol_is_none(state, cmp) ? NULL : cmp);
+	sol_obj_free(list);
+	sol_obj_free(key);
+	sol_obj_free(cmp);
+	return sol_incref(state->None);
+}
+
 sol_object_t *sol_f_map_add(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1), *map;
 	if(!sol_is_map(b)) {
@@ -1539,7 +1751,7 @@ sol_object_t *sol_f_map_setindex(sol_state_t *state, sol_object_t *args) {
 			sol_list_append(state, newls, args);
 			sol_obj_free(CALL_METHOD(state, setindexf, call, newls));
 			sol_obj_free(newls);
-			return sol_incref(state->None);
+			goto done;
 		} else if(setindexf->ops->setindex && setindexf->ops->setindex != sol_f_not_impl) {
 			newls = sol_new_list(state);
 			sol_list_insert(state, newls, 0, setindexf);
@@ -1547,11 +1759,12 @@ sol_object_t *sol_f_map_setindex(sol_state_t *state, sol_object_t *args) {
 			sol_list_insert(state, newls, 2, val);
 			sol_obj_free(CALL_METHOD(state, setindexf, index, newls));
 			sol_obj_free(newls);
-			return sol_incref(state->None);
+			goto done;
 		}
 	}
-	sol_obj_free(setindexf);
 	sol_map_set(state, map, b, val);
+done:
+	sol_obj_free(setindexf);
 	sol_obj_free(map);
 	sol_obj_free(b);
 	sol_obj_free(val);
@@ -1585,7 +1798,7 @@ sol_object_t *sol_f_map_len(sol_state_t *state, sol_object_t *args) {
 }
 
 sol_object_t *sol_f_map_iter(sol_state_t *state, sol_object_t *args) {
-	return sol_new_cfunc(state, sol_f_iter_map, "iter.map");
+	return sol_new_cfunc(state, sol_f_iter_keys, "iter.keys");
 }
 
 sol_object_t *sol_f_map_tostring(sol_state_t *state, sol_object_t *args) {
@@ -1605,10 +1818,38 @@ sol_object_t *sol_f_map_tostring(sol_state_t *state, sol_object_t *args) {
 	return res;
 }
 
-sol_object_t *sol_f_map_repr(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *cur = sol_new_string(state, "{"), *next, *str, *obj = sol_list_get_index(state, args, 0), *item, *reprf = sol_map_get_name(state, obj, "__repr"), *fargs;
-	dsl_seq_iter *iter;
+static sol_object_t *_sol_pair_repr(sol_state_t *state, sol_object_t *key, sol_object_t *val) {
+	sol_object_t *cur = sol_new_string(state, "["), *next, *str;
 	char s[64];
+	if(test_seen(key)) {
+		snprintf(s, 64, "... (%p)", key);
+		next = sol_string_concat_cstr(state, cur, s);
+	} else {
+		str = sol_cast_repr(state, key);
+		next = sol_string_concat(state, cur, str);
+		sol_obj_free(str);
+	}
+	sol_obj_free(cur);
+	cur = next;
+	next = sol_string_concat_cstr(state, cur, "] = ");
+	sol_obj_free(cur);
+	cur = next;
+	if(test_seen(val)) {
+		snprintf(s, 64, "... (%p)", val);
+		next = sol_string_concat_cstr(state, cur, s);
+	} else {
+		str = sol_cast_repr(state, val);
+		next = sol_string_concat(state, cur, str);
+		sol_obj_free(str);
+	}
+	sol_obj_free(cur);
+	return next;
+}
+
+sol_object_t *sol_f_map_repr(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *cur = sol_new_string(state, "{"), *next, *str, *obj = sol_list_get_index(state, args, 0), *key, *val, *reprf = sol_map_get_name(state, obj, "__repr"), *fargs;
+	size_t pos = 0;
+	int first = 1;
 	if(!sol_is_none(state, reprf) && reprf->ops->call) {
 		sol_obj_free(cur);
 		fargs = sol_new_list(state);
@@ -1620,60 +1861,31 @@ sol_object_t *sol_f_map_repr(sol_state_t *state, sol_object_t *args) {
 		sol_obj_free(reprf);
 		return cur;
 	}
-	iter = dsl_new_seq_iter(obj->seq);
-	while(!dsl_seq_iter_is_invalid(iter)) {
-		item = AS_OBJ(dsl_seq_iter_at(iter));
-		if(test_seen(item)) {
-			snprintf(s, 64, "... (%p)", item);
-			next = sol_string_concat_cstr(state, cur, s);
-		} else {
-			str = sol_cast_repr(state, item);
-			next = sol_string_concat(state, cur, str);
-			sol_obj_free(str);
-		}
-		sol_obj_free(cur);
-		cur = next;
-		if(!dsl_seq_iter_at_end(iter)) {
+	while(sol_map_next(state, obj, &pos, &key, &val)) {
+		if(!first) {
 			next = sol_string_concat_cstr(state, cur, ", ");
 			sol_obj_free(cur);
 			cur = next;
 		}
-		dsl_seq_iter_next(iter);
+		first = 0;
+		str = _sol_pair_repr(state, key, val);
+		next = sol_string_concat(state, cur, str);
+		sol_obj_free(str);
+		sol_obj_free(cur);
+		cur = next;
 	}
 	next = sol_string_concat_cstr(state, cur, "}");
 	sol_obj_free(cur);
-	dsl_free_seq_iter(iter);
+	sol_obj_free(reprf);
 	sol_obj_free(obj);
 	return next;
 }
 
 sol_object_t *sol_f_mcell_tostring(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *mcell = sol_list_get_index(state, args, 0), *cur = sol_new_string(state, "["), *next, *str;
-	char s[64];
-	if(test_seen(mcell->key)) {
-		snprintf(s, 64, "... (%p)", mcell->key);
-		next = sol_string_concat_cstr(state, cur, s);
-	} else {
-		str = sol_cast_repr(state, mcell->key);
-		next = sol_string_concat(state, cur, str);
-		sol_obj_free(str);
-	}
-	sol_obj_free(cur);
-	cur = next;
-	next = sol_string_concat_cstr(state, cur, "] = ");
-	sol_obj_free(cur);
-	cur = next;
-	if(test_seen(mcell->val)) {
-		snprintf(s, 64, "... (%p)", mcell->val);
-		next = sol_string_concat_cstr(state, cur, s);
-	} else {
-		str = sol_cast_repr(state, mcell->val);
-		next = sol_string_concat(state, cur, str);
-		sol_obj_free(str);
-	}
-	sol_obj_free(cur);
+	sol_object_t *mcell = sol_list_get_index(state, args, 0);
+	sol_object_t *res = _sol_pair_repr(state, mcell->key, mcell->val);
 	sol_obj_free(mcell);
-	return next;
+	return res;
 }
 
 sol_object_t *sol_f_func_index(sol_state_t *state, sol_object_t *args) {
@@ -1681,37 +1893,37 @@ sol_object_t *sol_f_func_index(sol_state_t *state, sol_object_t *args) {
 	identlist_node *curi;
 	int i = 0;
 	if(!sol_is_name(key)) {
-		res = sol_map_get(state, func->udata, key);
+		res = sol_map_get(state, func->fn->udata, key);
 	} else {
 		if(sol_name_eq(state, key, "name")) {
-			if(func->fname) {
-				res = sol_new_string(state, func->fname);
+			if(func->fn->fname) {
+				res = sol_new_string(state, func->fn->fname);
 			} else {
 				res = sol_incref(state->None);
 			}
 		} else if(sol_name_eq(state, key, "closure")) {
-			res = sol_incref(func->closure);
+			res = sol_incref(func->fn->closure);
 		} else if(sol_name_eq(state, key, "udata")) {
-			res = sol_incref(func->udata);
+			res = sol_incref(func->fn->udata);
 		} else if(sol_name_eq(state, key, "stmt")) {
-			res = sol_new_stmtnode(state, st_copy((stmt_node *) func->func));
+			res = sol_new_stmtnode(state, st_copy((stmt_node *) func->fn->func));
 		} else if(sol_name_eq(state, key, "args")) {
 			res = sol_new_list(state);
-			curi = func->args;
+			curi = func->fn->args;
 			while(curi) {
 				sol_list_insert(state, res, i++, sol_new_string(state, curi->ident));
 				curi = curi->next;
 			}
 		} else if(sol_name_eq(state, key, "rest")) {
-			if(func->rest) {
-				res = sol_new_string(state, func->rest);
+			if(func->fn->rest) {
+				res = sol_new_string(state, func->fn->rest);
 			} else {
 				res = sol_incref(state->None);
 			}
 		} else if(sol_name_eq(state, key, "annos")) {
-			res = sol_incref(func->annos);
+			res = sol_incref(func->fn->annos);
 		} else {
-			res = sol_map_get(state, func->udata, key);
+			res = sol_map_get(state, func->fn->udata, key);
 		}
 	}
 	sol_obj_free(func);
@@ -1724,27 +1936,27 @@ sol_object_t *sol_f_func_setindex(sol_state_t *state, sol_object_t *args) {
 	size_t i, len;
 	identlist_node *cur, *prev;
 	if(sol_name_eq(state, key, "name") && sol_is_name(val)) {
-		free(func->fname);
+		free(func->fn->fname);
 		if(sol_is_string(val)) {
-			func->fname = strdup(val->str);
+			func->fn->fname = strdup(val->str);
 		} else {
-			func->fname = sol_buffer_strdup(val);
+			func->fn->fname = sol_buffer_strdup(val);
 		}
 	} else if(sol_name_eq(state, key, "closure") && sol_is_map(val)) {
-		temp = func->closure;
-		func->closure = sol_incref(val);
+		temp = func->fn->closure;
+		func->fn->closure = sol_incref(val);
 		sol_obj_free(temp);
 	} else if(sol_name_eq(state, key, "udata") && sol_is_map(val)) {
-		temp = func->udata;
-		func->udata = sol_incref(val);
+		temp = func->fn->udata;
+		func->fn->udata = sol_incref(val);
 		sol_obj_free(temp);
 	} else if(sol_name_eq(state, key, "stmt") && sol_is_aststmt(val)) {
-		st_free(func->func);
-		func->func = st_copy(val->node);
+		st_free(func->fn->func);
+		func->fn->func = st_copy(val->node);
 	} else if(sol_name_eq(state, key, "args") && sol_is_list(val)) {
-		idl_free(func->args);
-		func->args = NEW(identlist_node);
-		cur = func->args;
+		idl_free(func->fn->args);
+		func->fn->args = NEW(identlist_node);
+		cur = func->fn->args;
 		prev = cur;
 		len = sol_list_len(state, val);
 		for(i = 0; i < len; i++ ) {
@@ -1758,20 +1970,20 @@ sol_object_t *sol_f_func_setindex(sol_state_t *state, sol_object_t *args) {
 			cur = cur->next;
 		} 
 		prev->next = NULL;
-		if(cur == func->args) func->args = NULL;
+		if(cur == func->fn->args) func->fn->args = NULL;
 		free(cur);
 	} else if(sol_name_eq(state, key, "rest") && sol_is_name(val)) {
-		free(func->rest);
+		free(func->fn->rest);
 		if(sol_is_string(val)) {
-			func->rest = strdup(val->str);
+			func->fn->rest = strdup(val->str);
 		} else {
-			func->rest = sol_buffer_strdup(val);
+			func->fn->rest = sol_buffer_strdup(val);
 		}
 	} else if(sol_name_eq(state, key, "annos") && sol_is_map(val)) {
-		sol_obj_free(func->annos);
-		func->annos = sol_incref(val);
+		sol_obj_free(func->fn->annos);
+		func->fn->annos = sol_incref(val);
 	} else {
-		sol_map_set(state, func->udata, key, val);
+		sol_map_set(state, func->fn->udata, key, val);
 	}
 	sol_obj_free(func);
 	sol_obj_free(key);
@@ -1782,8 +1994,8 @@ sol_object_t *sol_f_func_setindex(sol_state_t *state, sol_object_t *args) {
 sol_object_t *sol_f_func_tostring(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *func = sol_list_get_index(state, args, 0), *ret;
 	char *s = malloc(256 * sizeof(char));
-	if(func->fname) {
-		snprintf(s, 256, "<Function %s>", func->fname);
+	if(func->fn->fname) {
+		snprintf(s, 256, "<Function %s>", func->fn->fname);
 	} else {
 		snprintf(s, 256, "<Function>");
 	}
@@ -1802,6 +2014,7 @@ sol_object_t *sol_f_cfunc_call(sol_state_t *state, sol_object_t *args) {
 	if(tmp != func) {
 		printf("ERROR: Function stack imbalance\n");
 	}
+	sol_obj_free(tmp);
 	sol_obj_free(func);
 	sol_obj_free(fargs);
 	return res;
@@ -1837,7 +2050,7 @@ sol_object_t *sol_f_astnode_call(sol_state_t *state, sol_object_t *args) {
 		res = sol_eval(state, expr);
 	}
 	if(env) {
-		sol_state_pop_scope(state);
+		sol_obj_free(sol_state_pop_scope(state));
 		sol_obj_free(env);
 	}
 	return res;
@@ -2181,6 +2394,9 @@ sol_object_t *sol_f_astnode_setindex(sol_state_t *state, sol_object_t *args) {
 		} else {
 			switch(expr->type) {
 				case EX_LIT:
+					// Any cached constant no longer describes this literal
+					sol_obj_free(expr->lit->obj);
+					expr->lit->obj = NULL;
 					if(sol_string_eq(state, str, "littype")) {
 						ival = sol_cast_int(state, val);
 						expr->lit->type = ival->ival;
@@ -2194,7 +2410,14 @@ sol_object_t *sol_f_astnode_setindex(sol_state_t *state, sol_object_t *args) {
 						expr->lit->fval = fval->fval;
 						sol_obj_free(fval);
 					} else if(sol_string_eq(state, str, "str")) {
+						// str shares storage with buf, so this is a string literal now
 						sval = sol_cast_string(state, val);
+						if(expr->lit->type == LIT_STRING) {
+							free(expr->lit->str);
+						} else if(expr->lit->type == LIT_BUFFER) {
+							free(expr->lit->buf);
+						}
+						expr->lit->type = LIT_STRING;
 						expr->lit->str = strdup(sval->str);
 						sol_obj_free(sval);
 					}
@@ -2486,7 +2709,7 @@ sol_object_t *sol_f_buffer_index(sol_state_t *state, sol_object_t *args) {
 	if(sol_is_name(key)) {
 		res = sol_map_get(state, funcs, key);
 	} else if(sol_is_int(key)) {
-		res = sol_new_buffer(state, ((char *) a->buffer) + key->ival, (a->sz < 0) ? a->sz : (a->sz - key->ival), OWN_NONE, NULL, NULL);
+		res = sol_buffer_slice(state, a, key->ival, (a->mem->sz < 0) ? a->mem->sz : (a->mem->sz - key->ival));
 	} else {
 		res = sol_f_not_impl(state, args);
 	}
@@ -2509,32 +2732,17 @@ sol_object_t *sol_f_buffer_add(sol_state_t *state, sol_object_t *args) {
 }
 
 sol_object_t *sol_f_buffer_mul(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1), *bint = sol_cast_int(state, b);
-	long ival, i;
-	size_t sz;
-	char *buf;
+	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1), *bint = sol_cast_int(state, b), *res;
 	sol_obj_free(b);
 	if(sol_has_error(state)) {
 		sol_obj_free(a);
 		sol_obj_free(bint);
 		return sol_incref(state->None);
 	}
-	ival = bint->ival;
-	sol_obj_free(bint);
-	if(a->sz < 0) {
-		sol_obj_free(a);
-		return sol_set_error_string(state, "Multiply unsized buffer");
-	}
-	if(ival < 0) {
-		ival = 0;
-	}
-	sz = a->sz * ival;
-	buf = malloc(sz * sizeof(char));
-	for(i = 0; i < ival; i++) {
-		memcpy(buf + (i * a->sz), a->buffer, a->sz);
-	}
+	res = sol_buffer_repeat(state, a, bint->ival);
 	sol_obj_free(a);
-	return sol_new_buffer(state, buf, sz, OWN_FREE, NULL, NULL);
+	sol_obj_free(bint);
+	return res;
 }
 
 sol_object_t *sol_f_buffer_cmp(sol_state_t *state, sol_object_t *args) {
@@ -2546,19 +2754,19 @@ sol_object_t *sol_f_buffer_cmp(sol_state_t *state, sol_object_t *args) {
 		b = bb;
 	}
 	if(sol_is_buffer(b)) {
-		ssize_t len = a->sz;
-		if(a->sz >= 0 && b->sz >= 0 && a->sz != b->sz) {
+		ssize_t len = a->mem->sz;
+		if(a->mem->sz >= 0 && b->mem->sz >= 0 && a->mem->sz != b->mem->sz) {
 			res = sol_new_int(state, 1);
 		} else {
 			if(len < 0) {
-				len = b->sz;
+				len = b->mem->sz;
 			}
-			if(a->sz >= 0 && len > a->sz) len = a->sz;
-			if(b->sz >= 0 && len > b->sz) len = b->sz;
+			if(a->mem->sz >= 0 && len > a->mem->sz) len = a->mem->sz;
+			if(b->mem->sz >= 0 && len > b->mem->sz) len = b->mem->sz;
 			if(len < 0) {
 				res = sol_new_int(state, 1);
 			} else {
-				res = sol_new_int(state, memcmp(a->buffer, b->buffer, len));
+				res = sol_new_int(state, memcmp(a->mem->buffer, b->mem->buffer, len));
 			}
 		}
 	} else {
@@ -2571,7 +2779,7 @@ sol_object_t *sol_f_buffer_cmp(sol_state_t *state, sol_object_t *args) {
 
 sol_object_t *sol_f_buffer_len(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *a = sol_list_get_index(state, args, 0);
-	sol_object_t *res = sol_new_int(state, a->sz);
+	sol_object_t *res = sol_new_int(state, a->mem->sz);
 	sol_obj_free(a);
 	return res;
 }
@@ -2585,18 +2793,18 @@ sol_object_t *sol_f_buffer_tostring(sol_state_t *state, sol_object_t *args) {
 	char *b;
 	/*
 	char s[64];
-	if(buf->sz == -1) {
-		snprintf(s, 64, "<Buffer @%p>", buf->buffer);
+	if(buf->mem->sz == -1) {
+		snprintf(s, 64, "<Buffer @%p>", buf->mem->buffer);
 	} else {
-		snprintf(s, 64, "<Buffer @%p size %ld>", buf->buffer, buf->sz);
+		snprintf(s, 64, "<Buffer @%p size %ld>", buf->mem->buffer, buf->mem->sz);
 	}
 	*/
-	if(buf->sz < 0) {
+	if(buf->mem->sz < 0) {
 		res = sol_new_string(state, "<UNSIZED_BUFFER>");
 	} else {
-		b = malloc(buf->sz + 1);
-		strncpy(b, buf->buffer, buf->sz);
-		b[buf->sz] = '\0';
+		b = malloc(buf->mem->sz + 1);
+		strncpy(b, buf->mem->buffer, buf->mem->sz);
+		b[buf->mem->sz] = '\0';
 		res = sol_new_string(state, b);
 		free(b);
 	}
@@ -2615,15 +2823,34 @@ sol_object_t *sol_f_buffer_repr(sol_state_t *state, sol_object_t *args) {
 }
 
 sol_object_t *sol_f_buffer_toint(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *a = sol_list_get_index(state, args, 0);
-	sol_object_t *res = sol_new_int(state, a->buffer ? atoi(a->buffer) : 0);
+	sol_object_t *a = sol_list_get_index(state, args, 0), *res;
+	char *s;
+	if(a->mem->sz >= 0) {
+		// Sized buffers need not be NUL-terminated
+		s = sol_buffer_strdup(a);
+		res = sol_new_int(state, s ? atoi(s) : 0);
+		free(s);
+	} else if(a->mem->buffer) {
+		res = sol_new_int(state, atoi(a->mem->buffer));
+	} else {
+		res = sol_new_int(state, 0);
+	}
 	sol_obj_free(a);
 	return res;
 }
 
 sol_object_t *sol_f_buffer_tofloat(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *a = sol_list_get_index(state, args, 0);
-	sol_object_t *res = sol_new_float(state, a->buffer ? atof(a->buffer) : 0.0);
+	sol_object_t *a = sol_list_get_index(state, args, 0), *res;
+	char *s;
+	if(a->mem->sz >= 0) {
+		s = sol_buffer_strdup(a);
+		res = sol_new_float(state, s ? atof(s) : 0.0);
+		free(s);
+	} else if(a->mem->buffer) {
+		res = sol_new_float(state, atof(a->mem->buffer));
+	} else {
+		res = sol_new_float(state, 0.0);
+	}
 	sol_obj_free(a);
 	return res;
 }
@@ -2633,11 +2860,22 @@ sol_object_t *sol_f_buffer_tobuffer(sol_state_t *state, sol_object_t *args) {
 }
 
 sol_object_t *sol_f_buffer_new(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *sz = sol_list_get_index(state, args, 0), *isz = sol_cast_int(state, sz);
+	sol_object_t *sz = sol_list_get_index(state, args, 0), *isz = sol_cast_int(state, sz), *pooled = sol_list_get_index(state, args, 1);
 	size_t bufsz = isz->ival;
-	void *buf = malloc(bufsz);
+	void *buf;
 	sol_obj_free(sz);
 	sol_obj_free(isz);
+	if(!sol_is_none(state, pooled)) {
+		sz = sol_cast_int(state, pooled);
+		sol_obj_free(pooled);
+		pooled = sz;
+		if(pooled->ival) {
+			sol_obj_free(pooled);
+			return sol_new_pooled_buffer(state, bufsz);
+		}
+	}
+	sol_obj_free(pooled);
+	buf = malloc(bufsz);
 	if(buf) {
 		return sol_new_buffer(state, buf, bufsz, OWN_FREE, NULL, NULL);
 	}
@@ -2657,12 +2895,12 @@ sol_object_t *sol_f_buffer_get(sol_state_t *state, sol_object_t *args) {
 		ioff = sol_new_int(state, 0);
 	}
 	sol_obj_free(off);
-	if(buf->sz != -1 && (ioff->ival >= buf->sz || ioff->ival < 0)) {
+	if(buf->mem->sz != -1 && (ioff->ival >= buf->mem->sz || ioff->ival < 0)) {
 		sol_obj_free(buf);
 		sol_obj_free(ioff);
 		return sol_incref(state->None);
 	}
-	data = ((char *) buf->buffer) + ioff->ival;
+	data = ((char *) buf->mem->buffer) + ioff->ival;
 	sol_obj_free(buf);
 	sol_obj_free(ioff);
 	switch(buftp) {
@@ -2752,18 +2990,24 @@ sol_object_t *sol_f_buffer_set(sol_state_t *state, sol_object_t *args) {
 	char *data;
 	sol_obj_free(tp);
 	sol_obj_free(itp);
+	if(buf->mem->flags & SOL_BUF_IMMUTABLE) {
+		sol_obj_free(buf);
+		sol_obj_free(val);
+		sol_obj_free(off);
+		return sol_set_error_string(state, "Set into immutable buffer");
+	}
 	if(!sol_is_none(state, off)) {
 		ioff = sol_cast_int(state, off);
 	} else {
 		ioff = sol_new_int(state, 0);
 	}
 	sol_obj_free(off);
-	if(buf->sz != -1 && (ioff->ival >= buf->sz || ioff->ival < 0)) {
+	if(buf->mem->sz != -1 && (ioff->ival >= buf->mem->sz || ioff->ival < 0)) {
 		sol_obj_free(buf);
 		sol_obj_free(ioff);
 		return sol_incref(state->None);
 	}
-	data = ((char *) buf->buffer) + ioff->ival;
+	data = ((char *) buf->mem->buffer) + ioff->ival;
 	sol_obj_free(buf);
 	sol_obj_free(ioff);
 	switch(buftp) {
@@ -2854,9 +3098,9 @@ sol_object_t *sol_f_buffer_set(sol_state_t *state, sol_object_t *args) {
 
 		case BUF_PTR:
 			if(sol_is_buffer(val)) {
-				*((unsigned long *) data) = ((unsigned long) val->buffer);
-				if(val->own == OWN_CALLF) {
-					val->movef(val->buffer, val->sz);
+				*((unsigned long *) data) = ((unsigned long) val->mem->buffer);
+				if(val->mem->own == OWN_CALLF) {
+					val->mem->movef(val->mem->buffer, val->mem->sz);
 				}
 			} else {
 				ival = sol_cast_int(state, val);
@@ -2878,14 +3122,14 @@ sol_object_t *sol_f_buffer_set(sol_state_t *state, sol_object_t *args) {
 
 sol_object_t *sol_f_buffer_address(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *buf = sol_list_get_index(state, args, 0);
-	sol_object_t *res = sol_new_int(state, (unsigned long) buf->buffer);
+	sol_object_t *res = sol_new_int(state, (unsigned long) buf->mem->buffer);
 	sol_obj_free(buf);
 	return res;
 }
 
 sol_object_t *sol_f_buffer_size(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *buf = sol_list_get_index(state, args, 0);
-	sol_object_t *res = sol_new_int(state, (long) buf->sz);
+	sol_object_t *res = sol_new_int(state, (long) buf->mem->sz);
 	sol_obj_free(buf);
 	return res;
 }
@@ -2893,7 +3137,7 @@ sol_object_t *sol_f_buffer_size(sol_state_t *state, sol_object_t *args) {
 sol_object_t *sol_f_buffer_sub(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *buf = sol_list_get_index(state, args, 0);
 	sol_object_t *low = sol_list_get_index(state, args, 1), *high = sol_list_get_index(state, args, 2);
-	sol_object_t *ilow, *ihigh;
+	sol_object_t *ilow, *ihigh, *res;
 	long l, h;
 	char *b;
 	if(sol_is_none(state, low)) {
@@ -2902,7 +3146,7 @@ sol_object_t *sol_f_buffer_sub(sol_state_t *state, sol_object_t *args) {
 		ilow = sol_cast_int(state, low);
 	}
 	if(sol_is_none(state, high)) {
-		ihigh = sol_new_int(state, buf->sz);
+		ihigh = sol_new_int(state, buf->mem->sz);
 	} else {
 		ihigh = sol_cast_int(state, high);
 	}
@@ -2913,79 +3157,108 @@ sol_object_t *sol_f_buffer_sub(sol_state_t *state, sol_object_t *args) {
 	sol_obj_free(ilow);
 	sol_obj_free(ihigh);
 	if(l < 0) {
-		l += buf->sz;
+		l += buf->mem->sz;
 		if(l < 0) {
 			l = 0;
 		}
 	}
-	if(l > buf->sz) {
-		l = buf->sz;
+	if(l > buf->mem->sz) {
+		l = buf->mem->sz;
 	}
 	if(h < 0) {
-		h += buf->sz;
+		h += buf->mem->sz;
 		if(h < 0) {
 			h = 0;
 		}
 	}
-	if(h > buf->sz) {
-		h = buf->sz;
+	if(h > buf->mem->sz) {
+		h = buf->mem->sz;
 	}
 	if(l >= h) {
 		sol_obj_free(buf);
 		return sol_new_buffer(state, NULL, 0, OWN_NONE, NULL, NULL);
 	}
+	if((buf->mem->flags & SOL_BUF_IMMUTABLE) && (buf->mem->own != OWN_NONE || buf->mem->owner)) {
+		// Nothing can write through either buffer, and the slice keeps the
+		// region's owner alive, so they can share it; a borrowed region (one
+		// the buffer doesn't own) is copied, as its lender may free it
+		res = sol_buffer_slice(state, buf, l, h - l);
+		sol_obj_free(buf);
+		return res;
+	}
 	b = malloc(sizeof(char) * (h - l));
-	memcpy(b, ((char *) buf->buffer) + l, h - l);
+	memcpy(b, ((char *) buf->mem->buffer) + l, h - l);
 	sol_obj_free(buf);
 	return sol_new_buffer(state, b, h - l, OWN_FREE, NULL, NULL);
 }
 
 sol_object_t *sol_f_buffer_split(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *buf = sol_list_get_index(state, args, 0);
-	char *b;
-	sol_object_t *str, *res, *ls;
-	if(buf->sz < 0) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *res;
+	if(buf->mem->sz < 0) {
 		sol_obj_free(buf);
 		return sol_set_error_string(state, "split unsized buffer");
 	}
-	b = malloc(sizeof(char) * (buf->sz + 1));
-	memcpy(b, buf->buffer, buf->sz);
-	b[buf->sz] = '\0';
-	str = sol_new_string(state, b);
-	free(b);
-	ls = sol_new_list(state);
-	sol_list_insert(state, ls, 0, str);
-	sol_obj_free(str);
-	str = sol_list_get_index(state, args, 1);
-	sol_list_insert(state, ls, 1, str);
-	sol_obj_free(str);
-	res = sol_f_str_split(state, ls);
-	sol_obj_free(ls);
+	res = _sol_split(state, args, buf, buf->mem->buffer, buf->mem->sz, _sol_buffer_part);
+	sol_obj_free(buf);
 	return res;
 }
 
 sol_object_t *sol_f_buffer_find(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *buf = sol_list_get_index(state, args, 0), *subbuf = sol_list_get_index(state, args, 1), *bsubbuf = sol_cast_buffer(state, subbuf);
-	sol_object_t *res;
-	char *ptr;
-	sol_obj_free(subbuf);
-	if(buf->sz < 0 || bsubbuf->sz < 0) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *res;
+	if(buf->mem->sz < 0) {
 		sol_obj_free(buf);
-		sol_obj_free(bsubbuf);
 		return sol_set_error_string(state, "find with unsized buffer");
 	}
-	ptr = memmem(buf->buffer, buf->sz, bsubbuf->buffer, bsubbuf->sz);
-	res = sol_new_int(state, ptr ? (ptr - ((char *) buf->buffer)) : -1);
+	res = _sol_search(state, args, buf->mem->buffer, buf->mem->sz, 0);
+	sol_obj_free(buf);
+	return res;
+}
+
+sol_object_t *sol_f_buffer_count(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *res;
+	if(buf->mem->sz < 0) {
+		sol_obj_free(buf);
+		return sol_set_error_string(state, "count with unsized buffer");
+	}
+	res = _sol_search(state, args, buf->mem->buffer, buf->mem->sz, 1);
 	sol_obj_free(buf);
-	sol_obj_free(bsubbuf);
 	return res;
 }
 
+/* Mapped buffers (from io.mmap) point into a page-aligned mapping, which
+ * begins at most a page before their region when the offset wasn't aligned. */
+
+static char *_sol_page_base(void *addr) {
+	return (char *) ((uintptr_t) addr & ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1));
+}
+
+static void _sol_freef_munmap(void *buf, size_t sz) {
+	char *base = _sol_page_base(buf);
+	munmap(base, sz + ((char *) buf - base));
+}
+
+sol_object_t *sol_f_buffer_madvise(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *advice = sol_list_get_index(state, args, 1), *iadvice = sol_cast_int(state, advice);
+	sol_object_t *root = buf->mem->owner ? buf->mem->owner : buf;
+	char *base = _sol_page_base(buf->mem->buffer);
+	int res = -1;
+	if(root->mem->own == OWN_CALLF && root->mem->freef == _sol_freef_munmap && buf->mem->sz > 0) {
+		res = madvise(base, buf->mem->sz + ((char *) buf->mem->buffer - base), iadvice->ival);
+	}
+	sol_obj_free(buf);
+	sol_obj_free(advice);
+	sol_obj_free(iadvice);
+	if(res) {
+		return sol_set_error_string(state, "madvise failed (or buffer isn't mapped)");
+	}
+	return sol_incref(state->None);
+}
+
 sol_object_t *sol_f_buffer_fromstring(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *val = sol_list_get_index(state, args, 0), *sval = sol_cast_string(state, val);
 	size_t sz = strlen(sval->str) + 1;
 	sol_object_t *buf = sol_new_buffer(state, malloc(sz), sz, OWN_FREE, NULL, NULL);
-	strcpy(buf->buffer, sval->str);
+	strcpy(buf->mem->buffer, sval->str);
 	sol_obj_free(val);
 	sol_obj_free(sval);
 	return buf;
@@ -3061,25 +3334,103 @@ sol_object_t *sol_f_stream_index(sol_state_t *state, sol_object_t *args) {
 	return res;
 }
 
+sol_object_t *sol_f_stream_iter(sol_state_t *state, sol_object_t *args) {
+	return sol_new_cfunc(state, sol_f_iter_stream, "iter.stream");
+}
+
 sol_object_t *sol_f_stream_tostring(sol_state_t *state, sol_object_t *args) {
 	return sol_new_string(state, "<Stream>");
 }
 
 sol_object_t *sol_f_stream_write(sol_state_t *state, sol_object_t *args) {
-	sol_object_t *stream = sol_list_get_index(state, args, 0), *obj = sol_list_get_index(state, args, 1), *str;
-	size_t sz;
-	if(sol_is_buffer(obj)) {
-		sz = sol_stream_fwrite(state, stream, obj->buffer, sizeof(char), obj->sz);
-	} else {
-		str = sol_cast_string(state, obj);
-		sz = sol_stream_printf(state, stream, "%s", str->str);
-		sol_obj_free(str);
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *obj;
+	size_t sz = 0, i, len = sol_list_len(state, args);
+	// Each argument is queued on the stream's write buffer, so they usually go out together
+	for(i = 1; i < len && !sol_has_error(state); i++) {
+		obj = sol_list_get_index(state, args, i);
+		if(sol_is_buffer(obj) && obj->mem->sz >= 0) {
+			sz += sol_stream_write_bytes(state, stream, obj->mem->buffer, obj->mem->sz, obj->mem->flags & SOL_BUF_IMMUTABLE ? obj : NULL);
+		} else {
+			sz += sol_stream_write_obj(state, stream, obj);
+		}
+		sol_obj_free(obj);
 	}
-	sol_obj_free(obj);
 	sol_obj_free(stream);
+	if(sol_has_error(state)) {
+		return sol_incref(state->None);
+	}
 	return sol_new_int(state, sz);
 }
 
+sol_object_t *sol_f_stream_setbuffer(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *size = sol_list_get_index(state, args, 1), *line = sol_list_get_index(state, args, 2);
+	sol_object_t *isize = sol_cast_int(state, size), *iline;
+	long bufsize;
+	int linebuf = 0;
+	if(!sol_is_none(state, line)) {
+		iline = sol_cast_int(state, line);
+		linebuf = iline->ival != 0;
+		sol_obj_free(iline);
+	}
+	if(isize->ival < 0) {
+		sol_obj_free(isize);
+		sol_obj_free(size);
+		sol_obj_free(line);
+		sol_obj_free(stream);
+		return sol_set_error_string(state, "Negative buffer size");
+	}
+	bufsize = isize->ival;
+	sol_obj_free(isize);
+	sol_obj_free(size);
+	sol_obj_free(line);
+	if(sol_stream_setbuffer(state, stream, bufsize, linebuf)) {
+		sol_obj_free(stream);
+		return sol_set_error_string(state, "Stream has output that can't be written yet");
+	}
+	return stream;
+}
+
+sol_object_t *sol_f_stream_pending(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *res = sol_new_int(state, sol_stream_pending(state, stream));
+	sol_obj_free(stream);
+	return res;
+}
+
+sol_object_t *sol_f_stream_sendfile(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *dst = sol_list_get_index(state, args, 1), *offset = sol_list_get_index(state, args, 2), *count = sol_list_get_index(state, args, 3), *tmp, *res;
+	long off = 0;
+	size_t n = SIZE_MAX;
+	if(!sol_is_none(state, offset)) {
+		tmp = sol_cast_int(state, offset);
+		off = tmp->ival;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_none(state, count)) {
+		tmp = sol_cast_int(state, count);
+		n = tmp->ival < 0 ? 0 : tmp->ival;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_stream(dst)) {
+		res = sol_set_error_string(state, "Send to a non-stream");
+	} else if(off < 0) {
+		res = sol_set_error_string(state, "Negative offset");
+	} else {
+		n = sol_stream_copy(state, stream, dst, sol_is_none(state, offset) ? NULL : &off, n);
+		res = sol_has_error(state) ? sol_incref(state->None) : sol_new_int(state, n);
+	}
+	sol_obj_free(stream);
+	sol_obj_free(dst);
+	sol_obj_free(offset);
+	sol_obj_free(count);
+	return res;
+}
+
+sol_object_t *sol_f_stream_getbuffer(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *res = sol_stream_getbuffer(state, stream);
+	sol_obj_free(stream);
+	return res;
+}
+
 sol_object_t *sol_f_stream_read_buffer(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *stream = sol_list_get_index(state, args, 0), *amt = sol_list_get_index(state, args, 1), *iamt, *res;
 	char *s = NULL, *p;
@@ -3087,22 +3438,43 @@ sol_object_t *sol_f_stream_read_buffer(sol_state_t *state, sol_object_t *args) {
 	if(sol_is_name(amt)) {
 		if(sol_name_eq(state, amt, "ALL")) {
 			pos = sol_stream_ftell(state, stream);
-			sol_stream_fseek(state, stream, 0, SEEK_END);
-			end = sol_stream_ftell(state, stream);
-			sol_stream_fseek(state, stream, pos, SEEK_SET);
-			//printf("IO: Reading %ld bytes starting at %ld\n", end-pos, pos);
-			s = malloc((end - pos + 1) * sizeof(char));
-			if(sol_stream_fread(state, stream, s, sizeof(char), end - pos) < (end - pos)) {
-				free(s);
-				sol_obj_free(stream);
-				sol_obj_free(amt);
-				return sol_set_error_string(state, "IO read error");
+			if(pos != (size_t) -1 && !sol_stream_fseek(state, stream, 0, SEEK_END)) {
+				end = sol_stream_ftell(state, stream);
+				sol_stream_fseek(state, stream, pos, SEEK_SET);
+				//printf("IO: Reading %ld bytes starting at %ld\n", end-pos, pos);
+				s = malloc((end - pos + 1) * sizeof(char));
+				if(sol_stream_fread(state, stream, s, sizeof(char), end - pos) < (end - pos)) {
+					free(s);
+					sol_obj_free(stream);
+					sol_obj_free(amt);
+					return sol_set_error_string(state, "IO read error");
+				}
+				count = end - pos;
+			} else {
+				// Not seekable (a pipe or terminal), so read until the end
+				max = STDIO_CHUNK_SIZE;
+				s = malloc(max);
+				while((end = sol_stream_fread(state, stream, s + count, sizeof(char), max - count)) > 0) {
+					count += end;
+					if(count == max) {
+						max *= 2;
+						p = realloc(s, max);
+						if(!p) {
+							break;
+						}
+						s = p;
+					}
+				}
 			}
-			count = end - pos;
 		} else if(sol_name_eq(state, amt, "LINE")) {
-			s = malloc(STDIO_CHUNK_SIZE * sizeof(char));
-			sol_stream_fgets(state, stream, s, STDIO_CHUNK_SIZE);
-			count = strlen(s);
+			res = sol_stream_readline(state, stream);
+			if(sol_is_none(state, res) && !sol_has_error(state)) {
+				sol_obj_free(res);
+				res = sol_new_buffer(state, NULL, 0, OWN_NONE, NULL, NULL);
+			}
+			sol_obj_free(amt);
+			sol_obj_free(stream);
+			return res;
 		}
 	} else {
 		iamt = sol_cast_int(state, amt);
@@ -3122,10 +3494,39 @@ sol_object_t *sol_f_stream_read_buffer(sol_state_t *state, sol_object_t *args) {
 	return res;
 }
 
+sol_object_t *sol_f_stream_readinto(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *buf = sol_list_get_index(state, args, 1), *off = sol_list_get_index(state, args, 2), *amt = sol_list_get_index(state, args, 3), *tmp, *res;
+	long o = 0, n = -1;
+	if(!sol_is_none(state, off)) {
+		tmp = sol_cast_int(state, off);
+		o = tmp->ival;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_none(state, amt)) {
+		tmp = sol_cast_int(state, amt);
+		n = tmp->ival;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_buffer(buf) || buf->mem->sz < 0) {
+		res = sol_set_error_string(state, "Read into unsized buffer");
+	} else if(buf->mem->flags & SOL_BUF_IMMUTABLE) {
+		res = sol_set_error_string(state, "Read into immutable buffer");
+	} else if(o < 0 || o > buf->mem->sz || n > buf->mem->sz - o) {
+		res = sol_set_error_string(state, "Read outside of buffer");
+	} else {
+		res = sol_new_int(state, sol_stream_readinto(state, stream, ((char *) buf->mem->buffer) + o, n < 0 ? buf->mem->sz - o : n));
+	}
+	sol_obj_free(stream);
+	sol_obj_free(buf);
+	sol_obj_free(off);
+	sol_obj_free(amt);
+	return res;
+}
+
 /*
 sol_object_t *sol_f_stream_read(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *buf = sol_f_stream_read_buffer(state, args);
-	sol_object_t *str = sol_new_string(state, buf->buffer);
+	sol_object_t *str = sol_new_string(state, buf->mem->buffer);
 	sol_obj_free(buf);
 	return str;
 }
@@ -3164,7 +3565,7 @@ sol_object_t *sol_f_stream_eof(sol_state_t *state, sol_object_t *args) {
 sol_object_t *sol_f_stream_ioctl(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *stream = sol_list_get_index(state, args, 0), *buf = sol_list_get_index(state, args, 2);
 	sol_object_t *req = sol_list_get_index(state, args, 1), *ireq = sol_cast_int(state, req);
-	sol_object_t *res = sol_new_int(state, ioctl(fileno(stream->stream), (unsigned long) ireq->ival, buf->buffer));
+	sol_object_t *res = sol_new_int(state, ioctl(fileno(stream->io->stream), (unsigned long) ireq->ival, buf->mem->buffer));
 	sol_obj_free(stream);
 	sol_obj_free(buf);
 	sol_obj_free(req);
@@ -3228,3 +3629,99 @@ sol_object_t *sol_f_stream_open(sol_state_t *state, sol_object_t *args) {
 	}
 	return sol_new_stream(state, f, m);
 }
+
+sol_object_t *sol_f_io_copy(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *src = sol_list_get_index(state, args, 0), *dst = sol_list_get_index(state, args, 1), *count = sol_list_get_index(state, args, 2), *tmp, *res;
+	size_t n = SIZE_MAX;
+	if(!sol_is_none(state, count)) {
+		tmp = sol_cast_int(state, count);
+		n = tmp->ival < 0 ? 0 : tmp->ival;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_stream(src) || !sol_is_stream(dst)) {
+		res = sol_set_error_string(state, "Copy between non-streams");
+	} else {
+		n = sol_stream_copy(state, src, dst, NULL, n);
+		res = sol_has_error(state) ? sol_incref(state->None) : sol_new_int(state, n);
+	}
+	sol_obj_free(src);
+	sol_obj_free(dst);
+	sol_obj_free(count);
+	return res;
+}
+
+sol_object_t *sol_f_io_memstream(sol_state_t *state, sol_object_t *args) {
+	return sol_new_memstream(state, NULL);
+}
+
+sol_object_t *sol_f_io_frombuffer(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *res;
+	if(!sol_is_buffer(buf) || buf->mem->sz < 0) {
+		res = sol_set_error_string(state, "Stream from unsized buffer");
+	} else {
+		res = sol_new_memstream(state, buf);
+	}
+	sol_obj_free(buf);
+	return res;
+}
+
+sol_object_t *sol_f_io_mmap(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *fn = sol_list_get_index(state, args, 0), *mode = sol_list_get_index(state, args, 1), *offset = sol_list_get_index(state, args, 2), *length = sol_list_get_index(state, args, 3);
+	sol_object_t *sfn = sol_cast_string(state, fn), *tmp, *res;
+	int writable = 0, fd;
+	long off = 0, len = -1, delta;
+	struct stat st;
+	char *map;
+	if(!sol_is_none(state, mode)) {
+		tmp = sol_cast_int(state, mode);
+		writable = (tmp->ival & MODE_WRITE) != 0;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_none(state, offset)) {
+		tmp = sol_cast_int(state, offset);
+		off = tmp->ival;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_none(state, length)) {
+		tmp = sol_cast_int(state, length);
+		len = tmp->ival;
+		sol_obj_free(tmp);
+	}
+	sol_obj_free(fn);
+	sol_obj_free(mode);
+	sol_obj_free(offset);
+	sol_obj_free(length);
+	fd = open(sfn->str, writable ? O_RDWR : O_RDONLY);
+	sol_obj_free(sfn);
+	if(fd < 0) {
+		return sol_set_error_string(state, "File open failed");
+	}
+	if(fstat(fd, &st)) {
+		close(fd);
+		return sol_set_error_string(state, "File stat failed");
+	}
+	if(len < 0) {
+		len = st.st_size - off;
+	}
+	// Pages past the end of the file can't be touched, so don't map them
+	if(off < 0 || len < 0 || off > st.st_size || len > st.st_size - off) {
+		close(fd);
+		return sol_set_error_string(state, "Map outside of file");
+	}
+	if(!len) {
+		close(fd);
+		res = sol_new_buffer(state, NULL, 0, OWN_NONE, NULL, NULL);
+	} else {
+		delta = off % sysconf(_SC_PAGESIZE);
+		map = mmap(NULL, len + delta, writable ? PROT_READ | PROT_WRITE : PROT_READ, writable ? MAP_SHARED : MAP_PRIVATE, fd, off - delta);
+		close(fd);
+		if(map == MAP_FAILED) {
+			return sol_set_error_string(state, "mmap failed");
+		}
+		res = sol_new_buffer(state, map + delta, len, OWN_CALLF, _sol_freef_munmap, NULL);
+	}
+	if(!writable) {
+		res->mem->flags |= SOL_BUF_IMMUTABLE;
+	}
+	return res;
+}
@@ -0,0 +1,460 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "ast.h"
+
+/* Event loops.
+ *
+ * An event loop is a SOL_CDATA object with EventLoopOps, over an epoll
+ * descriptor. It watches streams (usually sockets from the net module) for
+ * being readable or writable, and keeps a heap of timers, and calls Sol
+ * functions when either happens:
+ *
+ *     loop:watch(stream, event.READ | event.WRITE, func(loop, stream, events) ... end)
+ *     id = loop:timer(ms, func(loop, id) ... end, repeat)
+ *
+ * Watches are level-triggered, so a callback that doesn't read or write
+ * everything is called again on the next turn. A stream whose read buffer
+ * still holds data after its callback counts as readable even though the
+ * descriptor may not be. The loop holds a reference to every stream it
+ * watches until it is unwatched.
+ */
+
+#define SOL_EVENT_READ 1
+#define SOL_EVENT_WRITE 2
+#define SOL_EVENT_MAX 64
+
+typedef struct {
+	long when; // When it next fires, in event.now() milliseconds
+	long id;
+	long interval; // For repeating timers, or 0
+	sol_object_t *func; // Or NULL once cancelled
+} _sol_timer_t;
+
+typedef struct {
+	int epfd;
+	sol_object_t *watches; // Map from descriptor to [stream, events, func]
+	sol_object_t *pending; // Watched streams with buffered input, to call again
+	_sol_timer_t *timers; // A min-heap on (when, id)
+	size_t ntimers, tcap, live; // live counts the timers not cancelled
+	long nextid;
+	char stopped;
+} _sol_loopbody_t;
+
+#define LOOP(obj) ((_sol_loopbody_t *) (obj)->cdata)
+
+static long _sol_event_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static int _sol_timer_before(_sol_timer_t *a, _sol_timer_t *b) {
+	return a->when < b->when || (a->when == b->when && a->id < b->id);
+}
+
+static int _sol_timer_push(_sol_loopbody_t *loop, _sol_timer_t t) {
+	_sol_timer_t *timers, tmp;
+	size_t i, parent;
+	if(loop->ntimers == loop->tcap) {
+		timers = realloc(loop->timers, (loop->tcap ? loop->tcap * 2 : 16) * sizeof(_sol_timer_t));
+		if(!timers) {
+			return -1;
+		}
+		loop->timers = timers;
+		loop->tcap = loop->tcap ? loop->tcap * 2 : 16;
+	}
+	i = loop->ntimers++;
+	loop->timers[i] = t;
+	while(i) {
+		parent = (i - 1) / 2;
+		if(!_sol_timer_before(&loop->timers[i], &loop->timers[parent])) {
+			break;
+		}
+		tmp = loop->timers[i];
+		loop->timers[i] = loop->timers[parent];
+		loop->timers[parent] = tmp;
+		i = parent;
+	}
+	return 0;
+}
+
+static _sol_timer_t _sol_timer_pop(_sol_loopbody_t *loop) {
+	_sol_timer_t res = loop->timers[0], tmp;
+	size_t i = 0, child;
+	loop->timers[0] = loop->timers[--loop->ntimers];
+	while((child = 2 * i + 1) < loop->ntimers) {
+		if(child + 1 < loop->ntimers && _sol_timer_before(&loop->timers[child + 1], &loop->timers[child])) {
+			child++;
+		}
+		if(!_sol_timer_before(&loop->timers[child], &loop->timers[i])) {
+			break;
+		}
+		tmp = loop->timers[i];
+		loop->timers[i] = loop->timers[child];
+		loop->timers[child] = tmp;
+		i = child;
+	}
+	return res;
+}
+
+// Calls func with [loop, a, b]; returns nonzero if it raised an error.
+static int _sol_event_call(sol_state_t *state, sol_object_t *func, sol_object_t *loop, sol_object_t *a, sol_object_t *b) {
+	sol_object_t *args = sol_new_list(state);
+	sol_list_insert(state, args, 0, func);
+	sol_list_insert(state, args, 1, loop);
+	sol_list_insert(state, args, 2, a);
+	sol_list_insert(state, args, 3, b);
+	sol_obj_free(CALL_METHOD(state, func, call, args));
+	sol_obj_free(args);
+	return sol_has_error(state);
+}
+
+// Calls the watch on a descriptor, if it still has one; returns nonzero on an error.
+static int _sol_event_dispatch(sol_state_t *state, sol_object_t *loopobj, int fd, int events) {
+	_sol_loopbody_t *loop = LOOP(loopobj);
+	sol_object_t *key = sol_new_int(state, fd), *watch = sol_map_get(state, loop->watches, key);
+	sol_object_t *stream, *func, *ev;
+	int err = 0;
+	sol_obj_free(key);
+	if(!sol_is_none(state, watch)) {
+		stream = sol_list_get_index(state, watch, 0);
+		func = sol_list_get_index(state, watch, 2);
+		ev = sol_new_int(state, events);
+		err = _sol_event_call(state, func, loopobj, stream, ev);
+		if(!err && sol_is_stream(stream) && stream->io->rend > stream->io->rpos) {
+			// The callback left input in the read buffer, which epoll can't see
+			sol_list_insert(state, loop->pending, sol_list_len(state, loop->pending), stream);
+		}
+		sol_obj_free(ev);
+		sol_obj_free(func);
+		sol_obj_free(stream);
+	}
+	sol_obj_free(watch);
+	return err;
+}
+
+// Returns the events the watch on a descriptor asks for, or 0.
+static int _sol_event_watching(sol_state_t *state, _sol_loopbody_t *loop, int fd) {
+	sol_object_t *key = sol_new_int(state, fd), *watch = sol_map_get(state, loop->watches, key), *ev;
+	int res = 0;
+	if(!sol_is_none(state, watch)) {
+		ev = sol_list_get_index(state, watch, 1);
+		res = ev->ival;
+		sol_obj_free(ev);
+	}
+	sol_obj_free(watch);
+	sol_obj_free(key);
+	return res;
+}
+
+sol_object_t *sol_new_event_loop(sol_state_t *state) {
+	_sol_loopbody_t *loop = malloc(sizeof(_sol_loopbody_t));
+	if(!loop) {
+		return sol_incref(state->OutOfMemory);
+	}
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(loop->epfd < 0) {
+		free(loop);
+		return sol_set_error_string(state, "epoll_create failed");
+	}
+	loop->watches = sol_new_map(state);
+	loop->pending = sol_new_list(state);
+	loop->timers = NULL;
+	loop->ntimers = loop->tcap = loop->live = 0;
+	loop->nextid = 1;
+	loop->stopped = 0;
+	return sol_new_cdata(state, loop, &state->EventLoopOps);
+}
+
+int sol_event_run_once(sol_state_t *state, sol_object_t *loopobj, long timeout) {
+	_sol_loopbody_t *loop = LOOP(loopobj);
+	struct epoll_event evs[SOL_EVENT_MAX];
+	sol_object_t *pending = loop->pending, *stream, *idobj;
+	_sol_timer_t t;
+	long now = _sol_event_now(), wait = timeout;
+	int nev, i, j, fd, events, watched, count = 0, npending = sol_list_len(state, pending);
+	if(npending) {
+		wait = 0;
+	} else if(loop->ntimers && (wait < 0 || loop->timers[0].when - now < wait)) {
+		wait = loop->timers[0].when > now ? loop->timers[0].when - now : 0;
+	}
+	if(wait < 0 && !sol_map_len(state, loop->watches)) {
+		// Nothing could ever happen
+		return 0;
+	}
+	nev = epoll_wait(loop->epfd, evs, SOL_EVENT_MAX, wait);
+	if(nev < 0) {
+		if(errno != EINTR) {
+			sol_obj_free(sol_set_error_string(state, "epoll_wait failed"));
+			return -1;
+		}
+		nev = 0;
+	}
+	// Streams left with buffered input last turn, unless epoll has them anyway
+	loop->pending = sol_new_list(state);
+	for(i = 0; i < npending && !loop->stopped; i++) {
+		stream = sol_list_get_index(state, pending, i);
+		fd = fileno(stream->io->stream);
+		for(j = 0; j < nev && evs[j].data.fd != fd; j++);
+		if(j == nev && (_sol_event_watching(state, loop, fd) & SOL_EVENT_READ)) {
+			count++;
+			if(_sol_event_dispatch(state, loopobj, fd, SOL_EVENT_READ)) {
+				sol_obj_free(stream);
+				sol_obj_free(pending);
+				return -1;
+			}
+		}
+		sol_obj_free(stream);
+	}
+	sol_obj_free(pending);
+	for(i = 0; i < nev && !loop->stopped; i++) {
+		fd = evs[i].data.fd;
+		// Errors and hangups wake whatever was asked for, to find out with a read or write
+		watched = _sol_event_watching(state, loop, fd);
+		events = 0;
+		if(evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			events |= SOL_EVENT_READ;
+		}
+		if(evs[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+			events |= SOL_EVENT_WRITE;
+		}
+		events &= watched;
+		if(!events) {
+			continue;
+		}
+		count++;
+		if(_sol_event_dispatch(state, loopobj, fd, events)) {
+			return -1;
+		}
+	}
+	now = _sol_event_now();
+	while(loop->ntimers && loop->timers[0].when <= now && !loop->stopped) {
+		t = _sol_timer_pop(loop);
+		if(!t.func) {
+			continue;
+		}
+		if(t.interval) {
+			// Back on the heap first, so that the callback can cancel it
+			t.when = t.when + t.interval > now ? t.when + t.interval : now + t.interval;
+			_sol_timer_push(loop, t);
+			sol_incref(t.func);
+		} else {
+			loop->live--;
+		}
+		count++;
+		idobj = sol_new_int(state, t.id);
+		i = _sol_event_call(state, t.func, loopobj, idobj, state->None);
+		sol_obj_free(idobj);
+		sol_obj_free(t.func);
+		if(i) {
+			return -1;
+		}
+	}
+	return count;
+}
+
+sol_object_t *sol_f_event_loop(sol_state_t *state, sol_object_t *args) {
+	return sol_new_event_loop(state);
+}
+
+sol_object_t *sol_f_event_now(sol_state_t *state, sol_object_t *args) {
+	return sol_new_int(state, _sol_event_now());
+}
+
+sol_object_t *sol_f_event_loop_watch(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *loopobj = sol_list_get_index(state, args, 0), *stream = sol_list_get_index(state, args, 1);
+	sol_object_t *events = sol_list_get_index(state, args, 2), *func = sol_list_get_index(state, args, 3);
+	sol_object_t *ievents = sol_cast_int(state, events), *key, *watch;
+	_sol_loopbody_t *loop = LOOP(loopobj);
+	struct epoll_event ev;
+	int fd = sol_is_stream(stream) ? fileno(stream->io->stream) : -1, had, err = 0;
+	if(fd < 0) {
+		sol_obj_free(sol_set_error_string(state, "Watch of non-stream"));
+		goto out;
+	}
+	key = sol_new_int(state, fd);
+	had = sol_map_has(state, loop->watches, key);
+	if(!(ievents->ival & (SOL_EVENT_READ | SOL_EVENT_WRITE)) || sol_is_none(state, func)) {
+		// Nothing to watch for
+		if(had) {
+			epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+			sol_map_set(state, loop->watches, key, state->None);
+		}
+		sol_obj_free(key);
+		goto out;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.data.fd = fd;
+	ev.events = EPOLLRDHUP;
+	if(ievents->ival & SOL_EVENT_READ) {
+		ev.events |= EPOLLIN;
+	}
+	if(ievents->ival & SOL_EVENT_WRITE) {
+		ev.events |= EPOLLOUT;
+	}
+	err = epoll_ctl(loop->epfd, had ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+	if(err) {
+		sol_obj_free(sol_set_error_string(state, "Watch failed (epoll_ctl)"));
+	} else {
+		watch = sol_new_list(state);
+		sol_list_insert(state, watch, 0, stream);
+		sol_list_insert(state, watch, 1, ievents);
+		sol_list_insert(state, watch, 2, func);
+		sol_map_set(state, loop->watches, key, watch);
+		sol_obj_free(watch);
+		if((ievents->ival & SOL_EVENT_READ) && stream->io->rend > stream->io->rpos) {
+			sol_list_insert(state, loop->pending, sol_list_len(state, loop->pending), stream);
+		}
+	}
+	sol_obj_free(key);
+out:
+	sol_obj_free(ievents);
+	sol_obj_free(events);
+	sol_obj_free(func);
+	sol_obj_free(stream);
+	return loopobj;
+}
+
+sol_object_t *sol_f_event_loop_unwatch(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *loopobj = sol_list_get_index(state, args, 0), *stream = sol_list_get_index(state, args, 1), *key;
+	_sol_loopbody_t *loop = LOOP(loopobj);
+	int fd = sol_is_stream(stream) ? fileno(stream->io->stream) : -1;
+	if(fd >= 0) {
+		key = sol_new_int(state, fd);
+		if(sol_map_has(state, loop->watches, key)) {
+			epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+			sol_map_set(state, loop->watches, key, state->None);
+		}
+		sol_obj_free(key);
+	}
+	sol_obj_free(stream);
+	return loopobj;
+}
+
+sol_object_t *sol_f_event_loop_timer(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *loopobj = sol_list_get_index(state, args, 0), *ms = sol_list_get_index(state, args, 1);
+	sol_object_t *func = sol_list_get_index(state, args, 2), *repeat = sol_list_get_index(state, args, 3), *ims = sol_cast_int(state, ms), *irepeat;
+	_sol_loopbody_t *loop = LOOP(loopobj);
+	_sol_timer_t t;
+	sol_object_t *res;
+	t.when = _sol_event_now() + (ims->ival > 0 ? ims->ival : 0);
+	t.id = loop->nextid++;
+	t.interval = 0;
+	t.func = func;
+	if(!sol_is_none(state, repeat)) {
+		irepeat = sol_cast_int(state, repeat);
+		if(irepeat->ival) {
+			// A zero interval would never let the loop wait
+			t.interval = ims->ival > 0 ? ims->ival : 1;
+		}
+		sol_obj_free(irepeat);
+	}
+	if(_sol_timer_push(loop, t)) {
+		sol_obj_free(func);
+		res = sol_incref(state->OutOfMemory);
+	} else {
+		loop->live++;
+		res = sol_new_int(state, t.id);
+	}
+	sol_obj_free(ims);
+	sol_obj_free(ms);
+	sol_obj_free(repeat);
+	sol_obj_free(loopobj);
+	return res;
+}
+
+sol_object_t *sol_f_event_loop_cancel(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *loopobj = sol_list_get_index(state, args, 0), *id = sol_list_get_index(state, args, 1), *iid = sol_cast_int(state, id);
+	_sol_loopbody_t *loop = LOOP(loopobj);
+	size_t i;
+	int found = 0;
+	// Cancelled timers stay in the heap until they come up
+	for(i = 0; i < loop->ntimers; i++) {
+		if(loop->timers[i].id == iid->ival && loop->timers[i].func) {
+			sol_obj_free(loop->timers[i].func);
+			loop->timers[i].func = NULL;
+			loop->live--;
+			found = 1;
+			break;
+		}
+	}
+	sol_obj_free(iid);
+	sol_obj_free(id);
+	sol_obj_free(loopobj);
+	return sol_new_int(state, found);
+}
+
+sol_object_t *sol_f_event_loop_run_once(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *loopobj = sol_list_get_index(state, args, 0), *timeout = sol_list_get_index(state, args, 1), *itimeout;
+	long ms = -1;
+	int count;
+	if(!sol_is_none(state, timeout)) {
+		itimeout = sol_cast_int(state, timeout);
+		ms = itimeout->ival;
+		sol_obj_free(itimeout);
+	}
+	sol_obj_free(timeout);
+	LOOP(loopobj)->stopped = 0;
+	count = sol_event_run_once(state, loopobj, ms);
+	sol_obj_free(loopobj);
+	if(count < 0) {
+		return sol_incref(state->None);
+	}
+	return sol_new_int(state, count);
+}
+
+sol_object_t *sol_f_event_loop_run(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *loopobj = sol_list_get_index(state, args, 0);
+	_sol_loopbody_t *loop = LOOP(loopobj);
+	loop->stopped = 0;
+	while(!loop->stopped && (loop->live || sol_map_len(state, loop->watches))) {
+		if(sol_event_run_once(state, loopobj, -1) < 0) {
+			break;
+		}
+	}
+	sol_obj_free(loopobj);
+	return sol_incref(state->None);
+}
+
+sol_object_t *sol_f_event_loop_stop(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *loopobj = sol_list_get_index(state, args, 0);
+	LOOP(loopobj)->stopped = 1;
+	sol_obj_free(loopobj);
+	return sol_incref(state->None);
+}
+
+sol_object_t *sol_f_event_loop_index(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *key = sol_list_get_index(state, args, 1), *funcs = sol_get_methods_name(state, "event_loop");
+	sol_object_t *res = sol_map_get(state, funcs, key);
+	sol_obj_free(key);
+	sol_obj_free(funcs);
+	return res;
+}
+
+sol_object_t *sol_f_event_loop_tostring(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *loopobj = sol_list_get_index(state, args, 0);
+	char buf[64];
+	snprintf(buf, sizeof(buf), "<event_loop: %d watches, %ld timers>", sol_map_len(state, LOOP(loopobj)->watches), (long) LOOP(loopobj)->live);
+	sol_obj_free(loopobj);
+	return sol_new_string(state, buf);
+}
+
+sol_object_t *sol_f_event_loop_free(sol_state_t *state, sol_object_t *loopobj) {
+	_sol_loopbody_t *loop = LOOP(loopobj);
+	size_t i;
+	for(i = 0; i < loop->ntimers; i++) {
+		if(loop->timers[i].func) {
+			sol_obj_free(loop->timers[i].func);
+		}
+	}
+	free(loop->timers);
+	sol_obj_free(loop->watches);
+	sol_obj_free(loop->pending);
+	close(loop->epfd);
+	free(loop);
+	return loopobj;
+}
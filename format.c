@@ -0,0 +1,572 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <errno.h>
+#include "sol.h"
+
+/* Number formatting for tostring and the print paths.
+ *
+ * Integers are converted two digits at a time from a table of digit pairs.
+ * Floats print with the fewest significant digits %g needs to read back as
+ * the same double: integral values take the integer path, and anything else
+ * tries more digits until one round-trips (17 always does). A normal double
+ * carries more than 15 digits, so rounding it to 15 gives any shorter form
+ * that round-trips (%g drops the trailing zeros), and the search starts
+ * there; subnormals carry fewer (5e-324 has one), so theirs starts at 1.
+ */
+
+static const char _sol_digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+size_t sol_format_int(char *buf, long val) {
+	char tmp[24], *p = tmp + sizeof(tmp);
+	unsigned long u = (val < 0) ? -((unsigned long) val) : (unsigned long) val;
+	size_t n, idx;
+	while(u >= 100) {
+		idx = (u % 100) * 2;
+		u /= 100;
+		*--p = _sol_digit_pairs[idx + 1];
+		*--p = _sol_digit_pairs[idx];
+	}
+	if(u >= 10) {
+		*--p = _sol_digit_pairs[u * 2 + 1];
+		*--p = _sol_digit_pairs[u * 2];
+	} else {
+		*--p = '0' + u;
+	}
+	if(val < 0) {
+		*--p = '-';
+	}
+	n = tmp + sizeof(tmp) - p;
+	memcpy(buf, p, n);
+	buf[n] = '\0';
+	return n;
+}
+
+size_t sol_format_float(char *buf, double val) {
+	size_t n;
+	int prec;
+	if(isnan(val)) {
+		strcpy(buf, "nan");
+		return 3;
+	}
+	if(isinf(val)) {
+		strcpy(buf, val < 0 ? "-inf" : "inf");
+		return val < 0 ? 4 : 3;
+	}
+	if(fabs(val) < 1e15 && val == (double) (long) val) {
+		if(val == 0 && signbit(val)) {
+			buf[0] = '-';
+			n = 1 + sol_format_int(buf + 1, 0);
+		} else {
+			n = sol_format_int(buf, (long) val);
+		}
+	} else {
+		for(prec = fabs(val) < DBL_MIN ? 1 : 15; prec < 17; prec++) {
+			n = snprintf(buf, SOL_FORMAT_SIZE, "%.*g", prec, val);
+			if(strtod(buf, NULL) == val) {
+				break;
+			}
+		}
+		if(prec == 17) {
+			n = snprintf(buf, SOL_FORMAT_SIZE, "%.17g", val);
+		}
+		if(strpbrk(buf, ".e")) {
+			return n;
+		}
+	}
+	// Keep floats recognizable as such
+	strcpy(buf + n, ".0");
+	return n + 2;
+}
+
+/* The format engine behind format() and string:format.
+ *
+ * A format string is text with replacement fields in braces:
+ *
+ *     {[index][:[[fill]align][sign][0][width][.precision][type]]}
+ *
+ * where align is one of `<>^=`, sign one of `+ -`, and type one of `d x X o b`
+ * (integers), `f F e E g G` (floats), `s` (tostring) or `r` (repr); `{{` and
+ * `}}` stand for literal braces. Fields without an index take the arguments in
+ * order. Widths and precisions are limited to SOL_FORMAT_MAX_WIDTH, and a
+ * numeric type only takes a string that holds a number.
+ *
+ * Compiling a format string unescapes its text and parses its fields into a
+ * sol_fmtspec_t, which is kept in a small per-state cache (see
+ * sol_fmtcache_lookup, which pack.c uses for its formats as well).
+ */
+
+// The largest width or precision a field may ask for
+#define SOL_FORMAT_MAX_WIDTH 65536
+
+typedef struct {
+	size_t lit; // The length of the text before this field
+	long arg; // The argument index, or -1 for the text after the last field
+	long width; // The minimum width, or -1
+	long prec; // The precision, or -1
+	char fill;
+	char align; // One of "<>^=", or 0 for the default for the value
+	char sign; // One of "+ -"
+	char conv; // The type letter, or 0
+} sol_fmtfield_t;
+
+typedef struct sol_fmtspec_t {
+	sol_fmtsrc_t head; // A copy of the format string (followed by the unescaped text)
+	char *text;
+	size_t textlen;
+	long nargs; // One more than the largest argument index used
+	size_t nfields; // Including the trailing text-only field
+	sol_fmtfield_t fields[];
+} sol_fmtspec_t;
+
+static long _sol_fmt_digits(const char *fmt, size_t len, size_t *i) {
+	long n = 0;
+	while(*i < len && fmt[*i] >= '0' && fmt[*i] <= '9') {
+		if(n < 100000000) {
+			n = n * 10 + (fmt[*i] - '0');
+		}
+		(*i)++;
+	}
+	return n;
+}
+
+static int _sol_fmt_isalign(char c) {
+	return c == '<' || c == '>' || c == '^' || c == '=';
+}
+
+// Parses the fields of a format string; returns NULL and sets *err on error.
+static sol_fmtsrc_t *_sol_fmt_compile(const char *fmt, size_t len, const char **err) {
+	sol_fmtspec_t *spec;
+	sol_fmtfield_t *f;
+	size_t i = 0, nfields = 1, lit = 0;
+	long next = 0;
+	int numbered = 0, automatic = 0;
+	char *text;
+	for(i = 0; i < len; i++) {
+		if(fmt[i] == '{') {
+			nfields++;
+		}
+	}
+	spec = malloc(sizeof(sol_fmtspec_t) + nfields * sizeof(sol_fmtfield_t));
+	spec->head.src = malloc(2 * len + 1);
+	memcpy(spec->head.src, fmt, len);
+	spec->head.len = len;
+	spec->text = text = spec->head.src + len;
+	spec->nargs = 0;
+	spec->nfields = 0;
+	for(i = 0; i < len;) {
+		if(fmt[i] == '}') {
+			if(i + 1 < len && fmt[i + 1] == '}') {
+				text[lit++] = '}';
+				i += 2;
+				continue;
+			}
+			*err = "Single '}' in format string";
+			goto fail;
+		}
+		if(fmt[i] != '{') {
+			text[lit++] = fmt[i++];
+			continue;
+		}
+		if(i + 1 < len && fmt[i + 1] == '{') {
+			text[lit++] = '{';
+			i += 2;
+			continue;
+		}
+		i++;
+		f = spec->fields + spec->nfields++;
+		f->lit = lit;
+		f->width = -1;
+		f->prec = -1;
+		f->fill = ' ';
+		f->align = 0;
+		f->sign = '-';
+		f->conv = 0;
+		if(i < len && fmt[i] >= '0' && fmt[i] <= '9') {
+			f->arg = _sol_fmt_digits(fmt, len, &i);
+			numbered = 1;
+		} else {
+			f->arg = next++;
+			automatic = 1;
+		}
+		if(numbered && automatic) {
+			*err = "Mixed numbered and automatic fields in format string";
+			goto fail;
+		}
+		if(f->arg + 1 > spec->nargs) {
+			spec->nargs = f->arg + 1;
+		}
+		if(i < len && fmt[i] == ':') {
+			i++;
+			if(i + 1 < len && _sol_fmt_isalign(fmt[i + 1]) && fmt[i] != '}') {
+				f->fill = fmt[i];
+				f->align = fmt[i + 1];
+				i += 2;
+			} else if(i < len && _sol_fmt_isalign(fmt[i])) {
+				f->align = fmt[i++];
+			}
+			if(i < len && (fmt[i] == '+' || fmt[i] == ' ' || fmt[i] == '-')) {
+				f->sign = fmt[i++];
+			}
+			if(i < len && fmt[i] == '0') {
+				if(!f->align) {
+					f->fill = '0';
+					f->align = '=';
+				}
+				i++;
+			}
+			if(i < len && fmt[i] >= '0' && fmt[i] <= '9') {
+				f->width = _sol_fmt_digits(fmt, len, &i);
+				if(f->width > SOL_FORMAT_MAX_WIDTH) {
+					*err = "Width too large in format string";
+					goto fail;
+				}
+			}
+			if(i < len && fmt[i] == '.') {
+				i++;
+				if(i >= len || fmt[i] < '0' || fmt[i] > '9') {
+					*err = "Missing precision in format string";
+					goto fail;
+				}
+				f->prec = _sol_fmt_digits(fmt, len, &i);
+				if(f->prec > SOL_FORMAT_MAX_WIDTH) {
+					*err = "Precision too large in format string";
+					goto fail;
+				}
+			}
+			if(i < len && fmt[i] != '}') {
+				if(!strchr("dxXobfFeEgGsr", fmt[i])) {
+					*err = "Unknown type in format string";
+					goto fail;
+				}
+				f->conv = fmt[i++];
+			}
+		}
+		if(i >= len || fmt[i] != '}') {
+			*err = "Unterminated field in format string";
+			goto fail;
+		}
+		i++;
+	}
+	f = spec->fields + spec->nfields++;
+	f->lit = lit;
+	f->arg = -1;
+	spec->textlen = lit;
+	return &spec->head;
+
+fail:
+	free(spec->head.src);
+	free(spec);
+	return NULL;
+}
+
+static void _sol_fmt_free(sol_fmtsrc_t *head) {
+	sol_fmtspec_t *spec = (sol_fmtspec_t *) head;
+	free(spec->head.src);
+	free(spec);
+}
+
+sol_fmtsrc_t *sol_fmtcache_lookup(sol_fmtsrc_t **cache, const char *fmt, size_t len, int literal, sol_fmtcompile_t compile, sol_fmtfree_t freef, const char **err) {
+	size_t h, i;
+	sol_fmtsrc_t *entry;
+	if(literal) {
+		h = ((size_t) fmt >> 3) ^ len;
+	} else {
+		h = 2166136261u;
+		for(i = 0; i < len; i++) {
+			h = (h ^ (unsigned char) fmt[i]) * 16777619u;
+		}
+	}
+	h = (h ^ (h >> 7)) % SOL_FORMAT_CACHE;
+	entry = cache[h];
+	if(entry && entry->len == len && !memcmp(entry->src, fmt, len)) {
+		return entry;
+	}
+	entry = compile(fmt, len, err);
+	if(entry) {
+		if(cache[h]) {
+			freef(cache[h]);
+		}
+		cache[h] = entry;
+	}
+	return entry;
+}
+
+void sol_fmtcache_clear(sol_fmtsrc_t **cache, sol_fmtfree_t freef) {
+	size_t i;
+	for(i = 0; i < SOL_FORMAT_CACHE; i++) {
+		if(cache[i]) {
+			freef(cache[i]);
+		}
+		cache[i] = NULL;
+	}
+}
+
+void sol_format_cache_clear(sol_state_t *state) {
+	sol_fmtcache_clear(state->fmtcache, _sol_fmt_free);
+}
+
+typedef struct {
+	char *buf;
+	size_t len, cap;
+} _sol_fmtout_t;
+
+static void _sol_fmt_reserve(_sol_fmtout_t *out, size_t n) {
+	if(out->len + n + 1 > out->cap) {
+		while(out->len + n + 1 > out->cap) {
+			out->cap *= 2;
+		}
+		out->buf = realloc(out->buf, out->cap);
+	}
+}
+
+static void _sol_fmt_put(_sol_fmtout_t *out, const char *s, size_t n) {
+	_sol_fmt_reserve(out, n);
+	memcpy(out->buf + out->len, s, n);
+	out->len += n;
+}
+
+static void _sol_fmt_fill(_sol_fmtout_t *out, char c, long n) {
+	if(n > 0) {
+		_sol_fmt_reserve(out, n);
+		memset(out->buf + out->len, c, n);
+		out->len += n;
+	}
+}
+
+static size_t _sol_fmt_unsigned(char *buf, unsigned long u, int base, int upper) {
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char tmp[72], *p = tmp + sizeof(tmp);
+	size_t n;
+	do {
+		*--p = digits[u % base];
+		u /= base;
+	} while(u);
+	n = tmp + sizeof(tmp) - p;
+	memcpy(buf, p, n);
+	return n;
+}
+
+// Converts a value for a numeric field into *ival or (if isfloat) *fval.
+// Strings must hold a number in full, rather than reading as 0 the way toint
+// and tofloat have them; returns 0 with the error set if there is no number.
+static int _sol_fmt_number(sol_state_t *state, sol_object_t *obj, int isfloat, long *ival, double *fval) {
+	sol_object_t *tmp;
+	char *end;
+	int ok = 1;
+	if(sol_is_int(obj)) {
+		*ival = obj->ival;
+		*fval = obj->ival;
+		return 1;
+	}
+	if(sol_is_float(obj)) {
+		*ival = (long) obj->fval;
+		*fval = obj->fval;
+		return 1;
+	}
+	if(sol_is_string(obj) || sol_is_buffer(obj)) {
+		tmp = sol_cast_string(state, obj);
+		errno = 0;
+		if(isfloat) {
+			*fval = strtod(tmp->str, &end);
+		} else {
+			*ival = strtol(tmp->str, &end, 10);
+		}
+		while(*end == ' ' || *end == '\t' || *end == '\n') {
+			end++;
+		}
+		if(end == tmp->str || *end || errno) {
+			sol_obj_free(sol_set_error_string(state, "Format a non-numeric string as a number"));
+			ok = 0;
+		}
+		sol_obj_free(tmp);
+		return ok;
+	}
+	tmp = isfloat ? sol_cast_float(state, obj) : sol_cast_int(state, obj);
+	if(sol_has_error(state)) {
+		ok = 0;
+	} else if(isfloat && sol_is_float(tmp)) {
+		*fval = tmp->fval;
+	} else if(!isfloat && sol_is_int(tmp)) {
+		*ival = tmp->ival;
+	} else {
+		sol_obj_free(sol_set_error_string(state, "Format a non-number as a number"));
+		ok = 0;
+	}
+	sol_obj_free(tmp);
+	return ok;
+}
+
+// Renders one field: its sign (if any) and body, padded to its width. Returns
+// 0 (with the error set) if the value can't be converted.
+static int _sol_fmt_field(sol_state_t *state, _sol_fmtout_t *out, sol_fmtfield_t *f, sol_object_t *obj) {
+	char small[72], cfmt[8], *dyn = NULL, sign = 0, align = f->align;
+	const char *body = small;
+	sol_object_t *tmp = NULL, *repr = NULL;
+	size_t blen;
+	long ival, pad;
+	double fval;
+	int n, shortest = 0;
+	char conv = f->conv;
+	if(!conv) {
+		if(sol_is_int(obj)) {
+			conv = 'd';
+		} else if(sol_is_float(obj)) {
+			conv = 'f';
+			shortest = f->prec < 0;
+		} else {
+			conv = 's';
+		}
+	}
+	switch(conv) {
+		case 'd': case 'x': case 'X': case 'o': case 'b':
+			if(!_sol_fmt_number(state, obj, 0, &ival, &fval)) {
+				return 0;
+			}
+			if(ival < 0) {
+				sign = '-';
+			}
+			if(conv == 'd') {
+				blen = sol_format_int(small, ival);
+				if(ival < 0) {
+					body++;
+					blen--;
+				}
+			} else {
+				blen = _sol_fmt_unsigned(small, ival < 0 ? -((unsigned long) ival) : (unsigned long) ival, conv == 'o' ? 8 : conv == 'b' ? 2 : 16, conv == 'X');
+			}
+			break;
+
+		case 's': case 'r':
+			if(conv == 'r') {
+				obj = repr = sol_cast_repr(state, obj);
+			}
+			if(sol_is_string(obj)) {
+				body = obj->str;
+				blen = obj->slen;
+			} else if(sol_is_buffer(obj) && obj->mem->sz >= 0) {
+				// As its string form, stopping at any NUL
+				body = obj->mem->buffer;
+				blen = strnlen(body, obj->mem->sz);
+			} else {
+				tmp = sol_cast_string(state, obj);
+				body = tmp->str;
+				blen = tmp->slen;
+			}
+			if(f->prec >= 0 && blen > (size_t) f->prec) {
+				blen = f->prec;
+			}
+			if(!align) {
+				align = '<';
+			}
+			break;
+
+		default:
+			if(!_sol_fmt_number(state, obj, 1, &ival, &fval)) {
+				return 0;
+			}
+			if(shortest) {
+				blen = sol_format_float(small, fval);
+			} else {
+				snprintf(cfmt, sizeof(cfmt), "%%.*%c", conv);
+				n = snprintf(small, sizeof(small), cfmt, f->prec >= 0 ? (int) f->prec : 6, fval);
+				if(n >= (int) sizeof(small)) {
+					dyn = malloc(n + 1);
+					snprintf(dyn, n + 1, cfmt, f->prec >= 0 ? (int) f->prec : 6, fval);
+					body = dyn;
+				}
+				blen = n;
+			}
+			if(body[0] == '-') {
+				sign = '-';
+				body++;
+				blen--;
+			}
+			break;
+	}
+	if(!sign && f->sign != '-' && conv != 's' && conv != 'r') {
+		sign = f->sign;
+	}
+	if(!align) {
+		align = '>';
+	}
+	pad = f->width - (long) blen - (sign ? 1 : 0);
+	if(pad < 0) {
+		pad = 0;
+	}
+	switch(align) {
+		case '>':
+			_sol_fmt_fill(out, f->fill, pad);
+			pad = 0;
+			break;
+
+		case '^':
+			_sol_fmt_fill(out, f->fill, pad / 2);
+			pad -= pad / 2;
+			break;
+	}
+	if(sign) {
+		_sol_fmt_put(out, &sign, 1);
+	}
+	if(align == '=') {
+		_sol_fmt_fill(out, f->fill, pad);
+		pad = 0;
+	}
+	_sol_fmt_put(out, body, blen);
+	_sol_fmt_fill(out, f->fill, pad);
+	free(dyn);
+	sol_obj_free(tmp);
+	sol_obj_free(repr);
+	return 1;
+}
+
+sol_object_t *sol_format(sol_state_t *state, const char *fmt, size_t len, int literal, sol_object_t *args, size_t first) {
+	const char *err = NULL;
+	sol_fmtspec_t *spec = (sol_fmtspec_t *) sol_fmtcache_lookup(state->fmtcache, fmt, len, literal, _sol_fmt_compile, _sol_fmt_free, &err);
+	_sol_fmtout_t out;
+	sol_fmtfield_t *f;
+	sol_object_t *obj;
+	size_t i, lit = 0;
+	if(!spec) {
+		return sol_set_error_string(state, err);
+	}
+	if(sol_list_len(state, args) < first + spec->nargs) {
+		return sol_set_error_string(state, "Too few arguments for format string");
+	}
+	out.len = 0;
+	out.cap = spec->textlen + 16 * spec->nfields + 1;
+	for(i = 0; i + 1 < spec->nfields; i++) {
+		if(spec->fields[i].width > 16) {
+			out.cap += spec->fields[i].width;
+		}
+	}
+	out.buf = malloc(out.cap);
+	for(i = 0; i < spec->nfields; i++) {
+		f = spec->fields + i;
+		_sol_fmt_put(&out, spec->text + lit, f->lit - lit);
+		lit = f->lit;
+		if(f->arg >= 0) {
+			obj = sol_list_get_index(state, args, first + f->arg);
+			if(!_sol_fmt_field(state, &out, f, obj)) {
+				sol_obj_free(obj);
+				free(out.buf);
+				return sol_incref(state->None);
+			}
+			sol_obj_free(obj);
+		}
+	}
+	out.buf[out.len] = '\0';
+	return sol_new_string_owned(state, out.buf, out.len);
+}
@@ -19,6 +19,57 @@ sol_object_t *_sol_gc_alloc_object(sol_state_t *state) {
 	return sol_incref(res);
 }
 
+/** Allocates and returns a new reference to a typeless container.
+ *
+ * This is an internal function. Users should use `sol_alloc_container`
+ * instead.
+ */
+
+sol_object_t *_sol_gc_alloc_container(sol_state_t *state) {
+	sol_gchead_t *head = malloc(sizeof(sol_gchead_t) + sizeof(sol_object_t));
+	sol_object_t *res;
+	if(!head) {
+		sol_set_error(state, state->OutOfMemory);
+		return sol_incref(state->None);
+	}
+	head->next = head;
+	head->prev = head;
+	head->refs = 0;
+	res = SOL_GC_OBJ(head);
+	res->refcnt = 0;
+	res->ops = &(state->NullOps);
+	return sol_incref(res);
+}
+
+static void _sol_gc_link(sol_gchead_t *list, sol_gchead_t *head) {
+	head->prev = list->prev;
+	head->next = list;
+	list->prev->next = head;
+	list->prev = head;
+}
+
+static void _sol_gc_unlink(sol_gchead_t *head) {
+	head->prev->next = head->next;
+	head->next->prev = head->prev;
+}
+
+/** Frees the memory of an object (after its destructor has run).
+ *
+ * Containers are unlinked from the collector's list first, if they are still
+ * on it.
+ */
+
+static void _sol_gc_free_memory(sol_object_t *obj) {
+	sol_gchead_t *head;
+	if(sol_is_container(obj)) {
+		head = SOL_GC_HEAD(obj);
+		_sol_gc_unlink(head);
+		free(head);
+	} else {
+		free(obj);
+	}
+}
+
 /** Frees a reference to an object.
  *
  * This is an internal function. Users should use `sol_obj_free` instead.
@@ -53,6 +104,181 @@ sol_object_t *sol_obj_acquire(sol_object_t *obj) {
 	return sol_incref(obj);
 }
 
+/** Makes an object immortal, and returns it.
+ *
+ * The reference passed in is absorbed; from then on, the object belongs to
+ * the state, and is only released by `sol_state_cleanup`. Reference counting
+ * operations on it become no-ops (see `SOL_REF_IMMORTAL`).
+ */
+
+sol_object_t *sol_immortalize(sol_state_t *state, sol_object_t *obj) {
+	if(!sol_is_immortal(obj)) {
+		obj->refcnt = SOL_REF_IMMORTAL;
+		dsl_seq_insert(state->immortals, dsl_seq_len(state->immortals), obj);
+	}
+	return obj;
+}
+
+/** Releases all of a state's immortal objects.
+ *
+ * Immortal objects may refer to each other in any order (and even in cycles,
+ * like the `debug` module and the module map), so this is done in two passes:
+ * first every destructor runs--any references they drop to other immortal
+ * objects are no-ops--and only then is any of their memory freed. This is
+ * called from `sol_state_cleanup`; afterward, none of them may be used.
+ */
+
+void sol_release_immortals(sol_state_t *state) {
+	size_t i, len;
+	sol_object_t *obj;
+	if(!state->immortals) {
+		return;
+	}
+	len = dsl_seq_len(state->immortals);
+	for(i = 0; i < len; i++) {
+		obj = dsl_seq_get(state->immortals, i);
+		if(obj->ops->free) {
+			obj->ops->free(NULL, obj);
+		}
+	}
+	for(i = 0; i < len; i++) {
+		_sol_gc_free_memory(dsl_seq_get(state->immortals, i));
+	}
+	dsl_free_seq(state->immortals);
+	state->immortals = NULL;
+}
+
+static void _sol_gc_initialize(sol_state_t *state) {
+	state->gc_tracked.next = &(state->gc_tracked);
+	state->gc_tracked.prev = &(state->gc_tracked);
+	state->gc_count = 0;
+	state->gc_live = 0;
+	state->gc_work = 0;
+	state->gc_threshold = SOL_GC_THRESHOLD;
+	state->gc_collections = 0;
+	state->gc_collected = 0;
+	state->gc_collecting = 0;
+}
+
+/** Starts tracking a container for the cycle collector.
+ *
+ * This should be called at the end of a container's constructor, once
+ * everything it refers to is in place; it may run a collection first, if
+ * enough containers have been made since the last one. "Enough" grows with
+ * the work the last collection did (the containers and references it
+ * visited), so that a large, long-lived heap isn't traversed again every few
+ * thousand allocations; this keeps collection time linear in allocations.
+ */
+
+void sol_gc_track(sol_state_t *state, sol_object_t *obj) {
+	state->gc_count++;
+	if(state->gc_threshold && state->gc_count >= state->gc_threshold && state->gc_count >= state->gc_work / 2) {
+		sol_gc_collect(state);
+	}
+	_sol_gc_link(&(state->gc_tracked), SOL_GC_HEAD(obj));
+}
+
+// A reference from one tracked object to another doesn't keep it alive.
+static void _sol_gc_visit_subtract(sol_object_t *obj, void *arg) {
+	(*((size_t *) arg))++;
+	if(sol_is_container(obj)) {
+		SOL_GC_HEAD(obj)->refs--;
+	}
+}
+
+// Collector states, in sol_gchead_t.refs, past the subtraction pass.
+#define GC_REACHABLE -1
+#define GC_UNREACHABLE -2
+
+// A reference from a reachable object makes the referent reachable (again).
+static void _sol_gc_visit_reachable(sol_object_t *obj, void *arg) {
+	sol_gchead_t *head;
+	if(!sol_is_container(obj)) {
+		return;
+	}
+	head = SOL_GC_HEAD(obj);
+	if(head->refs == GC_UNREACHABLE) {
+		_sol_gc_unlink(head);
+		_sol_gc_link((sol_gchead_t *) arg, head);
+		head->refs = 1;
+	} else if(head->refs == 0) {
+		head->refs = 1;
+	}
+}
+
+/** Frees unreachable reference cycles, and returns the number of containers
+ *   freed.
+ *
+ * This is trial deletion: every tracked container starts with its reference
+ * count, less the references held by other tracked containers. Those left
+ * with any references are held by something else (the interpreter or C code),
+ * and are reachable, as is everything they refer to. The rest are garbage;
+ * they are emptied with `sol_obj_clear`, which breaks their cycles and lets
+ * ordinary reference counting free them.
+ *
+ * Storage shared copy-on-write is not counted against its referents (see
+ * `sol_obj_traverse`), so cycles through it are never collected.
+ */
+
+size_t sol_gc_collect(sol_state_t *state) {
+	sol_gchead_t *list = &(state->gc_tracked), unreachable, *head, *next;
+	size_t count = 0, live = 0, work = 0;
+	if(state->gc_collecting) {
+		return 0;
+	}
+	state->gc_collecting = 1;
+	unreachable.next = &unreachable;
+	unreachable.prev = &unreachable;
+
+	for(head = list->next; head != list; head = head->next) {
+		head->refs = SOL_GC_OBJ(head)->refcnt;
+		work++;
+	}
+	for(head = list->next; head != list; head = head->next) {
+		sol_obj_traverse(SOL_GC_OBJ(head), 0, _sol_gc_visit_subtract, &work);
+	}
+	// Objects moved back from the unreachable list are appended, and so are
+	// visited later in this same loop. (A negative count here would be a
+	// refcounting bug elsewhere; it's safest to keep such objects alive.)
+	for(head = list->next; head != list; head = next) {
+		if(head->refs != 0) {
+			head->refs = GC_REACHABLE;
+			sol_obj_traverse(SOL_GC_OBJ(head), 1, _sol_gc_visit_reachable, list);
+			next = head->next;
+			live++;
+		} else {
+			next = head->next;
+			_sol_gc_unlink(head);
+			_sol_gc_link(&unreachable, head);
+			head->refs = GC_UNREACHABLE;
+		}
+	}
+
+	// Hold every garbage object while emptying them, so that none of them is
+	// freed until all of them are.
+	for(head = unreachable.next; head != &unreachable; head = head->next) {
+		sol_incref(SOL_GC_OBJ(head));
+		count++;
+	}
+	for(head = unreachable.next; head != &unreachable; head = head->next) {
+		sol_obj_clear(state, SOL_GC_OBJ(head));
+	}
+	while(unreachable.next != &unreachable) {
+		head = unreachable.next;
+		_sol_gc_unlink(head);
+		_sol_gc_link(list, head);
+		sol_obj_free(SOL_GC_OBJ(head));
+	}
+
+	state->gc_count = 0;
+	state->gc_live = live;
+	state->gc_work = work;
+	state->gc_collections++;
+	state->gc_collected += count;
+	state->gc_collecting = 0;
+	return count;
+}
+
 #ifdef DEBUG_GC
 
 static FILE *gclog = NULL;
@@ -74,6 +300,7 @@ char *prtime() {
 char *prtime() {return "";}
 
 void sol_mm_initialize(sol_state_t *state) {
+	_sol_gc_initialize(state);
 	if(gclog) {
 		fprintf(gclog, " === Reopened at %s ===\n", prtime());
 	} else {
@@ -98,13 +325,25 @@ sol_object_t *_int_sol_alloc_object(const char *func, sol_state_t *state) {
 	return _sol_gc_alloc_object(state);
 }
 
+sol_object_t *_int_sol_alloc_container(const char *func, sol_state_t *state) {
+	fprintf(gclog, "%s\tA\n", func);
+	return _sol_gc_alloc_container(state);
+}
+
 sol_object_t *_int_sol_incref(const char *func, sol_object_t *obj) {
-	int oldref = obj->refcnt++;
+	int oldref = obj->refcnt;
+	if(sol_is_immortal(obj)) {
+		return obj;
+	}
+	obj->refcnt++;
 	fprintf(gclog, "%s\tI\t%s\t%p\t%d\t->\t%d\n", func, obj->ops->tname, obj, oldref, obj->refcnt);
 	return obj;
 }
 
 void _int_sol_obj_free(const char *func, sol_object_t *obj) {
+	if(obj && sol_is_immortal(obj)) {
+		return;
+	}
 	fprintf(gclog, "%s\tD\t%s\t%p\t%d\t->\t%d\n", func, obj->ops->tname, obj, obj->refcnt, obj->refcnt - 1);
 	_sol_gc_obj_free(obj);
 }
@@ -113,15 +352,21 @@ void _int_sol_obj_free(const char *func, sol_object_t *obj) {
 void sol_obj_release(sol_object_t *obj) {
 	fprintf(gclog, "\tF\t%s\t%p\n", obj->ops->tname, obj);
     if(obj->ops->free) obj->ops->free(NULL, obj);
-    free(obj);
+    _sol_gc_free_memory(obj);
 }
 
 sol_object_t *_sol_gc_dsl_copier(sol_object_t *obj) {
+	if(sol_is_immortal(obj)) {
+		return obj;
+	}
 	fprintf(gclog, "<dsl>\tI\t%s\t%p\t%d\t->\t%d\n", obj->ops->tname, obj, obj->refcnt, ++obj->refcnt);
 	return obj;
 }
 
 void _sol_gc_dsl_destructor(sol_object_t *obj) {
+	if(sol_is_immortal(obj)) {
+		return;
+	}
 	fprintf(gclog, "<dsl>\tD\t%s\t%p\t%d\t->\t%d\n", obj->ops->tname, obj, obj->refcnt, obj->refcnt - 1);
 	_sol_gc_obj_free(obj);
 }
@@ -140,6 +385,17 @@ sol_object_t *sol_alloc_object(sol_state_t *state) {
 	return _sol_gc_alloc_object(state);
 }
 
+/** Allocates and returns a new reference to a typeless container.
+ *
+ * Lists, maps, MCELLs and functions must be allocated with this instead of
+ * `sol_alloc_object`, and their constructors should finish with
+ * `sol_gc_track`.
+ */
+
+sol_object_t *sol_alloc_container(sol_state_t *state) {
+	return _sol_gc_alloc_container(state);
+}
+
 /** Frees a reference to an object.
  *
  * If the given reference is the last reference to this object, the memory is
@@ -162,7 +418,7 @@ void sol_obj_release(sol_object_t *obj) {
 	if(obj->ops->free) {
 		obj->ops->free(NULL, obj);
 	}
-	free(obj);
+	_sol_gc_free_memory(obj);
 }
 
 /** Initialize the memory manager for a state.
@@ -170,7 +426,9 @@ void sol_obj_release(sol_object_t *obj) {
  * You normally do not need to call this; it is also done in `sol_state_init`.
  */
 
-void sol_mm_initialize(sol_state_t *state) {}
+void sol_mm_initialize(sol_state_t *state) {
+	_sol_gc_initialize(state);
+}
 
 /** Finalize the memory manager for a state.
  *
@@ -0,0 +1,641 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "ast.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* HTTP/1.x messages.
+ *
+ * The parsers read the head of a request or response (the start line and the
+ * headers) from a buffer, and return its parts as slices of that buffer, so
+ * nothing is copied:
+ *
+ *     req = http.parse_request(buf, offset, prevlen, len)
+ *     -- {method, path, minor_version, headers = [[name, value], ...],
+ *     --  content_length, chunked, keep_alive, length}
+ *
+ * They return None if the head isn't all there yet, so a server can call
+ * them again as more arrives; prevlen, the length that was there on the
+ * previous call, lets them skip looking again for the end of the head where
+ * it has already been looked for. len, if given, is how much of the buffer
+ * (from its start) has been filled, so that a server reading into one fixed
+ * buffer needn't slice it for each call. A malformed head is an error. length is
+ * the size of the head, so that the body (content_length bytes of it, if
+ * that was given) starts at offset + length. chunked is 1 if the body is sent
+ * in chunks instead (when Transfer-Encoding ends with chunked). A message with
+ * both Content-Length and Transfer-Encoding, or with Content-Lengths that
+ * disagree, is refused as malformed, since a server and a proxy in front of
+ * it could each frame it differently (request smuggling); so is a request
+ * whose Transfer-Encoding doesn't end with chunked.
+ *
+ * Lines are scanned 16 bytes at a time with SSE2 for the first byte that
+ * ends them (or isn't allowed in them), the way picohttpparser does with
+ * SSE4.2 ranges; headers are kept as offsets until the whole head has
+ * parsed, and only then made into slices.
+ *
+ * http.write_response writes a status line, headers and body to a stream,
+ * through its write buffer.
+ */
+
+/** The most headers a message may have. */
+#define SOL_HTTP_MAX_HEADERS 100
+
+typedef struct {
+	size_t name, namelen, value, valuelen; // Offsets into the buffer
+} _sol_httphdr_t;
+
+typedef struct {
+	size_t first, firstlen, second, secondlen; // The method and path, or the reason
+	int minor, status;
+	long content_length; // Or -1
+	int te, chunked; // Whether Transfer-Encoding was given, and ends with chunked
+	int close, keepalive; // What the Connection header asked for
+	size_t nhdrs;
+	_sol_httphdr_t hdrs[SOL_HTTP_MAX_HEADERS];
+} _sol_httpmsg_t;
+
+#define SOL_HTTP_INCOMPLETE -2
+#define SOL_HTTP_BAD -1
+
+static char _sol_http_tchar[256];
+
+// The characters allowed in methods and header names (tchar in RFC 7230).
+static int _sol_http_istoken(unsigned char c) {
+	const char *p;
+	if(!_sol_http_tchar['a']) {
+		for(p = "!#$%&'*+-.^_`|~0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"; *p; p++) {
+			_sol_http_tchar[(unsigned char) *p] = 1;
+		}
+	}
+	return _sol_http_tchar[c];
+}
+
+// Returns the first byte from p that is a control character (other than a
+// tab, unless tabs also stop it) or DEL, or, if space is set, a space or tab;
+// or end if there is none.
+static const char *_sol_http_scan(const char *p, const char *end, int space) {
+	unsigned char c;
+#ifdef __SSE2__
+	const __m128i lim = _mm_set1_epi8(space ? 0x20 : 0x1f), del = _mm_set1_epi8(0x7f), tab = _mm_set1_epi8('\t');
+	__m128i x, stop;
+	unsigned int mask;
+	for(; p + 16 <= end; p += 16) {
+		x = _mm_loadu_si128((const __m128i *) p);
+		// Bytes up to lim are those unchanged by an unsigned max with it
+		stop = _mm_cmpeq_epi8(_mm_max_epu8(x, lim), lim);
+		if(!space) {
+			stop = _mm_andnot_si128(_mm_cmpeq_epi8(x, tab), stop);
+		}
+		mask = _mm_movemask_epi8(_mm_or_si128(stop, _mm_cmpeq_epi8(x, del)));
+		if(mask) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+#endif
+	for(; p < end; p++) {
+		c = *p;
+		if(c == 0x7f || (c < 0x20 && (space || c != '\t')) || (space && c == ' ')) {
+			return p;
+		}
+	}
+	return end;
+}
+
+// Checks that a line ends at p, and returns where the next starts, NULL if
+// the buffer ends first, or end + 1 if something else is there.
+static const char *_sol_http_eol(const char *p, const char *end) {
+	if(p == end) {
+		return NULL;
+	}
+	if(*p == '\n') {
+		return p + 1;
+	}
+	if(*p != '\r') {
+		return end + 1;
+	}
+	if(p + 1 == end) {
+		return NULL;
+	}
+	return p[1] == '\n' ? p + 2 : end + 1;
+}
+
+// Checks whether the head ending blank line is there, looking from p.
+static int _sol_http_complete(const char *p, const char *end) {
+	while((p = memchr(p, '\n', end - p))) {
+		p++;
+		if(p < end && *p == '\n') {
+			return 1;
+		}
+		if(p + 1 < end && p[0] == '\r' && p[1] == '\n') {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Parses "HTTP/1.x" into the minor version.
+static int _sol_http_version(const char *p, const char *end, int *minor) {
+	if(end - p < 8) {
+		return SOL_HTTP_INCOMPLETE;
+	}
+	if(memcmp(p, "HTTP/1.", 7) || p[7] < '0' || p[7] > '9') {
+		return SOL_HTTP_BAD;
+	}
+	*minor = p[7] - '0';
+	return 0;
+}
+
+// Checks whether a comma-separated header value has the given token.
+static int _sol_http_hastoken(const char *p, size_t len, const char *tok) {
+	const char *end = p + len, *e;
+	size_t n = strlen(tok);
+	while(p < end) {
+		while(p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+			p++;
+		}
+		for(e = p; e < end && *e != ','; e++);
+		len = e - p;
+		while(len && (p[len - 1] == ' ' || p[len - 1] == '\t')) {
+			len--;
+		}
+		if(len == n && !strncasecmp(p, tok, n)) {
+			return 1;
+		}
+		p = e;
+	}
+	return 0;
+}
+
+// Checks whether the last token of a comma-separated header value is tok.
+static int _sol_http_lasttoken(const char *p, size_t len, const char *tok) {
+	const char *e = p + len, *b;
+	size_t n = strlen(tok);
+	while(e > p && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == ',')) {
+		e--;
+	}
+	for(b = e; b > p && b[-1] != ',' && b[-1] != ' ' && b[-1] != '\t'; b--);
+	return (size_t) (e - b) == n && !strncasecmp(b, tok, n);
+}
+
+// Parses the headers, from p to the blank line after them; returns the
+// length of the whole head (from base), or an error code.
+static long _sol_http_headers(const char *base, const char *p, const char *end, _sol_httpmsg_t *msg, int request, const char **err) {
+	const char *name, *value, *next;
+	size_t len;
+	long cl;
+	msg->nhdrs = 0;
+	msg->content_length = -1;
+	msg->te = msg->chunked = 0;
+	msg->close = msg->keepalive = 0;
+	while(1) {
+		if(p == end) {
+			return SOL_HTTP_INCOMPLETE;
+		}
+		if(*p == '\r' || *p == '\n') {
+			next = _sol_http_eol(p, end);
+			if(!next) {
+				return SOL_HTTP_INCOMPLETE;
+			}
+			if(next > end) {
+				*err = "Bad line ending";
+				return SOL_HTTP_BAD;
+			}
+			if(msg->te && msg->content_length >= 0) {
+				*err = "Both Content-Length and Transfer-Encoding";
+				return SOL_HTTP_BAD;
+			}
+			if(request && msg->te && !msg->chunked) {
+				*err = "Transfer-Encoding doesn't end with chunked";
+				return SOL_HTTP_BAD;
+			}
+			return next - base;
+		}
+		if(msg->nhdrs == SOL_HTTP_MAX_HEADERS) {
+			*err = "Too many headers";
+			return SOL_HTTP_BAD;
+		}
+		for(name = p; p < end && _sol_http_istoken(*p); p++);
+		if(p == end) {
+			return SOL_HTTP_INCOMPLETE;
+		}
+		if(p == name || *p != ':') {
+			// Including continuation lines (obs-fold), which RFC 7230 lets us refuse
+			*err = "Bad header name";
+			return SOL_HTTP_BAD;
+		}
+		len = p - name;
+		for(p++; p < end && (*p == ' ' || *p == '\t'); p++);
+		value = p;
+		p = _sol_http_scan(p, end, 0);
+		next = _sol_http_eol(p, end);
+		if(!next) {
+			return SOL_HTTP_INCOMPLETE;
+		}
+		if(next > end) {
+			*err = "Bad header value";
+			return SOL_HTTP_BAD;
+		}
+		while(p > value && (p[-1] == ' ' || p[-1] == '\t')) {
+			p--;
+		}
+		msg->hdrs[msg->nhdrs].name = name - base;
+		msg->hdrs[msg->nhdrs].namelen = len;
+		msg->hdrs[msg->nhdrs].value = value - base;
+		msg->hdrs[msg->nhdrs].valuelen = p - value;
+		msg->nhdrs++;
+		if(len == 14 && !strncasecmp(name, "Content-Length", 14)) {
+			if(p == value || p - value > 18) {
+				*err = "Bad Content-Length";
+				return SOL_HTTP_BAD;
+			}
+			for(cl = 0; value < p; value++) {
+				if(*value < '0' || *value > '9') {
+					*err = "Bad Content-Length";
+					return SOL_HTTP_BAD;
+				}
+				cl = cl * 10 + (*value - '0');
+			}
+			if(msg->content_length >= 0 && msg->content_length != cl) {
+				*err = "Conflicting Content-Length";
+				return SOL_HTTP_BAD;
+			}
+			msg->content_length = cl;
+		} else if(len == 17 && !strncasecmp(name, "Transfer-Encoding", 17)) {
+			// Only the last coding (of the last header) says how the body ends
+			msg->te = 1;
+			msg->chunked = _sol_http_lasttoken(value, p - value, "chunked");
+		} else if(len == 10 && !strncasecmp(name, "Connection", 10)) {
+			msg->close |= _sol_http_hastoken(value, p - value, "close");
+			msg->keepalive |= _sol_http_hastoken(value, p - value, "keep-alive");
+		}
+		p = next;
+	}
+}
+
+static long _sol_http_parse_request(const char *base, const char *end, _sol_httpmsg_t *msg, const char **err) {
+	const char *p = base, *tok;
+	int res;
+	// A stray line ending before a request is allowed (RFC 7230 3.5)
+	if(p < end && *p == '\r') {
+		p++;
+	}
+	if(p < end && *p == '\n') {
+		p++;
+	}
+	for(tok = p; p < end && _sol_http_istoken(*p); p++);
+	if(p == end) {
+		return SOL_HTTP_INCOMPLETE;
+	}
+	if(p == tok || *p != ' ') {
+		*err = "Bad method";
+		return SOL_HTTP_BAD;
+	}
+	msg->first = tok - base;
+	msg->firstlen = p - tok;
+	tok = ++p;
+	p = _sol_http_scan(p, end, 1);
+	if(p == end) {
+		return SOL_HTTP_INCOMPLETE;
+	}
+	if(p == tok || *p != ' ') {
+		*err = "Bad path";
+		return SOL_HTTP_BAD;
+	}
+	msg->second = tok - base;
+	msg->secondlen = p - tok;
+	p++;
+	if((res = _sol_http_version(p, end, &msg->minor))) {
+		*err = "Bad HTTP version";
+		return res;
+	}
+	tok = _sol_http_eol(p + 8, end);
+	if(!tok) {
+		return SOL_HTTP_INCOMPLETE;
+	}
+	if(tok > end) {
+		*err = "Bad request line";
+		return SOL_HTTP_BAD;
+	}
+	msg->status = 0;
+	return _sol_http_headers(base, tok, end, msg, 1, err);
+}
+
+static long _sol_http_parse_response(const char *base, const char *end, _sol_httpmsg_t *msg, const char **err) {
+	const char *p = base, *next;
+	int res;
+	if((res = _sol_http_version(p, end, &msg->minor))) {
+		*err = "Bad HTTP version";
+		return res;
+	}
+	p += 8;
+	if(end - p < 4) {
+		return SOL_HTTP_INCOMPLETE;
+	}
+	if(p[0] != ' ' || p[1] < '1' || p[1] > '9' || p[2] < '0' || p[2] > '9' || p[3] < '0' || p[3] > '9') {
+		*err = "Bad status";
+		return SOL_HTTP_BAD;
+	}
+	msg->status = (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+	p += 4;
+	// The reason may be empty, and even its space left out
+	if(p < end && *p == ' ') {
+		p++;
+	}
+	msg->second = p - base;
+	p = _sol_http_scan(p, end, 0);
+	next = _sol_http_eol(p, end);
+	if(!next) {
+		return SOL_HTTP_INCOMPLETE;
+	}
+	if(next > end) {
+		*err = "Bad status line";
+		return SOL_HTTP_BAD;
+	}
+	msg->secondlen = p - base - msg->second;
+	msg->first = msg->firstlen = 0;
+	return _sol_http_headers(base, next, end, msg, 0, err);
+}
+
+typedef long (*_sol_httpparser_t)(const char *, const char *, _sol_httpmsg_t *, const char **);
+
+// Does the work of http.parse_request and http.parse_response.
+static sol_object_t *_sol_http_parse(sol_state_t *state, sol_object_t *args, _sol_httpparser_t parser, int request) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *offset = sol_list_get_index(state, args, 1), *prevlen = sol_list_get_index(state, args, 2), *filled = sol_list_get_index(state, args, 3);
+	sol_object_t *tmp, *res, *hdrs, *pair, *name, *value;
+	_sol_httpmsg_t *msg;
+	const char *base, *end, *err = NULL;
+	long off = 0, prev = 0, fill = -1, len;
+	size_t i;
+	if(!sol_is_none(state, offset)) {
+		tmp = sol_cast_int(state, offset);
+		off = tmp->ival;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_none(state, prevlen)) {
+		tmp = sol_cast_int(state, prevlen);
+		prev = tmp->ival;
+		sol_obj_free(tmp);
+	}
+	if(!sol_is_none(state, filled)) {
+		tmp = sol_cast_int(state, filled);
+		fill = tmp->ival;
+		sol_obj_free(tmp);
+	}
+	sol_obj_free(offset);
+	sol_obj_free(prevlen);
+	sol_obj_free(filled);
+	if(!sol_is_buffer(buf) || buf->mem->sz < 0) {
+		sol_obj_free(buf);
+		return sol_set_error_string(state, "Parse HTTP from unsized buffer");
+	}
+	if(fill < 0) {
+		fill = buf->mem->sz;
+	}
+	if(off < 0 || fill > buf->mem->sz || off > fill) {
+		sol_obj_free(buf);
+		return sol_set_error_string(state, "Parse HTTP outside of buffer");
+	}
+	base = ((char *) buf->mem->buffer) + off;
+	end = ((char *) buf->mem->buffer) + fill;
+	// Only the new data (and the end of the old, in case the blank line straddles them) can finish the head
+	if(prev > 3 && prev - 3 < end - base && !_sol_http_complete(base + prev - 3, end)) {
+		sol_obj_free(buf);
+		return sol_incref(state->None);
+	}
+	msg = malloc(sizeof(_sol_httpmsg_t));
+	if(!msg) {
+		sol_obj_free(buf);
+		return sol_set_error_string(state, "Out of memory for HTTP headers");
+	}
+	len = parser(base, end, msg, &err);
+	if(len == SOL_HTTP_INCOMPLETE) {
+		free(msg);
+		sol_obj_free(buf);
+		return sol_incref(state->None);
+	}
+	if(len == SOL_HTTP_BAD) {
+		free(msg);
+		sol_obj_free(buf);
+		return sol_set_error_string(state, err);
+	}
+	res = sol_new_map(state);
+	if(request) {
+		sol_map_borrow_name(state, res, "method", sol_buffer_slice(state, buf, off + msg->first, msg->firstlen));
+		sol_map_borrow_name(state, res, "path", sol_buffer_slice(state, buf, off + msg->second, msg->secondlen));
+	} else {
+		sol_map_borrow_name(state, res, "status", sol_new_int(state, msg->status));
+		sol_map_borrow_name(state, res, "reason", sol_buffer_slice(state, buf, off + msg->second, msg->secondlen));
+	}
+	sol_map_borrow_name(state, res, "minor_version", sol_new_int(state, msg->minor));
+	hdrs = sol_new_list(state);
+	for(i = 0; i < msg->nhdrs; i++) {
+		pair = sol_new_list(state);
+		name = sol_buffer_slice(state, buf, off + msg->hdrs[i].name, msg->hdrs[i].namelen);
+		value = sol_buffer_slice(state, buf, off + msg->hdrs[i].value, msg->hdrs[i].valuelen);
+		sol_list_insert(state, pair, 0, name);
+		sol_list_insert(state, pair, 1, value);
+		sol_list_insert(state, hdrs, i, pair);
+		sol_obj_free(name);
+		sol_obj_free(value);
+		sol_obj_free(pair);
+	}
+	sol_map_borrow_name(state, res, "headers", hdrs);
+	if(msg->content_length >= 0) {
+		sol_map_borrow_name(state, res, "content_length", sol_new_int(state, msg->content_length));
+	}
+	sol_map_borrow_name(state, res, "chunked", sol_new_int(state, msg->chunked));
+	// HTTP/1.1 connections persist unless they say otherwise, and HTTP/1.0 ones don't
+	sol_map_borrow_name(state, res, "keep_alive", sol_new_int(state, msg->minor ? !msg->close : msg->keepalive && !msg->close));
+	sol_map_borrow_name(state, res, "length", sol_new_int(state, len));
+	free(msg);
+	sol_obj_free(buf);
+	return res;
+}
+
+sol_object_t *sol_f_http_parse_request(sol_state_t *state, sol_object_t *args) {
+	return _sol_http_parse(state, args, _sol_http_parse_request, 1);
+}
+
+sol_object_t *sol_f_http_parse_response(sol_state_t *state, sol_object_t *args) {
+	return _sol_http_parse(state, args, _sol_http_parse_response, 0);
+}
+
+// Returns the bytes of a string or sized buffer (or NULL), and their length.
+static const char *_sol_http_bytes(sol_object_t *obj, size_t *len) {
+	if(sol_is_string(obj)) {
+		*len = obj->slen;
+		return obj->str;
+	}
+	if(sol_is_buffer(obj) && obj->mem->sz >= 0) {
+		*len = obj->mem->sz;
+		return obj->mem->buffer;
+	}
+	return NULL;
+}
+
+sol_object_t *sol_f_http_header(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *hdrs = sol_list_get_index(state, args, 0), *name = sol_list_get_index(state, args, 1), *pair, *key, *res = NULL;
+	const char *want, *have;
+	size_t wlen, hlen, i, n;
+	want = _sol_http_bytes(name, &wlen);
+	if(!want || !sol_is_list(hdrs)) {
+		sol_obj_free(hdrs);
+		sol_obj_free(name);
+		return sol_set_error_string(state, "Look up a header by a non-name or in a non-list");
+	}
+	n = sol_list_len(state, hdrs);
+	for(i = 0; i < n && !res; i++) {
+		pair = sol_list_get_index(state, hdrs, i);
+		key = sol_is_list(pair) ? sol_list_get_index(state, pair, 0) : sol_incref(state->None);
+		have = _sol_http_bytes(key, &hlen);
+		if(have && hlen == wlen && !strncasecmp(have, want, wlen)) {
+			res = sol_list_get_index(state, pair, 1);
+		}
+		sol_obj_free(key);
+		sol_obj_free(pair);
+	}
+	sol_obj_free(hdrs);
+	sol_obj_free(name);
+	return res ? res : sol_incref(state->None);
+}
+
+static const char *_sol_http_reason(long status) {
+	switch(status) {
+		case 100: return "Continue";
+		case 101: return "Switching Protocols";
+		case 200: return "OK";
+		case 201: return "Created";
+		case 202: return "Accepted";
+		case 204: return "No Content";
+		case 206: return "Partial Content";
+		case 301: return "Moved Permanently";
+		case 302: return "Found";
+		case 303: return "See Other";
+		case 304: return "Not Modified";
+		case 307: return "Temporary Redirect";
+		case 308: return "Permanent Redirect";
+		case 400: return "Bad Request";
+		case 401: return "Unauthorized";
+		case 403: return "Forbidden";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 408: return "Request Timeout";
+		case 409: return "Conflict";
+		case 410: return "Gone";
+		case 411: return "Length Required";
+		case 413: return "Payload Too Large";
+		case 414: return "URI Too Long";
+		case 415: return "Unsupported Media Type";
+		case 416: return "Range Not Satisfiable";
+		case 426: return "Upgrade Required";
+		case 429: return "Too Many Requests";
+		case 500: return "Internal Server Error";
+		case 501: return "Not Implemented";
+		case 502: return "Bad Gateway";
+		case 503: return "Service Unavailable";
+		case 504: return "Gateway Timeout";
+		case 505: return "HTTP Version Not Supported";
+		default: return "Unknown";
+	}
+}
+
+sol_object_t *sol_f_http_reason(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *status = sol_list_get_index(state, args, 0), *istatus = sol_cast_int(state, status);
+	sol_object_t *res = sol_new_string(state, _sol_http_reason(istatus->ival));
+	sol_obj_free(istatus);
+	sol_obj_free(status);
+	return res;
+}
+
+// Writes a header name or value: strings and buffers as their bytes, anything
+// else as stream:write would.
+static size_t _sol_http_put(sol_state_t *state, sol_object_t *stream, sol_object_t *obj) {
+	if(sol_is_buffer(obj) && obj->mem->sz >= 0) {
+		return sol_stream_write_bytes(state, stream, obj->mem->buffer, obj->mem->sz, obj->mem->flags & SOL_BUF_IMMUTABLE ? obj : NULL);
+	}
+	return sol_stream_write_obj(state, stream, obj);
+}
+
+static size_t _sol_http_put_header(sol_state_t *state, sol_object_t *stream, sol_object_t *name, sol_object_t *value, int *haslen) {
+	const char *bytes;
+	size_t len, sz;
+	bytes = _sol_http_bytes(name, &len);
+	if(bytes && len == 14 && !strncasecmp(bytes, "Content-Length", 14)) {
+		*haslen = 1;
+	}
+	sz = _sol_http_put(state, stream, name);
+	sz += sol_stream_write_bytes(state, stream, ": ", 2, NULL);
+	sz += _sol_http_put(state, stream, value);
+	sz += sol_stream_write_bytes(state, stream, "\r\n", 2, NULL);
+	return sz;
+}
+
+sol_object_t *sol_f_http_write_response(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *status = sol_list_get_index(state, args, 1), *hdrs = sol_list_get_index(state, args, 2), *body = sol_list_get_index(state, args, 3);
+	sol_object_t *istatus, *pair, *name, *value, *sbody = NULL;
+	const char *bytes = NULL;
+	char line[64];
+	size_t sz = 0, i, n, len = 0, pos = 0;
+	int haslen = 0;
+	if(!sol_is_stream(stream)) {
+		sol_obj_free(stream);
+		sol_obj_free(status);
+		sol_obj_free(hdrs);
+		sol_obj_free(body);
+		return sol_set_error_string(state, "Write response to a non-stream");
+	}
+	istatus = sol_cast_int(state, status);
+	n = snprintf(line, sizeof(line), "HTTP/1.1 %ld %s\r\n", istatus->ival, _sol_http_reason(istatus->ival));
+	sol_obj_free(istatus);
+	sz += sol_stream_write_bytes(state, stream, line, n, NULL);
+	if(sol_is_list(hdrs)) {
+		n = sol_list_len(state, hdrs);
+		for(i = 0; i < n; i++) {
+			pair = sol_list_get_index(state, hdrs, i);
+			if(sol_is_list(pair)) {
+				name = sol_list_get_index(state, pair, 0);
+				value = sol_list_get_index(state, pair, 1);
+				sz += _sol_http_put_header(state, stream, name, value, &haslen);
+				sol_obj_free(name);
+				sol_obj_free(value);
+			}
+			sol_obj_free(pair);
+		}
+	} else if(sol_is_map(hdrs)) {
+		while(sol_map_next(state, hdrs, &pos, &name, &value)) {
+			sz += _sol_http_put_header(state, stream, name, value, &haslen);
+		}
+	}
+	if(!sol_is_none(state, body)) {
+		bytes = _sol_http_bytes(body, &len);
+		if(!bytes) {
+			sbody = sol_cast_string(state, body);
+			bytes = sbody->str;
+			len = sbody->slen;
+		}
+		if(!haslen) {
+			n = snprintf(line, sizeof(line), "Content-Length: %zu\r\n", len);
+			sz += sol_stream_write_bytes(state, stream, line, n, NULL);
+		}
+	}
+	sz += sol_stream_write_bytes(state, stream, "\r\n", 2, NULL);
+	if(len) {
+		// Strings and immutable buffers can be queued on the stream without a copy
+		sz += sol_stream_write_bytes(state, stream, bytes, len, sbody ? sbody : (sol_is_string(body) || (body->mem->flags & SOL_BUF_IMMUTABLE) ? body : NULL));
+	}
+	if(sbody) {
+		sol_obj_free(sbody);
+	}
+	sol_obj_free(stream);
+	sol_obj_free(status);
+	sol_obj_free(hdrs);
+	sol_obj_free(body);
+	if(sol_has_error(state)) {
+		return sol_incref(state->None);
+	}
+	return sol_new_int(state, sz);
+}
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include "ast.h"
+
+/* Lazy iterators, made by the combinators in the iter module.
+ *
+ * A lazy iterator is a SOL_CDATA object with IterOps; it is its own iter
+ * function, so it plugs into for loops (EX_ITER) like any other iterable, and
+ * it produces one item per call without building any intermediate list.
+ *
+ * Each reads from one or more sources. A source that is a list is read by
+ * index, and one that is itself a lazy iterator is stepped directly, so a
+ * pipeline of combinators over a list runs as a single pass of C calls; only
+ * the user's functions go through the interpreter. Anything else is read
+ * through its iter protocol, exactly as EX_ITER would.
+ *
+ * As in EX_ITER, a None item ends the iteration.
+ */
+
+typedef struct {
+	sol_object_t *obj; // A list, a lazy iterator, or the iter function of anything else
+	sol_object_t *args; // For the last, the arguments to call it with: itself, the iterable, and its local map
+	size_t idx; // For a list, the index of the next item
+} _sol_itersrc_t;
+
+typedef struct {
+	sol_iterkind_t kind;
+	sol_object_t *func; // For SOL_IT_MAP and SOL_IT_FILTER, the function applied
+	sol_object_t *fargs; // The arguments to func, reused for every call
+	long count; // For SOL_IT_ENUMERATE, the next index; for SOL_IT_TAKE, the items left
+	size_t cur; // For SOL_IT_CHAIN, the source being read
+	size_t nsrcs;
+	_sol_itersrc_t srcs[];
+} _sol_iterbody_t;
+
+#define sol_is_lazy_iter(state, obj) ((obj)->ops == &((state)->IterOps))
+
+static int _sol_itersrc_open(sol_state_t *state, _sol_itersrc_t *src, sol_object_t *obj) {
+	sol_object_t *list, *func;
+	src->args = NULL;
+	src->idx = 0;
+	if(sol_is_list(obj) || sol_is_lazy_iter(state, obj)) {
+		src->obj = sol_incref(obj);
+		return 0;
+	}
+	if(obj->ops->iter && obj->ops->iter != sol_f_not_impl) {
+		list = sol_new_list(state);
+		sol_list_insert(state, list, 0, obj);
+		func = CALL_METHOD(state, obj, iter, list);
+		sol_obj_free(list);
+	} else {
+		func = sol_incref(obj);
+	}
+	if(!func->ops->call || func->ops->call == sol_f_not_impl) {
+		sol_obj_free(func);
+		src->obj = NULL;
+		sol_obj_free(sol_set_error_string(state, "Iterate over non-iterable"));
+		return 1;
+	}
+	src->obj = func;
+	src->args = sol_new_list(state);
+	sol_list_insert(state, src->args, 0, func);
+	sol_list_insert(state, src->args, 1, obj);
+	list = sol_new_map(state);
+	sol_list_insert(state, src->args, 2, list);
+	sol_obj_free(list);
+	return 0;
+}
+
+static void _sol_itersrc_close(_sol_itersrc_t *src) {
+	if(src->obj) {
+		sol_obj_free(src->obj);
+	}
+	if(src->args) {
+		sol_obj_free(src->args);
+	}
+}
+
+static sol_object_t *_sol_itersrc_next(sol_state_t *state, _sol_itersrc_t *src) {
+	if(src->args) {
+		return CALL_METHOD(state, src->obj, call, src->args);
+	}
+	if(sol_is_list(src->obj)) {
+		if(src->idx >= sol_list_len(state, src->obj)) {
+			return sol_incref(state->None);
+		}
+		return sol_list_get_index(state, src->obj, src->idx++);
+	}
+	return sol_iter_next(state, src->obj);
+}
+
+// Calls the iterator's function on an item, and returns its result.
+static sol_object_t *_sol_iter_apply(sol_state_t *state, _sol_iterbody_t *body, sol_object_t *item) {
+	sol_list_set_index(state, body->fargs, 1, item);
+	return CALL_METHOD(state, body->func, call, body->fargs);
+}
+
+sol_object_t *sol_new_iter(sol_state_t *state, sol_iterkind_t kind, sol_object_t *func, sol_object_t *sources, long count) {
+	size_t n = sol_list_len(state, sources), i;
+	_sol_iterbody_t *body = malloc(sizeof(_sol_iterbody_t) + n * sizeof(_sol_itersrc_t));
+	sol_object_t *src;
+	if(!body) {
+		return sol_set_error(state, state->OutOfMemory);
+	}
+	body->kind = kind;
+	body->count = count;
+	body->cur = 0;
+	body->func = NULL;
+	body->fargs = NULL;
+	for(i = 0; i < n; i++) {
+		src = sol_list_get_index(state, sources, i);
+		if(_sol_itersrc_open(state, body->srcs + i, src)) {
+			sol_obj_free(src);
+			while(i > 0) {
+				_sol_itersrc_close(body->srcs + --i);
+			}
+			free(body);
+			return sol_incref(state->None);
+		}
+		sol_obj_free(src);
+	}
+	body->nsrcs = n;
+	if(func) {
+		body->func = sol_incref(func);
+		body->fargs = sol_new_list(state);
+		sol_list_insert(state, body->fargs, 0, func);
+		sol_list_insert(state, body->fargs, 1, state->None);
+	}
+	return sol_new_cdata(state, body, &(state->IterOps));
+}
+
+sol_object_t *sol_iter_next(sol_state_t *state, sol_object_t *iter) {
+	_sol_iterbody_t *body = iter->cdata;
+	sol_object_t *item, *res, *ires;
+	size_t i;
+	switch(body->kind) {
+		case SOL_IT_MAP:
+			item = _sol_itersrc_next(state, body->srcs);
+			if(sol_is_none(state, item)) {
+				return item;
+			}
+			res = _sol_iter_apply(state, body, item);
+			sol_obj_free(item);
+			return res;
+
+		case SOL_IT_FILTER:
+			while(1) {
+				item = _sol_itersrc_next(state, body->srcs);
+				if(sol_is_none(state, item) || sol_has_error(state)) {
+					return item;
+				}
+				res = _sol_iter_apply(state, body, item);
+				ires = sol_cast_int(state, res);
+				sol_obj_free(res);
+				if(sol_has_error(state) || ires->ival) {
+					sol_obj_free(ires);
+					return item;
+				}
+				sol_obj_free(ires);
+				sol_obj_free(item);
+			}
+
+		case SOL_IT_ZIP:
+			res = sol_new_list(state);
+			for(i = 0; i < body->nsrcs; i++) {
+				item = _sol_itersrc_next(state, body->srcs + i);
+				if(sol_is_none(state, item)) {
+					sol_obj_free(res);
+					return item;
+				}
+				sol_list_insert(state, res, i, item);
+				sol_obj_free(item);
+			}
+			return res;
+
+		case SOL_IT_ENUMERATE:
+			item = _sol_itersrc_next(state, body->srcs);
+			if(sol_is_none(state, item)) {
+				return item;
+			}
+			res = sol_new_list(state);
+			ires = sol_new_int(state, body->count++);
+			sol_list_insert(state, res, 0, ires);
+			sol_list_insert(state, res, 1, item);
+			sol_obj_free(ires);
+			sol_obj_free(item);
+			return res;
+
+		case SOL_IT_TAKE:
+			if(body->count <= 0) {
+				return sol_incref(state->None);
+			}
+			body->count--;
+			return _sol_itersrc_next(state, body->srcs);
+
+		case SOL_IT_CHAIN:
+			while(body->cur < body->nsrcs) {
+				item = _sol_itersrc_next(state, body->srcs + body->cur);
+				if(!sol_is_none(state, item) || sol_has_error(state)) {
+					return item;
+				}
+				sol_obj_free(item);
+				body->cur++;
+			}
+			return sol_incref(state->None);
+	}
+	return sol_incref(state->None);
+}
+
+sol_object_t *sol_iter_collect(sol_state_t *state, sol_object_t *obj) {
+	_sol_itersrc_t src;
+	sol_object_t *res, *item;
+	if(_sol_itersrc_open(state, &src, obj)) {
+		return sol_incref(state->None);
+	}
+	res = sol_new_list(state);
+	while(1) {
+		item = _sol_itersrc_next(state, &src);
+		if(sol_is_none(state, item)) {
+			sol_obj_free(item);
+			break;
+		}
+		sol_list_insert(state, res, sol_list_len(state, res), item);
+		sol_obj_free(item);
+		if(sol_has_error(state)) {
+			break;
+		}
+	}
+	_sol_itersrc_close(&src);
+	return res;
+}
+
+sol_object_t *sol_f_lazy_iter_call(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *iter = sol_list_get_index(state, args, 0), *res = sol_iter_next(state, iter);
+	sol_obj_free(iter);
+	return res;
+}
+
+sol_object_t *sol_f_lazy_iter_iter(sol_state_t *state, sol_object_t *args) {
+	return sol_list_get_index(state, args, 0);
+}
+
+sol_object_t *sol_f_lazy_iter_free(sol_state_t *state, sol_object_t *iter) {
+	_sol_iterbody_t *body = iter->cdata;
+	size_t i;
+	for(i = 0; i < body->nsrcs; i++) {
+		_sol_itersrc_close(body->srcs + i);
+	}
+	if(body->func) {
+		sol_obj_free(body->func);
+		sol_obj_free(body->fargs);
+	}
+	free(body);
+	return iter;
+}
@@ -0,0 +1,700 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "ast.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* JSON.
+ *
+ * json.decode(text) builds Sol values from a JSON string or buffer: objects
+ * become maps, arrays lists, true and false 1 and 0, and null None. The
+ * members of a container are gathered on a stack until it closes, so each map
+ * is made with room for all of them at once (see `sol_map_reserve`). Keys
+ * without escapes go through a small cache for the length of the decode, so a
+ * key repeated across an array of objects is one string; they aren't interned
+ * in the state (see `sol_intern`), which would keep every key of every
+ * document forever.
+ *
+ * With a callback, json.decode(text, func(event, value) ... end) builds
+ * nothing, and instead calls it for each part of the document in order:
+ * "start_map", "key" (with the key), "end_map", "start_list", "end_list", and
+ * "value" (with a string, number or None). A large file can be decoded this
+ * way from io.mmap without reading it or holding its values.
+ *
+ * json.encode(value) returns a value as a JSON string, and json.dump(value,
+ * stream) writes it to a stream, through the stream's write buffer.
+ */
+
+/** The deepest nesting of containers decoded or encoded (which also stops
+ * encoding a cycle). */
+#define SOL_JSON_MAX_DEPTH 512
+/** The number of slots in the key cache used while decoding. */
+#define SOL_JSON_KEYCACHE 256
+/** The size of the buffer the encoder gathers output in before writing it to
+ * a stream. */
+#define SOL_JSON_CHUNK 4096
+
+typedef struct {
+	sol_state_t *state;
+	const char *start, *p, *end;
+	sol_object_t *sax; // The callback, or NULL to build values
+	sol_object_t **stack; // Members of the containers being built
+	size_t nstack, cap;
+	size_t depth;
+	sol_object_t *keys[SOL_JSON_KEYCACHE];
+} _sol_jsondec_t;
+
+// Sets an error about the text at the decoder's position; returns NULL.
+static sol_object_t *_sol_json_error(_sol_jsondec_t *d, const char *what) {
+	char msg[128];
+	snprintf(msg, sizeof(msg), "JSON decode error at offset %ld: %s", (long) (d->p - d->start), what);
+	sol_obj_free(sol_set_error_string(d->state, msg));
+	return NULL;
+}
+
+static int _sol_json_push(_sol_jsondec_t *d, sol_object_t *obj) {
+	sol_object_t **stack;
+	if(d->nstack == d->cap) {
+		stack = realloc(d->stack, sizeof(sol_object_t *) * (d->cap ? d->cap * 2 : 64));
+		if(!stack) {
+			sol_obj_free(obj);
+			return 0;
+		}
+		d->stack = stack;
+		d->cap = d->cap ? d->cap * 2 : 64;
+	}
+	d->stack[d->nstack++] = obj;
+	return 1;
+}
+
+// Calls the callback with an event (and a value, or None); returns nonzero on an error.
+static int _sol_json_event(_sol_jsondec_t *d, const char *event, sol_object_t *value) {
+	sol_state_t *state = d->state;
+	sol_object_t *args = sol_new_list(state), *name = sol_intern(state, event);
+	sol_list_insert(state, args, 0, d->sax);
+	sol_list_insert(state, args, 1, name);
+	sol_list_insert(state, args, 2, value ? value : state->None);
+	sol_obj_free(CALL_METHOD(state, d->sax, call, args));
+	sol_obj_free(args);
+	sol_obj_free(name);
+	return sol_has_error(state);
+}
+
+static void _sol_json_ws(_sol_jsondec_t *d) {
+	while(d->p < d->end && (*d->p == ' ' || *d->p == '\n' || *d->p == '\r' || *d->p == '\t')) {
+		d->p++;
+	}
+}
+
+// Returns the first byte from p that ends a run of plain string characters
+// (a quote, backslash or control character), or end.
+static const char *_sol_json_scan(const char *p, const char *end) {
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\'), lim = _mm_set1_epi8(0x1f);
+	__m128i x;
+	unsigned int mask;
+	for(; p + 16 <= end; p += 16) {
+		x = _mm_loadu_si128((const __m128i *) p);
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, bslash)), _mm_cmpeq_epi8(_mm_max_epu8(x, lim), lim)));
+		if(mask) {
+			return p + __builtin_ctz(mask);
+		}
+	}
+#endif
+	for(; p < end; p++) {
+		if(*p == '"' || *p == '\\' || (unsigned char) *p < 0x20) {
+			return p;
+		}
+	}
+	return end;
+}
+
+static int _sol_json_hex4(const char *p, unsigned int *cp) {
+	int i;
+	*cp = 0;
+	for(i = 0; i < 4; i++) {
+		*cp <<= 4;
+		if(p[i] >= '0' && p[i] <= '9') {
+			*cp |= p[i] - '0';
+		} else if(p[i] >= 'a' && p[i] <= 'f') {
+			*cp |= p[i] - 'a' + 10;
+		} else if(p[i] >= 'A' && p[i] <= 'F') {
+			*cp |= p[i] - 'A' + 10;
+		} else {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static size_t _sol_json_utf8(char *out, unsigned int cp) {
+	if(cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	}
+	if(cp < 0x800) {
+		out[0] = 0xc0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	}
+	if(cp < 0x10000) {
+		out[0] = 0xe0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3f);
+		out[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+	out[0] = 0xf0 | (cp >> 18);
+	out[1] = 0x80 | ((cp >> 12) & 0x3f);
+	out[2] = 0x80 | ((cp >> 6) & 0x3f);
+	out[3] = 0x80 | (cp & 0x3f);
+	return 4;
+}
+
+// Returns a key without escapes from the cache, adding it if it isn't there.
+static sol_object_t *_sol_json_key(_sol_jsondec_t *d, const char *s, size_t len) {
+	unsigned long hash = 2166136261UL;
+	sol_object_t **slot;
+	size_t i;
+	for(i = 0; i < len; i++) {
+		hash = (hash ^ (unsigned char) s[i]) * 16777619UL;
+	}
+	slot = &d->keys[hash & (SOL_JSON_KEYCACHE - 1)];
+	if(*slot && (*slot)->slen == len && !memcmp((*slot)->str, s, len)) {
+		return sol_incref(*slot);
+	}
+	if(*slot) {
+		sol_obj_free(*slot);
+	}
+	*slot = sol_new_string_len(d->state, s, len);
+	return sol_incref(*slot);
+}
+
+// Decodes a string, with the decoder at its opening quote.
+static sol_object_t *_sol_json_string(_sol_jsondec_t *d, int key) {
+	const char *p = d->p + 1, *run;
+	char *out = NULL, *grown;
+	size_t len = 0, cap = 0, n;
+	unsigned int cp, lo;
+	while(1) {
+		run = p;
+		p = _sol_json_scan(p, d->end);
+		if(p == d->end) {
+			free(out);
+			d->p = p;
+			return _sol_json_error(d, "Unterminated string");
+		}
+		if(*p == '"' && !out) {
+			// No escapes, so the string is the text as it is
+			d->p = p + 1;
+			return key ? _sol_json_key(d, run, p - run) : sol_new_string_len(d->state, run, p - run);
+		}
+		if((unsigned char) *p < 0x20) {
+			free(out);
+			d->p = p;
+			return _sol_json_error(d, "Control character in string");
+		}
+		// Room for the run, an escape's UTF-8 (at most 4 bytes) and the NUL
+		n = p - run;
+		if(len + n + 5 > cap) {
+			cap = (len + n + 5) * 2;
+			grown = realloc(out, cap);
+			if(!grown) {
+				free(out);
+				sol_obj_free(sol_set_error_string(d->state, "Out of memory decoding JSON"));
+				return NULL;
+			}
+			out = grown;
+		}
+		memcpy(out + len, run, n);
+		len += n;
+		if(*p == '"') {
+			break;
+		}
+		d->p = p;
+		if(p + 1 == d->end) {
+			free(out);
+			return _sol_json_error(d, "Unterminated string");
+		}
+		switch(p[1]) {
+			case '"': case '\\': case '/': out[len++] = p[1]; break;
+			case 'b': out[len++] = '\b'; break;
+			case 'f': out[len++] = '\f'; break;
+			case 'n': out[len++] = '\n'; break;
+			case 'r': out[len++] = '\r'; break;
+			case 't': out[len++] = '\t'; break;
+			case 'u':
+				if(d->end - p < 6 || !_sol_json_hex4(p + 2, &cp)) {
+					free(out);
+					return _sol_json_error(d, "Bad \\u escape");
+				}
+				if(cp >= 0xd800 && cp < 0xdc00) {
+					// A UTF-16 surrogate pair
+					if(d->end - p < 12 || p[6] != '\\' || p[7] != 'u' || !_sol_json_hex4(p + 8, &lo) || lo < 0xdc00 || lo >= 0xe000) {
+						free(out);
+						return _sol_json_error(d, "Unpaired surrogate");
+					}
+					cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+					p += 6;
+				} else if(cp >= 0xdc00 && cp < 0xe000) {
+					free(out);
+					return _sol_json_error(d, "Unpaired surrogate");
+				}
+				if(!cp) {
+					free(out);
+					return _sol_json_error(d, "NUL in string");
+				}
+				len += _sol_json_utf8(out + len, cp);
+				p += 4;
+				break;
+			default:
+				free(out);
+				return _sol_json_error(d, "Bad escape");
+		}
+		p += 2;
+	}
+	d->p = p + 1;
+	out[len] = '\0';
+	return sol_new_string_owned(d->state, out, len);
+}
+
+static sol_object_t *_sol_json_number(_sol_jsondec_t *d) {
+	const char *p = d->p, *end = d->end;
+	char tmp[64], *num = tmp;
+	int isfloat = 0;
+	size_t len;
+	long ival;
+	double fval;
+	if(p < end && *p == '-') {
+		p++;
+	}
+	if(p < end && *p == '0') {
+		p++;
+	} else if(p < end && *p >= '1' && *p <= '9') {
+		while(p < end && *p >= '0' && *p <= '9') {
+			p++;
+		}
+	} else {
+		return _sol_json_error(d, "Bad value");
+	}
+	if(p < end && *p == '.') {
+		isfloat = 1;
+		if(++p == end || *p < '0' || *p > '9') {
+			return _sol_json_error(d, "Bad number");
+		}
+		while(p < end && *p >= '0' && *p <= '9') {
+			p++;
+		}
+	}
+	if(p < end && (*p == 'e' || *p == 'E')) {
+		isfloat = 1;
+		if(++p < end && (*p == '+' || *p == '-')) {
+			p++;
+		}
+		if(p == end || *p < '0' || *p > '9') {
+			return _sol_json_error(d, "Bad number");
+		}
+		while(p < end && *p >= '0' && *p <= '9') {
+			p++;
+		}
+	}
+	// strtol and strtod need it terminated
+	len = p - d->p;
+	if(len >= sizeof(tmp) && !(num = malloc(len + 1))) {
+		sol_obj_free(sol_set_error_string(d->state, "Out of memory decoding JSON"));
+		return NULL;
+	}
+	memcpy(num, d->p, len);
+	num[len] = '\0';
+	d->p = p;
+	if(!isfloat) {
+		errno = 0;
+		ival = strtol(num, NULL, 10);
+		if(errno != ERANGE) {
+			if(num != tmp) {
+				free(num);
+			}
+			return sol_new_int(d->state, ival);
+		}
+	}
+	fval = strtod(num, NULL);
+	if(num != tmp) {
+		free(num);
+	}
+	return sol_new_float(d->state, fval);
+}
+
+static sol_object_t *_sol_json_value(_sol_jsondec_t *);
+
+// Decodes an array or object, with the decoder at its opening bracket.
+static sol_object_t *_sol_json_container(_sol_jsondec_t *d, int ismap) {
+	sol_state_t *state = d->state;
+	size_t base = d->nstack, i;
+	sol_object_t *res, *key, *val;
+	char close = ismap ? '}' : ']';
+	if(++d->depth > SOL_JSON_MAX_DEPTH) {
+		return _sol_json_error(d, "Nested too deeply");
+	}
+	if(d->sax && _sol_json_event(d, ismap ? "start_map" : "start_list", NULL)) {
+		return NULL;
+	}
+	d->p++;
+	_sol_json_ws(d);
+	if(d->p < d->end && *d->p == close) {
+		d->p++;
+	} else {
+		while(1) {
+			if(ismap) {
+				if(d->p == d->end || *d->p != '"') {
+					return _sol_json_error(d, "Expected a key");
+				}
+				key = _sol_json_string(d, 1);
+				if(!key) {
+					return NULL;
+				}
+				if(d->sax) {
+					i = _sol_json_event(d, "key", key);
+					sol_obj_free(key);
+					if(i) {
+						return NULL;
+					}
+				} else if(!_sol_json_push(d, key)) {
+					return NULL;
+				}
+				_sol_json_ws(d);
+				if(d->p == d->end || *d->p != ':') {
+					return _sol_json_error(d, "Expected ':'");
+				}
+				d->p++;
+			}
+			val = _sol_json_value(d);
+			if(!val) {
+				return NULL;
+			}
+			if(d->sax) {
+				sol_obj_free(val);
+			} else if(!_sol_json_push(d, val)) {
+				return NULL;
+			}
+			_sol_json_ws(d);
+			if(d->p < d->end && *d->p == ',') {
+				d->p++;
+				_sol_json_ws(d);
+				continue;
+			}
+			if(d->p < d->end && *d->p == close) {
+				d->p++;
+				break;
+			}
+			return _sol_json_error(d, ismap ? "Expected ',' or '}'" : "Expected ',' or ']'");
+		}
+	}
+	d->depth--;
+	if(d->sax) {
+		return _sol_json_event(d, ismap ? "end_map" : "end_list", NULL) ? NULL : sol_incref(state->None);
+	}
+	if(ismap) {
+		res = sol_new_map(state);
+		sol_map_reserve(state, res, (d->nstack - base) / 2);
+		for(i = base; i < d->nstack; i += 2) {
+			sol_map_set(state, res, d->stack[i], d->stack[i + 1]);
+			sol_obj_free(d->stack[i]);
+			sol_obj_free(d->stack[i + 1]);
+		}
+	} else {
+		res = sol_new_list(state);
+		for(i = base; i < d->nstack; i++) {
+			sol_list_insert(state, res, i - base, d->stack[i]);
+			sol_obj_free(d->stack[i]);
+		}
+	}
+	d->nstack = base;
+	return res;
+}
+
+static sol_object_t *_sol_json_literal(_sol_jsondec_t *d, const char *word, sol_object_t *val) {
+	size_t len = strlen(word);
+	if(d->end - d->p < len || memcmp(d->p, word, len)) {
+		sol_obj_free(val);
+		return _sol_json_error(d, "Bad value");
+	}
+	d->p += len;
+	return val;
+}
+
+static sol_object_t *_sol_json_value(_sol_jsondec_t *d) {
+	sol_object_t *res;
+	_sol_json_ws(d);
+	if(d->p == d->end) {
+		return _sol_json_error(d, "Expected a value");
+	}
+	switch(*d->p) {
+		case '{':
+			return _sol_json_container(d, 1);
+		case '[':
+			return _sol_json_container(d, 0);
+		case '"':
+			res = _sol_json_string(d, 0);
+			break;
+		case 't':
+			res = _sol_json_literal(d, "true", sol_new_int(d->state, 1));
+			break;
+		case 'f':
+			res = _sol_json_literal(d, "false", sol_new_int(d->state, 0));
+			break;
+		case 'n':
+			res = _sol_json_literal(d, "null", sol_incref(d->state->None));
+			break;
+		default:
+			res = _sol_json_number(d);
+	}
+	if(res && d->sax && _sol_json_event(d, "value", res)) {
+		sol_obj_free(res);
+		return NULL;
+	}
+	return res;
+}
+
+sol_object_t *sol_f_json_decode(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *text = sol_list_get_index(state, args, 0), *sax = sol_list_get_index(state, args, 1), *res;
+	_sol_jsondec_t d;
+	size_t i;
+	memset(&d, 0, sizeof(d));
+	d.state = state;
+	if(sol_is_string(text)) {
+		d.start = text->str;
+		d.end = text->str + text->slen;
+	} else if(sol_is_buffer(text) && text->mem->sz >= 0) {
+		d.start = text->mem->buffer;
+		d.end = d.start + text->mem->sz;
+	} else {
+		sol_obj_free(text);
+		sol_obj_free(sax);
+		return sol_set_error_string(state, "Decode JSON from a non-string");
+	}
+	d.p = d.start;
+	d.sax = sol_is_none(state, sax) ? NULL : sax;
+	res = _sol_json_value(&d);
+	if(res) {
+		_sol_json_ws(&d);
+		if(d.p != d.end) {
+			sol_obj_free(res);
+			res = _sol_json_error(&d, "Trailing data");
+		}
+	}
+	// After an error, the members of unfinished containers are still here
+	for(i = 0; i < d.nstack; i++) {
+		sol_obj_free(d.stack[i]);
+	}
+	free(d.stack);
+	for(i = 0; i < SOL_JSON_KEYCACHE; i++) {
+		if(d.keys[i]) {
+			sol_obj_free(d.keys[i]);
+		}
+	}
+	sol_obj_free(text);
+	sol_obj_free(sax);
+	if(!res) {
+		return sol_incref(state->None);
+	}
+	if(d.sax) {
+		sol_obj_free(res);
+		return sol_incref(state->None);
+	}
+	return res;
+}
+
+typedef struct {
+	sol_state_t *state;
+	sol_object_t *stream; // Or NULL to build a string
+	char *buf;
+	size_t len, cap;
+	size_t total; // Bytes written to the stream
+	size_t depth;
+} _sol_jsonenc_t;
+
+static void _sol_json_flush(_sol_jsonenc_t *e) {
+	if(e->len) {
+		e->total += sol_stream_write_bytes(e->state, e->stream, e->buf, e->len, NULL);
+		e->len = 0;
+	}
+}
+
+static int _sol_json_put(_sol_jsonenc_t *e, const char *s, size_t n) {
+	char *grown;
+	if(e->len + n > e->cap) {
+		if(e->stream) {
+			_sol_json_flush(e);
+			if(n > e->cap) {
+				e->total += sol_stream_write_bytes(e->state, e->stream, s, n, NULL);
+				return 1;
+			}
+		} else {
+			e->cap = (e->len + n) * 2;
+			grown = realloc(e->buf, e->cap + 1);
+			if(!grown) {
+				sol_obj_free(sol_set_error_string(e->state, "Out of memory encoding JSON"));
+				return 0;
+			}
+			e->buf = grown;
+		}
+	}
+	memcpy(e->buf + e->len, s, n);
+	e->len += n;
+	return 1;
+}
+
+static int _sol_json_put_string(_sol_jsonenc_t *e, const char *s, size_t n) {
+	static const char hex[] = "0123456789abcdef";
+	const char *end = s + n, *run;
+	char esc[6] = {'\\', 'u', '0', '0'};
+	if(!_sol_json_put(e, "\"", 1)) {
+		return 0;
+	}
+	while(s < end) {
+		run = s;
+		s = _sol_json_scan(s, end);
+		if(s > run && !_sol_json_put(e, run, s - run)) {
+			return 0;
+		}
+		if(s == end) {
+			break;
+		}
+		switch(*s) {
+			case '"': run = "\\\""; break;
+			case '\\': run = "\\\\"; break;
+			case '\b': run = "\\b"; break;
+			case '\f': run = "\\f"; break;
+			case '\n': run = "\\n"; break;
+			case '\r': run = "\\r"; break;
+			case '\t': run = "\\t"; break;
+			default:
+				esc[4] = hex[(*s >> 4) & 0xf];
+				esc[5] = hex[*s & 0xf];
+				if(!_sol_json_put(e, esc, 6)) {
+					return 0;
+				}
+				run = NULL;
+		}
+		if(run && !_sol_json_put(e, run, 2)) {
+			return 0;
+		}
+		s++;
+	}
+	return _sol_json_put(e, "\"", 1);
+}
+
+static int _sol_json_encode(_sol_jsonenc_t *e, sol_object_t *obj) {
+	sol_state_t *state = e->state;
+	sol_object_t *key, *val;
+	char num[SOL_FORMAT_SIZE + 2], msg[64];
+	size_t n, i, pos = 0;
+	int ok = 1;
+	if(sol_is_none(state, obj)) {
+		return _sol_json_put(e, "null", 4);
+	}
+	if(sol_is_int(obj)) {
+		return _sol_json_put(e, num, sol_format_int(num, obj->ival));
+	}
+	if(sol_is_float(obj)) {
+		if(isnan(obj->fval) || isinf(obj->fval)) {
+			sol_obj_free(sol_set_error_string(state, "Encode a non-finite float as JSON"));
+			return 0;
+		}
+		n = sol_format_float(num, obj->fval);
+		// Keep it a float when it's decoded again
+		if(!memchr(num, '.', n) && !memchr(num, 'e', n)) {
+			memcpy(num + n, ".0", 2);
+			n += 2;
+		}
+		return _sol_json_put(e, num, n);
+	}
+	if(sol_is_string(obj)) {
+		return _sol_json_put_string(e, obj->str, obj->slen);
+	}
+	if(sol_is_buffer(obj) && obj->mem->sz >= 0) {
+		return _sol_json_put_string(e, obj->mem->buffer, obj->mem->sz);
+	}
+	if(!sol_is_list(obj) && obj->type != SOL_MAP) {
+		snprintf(msg, sizeof(msg), "Encode %s as JSON", obj->ops->tname);
+		sol_obj_free(sol_set_error_string(state, msg));
+		return 0;
+	}
+	if(++e->depth > SOL_JSON_MAX_DEPTH) {
+		sol_obj_free(sol_set_error_string(state, "Encode JSON nested too deeply (or a cycle)"));
+		return 0;
+	}
+	if(sol_is_list(obj)) {
+		ok = _sol_json_put(e, "[", 1);
+		n = sol_list_len(state, obj);
+		for(i = 0; ok && i < n; i++) {
+			val = sol_list_get_index(state, obj, i);
+			ok = (!i || _sol_json_put(e, ",", 1)) && _sol_json_encode(e, val);
+			sol_obj_free(val);
+		}
+		ok = ok && _sol_json_put(e, "]", 1);
+	} else {
+		ok = _sol_json_put(e, "{", 1);
+		for(i = 0; ok && sol_map_next(state, obj, &pos, &key, &val); i++) {
+			ok = !i || _sol_json_put(e, ",", 1);
+			if(!ok) {
+				break;
+			}
+			if(sol_is_string(key)) {
+				ok = _sol_json_put_string(e, key->str, key->slen);
+			} else if(sol_is_buffer(key) && key->mem->sz >= 0) {
+				ok = _sol_json_put_string(e, key->mem->buffer, key->mem->sz);
+			} else if(sol_is_int(key)) {
+				n = sol_format_int(num, key->ival);
+				ok = _sol_json_put_string(e, num, n);
+			} else {
+				sol_obj_free(sol_set_error_string(state, "Encode a JSON key that isn't a string or int"));
+				ok = 0;
+			}
+			ok = ok && _sol_json_put(e, ":", 1) && _sol_json_encode(e, val);
+		}
+		ok = ok && _sol_json_put(e, "}", 1);
+	}
+	e->depth--;
+	return ok;
+}
+
+sol_object_t *sol_f_json_encode(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *obj = sol_list_get_index(state, args, 0);
+	_sol_jsonenc_t e = {state, NULL, NULL, 0, 0, 0, 0};
+	int ok = _sol_json_encode(&e, obj);
+	sol_obj_free(obj);
+	if(!ok) {
+		free(e.buf);
+		return sol_incref(state->None);
+	}
+	if(!e.buf) {
+		return sol_new_string(state, "");
+	}
+	e.buf[e.len] = '\0';
+	return sol_new_string_owned(state, e.buf, e.len);
+}
+
+sol_object_t *sol_f_json_dump(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *obj = sol_list_get_index(state, args, 0), *stream = sol_list_get_index(state, args, 1);
+	char chunk[SOL_JSON_CHUNK];
+	_sol_jsonenc_t e = {state, stream, chunk, 0, sizeof(chunk), 0, 0};
+	int ok;
+	if(!sol_is_stream(stream)) {
+		sol_obj_free(obj);
+		sol_obj_free(stream);
+		return sol_set_error_string(state, "Dump JSON to a non-stream");
+	}
+	ok = _sol_json_encode(&e, obj);
+	_sol_json_flush(&e);
+	sol_obj_free(obj);
+	sol_obj_free(stream);
+	if(!ok || sol_has_error(state)) {
+		return sol_incref(state->None);
+	}
+	return sol_new_int(state, e.total);
+}
@@ -0,0 +1,543 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "ast.h"
+
+/* Marshalling of values.
+ *
+ * marshal.dumps(value) returns a buffer holding None, ints, floats, strings,
+ * buffers, lists and maps in a compact binary form, and marshal.loads(buf)
+ * (from a buffer or string, such as one from io.mmap) makes them again in one
+ * pass. marshal.dump(value, stream) and marshal.load(stream) do the same on a
+ * stream, one value after another; load returns None at the end of the
+ * stream.
+ *
+ * A value is the header "Sol" and a version byte, the length of what follows
+ * as a varint, and then the value as a tag byte and its contents:
+ *
+ *     N                   None
+ *     i <varint>          an int, zigzagged so small negatives stay small
+ *     f <8 bytes>         a float, little-endian
+ *     s <varint> <bytes>  a string
+ *     b <varint> <bytes>  a buffer
+ *     [ <varint> ...      a list of that many values
+ *     { <varint> ...      a map of that many keys, each followed by its value
+ *     r <varint>          the same object as an earlier s, b, [ or {
+ *
+ * Strings, buffers, lists and maps are numbered in the order they start, and
+ * an object met again (even one that contains itself) is written as a
+ * reference to its number, so shared objects stay shared and cycles survive.
+ * Since lists and maps give their length first, maps are made with room for
+ * all their keys (see `sol_map_reserve`), and no input can make the decoder
+ * allocate more than it has bytes for.
+ */
+
+/** The deepest nesting of containers marshalled or unmarshalled (cycles don't count, since they become references). */
+#define SOL_MARSHAL_MAX_DEPTH 1024
+/** The version written after the "Sol" magic. */
+#define SOL_MARSHAL_VERSION 1
+/** Room for the magic, version and longest varint before the value. */
+#define SOL_MARSHAL_HEADER 14
+
+enum {
+	MARSHAL_NONE = 'N',
+	MARSHAL_INT = 'i',
+	MARSHAL_FLOAT = 'f',
+	MARSHAL_STRING = 's',
+	MARSHAL_BUFFER = 'b',
+	MARSHAL_LIST = '[',
+	MARSHAL_MAP = '{',
+	MARSHAL_REF = 'r',
+};
+
+typedef struct {
+	sol_state_t *state;
+	unsigned char *buf;
+	size_t len, cap;
+	sol_object_t **seen; // Open-addressed table of objects already written...
+	size_t *ids; // ...and their numbers
+	size_t nseen, seencap;
+	size_t depth;
+} _sol_marshal_t;
+
+static int _sol_marshal_put(_sol_marshal_t *m, const void *data, size_t n) {
+	unsigned char *grown;
+	if(m->len + n > m->cap) {
+		m->cap = (m->len + n) * 2;
+		grown = realloc(m->buf, m->cap);
+		if(!grown) {
+			sol_obj_free(sol_set_error_string(m->state, "Out of memory marshalling"));
+			return 0;
+		}
+		m->buf = grown;
+	}
+	memcpy(m->buf + m->len, data, n);
+	m->len += n;
+	return 1;
+}
+
+static size_t _sol_marshal_varint(unsigned char *out, uint64_t v) {
+	size_t n = 0;
+	while(v >= 0x80) {
+		out[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	out[n++] = v;
+	return n;
+}
+
+static int _sol_marshal_tagged(_sol_marshal_t *m, unsigned char tag, uint64_t v) {
+	unsigned char out[11];
+	out[0] = tag;
+	return _sol_marshal_put(m, out, 1 + _sol_marshal_varint(out + 1, v));
+}
+
+static size_t _sol_marshal_hash(sol_object_t *obj, size_t cap) {
+	uintptr_t p = (uintptr_t) obj;
+	return ((p >> 4) * 0x9e3779b97f4a7c15ULL >> 16) & (cap - 1);
+}
+
+/* Looks an object up among those already written. If it's there, writes a
+ * reference to it and returns 1; otherwise numbers it and returns 0 (or -1
+ * on an error). */
+static int _sol_marshal_seen(_sol_marshal_t *m, sol_object_t *obj) {
+	sol_object_t **seen;
+	size_t *ids, cap, i, j;
+	if(m->seencap) {
+		for(i = _sol_marshal_hash(obj, m->seencap); m->seen[i]; i = (i + 1) & (m->seencap - 1)) {
+			if(m->seen[i] == obj) {
+				return _sol_marshal_tagged(m, MARSHAL_REF, m->ids[i]) ? 1 : -1;
+			}
+		}
+	}
+	if((m->nseen + 1) * 2 > m->seencap) {
+		cap = m->seencap ? m->seencap * 2 : 64;
+		seen = calloc(cap, sizeof(sol_object_t *));
+		ids = malloc(cap * sizeof(size_t));
+		if(!seen || !ids) {
+			free(seen);
+			free(ids);
+			sol_obj_free(sol_set_error_string(m->state, "Out of memory marshalling"));
+			return -1;
+		}
+		for(i = 0; i < m->seencap; i++) {
+			if(m->seen[i]) {
+				for(j = _sol_marshal_hash(m->seen[i], cap); seen[j]; j = (j + 1) & (cap - 1));
+				seen[j] = m->seen[i];
+				ids[j] = m->ids[i];
+			}
+		}
+		free(m->seen);
+		free(m->ids);
+		m->seen = seen;
+		m->ids = ids;
+		m->seencap = cap;
+	}
+	for(i = _sol_marshal_hash(obj, m->seencap); m->seen[i]; i = (i + 1) & (m->seencap - 1));
+	m->seen[i] = obj;
+	m->ids[i] = m->nseen++;
+	return 0;
+}
+
+static int _sol_marshal_value(_sol_marshal_t *m, sol_object_t *obj) {
+	sol_state_t *state = m->state;
+	sol_object_t *key, *val;
+	unsigned char out[9];
+	uint64_t bits;
+	size_t n, i, pos = 0;
+	char msg[64];
+	int ok = 1;
+	if(sol_is_none(state, obj)) {
+		out[0] = MARSHAL_NONE;
+		return _sol_marshal_put(m, out, 1);
+	}
+	if(sol_is_int(obj)) {
+		bits = obj->ival;
+		return _sol_marshal_tagged(m, MARSHAL_INT, (bits << 1) ^ (obj->ival < 0 ? ~(uint64_t) 0 : 0));
+	}
+	if(sol_is_float(obj)) {
+		memcpy(&bits, &obj->fval, sizeof(bits));
+		out[0] = MARSHAL_FLOAT;
+		for(i = 0; i < 8; i++) {
+			out[1 + i] = bits >> (8 * i);
+		}
+		return _sol_marshal_put(m, out, 9);
+	}
+	if(!sol_is_string(obj) && !(sol_is_buffer(obj) && obj->mem->sz >= 0) && !sol_is_list(obj) && obj->type != SOL_MAP) {
+		snprintf(msg, sizeof(msg), "Marshal %s", obj->ops->tname);
+		sol_obj_free(sol_set_error_string(state, msg));
+		return 0;
+	}
+	switch(_sol_marshal_seen(m, obj)) {
+		case 1:
+			return 1;
+		case -1:
+			return 0;
+	}
+	if(sol_is_string(obj)) {
+		return _sol_marshal_tagged(m, MARSHAL_STRING, obj->slen) && _sol_marshal_put(m, obj->str, obj->slen);
+	}
+	if(sol_is_buffer(obj)) {
+		return _sol_marshal_tagged(m, MARSHAL_BUFFER, obj->mem->sz) && _sol_marshal_put(m, obj->mem->buffer, obj->mem->sz);
+	}
+	if(++m->depth > SOL_MARSHAL_MAX_DEPTH) {
+		sol_obj_free(sol_set_error_string(state, "Marshal values nested too deeply"));
+		return 0;
+	}
+	if(sol_is_list(obj)) {
+		n = sol_list_len(state, obj);
+		ok = _sol_marshal_tagged(m, MARSHAL_LIST, n);
+		for(i = 0; ok && i < n; i++) {
+			val = sol_list_get_index(state, obj, i);
+			ok = _sol_marshal_value(m, val);
+			sol_obj_free(val);
+		}
+	} else {
+		ok = _sol_marshal_tagged(m, MARSHAL_MAP, sol_map_len(state, obj));
+		while(ok && sol_map_next(state, obj, &pos, &key, &val)) {
+			ok = _sol_marshal_value(m, key) && _sol_marshal_value(m, val);
+		}
+	}
+	m->depth--;
+	return ok;
+}
+
+/* Marshals a value after room for its header, and then writes the header
+ * just before it; returns where the header starts, or -1 on an error. The
+ * caller frees m->buf either way. */
+static ssize_t _sol_marshal(_sol_marshal_t *m, sol_object_t *obj) {
+	unsigned char head[SOL_MARSHAL_HEADER] = {'S', 'o', 'l', SOL_MARSHAL_VERSION};
+	size_t hlen;
+	int ok;
+	m->len = SOL_MARSHAL_HEADER;
+	m->cap = 256;
+	m->buf = malloc(m->cap);
+	if(!m->buf) {
+		sol_obj_free(sol_set_error_string(m->state, "Out of memory marshalling"));
+		return -1;
+	}
+	ok = _sol_marshal_value(m, obj);
+	free(m->seen);
+	free(m->ids);
+	if(!ok) {
+		return -1;
+	}
+	hlen = 4 + _sol_marshal_varint(head + 4, m->len - SOL_MARSHAL_HEADER);
+	memcpy(m->buf + SOL_MARSHAL_HEADER - hlen, head, hlen);
+	return SOL_MARSHAL_HEADER - hlen;
+}
+
+sol_object_t *sol_f_marshal_dumps(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *obj = sol_list_get_index(state, args, 0);
+	_sol_marshal_t m;
+	ssize_t start;
+	memset(&m, 0, sizeof(m));
+	m.state = state;
+	start = _sol_marshal(&m, obj);
+	sol_obj_free(obj);
+	if(start < 0) {
+		free(m.buf);
+		return sol_incref(state->None);
+	}
+	memmove(m.buf, m.buf + start, m.len - start);
+	return sol_new_buffer(state, m.buf, m.len - start, OWN_FREE, NULL, NULL);
+}
+
+sol_object_t *sol_f_marshal_dump(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *obj = sol_list_get_index(state, args, 0), *stream = sol_list_get_index(state, args, 1), *res;
+	_sol_marshal_t m;
+	ssize_t start;
+	if(!sol_is_stream(stream)) {
+		sol_obj_free(obj);
+		sol_obj_free(stream);
+		return sol_set_error_string(state, "Marshal to a non-stream");
+	}
+	memset(&m, 0, sizeof(m));
+	m.state = state;
+	start = _sol_marshal(&m, obj);
+	if(start < 0) {
+		res = sol_incref(state->None);
+	} else {
+		res = sol_new_int(state, sol_stream_write_bytes(state, stream, (char *) m.buf + start, m.len - start, NULL));
+	}
+	free(m.buf);
+	sol_obj_free(obj);
+	sol_obj_free(stream);
+	return res;
+}
+
+typedef struct {
+	sol_state_t *state;
+	const unsigned char *p, *end;
+	sol_object_t **objs; // References to the objects numbered so far
+	size_t nobjs, cap;
+	size_t depth;
+} _sol_unmarshal_t;
+
+static sol_object_t *_sol_unmarshal_error(_sol_unmarshal_t *u, const char *what) {
+	sol_obj_free(sol_set_error_string(u->state, what));
+	return NULL;
+}
+
+static int _sol_unmarshal_varint(_sol_unmarshal_t *u, uint64_t *v) {
+	int shift;
+	*v = 0;
+	for(shift = 0; shift < 64 && u->p < u->end; shift += 7) {
+		*v |= (uint64_t) (*u->p & 0x7f) << shift;
+		if(!(*u->p++ & 0x80)) {
+			return 1;
+		}
+	}
+	_sol_unmarshal_error(u, "Truncated or bad varint in marshalled data");
+	return 0;
+}
+
+// Reads a length, which can't be more than the bytes left (since each item takes at least one).
+static int _sol_unmarshal_len(_sol_unmarshal_t *u, size_t *n) {
+	uint64_t v;
+	if(!_sol_unmarshal_varint(u, &v)) {
+		return 0;
+	}
+	if(v > (uint64_t) (u->end - u->p)) {
+		_sol_unmarshal_error(u, "Truncated marshalled data");
+		return 0;
+	}
+	*n = v;
+	return 1;
+}
+
+static int _sol_unmarshal_number(_sol_unmarshal_t *u, sol_object_t *obj) {
+	sol_object_t **objs;
+	if(u->nobjs == u->cap) {
+		objs = realloc(u->objs, sizeof(sol_object_t *) * (u->cap ? u->cap * 2 : 64));
+		if(!objs) {
+			sol_obj_free(obj);
+			_sol_unmarshal_error(u, "Out of memory unmarshalling");
+			return 0;
+		}
+		u->objs = objs;
+		u->cap = u->cap ? u->cap * 2 : 64;
+	}
+	u->objs[u->nobjs++] = obj;
+	return 1;
+}
+
+static sol_object_t *_sol_unmarshal_value(_sol_unmarshal_t *u) {
+	sol_state_t *state = u->state;
+	sol_object_t *obj, *key, *val;
+	unsigned char tag;
+	uint64_t v;
+	size_t n, i;
+	char *data;
+	double f;
+	if(u->p == u->end) {
+		return _sol_unmarshal_error(u, "Truncated marshalled data");
+	}
+	tag = *u->p++;
+	switch(tag) {
+		case MARSHAL_NONE:
+			return sol_incref(state->None);
+
+		case MARSHAL_INT:
+			if(!_sol_unmarshal_varint(u, &v)) {
+				return NULL;
+			}
+			return sol_new_int(state, (long) ((v >> 1) ^ (0 - (v & 1))));
+
+		case MARSHAL_FLOAT:
+			if(u->end - u->p < 8) {
+				return _sol_unmarshal_error(u, "Truncated marshalled data");
+			}
+			v = 0;
+			for(i = 0; i < 8; i++) {
+				v |= (uint64_t) u->p[i] << (8 * i);
+			}
+			u->p += 8;
+			memcpy(&f, &v, sizeof(f));
+			return sol_new_float(state, f);
+
+		case MARSHAL_REF:
+			if(!_sol_unmarshal_varint(u, &v)) {
+				return NULL;
+			}
+			if(v >= u->nobjs) {
+				return _sol_unmarshal_error(u, "Bad reference in marshalled data");
+			}
+			return sol_incref(u->objs[v]);
+
+		case MARSHAL_STRING:
+		case MARSHAL_BUFFER:
+		case MARSHAL_LIST:
+		case MARSHAL_MAP:
+			if(!_sol_unmarshal_len(u, &n)) {
+				return NULL;
+			}
+			break;
+
+		default:
+			return _sol_unmarshal_error(u, "Bad tag in marshalled data");
+	}
+	if(tag == MARSHAL_STRING) {
+		if(memchr(u->p, '\0', n)) {
+			return _sol_unmarshal_error(u, "NUL in marshalled string");
+		}
+		obj = sol_new_string_len(state, (const char *) u->p, n);
+		u->p += n;
+		return _sol_unmarshal_number(u, obj) ? sol_incref(obj) : NULL;
+	}
+	if(tag == MARSHAL_BUFFER) {
+		data = malloc(n ? n : 1);
+		if(!data) {
+			return _sol_unmarshal_error(u, "Out of memory unmarshalling");
+		}
+		memcpy(data, u->p, n);
+		u->p += n;
+		obj = sol_new_buffer(state, data, n, OWN_FREE, NULL, NULL);
+		return _sol_unmarshal_number(u, obj) ? sol_incref(obj) : NULL;
+	}
+	if(++u->depth > SOL_MARSHAL_MAX_DEPTH) {
+		return _sol_unmarshal_error(u, "Marshalled values nested too deeply");
+	}
+	// Numbered before its contents, which may refer to it
+	if(tag == MARSHAL_LIST) {
+		obj = sol_new_list(state);
+	} else {
+		obj = sol_new_map(state);
+		sol_map_reserve(state, obj, n);
+	}
+	if(!_sol_unmarshal_number(u, obj)) {
+		return NULL;
+	}
+	for(i = 0; i < n; i++) {
+		if(tag == MARSHAL_LIST) {
+			if(!(val = _sol_unmarshal_value(u))) {
+				return NULL;
+			}
+			sol_list_insert(state, obj, i, val);
+		} else {
+			if(!(key = _sol_unmarshal_value(u))) {
+				return NULL;
+			}
+			if(!(val = _sol_unmarshal_value(u))) {
+				sol_obj_free(key);
+				return NULL;
+			}
+			sol_map_set(state, obj, key, val);
+			sol_obj_free(key);
+		}
+		sol_obj_free(val);
+	}
+	u->depth--;
+	return sol_incref(obj);
+}
+
+// Unmarshals a value from after its header; the objects it numbered are freed either way.
+static sol_object_t *_sol_unmarshal(sol_state_t *state, const unsigned char *data, size_t len) {
+	_sol_unmarshal_t u;
+	sol_object_t *res;
+	size_t i;
+	memset(&u, 0, sizeof(u));
+	u.state = state;
+	u.p = data;
+	u.end = data + len;
+	res = _sol_unmarshal_value(&u);
+	if(res && u.p != u.end) {
+		sol_obj_free(res);
+		res = _sol_unmarshal_error(&u, "Trailing data after marshalled value");
+	}
+	for(i = 0; i < u.nobjs; i++) {
+		sol_obj_free(u.objs[i]);
+	}
+	free(u.objs);
+	return res;
+}
+
+// Checks a header, and returns the length of the value after it, or -1 on an error.
+static ssize_t _sol_unmarshal_header(sol_state_t *state, const unsigned char *head, size_t len, size_t *hlen) {
+	uint64_t v = 0;
+	size_t i;
+	if(len < 4 || memcmp(head, "Sol", 3)) {
+		sol_obj_free(sol_set_error_string(state, "Not marshalled data"));
+		return -1;
+	}
+	if(head[3] != SOL_MARSHAL_VERSION) {
+		sol_obj_free(sol_set_error_string(state, "Unknown marshal version"));
+		return -1;
+	}
+	for(i = 4; i < len && i < SOL_MARSHAL_HEADER; i++) {
+		v |= (uint64_t) (head[i] & 0x7f) << (7 * (i - 4));
+		if(!(head[i] & 0x80)) {
+			break;
+		}
+	}
+	if(i < len && i < SOL_MARSHAL_HEADER && v <= SSIZE_MAX) {
+		*hlen = i + 1;
+		return v;
+	}
+	sol_obj_free(sol_set_error_string(state, "Truncated or bad marshal header"));
+	return -1;
+}
+
+sol_object_t *sol_f_marshal_loads(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *data = sol_list_get_index(state, args, 0), *res;
+	const unsigned char *p;
+	size_t len, hlen;
+	ssize_t vlen;
+	if(sol_is_string(data)) {
+		p = (const unsigned char *) data->str;
+		len = data->slen;
+	} else if(sol_is_buffer(data) && data->mem->sz >= 0) {
+		p = data->mem->buffer;
+		len = data->mem->sz;
+	} else {
+		sol_obj_free(data);
+		return sol_set_error_string(state, "Unmarshal a non-buffer");
+	}
+	vlen = _sol_unmarshal_header(state, p, len, &hlen);
+	if(vlen >= 0 && (size_t) vlen != len - hlen) {
+		sol_obj_free(sol_set_error_string(state, (size_t) vlen > len - hlen ? "Truncated marshalled data" : "Trailing data after marshalled value"));
+		vlen = -1;
+	}
+	res = vlen < 0 ? NULL : _sol_unmarshal(state, p + hlen, vlen);
+	sol_obj_free(data);
+	return res ? res : sol_incref(state->None);
+}
+
+sol_object_t *sol_f_marshal_load(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *stream = sol_list_get_index(state, args, 0), *res = NULL;
+	unsigned char head[SOL_MARSHAL_HEADER], *data;
+	size_t len = 0, hlen;
+	ssize_t vlen = -1;
+	if(!sol_is_stream(stream)) {
+		sol_obj_free(stream);
+		return sol_set_error_string(state, "Unmarshal from a non-stream");
+	}
+	// The header is read a byte at a time (from the read buffer), so no more of the stream is taken than the value
+	while(len < SOL_MARSHAL_HEADER && sol_stream_fread(state, stream, (char *) head + len, 1, 1) == 1) {
+		len++;
+		if(len > 4 && !(head[len - 1] & 0x80)) {
+			break;
+		}
+	}
+	if(!len) {
+		// The end of the stream
+		sol_obj_free(stream);
+		return sol_incref(state->None);
+	}
+	vlen = _sol_unmarshal_header(state, head, len, &hlen);
+	if(vlen >= 0) {
+		data = malloc(vlen ? vlen : 1);
+		if(!data) {
+			sol_obj_free(sol_set_error_string(state, "Out of memory unmarshalling"));
+		} else if(sol_stream_fread(state, stream, (char *) data, 1, vlen) != (size_t) vlen) {
+			sol_obj_free(sol_set_error_string(state, "Truncated marshalled data"));
+		} else {
+			res = _sol_unmarshal(state, data, vlen);
+		}
+		free(data);
+	}
+	sol_obj_free(stream);
+	return res ? res : sol_incref(state->None);
+}
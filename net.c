@@ -0,0 +1,352 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "ast.h"
+
+/* Sockets.
+ *
+ * A socket is an ordinary stream (SOL_STREAM) over a socket descriptor, so it
+ * is read and written with the stream methods, through the stream's read and
+ * write buffers. Sockets are non-blocking unless `net.setblocking` says
+ * otherwise: a read returns whatever has arrived (an empty buffer, or None
+ * from read(io.LINE), if a whole line hasn't; check stream:eof() for the end
+ * of the connection), and a write that the socket can't take yet stays
+ * queued on the stream until a later flush (see stream:pending()). The event
+ * module says when a socket is ready for either.
+ */
+
+// Makes an error of the failed operation and the reason errno gives.
+static sol_object_t *_sol_net_error(sol_state_t *state, const char *what) {
+	char msg[256];
+	snprintf(msg, sizeof(msg), "%s: %s", what, strerror(errno));
+	return sol_set_error_string(state, msg);
+}
+
+// Returns the descriptor of a socket stream, or -1 (with the error set).
+static int _sol_net_fd(sol_state_t *state, sol_object_t *sock) {
+	int fd;
+	if(!sol_is_stream(sock)) {
+		sol_obj_free(sol_set_error_string(state, "Not a socket stream"));
+		return -1;
+	}
+	fd = fileno(sock->io->stream);
+	if(fd < 0) {
+		sol_obj_free(sol_set_error_string(state, "Not a socket stream"));
+	}
+	return fd;
+}
+
+static int _sol_net_nonblock(int fd, int on) {
+	int flags = fcntl(fd, F_GETFL);
+	if(flags < 0) {
+		return -1;
+	}
+	return fcntl(fd, F_SETFL, on ? flags | O_NONBLOCK : flags & ~O_NONBLOCK);
+}
+
+// Wraps a connected or listening socket in a stream, closing it on failure.
+static sol_object_t *_sol_net_stream(sol_state_t *state, int fd) {
+	FILE *f = fdopen(fd, "r+");
+	if(!f) {
+		close(fd);
+		return _sol_net_error(state, "Socket stream failed");
+	}
+	return sol_new_stream(state, f, MODE_READ | MODE_WRITE);
+}
+
+// Resolves a host (None or "" for any address) and port for a TCP socket.
+static struct addrinfo *_sol_net_resolve(sol_state_t *state, sol_object_t *host, sol_object_t *port, int passive) {
+	struct addrinfo hints, *res = NULL;
+	sol_object_t *shost = NULL, *iport = sol_cast_int(state, port);
+	char sport[32];
+	int err;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV | (passive ? AI_PASSIVE : 0);
+	snprintf(sport, sizeof(sport), "%ld", iport->ival);
+	sol_obj_free(iport);
+	if(!sol_is_none(state, host)) {
+		shost = sol_cast_string(state, host);
+	}
+	err = getaddrinfo(shost && shost->slen ? shost->str : NULL, sport, &hints, &res);
+	if(shost) {
+		sol_obj_free(shost);
+	}
+	if(err) {
+		sol_obj_free(sol_set_error_string(state, gai_strerror(err)));
+		return NULL;
+	}
+	return res;
+}
+
+// Fills in a Unix socket address; returns its length, or 0 if the path is too long.
+static socklen_t _sol_net_unix_addr(sol_state_t *state, struct sockaddr_un *addr, sol_object_t *path) {
+	sol_object_t *spath = sol_cast_string(state, path);
+	socklen_t len = 0;
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if(spath->slen < sizeof(addr->sun_path)) {
+		memcpy(addr->sun_path, spath->str, spath->slen);
+		len = offsetof(struct sockaddr_un, sun_path) + spath->slen + 1;
+	}
+	sol_obj_free(spath);
+	if(!len) {
+		sol_obj_free(sol_set_error_string(state, "Socket path too long"));
+	}
+	return len;
+}
+
+static int _sol_net_backlog(sol_state_t *state, sol_object_t *backlog) {
+	sol_object_t *ibacklog;
+	int res = SOMAXCONN;
+	if(!sol_is_none(state, backlog)) {
+		ibacklog = sol_cast_int(state, backlog);
+		res = ibacklog->ival;
+		sol_obj_free(ibacklog);
+	}
+	return res;
+}
+
+sol_object_t *sol_f_net_listen(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *host = sol_list_get_index(state, args, 0), *port = sol_list_get_index(state, args, 1), *backlog = sol_list_get_index(state, args, 2);
+	struct addrinfo *addrs = _sol_net_resolve(state, host, port, 1), *ai;
+	int fd = -1, one = 1, n = _sol_net_backlog(state, backlog);
+	sol_obj_free(host);
+	sol_obj_free(port);
+	sol_obj_free(backlog);
+	if(!addrs) {
+		return sol_incref(state->None);
+	}
+	for(ai = addrs; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if(fd < 0) {
+			continue;
+		}
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if(!bind(fd, ai->ai_addr, ai->ai_addrlen) && !listen(fd, n)) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addrs);
+	if(fd < 0) {
+		return _sol_net_error(state, "Listen failed");
+	}
+	return _sol_net_stream(state, fd);
+}
+
+sol_object_t *sol_f_net_listen_unix(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *path = sol_list_get_index(state, args, 0), *backlog = sol_list_get_index(state, args, 1);
+	struct sockaddr_un addr;
+	socklen_t len = _sol_net_unix_addr(state, &addr, path);
+	int fd, n = _sol_net_backlog(state, backlog);
+	sol_obj_free(path);
+	sol_obj_free(backlog);
+	if(!len) {
+		return sol_incref(state->None);
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0 || bind(fd, (struct sockaddr *) &addr, len) || listen(fd, n)) {
+		if(fd >= 0) {
+			close(fd);
+		}
+		return _sol_net_error(state, "Listen failed");
+	}
+	return _sol_net_stream(state, fd);
+}
+
+sol_object_t *sol_f_net_connect(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *host = sol_list_get_index(state, args, 0), *port = sol_list_get_index(state, args, 1);
+	struct addrinfo *addrs = _sol_net_resolve(state, host, port, 0), *ai;
+	int fd = -1;
+	sol_obj_free(host);
+	sol_obj_free(port);
+	if(!addrs) {
+		return sol_incref(state->None);
+	}
+	for(ai = addrs; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if(fd < 0) {
+			continue;
+		}
+		// The connection finishes in the background; the socket becomes
+		// writable when it has (see net.error)
+		if(!connect(fd, ai->ai_addr, ai->ai_addrlen) || errno == EINPROGRESS) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addrs);
+	if(fd < 0) {
+		return _sol_net_error(state, "Connect failed");
+	}
+	return _sol_net_stream(state, fd);
+}
+
+sol_object_t *sol_f_net_connect_unix(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *path = sol_list_get_index(state, args, 0);
+	struct sockaddr_un addr;
+	socklen_t len = _sol_net_unix_addr(state, &addr, path);
+	int fd;
+	sol_obj_free(path);
+	if(!len) {
+		return sol_incref(state->None);
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0 || (connect(fd, (struct sockaddr *) &addr, len) && errno != EINPROGRESS && errno != EAGAIN)) {
+		if(fd >= 0) {
+			close(fd);
+		}
+		return _sol_net_error(state, "Connect failed");
+	}
+	return _sol_net_stream(state, fd);
+}
+
+sol_object_t *sol_f_net_accept(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *sock = sol_list_get_index(state, args, 0);
+	int fd = _sol_net_fd(state, sock), conn;
+	sol_obj_free(sock);
+	if(fd < 0) {
+		return sol_incref(state->None);
+	}
+	do {
+		conn = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	} while(conn < 0 && errno == EINTR);
+	if(conn < 0) {
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) {
+			// No connection waiting
+			return sol_incref(state->None);
+		}
+		return _sol_net_error(state, "Accept failed");
+	}
+	return _sol_net_stream(state, conn);
+}
+
+// Returns [host, port] for an internet address, or [path, None] for a Unix one.
+static sol_object_t *_sol_net_addr_list(sol_state_t *state, struct sockaddr_storage *addr, socklen_t len) {
+	sol_object_t *res = sol_new_list(state), *name, *port;
+	char host[INET6_ADDRSTRLEN] = "";
+	switch(addr->ss_family) {
+		case AF_INET:
+			inet_ntop(AF_INET, &((struct sockaddr_in *) addr)->sin_addr, host, sizeof(host));
+			port = sol_new_int(state, ntohs(((struct sockaddr_in *) addr)->sin_port));
+			name = sol_new_string(state, host);
+			break;
+
+		case AF_INET6:
+			inet_ntop(AF_INET6, &((struct sockaddr_in6 *) addr)->sin6_addr, host, sizeof(host));
+			port = sol_new_int(state, ntohs(((struct sockaddr_in6 *) addr)->sin6_port));
+			name = sol_new_string(state, host);
+			break;
+
+		default:
+			// An unnamed Unix socket has no path
+			port = sol_incref(state->None);
+			name = sol_new_string(state, len > offsetof(struct sockaddr_un, sun_path) ? ((struct sockaddr_un *) addr)->sun_path : "");
+			break;
+	}
+	sol_list_insert(state, res, 0, name);
+	sol_list_insert(state, res, 1, port);
+	sol_obj_free(name);
+	sol_obj_free(port);
+	return res;
+}
+
+static sol_object_t *_sol_net_name(sol_state_t *state, sol_object_t *args, int peer) {
+	sol_object_t *sock = sol_list_get_index(state, args, 0);
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	int fd = _sol_net_fd(state, sock);
+	sol_obj_free(sock);
+	if(fd < 0) {
+		return sol_incref(state->None);
+	}
+	memset(&addr, 0, sizeof(addr));
+	if((peer ? getpeername : getsockname)(fd, (struct sockaddr *) &addr, &len)) {
+		return _sol_net_error(state, "Address lookup failed");
+	}
+	return _sol_net_addr_list(state, &addr, len);
+}
+
+sol_object_t *sol_f_net_address(sol_state_t *state, sol_object_t *args) {
+	return _sol_net_name(state, args, 0);
+}
+
+sol_object_t *sol_f_net_peer(sol_state_t *state, sol_object_t *args) {
+	return _sol_net_name(state, args, 1);
+}
+
+sol_object_t *sol_f_net_shutdown(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *sock = sol_list_get_index(state, args, 0), *how = sol_list_get_index(state, args, 1), *ihow;
+	int fd = _sol_net_fd(state, sock), h = SHUT_RDWR;
+	if(fd >= 0) {
+		if(!sol_is_none(state, how)) {
+			ihow = sol_cast_int(state, how);
+			h = ihow->ival;
+			sol_obj_free(ihow);
+		}
+		if(h != SHUT_RD) {
+			// What's still buffered goes out before the end of the stream
+			sol_stream_fflush(state, sock);
+		}
+		if(shutdown(fd, h)) {
+			sol_obj_free(_sol_net_error(state, "Shutdown failed"));
+		}
+	}
+	sol_obj_free(sock);
+	sol_obj_free(how);
+	return sol_incref(state->None);
+}
+
+sol_object_t *sol_f_net_setblocking(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *sock = sol_list_get_index(state, args, 0), *flag = sol_list_get_index(state, args, 1), *iflag = sol_cast_int(state, flag);
+	int fd = _sol_net_fd(state, sock);
+	if(fd >= 0 && _sol_net_nonblock(fd, !iflag->ival)) {
+		sol_obj_free(_sol_net_error(state, "Setting blocking mode failed"));
+	}
+	sol_obj_free(iflag);
+	sol_obj_free(flag);
+	return sock;
+}
+
+sol_object_t *sol_f_net_nodelay(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *sock = sol_list_get_index(state, args, 0), *flag = sol_list_get_index(state, args, 1), *iflag = sol_cast_int(state, flag);
+	int fd = _sol_net_fd(state, sock), on = iflag->ival != 0;
+	if(fd >= 0 && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on))) {
+		sol_obj_free(_sol_net_error(state, "Setting TCP_NODELAY failed"));
+	}
+	sol_obj_free(iflag);
+	sol_obj_free(flag);
+	return sock;
+}
+
+sol_object_t *sol_f_net_error(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *sock = sol_list_get_index(state, args, 0);
+	int fd = _sol_net_fd(state, sock), err = 0;
+	socklen_t len = sizeof(err);
+	sol_obj_free(sock);
+	if(fd < 0) {
+		return sol_incref(state->None);
+	}
+	if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len)) {
+		err = errno;
+	}
+	if(!err) {
+		return sol_incref(state->None);
+	}
+	return sol_new_string(state, strerror(err));
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "ast.h"  // For CALL_METHOD
 
 #include <stdlib.h>
@@ -6,6 +7,14 @@
 #include <assert.h>
 #include <dlfcn.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
 
 sol_object_t *sol_cast_int(sol_state_t *state, sol_object_t *obj) {
 	sol_object_t *res, *ls;
@@ -72,12 +81,14 @@ sol_object_t *sol_new_singlet(sol_state_t *state, const char *name) {
 		res->refcnt = 0;
 		res->ops = &(state->SingletOps);
 		res->str = strdup(name);
+		res->slen = strlen(name);
 	}
 	return sol_incref(res); // XXX Segfault
 }
 
 sol_object_t *sol_f_singlet_free(sol_state_t *state, sol_object_t *singlet) {
 	free(singlet->str);
+	return singlet;
 }
 
 // And, now, for the rest of the checked stuff...
@@ -117,32 +128,62 @@ sol_object_t *sol_new_float(sol_state_t *state, double f) {
 	return res;
 }
 
-sol_object_t *sol_new_string(sol_state_t *state, const char *s) {
-	sol_object_t *res = sol_alloc_object(state);
-	res->type = SOL_STRING;
-	res->str = strdup(s);
-	if(!res->str) {
-		sol_obj_free(res);
+sol_object_t *sol_new_string_owned(sol_state_t *state, char *s, size_t len) {
+	sol_object_t *res;
+	if(!s) {
 		sol_set_error(state, state->OutOfMemory);
 		return sol_incref(state->None);
 	}
+	res = sol_alloc_object(state);
+	res->type = SOL_STRING;
+	res->str = s;
+	res->slen = len;
 	res->ops = &(state->StringOps);
 	sol_init_object(state, res);
 	return res;
 }
 
+sol_object_t *sol_new_string(sol_state_t *state, const char *s) {
+	return sol_new_string_owned(state, strdup(s), strlen(s));
+}
+
+sol_object_t *sol_new_string_len(sol_state_t *state, const char *s, size_t len) {
+	char *copy = malloc(len + 1);
+	if(copy) {
+		memcpy(copy, s, len);
+		copy[len] = '\0';
+	}
+	return sol_new_string_owned(state, copy, len);
+}
+
+sol_object_t *sol_intern(sol_state_t *state, const char *s) {
+	sol_object_t *res = sol_map_get_name(state, state->interned, (char *) s);
+	if(!sol_is_none(state, res)) {
+		return res;
+	}
+	res = sol_new_string(state, s);
+	if(sol_has_error(state)) {
+		return res;
+	}
+	sol_immortalize(state, res);
+	sol_map_set(state, state->interned, res, res);
+	return res;
+}
+
 int sol_string_cmp(sol_state_t *state, sol_object_t *str, const char *s) {
 	return strcmp(str->str, s);
 }
 
 sol_object_t *sol_string_concat(sol_state_t *state, sol_object_t *a, sol_object_t *b) {
 	sol_object_t *res, *sa = sol_cast_string(state, a), *sb = sol_cast_string(state, b);
-	int n = strlen(sa->str) + strlen(sb->str) + 1;
-	char *s = malloc(n);
-	res = sol_new_string(state, strncat(strncpy(s, a->str, n), b->str, n));
+	char *s = malloc(sa->slen + sb->slen + 1);
+	if(s) {
+		memcpy(s, sa->str, sa->slen);
+		memcpy(s + sa->slen, sb->str, sb->slen + 1);
+	}
+	res = sol_new_string_owned(state, s, sa->slen + sb->slen);
 	sol_obj_free(sa);
 	sol_obj_free(sb);
-	free(s);
 	return res;
 }
 
@@ -153,26 +194,126 @@ sol_object_t *sol_string_concat_cstr(sol_state_t *state, sol_object_t *a, char *
 	return res;
 }
 
+// Regions grown in place get power-of-two capacities, so that repeated appends
+// (as in a loop doing `s += x`) copy each byte only a constant number of times
+// on average.
+static size_t _sol_grow_size(size_t sz) {
+	size_t cap = 16;
+	while(cap < sz) {
+		cap <<= 1;
+	}
+	return cap;
+}
+
+int sol_concat_inplace(sol_state_t *state, sol_object_t *a, sol_object_t *b) {
+	char *s, *bs;
+	size_t blen, len;
+	if(a == b) {
+		return 0;
+	}
+	// Take b's bytes the way the add operation would cast them
+	if(sol_is_string(b)) {
+		bs = b->str;
+		blen = b->slen;
+	} else if(sol_is_buffer(b) && b->mem->sz >= 0) {
+		bs = b->mem->buffer;
+		blen = sol_is_string(a) ? strnlen(bs, b->mem->sz) : b->mem->sz;
+	} else {
+		return 0;
+	}
+	if(sol_is_string(a)) {
+		len = a->slen + blen;
+		// realloc returns quickly while the grown capacity still fits
+		s = realloc(a->str, _sol_grow_size(len + 1));
+		if(!s) {
+			return 0;
+		}
+		memcpy(s + a->slen, bs, blen);
+		s[len] = '\0';
+		a->str = s;
+		a->slen = len;
+		return 1;
+	}
+	if(sol_is_buffer(a)) {
+		if(a->mem->own != OWN_FREE || (a->mem->flags & SOL_BUF_IMMUTABLE) || a->mem->sz < 0) {
+			return 0;
+		}
+		s = a->mem->buffer;
+		// b may be a view into a, which realloc could move
+		if(bs >= s && bs < s + a->mem->sz) {
+			return 0;
+		}
+		len = a->mem->sz + blen;
+		s = realloc(s, _sol_grow_size(len));
+		if(!s) {
+			return 0;
+		}
+		memcpy(s + a->mem->sz, bs, blen);
+		a->mem->buffer = s;
+		a->mem->sz = len;
+		return 1;
+	}
+	return 0;
+}
+
+// Fills dst (of size total) with copies of the len bytes at src, doubling the
+// filled prefix each pass so there are only O(log n) memcpy calls.
+static void _sol_repeat_bytes(char *dst, const char *src, size_t len, size_t total) {
+	size_t done;
+	if(!total) {
+		return;
+	}
+	memcpy(dst, src, len);
+	for(done = len; done < total; done *= 2) {
+		memcpy(dst + done, dst, (total - done < done) ? total - done : done);
+	}
+}
+
+// Returns len * n, or (size_t) -1 if that would overflow.
+static size_t _sol_repeat_size(size_t len, long n) {
+	if(n <= 0) {
+		return 0;
+	}
+	if(len > (((size_t) -1) - 1) / n) {
+		return (size_t) -1;
+	}
+	return len * n;
+}
+
+sol_object_t *sol_string_repeat(sol_state_t *state, sol_object_t *a, long n) {
+	size_t total = _sol_repeat_size(a->slen, n);
+	char *s = (total == (size_t) -1) ? NULL : malloc(total + 1);
+	if(s) {
+		_sol_repeat_bytes(s, a->str, a->slen, total);
+		s[total] = '\0';
+	}
+	return sol_new_string_owned(state, s, total);
+}
+
 sol_object_t *sol_f_str_free(sol_state_t *state, sol_object_t *obj) {
 	free(obj->str);
 	return obj;
 }
 
 sol_object_t *sol_new_list(sol_state_t *state) {
-	sol_object_t *res = sol_alloc_object(state);
+	sol_object_t *res = sol_alloc_container(state);
 	res->type = SOL_LIST;
 	res->seq = dsl_seq_new_array(NULL, &(state->obfuncs));
+	res->seqref = NULL;
 	res->ops = &(state->ListOps);
 	sol_init_object(state, res);
+	sol_gc_track(state, res);
 	return res;
 }
 
 sol_object_t *sol_list_from_seq(sol_state_t *state, dsl_seq *seq) {
-	sol_object_t *res = sol_alloc_object(state);
+	sol_object_t *res = sol_alloc_container(state);
 	res->type = SOL_LIST;
 	res->seq = seq;
+	res->seqref = NULL;
 	res->ops = &(state->ListOps);
 	sol_init_object(state, res);
+	sol_gc_track(state, res);
 	return res;
 }
 
@@ -204,6 +345,7 @@ void sol_list_set_index(sol_state_t *state, sol_object_t *list, int idx, sol_obj
 	if(idx < 0 || idx >= dsl_seq_len(list->seq)) {
 		return;
 	}
+	sol_list_unshare(state, list);
 	dsl_seq_set(list->seq, idx, obj);
 }
 
@@ -211,6 +353,7 @@ void sol_list_insert(sol_state_t *state, sol_object_t *list, int idx, sol_object
 	if(idx < 0 || idx > dsl_seq_len(list->seq)) {
 		return;
 	}
+	sol_list_unshare(state, list);
 	dsl_seq_insert(list->seq, idx, obj);
 }
 
@@ -218,11 +361,65 @@ sol_object_t *sol_list_remove(sol_state_t *state, sol_object_t *list, int idx) {
 	if(idx < 0 || idx >= dsl_seq_len(list->seq)) {
 		return sol_incref(state->None);
 	}
+	sol_list_unshare(state, list);
 	return dsl_seq_remove(list->seq, idx);
 }
 
+/* Lists share their dsl_seq copy-on-write: the first copy allocates a counter
+ * that every sharer points to, and the first write through any of them takes a
+ * private copy (or, if it turns out to be the last sharer, simply drops the
+ * counter). Maps do the same with the refcnt in their table. */
+
+static void _sol_seq_share(sol_object_t *src, sol_object_t *dest) {
+	if(!src->seqref) {
+		src->seqref = malloc(sizeof(size_t));
+		if(!src->seqref) {
+			// No counter to share through, so take a private copy now
+			dest->seq = dsl_seq_copy(src->seq);
+			dest->seqref = NULL;
+			return;
+		}
+		*src->seqref = 1;
+	}
+	(*src->seqref)++;
+	dest->seq = src->seq;
+	dest->seqref = src->seqref;
+}
+
+static void _sol_seq_unshare(sol_object_t *obj) {
+	if(!obj->seqref) {
+		return;
+	}
+	if(--(*obj->seqref) == 0) {
+		free(obj->seqref);
+	} else {
+		obj->seq = dsl_seq_copy(obj->seq);
+	}
+	obj->seqref = NULL;
+}
+
+static void _sol_seq_release(sol_object_t *obj) {
+	if(obj->seqref) {
+		if(--(*obj->seqref) > 0) {
+			return;
+		}
+		free(obj->seqref);
+	}
+	dsl_free_seq(obj->seq);
+}
+
+void sol_list_unshare(sol_state_t *state, sol_object_t *list) {
+	_sol_seq_unshare(list);
+}
+
 sol_object_t *sol_list_copy(sol_state_t *state, sol_object_t *list) {
-	return sol_list_from_seq(state, dsl_seq_copy(list->seq));
+	sol_object_t *res = sol_alloc_container(state);
+	res->type = SOL_LIST;
+	res->ops = &(state->ListOps);
+	_sol_seq_share(list, res);
+	sol_init_object(state, res);
+	sol_gc_track(state, res);
+	return res;
 }
 
 sol_object_t *sol_list_truncate(sol_state_t *state, sol_object_t *list, int len) {
@@ -241,13 +438,35 @@ sol_object_t *sol_list_truncate(sol_state_t *state, sol_object_t *list, int len)
 }
 
 void sol_list_append(sol_state_t *state, sol_object_t *dest, sol_object_t *src) {
-	dsl_seq *oldseq = dest->seq;
-	dest->seq = dsl_seq_append(dest->seq, src->seq);
-	dsl_free_seq(oldseq);
+	dsl_seq *newseq = dsl_seq_append(dest->seq, src->seq);
+	_sol_seq_release(dest);
+	dest->seq = newseq;
+	dest->seqref = NULL;
+}
+
+sol_object_t *sol_list_repeat(sol_state_t *state, sol_object_t *list, long n) {
+	dsl_seq *seq;
+	size_t len = dsl_seq_len(list->seq), total = _sol_repeat_size(len, n), i, j;
+	// List positions are ints
+	if(total > INT_MAX) {
+		return sol_set_error(state, state->OutOfMemory);
+	}
+	if(n == 1) {
+		return sol_list_from_seq(state, dsl_seq_copy(list->seq));
+	}
+	// Fill the new sequence directly from the source, one reference per slot,
+	// always at its end (dsl has no way to reserve the room up front)
+	seq = dsl_seq_new_array(NULL, &(state->obfuncs));
+	for(j = 0; j < total; j += len) {
+		for(i = 0; i < len; i++) {
+			dsl_seq_insert(seq, j + i, dsl_seq_get(list->seq, i));
+		}
+	}
+	return sol_list_from_seq(state, seq);
 }
 
 sol_object_t *sol_f_list_free(sol_state_t *state, sol_object_t *list) {
-	dsl_free_seq(list->seq);
+	_sol_seq_release(list);
 	return list;
 }
 
@@ -296,194 +515,653 @@ int sol_validate_list(sol_state_t *state, sol_object_t *list) {
 	return 0;
 }*/
 
-sol_object_t *sol_new_map(sol_state_t *state) {
-	sol_object_t *map = sol_alloc_object(state);
-	map->type = SOL_MAP;
-	map->ops = &(state->MapOps);
-	map->seq = dsl_seq_new_array(NULL, &(state->obfuncs));
-	sol_init_object(state, map);
-	return map;
+/* Maps keep their associations inline in a sol_mtable_t (see sol.h): a dense,
+ * insertion-ordered array of key/value/hash entries, plus an open-addressed
+ * (linear probing) index into it once there are more than a handful of them.
+ * Deleted entries are tombstoned (NULL key) until the next resize compacts
+ * them away. */
+
+#define SOL_MTABLE_LINEAR 8
+#define SOL_MTABLE_EMPTY (-1)
+#define SOL_MTABLE_DUMMY (-2)
+// Returned by _sol_mtable_find when comparing keys raised an error.
+#define SOL_MTABLE_ERROR (-2)
+
+static unsigned long _sol_hash_mix(unsigned long x) {
+	x *= 2654435761UL;
+	return x ^ (x >> 16);
+}
+
+static unsigned long _sol_hash_bytes(const char *s, size_t len) {
+	unsigned long h = 2166136261UL;
+	size_t i;
+	for(i = 0; i < len && s[i]; i++) {
+		h ^= (unsigned char) s[i];
+		h *= 16777619UL;
+	}
+	return h;
 }
 
-sol_object_t *sol_map_from_seq(sol_state_t *state, dsl_seq *seq) {
-	sol_object_t *map = sol_alloc_object(state);
-	if(sol_has_error(state)) {
-		return sol_incref(state->None);
+unsigned long sol_map_hash(sol_state_t *state, sol_object_t *key) {
+	unsigned long long bits;
+	double d;
+	switch(key->type) {
+		case SOL_INTEGER:
+			return _sol_hash_mix(key->ival);
+
+		case SOL_FLOAT:
+			d = key->fval;
+			if(d == 0.0) {
+				d = 0.0;  // -0.0 == 0.0
+			}
+			memcpy(&bits, &d, sizeof(bits));
+			return _sol_hash_mix((unsigned long) (bits ^ (bits >> 32)));
+
+		case SOL_STRING:
+			return _sol_hash_bytes(key->str, (size_t) -1);
+
+		case SOL_BUFFER:
+			if(key->mem->sz < 0) {
+				return 0;
+			}
+			return _sol_hash_bytes(key->mem->buffer, key->mem->sz);
+
+		default:
+			if(key->ops->cmp == sol_f_default_cmp) {
+				return _sol_hash_mix(((unsigned long) key) >> 4);
+			}
+			return 0;
+	}
+}
+
+// Returns 1 if the keys are equal, 0 if not, or -1 (leaving the error set) if
+// comparing them raised an error.
+static int _sol_map_keyeq(sol_state_t *state, sol_object_t *a, sol_object_t *b) {
+	sol_object_t *list, *cmp, *icmp;
+	int res, pending = sol_has_error(state);
+	if(a == b) {
+		return 1;
+	}
+	if(sol_is_int(a) && sol_is_int(b)) {
+		return a->ival == b->ival;
+	}
+	if(sol_is_string(a) && sol_is_string(b)) {
+		return !strcmp(a->str, b->str);
+	}
+	if(a->ops->cmp == sol_f_default_cmp) {
+		return 0;
+	}
+	list = sol_new_list(state);
+	sol_list_insert(state, list, 0, a);
+	sol_list_insert(state, list, 1, b);
+	cmp = CALL_METHOD(state, a, cmp, list);
+	sol_obj_free(list);
+	if(!pending && sol_has_error(state)) {
+		sol_obj_free(cmp);
+		return -1;
+	}
+	icmp = sol_cast_int(state, cmp);
+	res = (icmp->ival == 0);
+	sol_obj_free(cmp);
+	sol_obj_free(icmp);
+	return res;
+}
+
+static sol_mtable_t *_sol_mtable_new() {
+	sol_mtable_t *t = malloc(sizeof(sol_mtable_t));
+	t->refcnt = 1;
+	t->len = 0;
+	t->used = 0;
+	t->dummies = 0;
+	t->cap = 0;
+	t->mask = 0;
+	t->index = NULL;
+	t->entries = NULL;
+	return t;
+}
+
+static void _sol_mtable_release(sol_mtable_t *t) {
+	size_t i;
+	if(--t->refcnt > 0) {
+		return;
+	}
+	for(i = 0; i < t->used; i++) {
+		if(t->entries[i].key) {
+			sol_obj_free(t->entries[i].key);
+			sol_obj_free(t->entries[i].val);
+		}
+	}
+	free(t->entries);
+	free(t->index);
+	free(t);
+}
+
+// Reallocates the entries to hold cap of them, dropping deleted entries and
+// rebuilding the index (if the new size needs one).
+static int _sol_mtable_resize(sol_mtable_t *t, size_t cap) {
+	sol_mentry_t *entries = malloc(sizeof(sol_mentry_t) * cap);
+	long *index = NULL;
+	size_t i, j = 0, size = 0, slot;
+	if(!entries) {
+		return 0;
+	}
+	if(cap > SOL_MTABLE_LINEAR) {
+		for(size = 1; size < cap * 2; size <<= 1);
+		index = malloc(sizeof(long) * size);
+		if(!index) {
+			free(entries);
+			return 0;
+		}
+		for(i = 0; i < size; i++) {
+			index[i] = SOL_MTABLE_EMPTY;
+		}
+	}
+	for(i = 0; i < t->used; i++) {
+		if(!t->entries[i].key) {
+			continue;
+		}
+		entries[j] = t->entries[i];
+		if(index) {
+			slot = entries[j].hash & (size - 1);
+			while(index[slot] != SOL_MTABLE_EMPTY) {
+				slot = (slot + 1) & (size - 1);
+			}
+			index[slot] = j;
+		}
+		j++;
+	}
+	free(t->entries);
+	free(t->index);
+	t->entries = entries;
+	t->index = index;
+	t->mask = index ? size - 1 : 0;
+	t->cap = cap;
+	t->used = j;
+	t->dummies = 0;
+	return 1;
+}
+
+// As _sol_map_keyeq(state, key, <name as a buffer>), without the buffer.
+static int _sol_map_keyeq_name(sol_object_t *key, const char *name, size_t len) {
+	if(sol_is_string(key)) {
+		return !strcmp(key->str, name);
+	}
+	if(sol_is_buffer(key)) {
+		return key->mem->sz == len && !memcmp(key->mem->buffer, name, len);
 	}
+	return 0;
+}
+
+static int _sol_mtable_match(sol_state_t *state, sol_mentry_t *e, unsigned long hash, sol_object_t *key, const char *name, size_t len) {
+	if(e->hash != hash) {
+		return 0;
+	}
+	if(name) {
+		return _sol_map_keyeq_name(e->key, name, len);
+	}
+	return _sol_map_keyeq(state, e->key, key);
+}
+
+// Returns the position of the entry for key (or, if name isn't NULL, the C
+// string name of length len), -1 if there is none, or SOL_MTABLE_ERROR if a
+// comparison raised an error; if slot isn't NULL, it receives the index slot
+// referring to the entry.
+static long _sol_mtable_find(sol_state_t *state, sol_mtable_t *t, sol_object_t *key, const char *name, size_t len, unsigned long hash, size_t *slot) {
+	size_t i, s;
+	long ix;
+	int eq;
+	if(!t->index) {
+		for(i = 0; i < t->used; i++) {
+			if(t->entries[i].key && (eq = _sol_mtable_match(state, &(t->entries[i]), hash, key, name, len))) {
+				return eq < 0 ? SOL_MTABLE_ERROR : i;
+			}
+		}
+		return -1;
+	}
+	s = hash & t->mask;
+	while((ix = t->index[s]) != SOL_MTABLE_EMPTY) {
+		if(ix >= 0 && (eq = _sol_mtable_match(state, &(t->entries[ix]), hash, key, name, len))) {
+			if(eq < 0) {
+				return SOL_MTABLE_ERROR;
+			}
+			if(slot) {
+				*slot = s;
+			}
+			return ix;
+		}
+		s = (s + 1) & t->mask;
+	}
+	return -1;
+}
+
+// The key must not already be present. The table is rebuilt (which also drops
+// deleted entries) once its entries are all used, or once live and deleted
+// slots fill half the index, so probes always reach an empty slot.
+static int _sol_mtable_insert(sol_mtable_t *t, sol_object_t *key, sol_object_t *val, unsigned long hash) {
+	size_t s;
+	if((t->used == t->cap || (t->index && (t->len + t->dummies + 1) * 2 > t->mask + 1)) && !_sol_mtable_resize(t, t->len < 2 ? 4 : t->len * 2)) {
+		return 0;
+	}
+	t->entries[t->used].key = sol_incref(key);
+	t->entries[t->used].val = sol_incref(val);
+	t->entries[t->used].hash = hash;
+	if(t->index) {
+		s = hash & t->mask;
+		while(t->index[s] >= 0) {
+			s = (s + 1) & t->mask;
+		}
+		if(t->index[s] == SOL_MTABLE_DUMMY) {
+			t->dummies--;
+		}
+		t->index[s] = t->used;
+	}
+	t->used++;
+	t->len++;
+	return 1;
+}
+
+static void _sol_mtable_delete(sol_mtable_t *t, long ix, size_t slot) {
+	sol_object_t *key = t->entries[ix].key, *val = t->entries[ix].val;
+	t->entries[ix].key = NULL;
+	t->entries[ix].val = NULL;
+	if(t->index) {
+		t->index[slot] = SOL_MTABLE_DUMMY;
+		t->dummies++;
+	}
+	t->len--;
+	sol_obj_free(key);
+	sol_obj_free(val);
+}
+
+static int _sol_mtable_next(sol_mtable_t *t, size_t *pos, sol_object_t **key, sol_object_t **val) {
+	sol_mentry_t *e;
+	while(*pos < t->used) {
+		e = &(t->entries[(*pos)++]);
+		if(e->key) {
+			if(key) {
+				*key = e->key;
+			}
+			if(val) {
+				*val = e->val;
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static sol_object_t *_sol_new_mcell(sol_state_t *state, sol_object_t *key, sol_object_t *val) {
+	sol_object_t *mcell = sol_alloc_container(state);
+	mcell->type = SOL_MCELL;
+	mcell->ops = &(state->MCellOps);
+	mcell->key = sol_incref(key);
+	mcell->val = sol_incref(val);
+	sol_init_object(state, mcell);
+	sol_gc_track(state, mcell);
+	return mcell;
+}
+
+sol_object_t *sol_new_map(sol_state_t *state) {
+	sol_object_t *map = sol_alloc_container(state);
 	map->type = SOL_MAP;
 	map->ops = &(state->MapOps);
-	map->seq = seq;
+	map->mtable = _sol_mtable_new();
+	sol_init_object(state, map);
+	sol_gc_track(state, map);
 	return map;
 }
 
 int sol_map_len(sol_state_t *state, sol_object_t *map) {
-	return dsl_seq_len(map->seq);
+	return map->mtable->len;
+}
+
+int sol_map_next(sol_state_t *state, sol_object_t *map, size_t *pos, sol_object_t **key, sol_object_t **val) {
+	return _sol_mtable_next(map->mtable, pos, key, val);
 }
 
 sol_object_t *sol_map_mcell_index(sol_state_t *state, sol_object_t *map, int index) {
-	sol_object_t *res = dsl_seq_get(map->seq, index);
-	if(res) {
-		return sol_incref(res);
+	sol_mtable_t *t = map->mtable;
+	sol_object_t *key, *val;
+	size_t pos = 0;
+	if(index < 0 || index >= t->len) {
+		return sol_incref(state->None);
+	}
+	if(t->used == t->len) {
+		return _sol_new_mcell(state, t->entries[index].key, t->entries[index].val);
+	}
+	while(_sol_mtable_next(t, &pos, &key, &val)) {
+		if(!index--) {
+			return _sol_new_mcell(state, key, val);
+		}
 	}
 	return sol_incref(state->None);
 }
 
-sol_object_t *sol_map_mcell(sol_state_t *state, sol_object_t *map, sol_object_t *key) {
-	sol_object_t *list, *cmp, *icmp, *res = NULL;
-	dsl_seq_iter *iter;
+static long _sol_map_find(sol_state_t *state, sol_object_t *map, sol_object_t *key, unsigned long *hash, size_t *slot) {
 	if(!sol_is_map(map)) {
 		printf("WARNING: Attempt to index non-map as map\n");
-		return sol_incref(state->None);
+		return -1;
 	}
-	list = sol_new_list(state);
-	iter = dsl_new_seq_iter(map->seq);
-	if(sol_has_error(state)) {
-		dsl_free_seq_iter(iter);
-		sol_obj_free(list);
-		return sol_incref(state->None);
+	*hash = sol_map_hash(state, key);
+	return _sol_mtable_find(state, map->mtable, key, NULL, 0, *hash, slot);
+}
+
+static long _sol_map_find_name(sol_state_t *state, sol_object_t *map, const char *name, unsigned long *hash, size_t *slot) {
+	size_t len = strlen(name);
+	if(!sol_is_map(map)) {
+		printf("WARNING: Attempt to index non-map as map\n");
+		return -1;
 	}
-	sol_list_insert(state, list, 0, state->None);
-	sol_list_insert(state, list, 1, key);
-	while(!res && !dsl_seq_iter_is_invalid(iter)) {
-		sol_list_set_index(state, list, 0, AS_OBJ(dsl_seq_iter_at(iter))->key);
-		cmp = CALL_METHOD(state, AS_OBJ(dsl_seq_iter_at(iter))->key, cmp, list);
-		if(sol_has_error(state)) {
-			sol_obj_free(cmp);
-			sol_clear_error(state);
-			continue;
-		}
-		icmp = sol_cast_int(state, cmp);
-		sol_obj_free(cmp);
-		if(icmp->ival == 0) {
-			res = AS_OBJ(dsl_seq_iter_at(iter));
-		}
-		sol_obj_free(icmp);
-		dsl_seq_iter_next(iter);
-	} 
-	dsl_free_seq_iter(iter);
-	sol_obj_free(list);
-	if(res) {
-		return sol_incref(res);
+	*hash = _sol_hash_bytes(name, len);
+	return _sol_mtable_find(state, map->mtable, NULL, name, len, *hash, slot);
+}
+
+sol_object_t *sol_map_mcell(sol_state_t *state, sol_object_t *map, sol_object_t *key) {
+	unsigned long hash;
+	long ix = _sol_map_find(state, map, key, &hash, NULL);
+	if(ix < 0) {
+		return sol_incref(state->None);
 	}
-	return sol_incref(state->None);
+	return _sol_new_mcell(state, map->mtable->entries[ix].key, map->mtable->entries[ix].val);
 }
 
 int sol_map_has(sol_state_t *state, sol_object_t *map, sol_object_t *key) {
-	sol_object_t *mcell = sol_map_mcell(state, map, key);
-	int res = !sol_is_none(state, mcell);
-	sol_decref(mcell);
-	return res;
+	unsigned long hash;
+	return _sol_map_find(state, map, key, &hash, NULL) >= 0;
 }
 
 sol_object_t *sol_map_get(sol_state_t *state, sol_object_t *map, sol_object_t *key) {
-	sol_object_t *mcell = sol_map_mcell(state, map, key), *ret;
-	if(sol_is_none(state, mcell)) {
-		ret = mcell;
-	} else {
-		ret = mcell->val;
+	unsigned long hash;
+	long ix = _sol_map_find(state, map, key, &hash, NULL);
+	if(ix < 0) {
+		return sol_incref(state->None);
 	}
-	sol_obj_free(mcell);
-	return sol_incref(ret);
+	return sol_incref(map->mtable->entries[ix].val);
 }
 
 sol_object_t *sol_map_get_name(sol_state_t *state, sol_object_t *map, char *name) {
-	sol_object_t *key = sol_new_buffer(state, name, strlen(name), OWN_NONE, NULL, NULL);
-	sol_object_t *res = sol_map_get(state, map, key);
-	sol_obj_free(key);
+	unsigned long hash;
+	long ix = _sol_map_find_name(state, map, name, &hash, NULL);
+	if(ix < 0) {
+		return sol_incref(state->None);
+	}
+	return sol_incref(map->mtable->entries[ix].val);
+}
+
+// Returns a new reference to the key to store for key: an immutable copy of a
+// mutable (sized) buffer, whose hash would go stale if it were changed in
+// place, or key itself. Returns NULL if the copy can't be allocated.
+static sol_object_t *_sol_map_key(sol_state_t *state, sol_object_t *key) {
+	sol_object_t *res;
+	char *copy;
+	if(!sol_is_buffer(key) || key->mem->sz < 0 || (key->mem->flags & SOL_BUF_IMMUTABLE)) {
+		return sol_incref(key);
+	}
+	copy = malloc(key->mem->sz ? key->mem->sz : 1);
+	if(!copy) {
+		return NULL;
+	}
+	memcpy(copy, key->mem->buffer, key->mem->sz);
+	res = sol_new_buffer(state, copy, key->mem->sz, OWN_FREE, NULL, NULL);
+	res->mem->flags |= SOL_BUF_IMMUTABLE;
 	return res;
 }
 
 void sol_map_set(sol_state_t *state, sol_object_t *map, sol_object_t *key, sol_object_t *val) {
-	sol_object_t *mcell = sol_map_mcell(state, map, key), *newcell, *temp;
+	unsigned long hash;
+	size_t slot = 0;
+	long ix = _sol_map_find(state, map, key, &hash, &slot);
+	sol_object_t *temp;
+	if(!sol_is_map(map) || ix == SOL_MTABLE_ERROR) {
+		return;
+	}
 	if(sol_is_none(state, val)) {
-		if(!sol_is_none(state, mcell)) {
-			// XXX hacky
-			dsl_seq_iter *iter = dsl_new_seq_iter(map->seq);
-			while(!dsl_seq_iter_is_invalid(iter)) {
-				if(mcell == dsl_seq_iter_at(iter)) {
-					dsl_seq_iter_delete_at(iter);
-					break;
-				}
-				dsl_seq_iter_next(iter);
-			}
+		if(ix >= 0) {
+			sol_map_unshare(state, map);
+			_sol_mtable_delete(map->mtable, ix, slot);
 		}
 		return;
-	} 
-	if(sol_is_none(state, mcell)) {
-		newcell = sol_alloc_object(state);
-		newcell->type = SOL_MCELL;
-		newcell->ops = &(state->MCellOps);
-		newcell->key = sol_incref(key);
-		newcell->val = sol_incref(val);
-		dsl_seq_insert(map->seq, 0, newcell);
-		sol_obj_free(newcell);
-	} else {
-		temp = mcell->val;
-		mcell->val = sol_incref(val);
+	}
+	sol_map_unshare(state, map);
+	if(ix >= 0) {
+		temp = map->mtable->entries[ix].val;
+		map->mtable->entries[ix].val = sol_incref(val);
 		sol_obj_free(temp);
+	} else {
+		key = _sol_map_key(state, key);
+		if(!key || !_sol_mtable_insert(map->mtable, key, val, hash)) {
+			sol_obj_free(sol_set_error(state, state->OutOfMemory));
+		}
+		if(key) {
+			sol_obj_free(key);
+		}
 	}
-	sol_obj_free(mcell);
 }
 
 void sol_map_set_name(sol_state_t *state, sol_object_t *map, char *name, sol_object_t *val) {
-	sol_object_t *key = sol_new_buffer(state, name, strlen(name), OWN_NONE, NULL, NULL);
-	sol_map_set(state, map, key, val);
-	sol_obj_free(key);
+	unsigned long hash;
+	size_t slot = 0;
+	long ix = _sol_map_find_name(state, map, name, &hash, &slot);
+	sol_object_t *key, *temp;
+	if(!sol_is_map(map)) {
+		return;
+	}
+	if(ix < 0) {
+		if(!sol_is_none(state, val)) {
+			// Reuse the interned name if there is one, but don't intern new ones:
+			// names here can come from data, and interned strings never die.
+			key = state->interned ? sol_map_get_name(state, state->interned, name) : sol_incref(state->None);
+			if(sol_is_none(state, key)) {
+				sol_obj_free(key);
+				key = sol_new_string(state, name);
+			}
+			sol_map_set(state, map, key, val);
+			sol_obj_free(key);
+		}
+		return;
+	}
+	sol_map_unshare(state, map);
+	if(sol_is_none(state, val)) {
+		_sol_mtable_delete(map->mtable, ix, slot);
+	} else {
+		temp = map->mtable->entries[ix].val;
+		map->mtable->entries[ix].val = sol_incref(val);
+		sol_obj_free(temp);
+	}
 }
 
 void sol_map_set_existing(sol_state_t *state, sol_object_t *map, sol_object_t *key, sol_object_t *val) {
-	sol_object_t *mcell = sol_map_mcell(state, map, key), *temp;
-	if(!sol_is_none(state, mcell)) {
-		temp = mcell->val;
-		mcell->val = sol_incref(val);
+	unsigned long hash;
+	long ix = _sol_map_find(state, map, key, &hash, NULL);
+	sol_object_t *temp;
+	if(ix >= 0 && map->mtable->entries[ix].val != val) {
+		sol_map_unshare(state, map);
+		temp = map->mtable->entries[ix].val;
+		map->mtable->entries[ix].val = sol_incref(val);
 		sol_obj_free(temp);
 	}
-	sol_obj_free(mcell);
+}
+
+void sol_map_unshare(sol_state_t *state, sol_object_t *map) {
+	sol_mtable_t *t = map->mtable, *n;
+	size_t i;
+	if(t->refcnt <= 1) {
+		return;
+	}
+	n = malloc(sizeof(sol_mtable_t));
+	*n = *t;
+	n->refcnt = 1;
+	n->entries = NULL;
+	n->index = NULL;
+	if(t->cap) {
+		n->entries = malloc(sizeof(sol_mentry_t) * t->cap);
+		memcpy(n->entries, t->entries, sizeof(sol_mentry_t) * t->used);
+	}
+	if(t->index) {
+		n->index = malloc(sizeof(long) * (t->mask + 1));
+		memcpy(n->index, t->index, sizeof(long) * (t->mask + 1));
+	}
+	for(i = 0; i < n->used; i++) {
+		if(n->entries[i].key) {
+			sol_incref(n->entries[i].key);
+			sol_incref(n->entries[i].val);
+		}
+	}
+	t->refcnt--;
+	map->mtable = n;
+}
+
+void sol_map_reserve(sol_state_t *state, sol_object_t *map, size_t n) {
+	sol_map_unshare(state, map);
+	if(map->mtable->cap < n) {
+		_sol_mtable_resize(map->mtable, n);
+	}
 }
 
 sol_object_t *sol_map_copy(sol_state_t *state, sol_object_t *map) {
-	return sol_map_from_seq(state, dsl_seq_copy(map->seq));
+	sol_object_t *res = sol_alloc_container(state);
+	if(sol_has_error(state)) {
+		return sol_incref(state->None);
+	}
+	res->type = SOL_MAP;
+	res->ops = &(state->MapOps);
+	res->mtable = map->mtable;
+	res->mtable->refcnt++;
+	sol_init_object(state, res);
+	sol_gc_track(state, res);
+	return res;
 }
 
 void sol_map_merge(sol_state_t *state, sol_object_t *dest, sol_object_t *src) {
-	dsl_seq_iter *iter = dsl_new_seq_iter(src->seq);
-	while(!dsl_seq_iter_is_invalid(iter)) {
-		sol_map_set(state, dest, AS_OBJ(dsl_seq_iter_at(iter))->key, AS_OBJ(dsl_seq_iter_at(iter))->val);
-		dsl_seq_iter_next(iter);
+	sol_mtable_t *t = src->mtable;
+	sol_object_t *key, *val;
+	size_t pos = 0;
+	t->refcnt++;  // Holds the source steady, even if it is dest
+	while(_sol_mtable_next(t, &pos, &key, &val)) {
+		sol_map_set(state, dest, key, val);
 	}
-	dsl_free_seq_iter(iter);
+	_sol_mtable_release(t);
 }
 
 void sol_map_merge_existing(sol_state_t *state, sol_object_t *dest, sol_object_t *src) {
-	dsl_seq_iter *iter = dsl_new_seq_iter(src->seq);
-	while(!dsl_seq_iter_is_invalid(iter)) {
-		sol_map_set_existing(state, dest, AS_OBJ(dsl_seq_iter_at(iter))->key, AS_OBJ(dsl_seq_iter_at(iter))->val);
-		dsl_seq_iter_next(iter);
+	sol_mtable_t *t = src->mtable;
+	sol_object_t *key, *val;
+	size_t pos = 0;
+	if(t == dest->mtable) {
+		return;
 	}
-	dsl_free_seq_iter(iter);
+	t->refcnt++;
+	while(_sol_mtable_next(t, &pos, &key, &val)) {
+		sol_map_set_existing(state, dest, key, val);
+	}
+	_sol_mtable_release(t);
 }
 
 void sol_map_invert(sol_state_t *state, sol_object_t *map) {
-	dsl_seq *pairs = dsl_seq_copy(map->seq);
-	dsl_seq_iter *iter = dsl_new_seq_iter(pairs);
-	sol_object_t *mcell;
-	while(!dsl_seq_iter_is_invalid(iter)) {
-		mcell = dsl_seq_iter_at(iter);
-		sol_map_set(state, map, mcell->val, mcell->key);
-		dsl_seq_iter_next(iter);
+	sol_mtable_t *t = map->mtable;
+	sol_object_t *key, *val;
+	size_t pos = 0;
+	t->refcnt++;
+	while(_sol_mtable_next(t, &pos, &key, &val)) {
+		sol_map_set(state, map, val, key);
 	}
-	dsl_free_seq_iter(iter);
-	dsl_free_seq(pairs);
+	_sol_mtable_release(t);
 }
 
-sol_object_t *sol_f_map_free(sol_state_t *state, sol_object_t *map) {
-	dsl_free_seq(map->seq);
-	return map;
-}
+void sol_obj_traverse(sol_object_t *obj, int shared, sol_visitfunc_t visit, void *arg) {
+	size_t i, len;
+	switch(obj->type) {
+		case SOL_LIST:
+			if(!shared && obj->seqref && *obj->seqref > 1) {
+				break;
+			}
+			len = dsl_seq_len(obj->seq);
+			for(i = 0; i < len; i++) {
+				visit(dsl_seq_get(obj->seq, i), arg);
+			}
+			break;
 
-sol_object_t *sol_f_mcell_free(sol_state_t *state, sol_object_t *mcell) {
-	if(mcell->key) {
-		sol_obj_free(mcell->key);
+		case SOL_MAP:
+			if(!shared && obj->mtable->refcnt > 1) {
+				break;
+			}
+			for(i = 0; i < obj->mtable->used; i++) {
+				if(obj->mtable->entries[i].key) {
+					visit(obj->mtable->entries[i].key, arg);
+					visit(obj->mtable->entries[i].val, arg);
+				}
+			}
+			break;
+
+		case SOL_MCELL:
+			visit(obj->key, arg);
+			visit(obj->val, arg);
+			break;
+
+		case SOL_FUNCTION:
+		case SOL_MACRO:
+			visit(obj->fn->closure, arg);
+			visit(obj->fn->udata, arg);
+			visit(obj->fn->annos, arg);
+			break;
+
+		default:
+			break;
+	}
+}
+
+void sol_obj_clear(sol_state_t *state, sol_object_t *obj) {
+	sol_mtable_t *t;
+	sol_object_t *temp;
+	switch(obj->type) {
+		case SOL_LIST:
+			_sol_seq_release(obj);
+			obj->seq = dsl_seq_new_array(NULL, &(state->obfuncs));
+			obj->seqref = NULL;
+			break;
+
+		case SOL_MAP:
+			t = obj->mtable;
+			obj->mtable = _sol_mtable_new();
+			_sol_mtable_release(t);
+			break;
+
+		// None is immortal, so the destructors may still free these.
+		case SOL_MCELL:
+			temp = obj->key;
+			obj->key = state->None;
+			sol_obj_free(temp);
+			temp = obj->val;
+			obj->val = state->None;
+			sol_obj_free(temp);
+			break;
+
+		case SOL_FUNCTION:
+		case SOL_MACRO:
+			temp = obj->fn->closure;
+			obj->fn->closure = state->None;
+			sol_obj_free(temp);
+			temp = obj->fn->udata;
+			obj->fn->udata = state->None;
+			sol_obj_free(temp);
+			temp = obj->fn->annos;
+			obj->fn->annos = state->None;
+			sol_obj_free(temp);
+			break;
+
+		default:
+			break;
+	}
+}
+
+sol_object_t *sol_f_map_free(sol_state_t *state, sol_object_t *map) {
+	_sol_mtable_release(map->mtable);
+	return map;
+}
+
+sol_object_t *sol_f_mcell_free(sol_state_t *state, sol_object_t *mcell) {
+	if(mcell->key) {
+		sol_obj_free(mcell->key);
 	} else {
 		printf("WARNING: Freed mcell with NULL key\n");
 	}
@@ -523,6 +1201,9 @@ sol_object_t *sol_new_cfunc(sol_state_t *state, sol_cfunc_t cfunc, char *name) {
 	res->cfunc = cfunc;
 	res->cfname = name ? strdup(name) : NULL;
 	sol_init_object(state, res);
+	if(state->immortal_init) {
+		sol_immortalize(state, res);
+	}
 	return res;
 }
 
@@ -533,6 +1214,9 @@ sol_object_t *sol_new_cmacro(sol_state_t *state, sol_cfunc_t cfunc, char *name)
 	res->cfunc = cfunc;
 	res->cfname = name ? strdup(name) : NULL;
 	sol_init_object(state, res);
+	if(state->immortal_init) {
+		sol_immortalize(state, res);
+	}
 	return res;
 }
 
@@ -567,39 +1251,42 @@ sol_object_t *sol_new_buffer(sol_state_t *state, void *buffer, ssize_t sz, sol_o
 	sol_object_t *res = sol_alloc_object(state);
 	res->type = SOL_BUFFER;
 	res->ops = &(state->BufferOps);
-	res->buffer = buffer;
-	res->sz = sz;
-	res->own = own;
-	res->freef = freef;
-	res->movef = movef;
+	res->mem = malloc(sizeof(sol_bufbody_t));
+	res->mem->buffer = buffer;
+	res->mem->sz = sz;
+	res->mem->own = own;
+	res->mem->freef = freef;
+	res->mem->movef = movef;
+	res->mem->flags = 0;
+	res->mem->owner = NULL;
 	sol_init_object(state, res);
 	return res;
 }
 
 int sol_buffer_cmp(sol_state_t *state, sol_object_t *buf, const char *s) {
 	size_t len = strlen(s);
-	if(buf->sz != -1 && buf->sz < len) len = buf->sz;
-	return memcmp(buf->buffer, s, len);
+	if(buf->mem->sz != -1 && buf->mem->sz < len) len = buf->mem->sz;
+	return memcmp(buf->mem->buffer, s, len);
 }
 
 sol_object_t *sol_buffer_concat(sol_state_t *state, sol_object_t *a, sol_object_t *b) {
 	sol_object_t *ba = sol_cast_buffer(state, a), *bb = sol_cast_buffer(state, b);
 	char *buf;
 	size_t total;
-	if(ba->sz < 0 || bb->sz < 0) {
+	if(ba->mem->sz < 0 || bb->mem->sz < 0) {
 		sol_obj_free(ba);
 		sol_obj_free(bb);
 		return sol_set_error_string(state, "Concatenate unsized buffer");
 	}
-	total = ba->sz + bb->sz;
+	total = ba->mem->sz + bb->mem->sz;
 	buf = malloc(sizeof(char) * total);
 	if(!buf) {
 		sol_obj_free(ba);
 		sol_obj_free(bb);
 		return sol_incref(state->OutOfMemory);
 	}
-	memcpy(buf, ba->buffer, ba->sz);
-	memcpy(buf + ba->sz, bb->buffer, bb->sz);
+	memcpy(buf, ba->mem->buffer, ba->mem->sz);
+	memcpy(buf + ba->mem->sz, bb->mem->buffer, bb->mem->sz);
 	sol_obj_free(ba);
 	sol_obj_free(bb);
 	return sol_new_buffer(state, buf, total, OWN_FREE, NULL, NULL);
@@ -612,26 +1299,111 @@ sol_object_t *sol_buffer_concat_cstr(sol_state_t *state, sol_object_t *a, char *
 	return res;
 }
 
+sol_object_t *sol_buffer_repeat(sol_state_t *state, sol_object_t *a, long n) {
+	size_t total;
+	char *buf;
+	if(a->mem->sz < 0) {
+		return sol_set_error_string(state, "Multiply unsized buffer");
+	}
+	total = _sol_repeat_size(a->mem->sz, n);
+	buf = (total == (size_t) -1) ? NULL : malloc(total ? total : 1);
+	if(!buf) {
+		return sol_set_error(state, state->OutOfMemory);
+	}
+	_sol_repeat_bytes(buf, a->mem->buffer, a->mem->sz, total);
+	return sol_new_buffer(state, buf, total, OWN_FREE, NULL, NULL);
+}
+
+sol_object_t *sol_buffer_slice(sol_state_t *state, sol_object_t *buf, size_t off, ssize_t len) {
+	sol_object_t *res = sol_new_buffer(state, ((char *) buf->mem->buffer) + off, len, OWN_NONE, NULL, NULL);
+	if(sol_has_error(state)) {
+		return res;
+	}
+	res->mem->flags = buf->mem->flags;
+	res->mem->owner = sol_incref(buf->mem->owner ? buf->mem->owner : buf);
+	return res;
+}
+
+/* The buffer pool keeps freed regions in power-of-two size classes. Each
+ * region starts with a header recording its state and class, before the bytes
+ * the buffer sees, so that the free function (which isn't given the state) can
+ * return it to the right list. */
+
+#define SOL_POOL_MIN 6 // 64 bytes
+
+typedef union {
+	struct {
+		sol_state_t *state;
+		size_t cls;
+	} h;
+	max_align_t align;
+} _sol_poolhdr_t;
+
+static void _sol_freef_pool(void *buf, size_t sz) {
+	_sol_poolhdr_t *hdr = ((_sol_poolhdr_t *) buf) - 1;
+	sol_poolclass_t *pool = &hdr->h.state->pool[hdr->h.cls];
+	if(pool->count < SOL_BUFFER_POOL) {
+		pool->free[pool->count++] = hdr;
+	} else {
+		free(hdr);
+	}
+}
+
+sol_object_t *sol_new_pooled_buffer(sol_state_t *state, size_t sz) {
+	_sol_poolhdr_t *hdr;
+	size_t cls = SOL_POOL_MIN;
+	void *mem;
+	while(cls <= SOL_BUFFER_POOL_MAX && ((size_t) 1 << cls) < sz) {
+		cls++;
+	}
+	if(cls > SOL_BUFFER_POOL_MAX) {
+		mem = malloc(sz ? sz : 1);
+		return mem ? sol_new_buffer(state, mem, sz, OWN_FREE, NULL, NULL) : sol_set_error(state, state->OutOfMemory);
+	}
+	if(state->pool[cls].count) {
+		hdr = state->pool[cls].free[--state->pool[cls].count];
+	} else {
+		hdr = malloc(sizeof(_sol_poolhdr_t) + ((size_t) 1 << cls));
+		if(!hdr) {
+			return sol_set_error(state, state->OutOfMemory);
+		}
+		hdr->h.state = state;
+		hdr->h.cls = cls;
+	}
+	return sol_new_buffer(state, hdr + 1, sz, OWN_CALLF, _sol_freef_pool, NULL);
+}
+
+void sol_buffer_pool_clear(sol_state_t *state) {
+	size_t cls;
+	for(cls = 0; cls <= SOL_BUFFER_POOL_MAX; cls++) {
+		while(state->pool[cls].count) {
+			free(state->pool[cls].free[--state->pool[cls].count]);
+		}
+	}
+}
+
 char *sol_buffer_strdup(sol_object_t *a) {
 	char *b;
-	if(a->sz < 0) return NULL;
-	b = malloc(a->sz + 1);
+	if(a->mem->sz < 0) return NULL;
+	b = malloc(a->mem->sz + 1);
 	if(!b) return NULL;
-	strncpy(b, a->buffer, a->sz);
-	b[a->sz] = '\0';
+	strncpy(b, a->mem->buffer, a->mem->sz);
+	b[a->mem->sz] = '\0';
 	return b;
 }
 
 sol_object_t *sol_f_buffer_free(sol_state_t *state, sol_object_t *buf) {
-	switch(buf->own) {
+	switch(buf->mem->own) {
 		case OWN_FREE:
-			free(buf->buffer);
+			free(buf->mem->buffer);
 			break;
 
 		case OWN_CALLF:
-			if(buf->freef) buf->freef(buf->buffer, buf->sz);
+			if(buf->mem->freef) buf->mem->freef(buf->mem->buffer, buf->mem->sz);
 			break;
 	}
+	sol_obj_free(buf->mem->owner);
+	free(buf->mem);
 	return buf;
 }
 
@@ -653,13 +1425,14 @@ sol_object_t *sol_new_dysym(sol_state_t *state, void *sym, dsl_seq *argtp, sol_b
 	sol_object_t *res = sol_alloc_object(state);
 	res->type = SOL_DYSYM;
 	res->ops = &(state->DySymOps);
-	res->dlsym = sym;
+	res->sym = malloc(sizeof(sol_symbody_t));
+	res->sym->dlsym = sym;
 	if(argtp) {
-		res->argtp = dsl_seq_copy(argtp);
+		res->sym->argtp = dsl_seq_copy(argtp);
 	} else {
-		res->argtp = dsl_seq_new_array(NULL, &(state->obfuncs));
+		res->sym->argtp = dsl_seq_new_array(NULL, &(state->obfuncs));
 	}
-	res->rettp = rettp;
+	res->sym->rettp = rettp;
 	sol_init_object(state, res);
 	return res;
 }
@@ -668,116 +1441,968 @@ sol_object_t *sol_new_stream(sol_state_t *state, FILE *stream, sol_modes_t modes
 	sol_object_t *res = sol_alloc_object(state);
 	res->type = SOL_STREAM;
 	res->ops = &(state->StreamOps);
-	res->stream = stream;
-	res->modes = modes;
+	res->io = malloc(sizeof(sol_streambody_t));
+	res->io->stream = stream;
+	res->io->modes = modes;
+	res->io->rbuf = NULL;
+	res->io->nlines = 0;
+	res->io->rpos = 0;
+	res->io->rend = 0;
+	res->io->reof = 0;
+	res->io->nonseek = 0;
+	res->io->wbuf = NULL;
+	res->io->wcap = SOL_STREAM_BUFSIZE;
+	res->io->wlen = 0;
+	res->io->niov = 0;
+	res->io->nobjs = 0;
+	res->io->linebuf = 0;
+	res->io->mem = NULL;
+	if(stream == stderr) {
+		res->io->wcap = 0;
+	} else if(fileno(stream) >= 0 && isatty(fileno(stream))) {
+		res->io->linebuf = 1;
+	}
 	sol_init_object(state, res);
 	return res;
 }
 
-size_t sol_stream_printf(sol_state_t *state, sol_object_t *stream, const char *fmt, ...) {
-	va_list va;
-	size_t res;
-	if(!(stream->modes & MODE_WRITE)) {
+/* Memory streams keep their contents in a buffer object, which the stream's
+ * file reads and writes through fopencookie (unbuffered, since the stream has
+ * its own buffers). Reads don't go through the file: the read buffer is a
+ * slice of the contents, so lines read are slices of them too. Anything else
+ * referring to the contents keeps them as they were, since writes copy the
+ * buffer while it is shared.
+ */
+
+static int _sol_stream_wflush(sol_streambody_t *);
+
+static ssize_t _sol_memstream_read(void *cookie, char *out, size_t n) {
+	sol_memstream_t *mem = cookie;
+	if(mem->pos >= mem->len) {
+		return 0;
+	}
+	if(n > mem->len - mem->pos) {
+		n = mem->len - mem->pos;
+	}
+	memcpy(out, ((char *) mem->buf->mem->buffer) + mem->pos, n);
+	mem->pos += n;
+	return n;
+}
+
+// Makes room for contents up to end, in storage nothing else refers to.
+static int _sol_memstream_reserve(sol_memstream_t *mem, size_t end) {
+	size_t cap = mem->buf ? mem->buf->mem->sz : 0, newcap;
+	char *data;
+	if(mem->buf && mem->buf->refcnt == 1 && mem->buf->mem->own == OWN_FREE && !mem->buf->mem->owner && !(mem->buf->mem->flags & SOL_BUF_IMMUTABLE)) {
+		if(end <= cap) {
+			return 0;
+		}
+		for(newcap = cap ? cap : 64; newcap < end; newcap *= 2);
+		data = realloc(mem->buf->mem->buffer, newcap);
+		if(!data) {
+			return -1;
+		}
+		mem->buf->mem->buffer = data;
+		mem->buf->mem->sz = newcap;
+		return 0;
+	}
+	for(newcap = cap > 64 ? cap : 64; newcap < end; newcap *= 2);
+	data = malloc(newcap);
+	if(!data) {
+		return -1;
+	}
+	if(mem->len) {
+		memcpy(data, mem->buf->mem->buffer, mem->len);
+	}
+	if(mem->buf) {
+		sol_obj_free(mem->buf);
+	}
+	mem->buf = sol_new_buffer(mem->state, data, newcap, OWN_FREE, NULL, NULL);
+	return 0;
+}
+
+static ssize_t _sol_memstream_write(void *cookie, const char *data, size_t n) {
+	sol_memstream_t *mem = cookie;
+	char *buf;
+	if(_sol_memstream_reserve(mem, mem->pos + n)) {
+		return 0;
+	}
+	buf = mem->buf->mem->buffer;
+	if(mem->pos > mem->len) {
+		// Written past the end; the gap reads as NULs
+		memset(buf + mem->len, 0, mem->pos - mem->len);
+	}
+	memcpy(buf + mem->pos, data, n);
+	mem->pos += n;
+	if(mem->pos > mem->len) {
+		mem->len = mem->pos;
+	}
+	return n;
+}
+
+static int _sol_memstream_seek(void *cookie, off64_t *offset, int whence) {
+	sol_memstream_t *mem = cookie;
+	off64_t pos = *offset;
+	if(whence == SEEK_CUR) {
+		pos += mem->pos;
+	} else if(whence == SEEK_END) {
+		pos += mem->len;
+	}
+	if(pos < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	mem->pos = *offset = pos;
+	return 0;
+}
+
+static int _sol_memstream_close(void *cookie) {
+	sol_memstream_t *mem = cookie;
+	if(mem->buf) {
+		sol_obj_free(mem->buf);
+	}
+	free(mem);
+	return 0;
+}
+
+sol_object_t *sol_new_memstream(sol_state_t *state, sol_object_t *buf) {
+	cookie_io_functions_t fns = {_sol_memstream_read, _sol_memstream_write, _sol_memstream_seek, _sol_memstream_close};
+	sol_memstream_t *mem = malloc(sizeof(sol_memstream_t));
+	sol_object_t *res;
+	FILE *f;
+	if(!mem) {
+		return sol_set_error_string(state, "Out of memory for memory stream");
+	}
+	mem->state = state;
+	mem->buf = buf ? sol_incref(buf) : NULL;
+	mem->len = buf ? buf->mem->sz : 0;
+	mem->pos = 0;
+	f = fopencookie(mem, "r+", fns);
+	if(!f) {
+		_sol_memstream_close(mem);
+		return sol_set_error_string(state, "Memory stream open failed");
+	}
+	setvbuf(f, NULL, _IONBF, 0);
+	res = sol_new_stream(state, f, MODE_READ | MODE_WRITE);
+	res->io->mem = mem;
+	// Writing to memory is no cheaper in batches
+	res->io->wcap = 0;
+	return res;
+}
+
+sol_object_t *sol_stream_getbuffer(sol_state_t *state, sol_object_t *stream) {
+	sol_memstream_t *mem = stream->io->mem;
+	sol_object_t *res;
+	if(!mem) {
+		return sol_set_error_string(state, "Get buffer of a stream not in memory");
+	}
+	_sol_stream_wflush(stream->io);
+	if(!mem->buf) {
+		return sol_new_buffer(state, NULL, 0, OWN_NONE, NULL, NULL);
+	}
+	res = sol_buffer_slice(state, mem->buf, 0, mem->len);
+	res->mem->flags |= SOL_BUF_IMMUTABLE;
+	return res;
+}
+
+/* Reads from streams go through the stream's own read buffer, filled with
+ * read(2) directly from the file descriptor; this returns whatever is
+ * available (so a line from a pipe or terminal doesn't wait for more), and
+ * keeps stdio from reading ahead where the buffer can't see it. Streams
+ * without a descriptor fall back to fread. (Only sol_stream_scanf still reads
+ * through stdio, and doesn't see what the buffer holds.)
+ */
+
+/* Writes go through the stream's own write buffer. Small writes are copied
+ * into it; large writes of immutable strings and buffers are queued as
+ * references instead, and the queue goes out with one writev when it (or the
+ * buffer) fills, or on a flush, seek or read. Anything written through stdio
+ * on the same FILE is flushed first, so it comes out in order.
+ */
+
+// Writes out everything queued; returns 0, or -1 on an error (which drops
+// the queued output). If a non-blocking descriptor isn't ready for all of it,
+// the rest stays queued and niov stays nonzero.
+static int _sol_stream_wflush(sol_streambody_t *io) {
+	struct iovec *iov = io->wiov;
+	size_t cnt = io->niov, i;
+	ssize_t n;
+	int fd = fileno(io->stream), res = 0;
+	fflush(io->stream);
+	if(fd < 0) {
+		for(i = 0; i < cnt; i++) {
+			if(fwrite(iov[i].iov_base, sizeof(char), iov[i].iov_len, io->stream) < iov[i].iov_len) {
+				res = -1;
+			}
+		}
+		fflush(io->stream);
+		cnt = 0;
+	}
+	while(cnt) {
+		n = writev(fd, iov, cnt);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				memmove(io->wiov, iov, cnt * sizeof(struct iovec));
+				io->niov = cnt;
+				return 0;
+			}
+			res = -1;
+			break;
+		}
+		// Skip what was written, which may end partway through an entry
+		while(cnt && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if(cnt) {
+			iov->iov_base = ((char *) iov->iov_base) + n;
+			iov->iov_len -= n;
+		}
+	}
+	for(i = 0; i < io->nobjs; i++) {
+		sol_obj_free(io->wobjs[i]);
+	}
+	io->wlen = io->niov = io->nobjs = 0;
+	return res;
+}
+
+// Lets go of the lines sliced from the read buffer. A line that something else
+// still refers to is copied into a region of its own first (or, if that can't
+// be allocated, stays a slice), so that it no longer holds the buffer.
+static void _sol_stream_release_lines(sol_streambody_t *io) {
+	sol_bufbody_t *body;
+	char *copy;
+	size_t i;
+	for(i = 0; i < io->nlines; i++) {
+		body = io->lines[i]->mem;
+		if(io->lines[i]->refcnt > 1 && body->owner == io->rbuf && (copy = malloc(body->sz ? body->sz : 1))) {
+			memcpy(copy, body->buffer, body->sz);
+			body->buffer = copy;
+			body->own = OWN_FREE;
+			sol_obj_free(body->owner);
+			body->owner = NULL;
+		}
+		sol_obj_free(io->lines[i]);
+	}
+	io->nlines = 0;
+}
+
+// Reads more of the file into the read buffer, after the unread bytes;
+// returns the number of bytes read, 0 at the end of the file, or -1.
+static ssize_t _sol_stream_fill(sol_state_t *state, sol_object_t *stream) {
+	sol_streambody_t *io = stream->io;
+	size_t unread = io->rend - io->rpos, cap = io->rbuf ? io->rbuf->mem->sz : 0;
+	char *mem;
+	ssize_t n;
+	int fd;
+	_sol_stream_release_lines(io);
+	if(io->mem) {
+		_sol_stream_wflush(io);
+		if(io->mem->pos >= io->mem->len) {
+			io->reof = 1;
+			return 0;
+		}
+	}
+	if(io->mem && !unread) {
+		// The rest of the contents, without copying them
+		if(io->rbuf) {
+			sol_obj_free(io->rbuf);
+		}
+		io->rbuf = sol_buffer_slice(io->mem->state, io->mem->buf, io->mem->pos, io->mem->len - io->mem->pos);
+		io->rbuf->mem->flags |= SOL_BUF_IMMUTABLE;
+		io->rpos = 0;
+		io->rend = io->mem->len - io->mem->pos;
+		io->mem->pos = io->mem->len;
+		return io->rend;
+	}
+	if(!io->rbuf || io->rbuf->refcnt > 1 || unread == cap) {
+		// Start a new buffer if lines still refer to this one (or it's full)
+		if(!cap) {
+			cap = SOL_STREAM_BUFSIZE;
+		}
+		while(unread >= cap / 2) {
+			cap *= 2;
+		}
+		mem = malloc(cap);
+		if(!mem) {
+			return -1;
+		}
+		if(unread) {
+			memcpy(mem, ((char *) io->rbuf->mem->buffer) + io->rpos, unread);
+		}
+		if(io->rbuf) {
+			sol_obj_free(io->rbuf);
+		}
+		io->rbuf = sol_new_buffer(state, mem, cap, OWN_FREE, NULL, NULL);
+	} else if(io->rpos) {
+		memmove(io->rbuf->mem->buffer, ((char *) io->rbuf->mem->buffer) + io->rpos, unread);
+	}
+	io->rpos = 0;
+	io->rend = unread;
+	mem = io->rbuf->mem->buffer;
+	if(io->modes & MODE_WRITE) {
+		_sol_stream_wflush(io);
+	}
+	if(state && state->_stdout && state->_stdout != stream && sol_is_stream(state->_stdout)) {
+		// So that a prompt shows before waiting for input
+		_sol_stream_wflush(state->_stdout->io);
+	}
+	fd = fileno(io->stream);
+	if(fd < 0) {
+		n = fread(mem + io->rend, sizeof(char), cap - io->rend, io->stream);
+		if(!n && ferror(io->stream)) {
+			n = -1;
+		}
+	} else {
+		do {
+			n = read(fd, mem + io->rend, cap - io->rend);
+		} while(n < 0 && errno == EINTR);
+	}
+	if(n > 0) {
+		io->rend += n;
+	} else if(!n) {
+		io->reof = 1;
+	}
+	return n;
+}
+
+// Moves the file position, as lseek, or fseek without a descriptor. (Reads
+// bypass stdio, so its idea of the position is stale; pending writes are
+// flushed first, so that the descriptor's position is the stream's.)
+static long _sol_stream_lseek(sol_streambody_t *io, long offset, int whence) {
+	int fd = fileno(io->stream);
+	long pos;
+	if(io->modes & MODE_WRITE) {
+		_sol_stream_wflush(io);
+	}
+	if(fd < 0) {
+		return fseek(io->stream, offset, whence) ? -1 : ftell(io->stream);
+	}
+	pos = lseek(fd, offset, whence);
+	if(pos < 0 && errno == ESPIPE) {
+		io->nonseek = 1;
+	}
+	return pos;
+}
+
+// Drops the unread bytes of the read buffer, moving the file position back
+// over them; used before writing or seeking.
+static void _sol_stream_unread(sol_object_t *stream) {
+	sol_streambody_t *io = stream->io;
+	if(io->nonseek) {
+		// Reading and writing a pipe or socket are independent
+		return;
+	}
+	if(io->rend > io->rpos || io->reof) {
+		if(_sol_stream_lseek(io, -(long) (io->rend - io->rpos), SEEK_CUR) < 0 && io->nonseek) {
+			return;
+		}
+	}
+	io->rpos = io->rend = 0;
+	io->reof = 0;
+}
+
+// After a flush that couldn't finish, copies what's left of data (which the
+// caller owns) out of the queue, so that the queue doesn't refer to it.
+static int _sol_stream_keep(sol_state_t *state, sol_streambody_t *io, const char *data, size_t n) {
+	struct iovec *last = &io->wiov[io->niov - 1];
+	char *copy;
+	if((char *) last->iov_base < data || (char *) last->iov_base >= data + n) {
+		return 0;
+	}
+	copy = state ? malloc(last->iov_len) : NULL;
+	if(!copy) {
+		io->niov--;
+		return -1;
+	}
+	memcpy(copy, last->iov_base, last->iov_len);
+	last->iov_base = copy;
+	io->wobjs[io->nobjs++] = sol_new_buffer(state, copy, last->iov_len, OWN_FREE, NULL, NULL);
+	return 0;
+}
+
+size_t sol_stream_write_bytes(sol_state_t *state, sol_object_t *stream, const char *data, size_t n, sol_object_t *owner) {
+	sol_streambody_t *io = stream->io;
+	struct iovec *last;
+	int err = 0;
+	if(!(io->modes & MODE_WRITE)) {
 		if(state) {
 			sol_obj_free(sol_set_error_string(state, "Write to non-writable stream"));
 		}
 		return 0;
 	}
+	if(!n) {
+		return 0;
+	}
+	_sol_stream_unread(stream);
+	if((owner && n >= SOL_STREAM_ZEROCOPY) || n >= io->wcap) {
+		// Queued without copying; it goes out now unless owner keeps it alive and it fits
+		if(io->niov == SOL_STREAM_IOV || io->nobjs == SOL_STREAM_IOV) {
+			err |= _sol_stream_wflush(io);
+			if(io->niov == SOL_STREAM_IOV || io->nobjs == SOL_STREAM_IOV) {
+				// Not ready for more
+				return 0;
+			}
+		}
+		if(owner) {
+			io->wobjs[io->nobjs++] = sol_incref(owner);
+		}
+		io->wiov[io->niov].iov_base = (char *) data;
+		io->wiov[io->niov++].iov_len = n;
+		if(!owner || n >= io->wcap) {
+			err |= _sol_stream_wflush(io);
+			if(!owner && io->niov) {
+				err |= _sol_stream_keep(state, io, data, n);
+			}
+		}
+	} else {
+		if(!io->wbuf) {
+			io->wbuf = malloc(io->wcap);
+			if(!io->wbuf) {
+				if(state) {
+					sol_obj_free(sol_set_error_string(state, "Out of memory for write buffer"));
+				}
+				return 0;
+			}
+		}
+		last = io->niov ? &io->wiov[io->niov - 1] : NULL;
+		if(io->wlen + n > io->wcap || (io->niov == SOL_STREAM_IOV && ((char *) last->iov_base) + last->iov_len != io->wbuf + io->wlen)) {
+			err |= _sol_stream_wflush(io);
+			if(io->niov) {
+				// Not ready for more
+				return 0;
+			}
+			last = NULL;
+		}
+		memcpy(io->wbuf + io->wlen, data, n);
+		if(last && ((char *) last->iov_base) + last->iov_len == io->wbuf + io->wlen) {
+			last->iov_len += n;
+		} else {
+			io->wiov[io->niov].iov_base = io->wbuf + io->wlen;
+			io->wiov[io->niov++].iov_len = n;
+		}
+		io->wlen += n;
+	}
+	if(io->linebuf && io->niov && memchr(data, '\n', n)) {
+		err |= _sol_stream_wflush(io);
+	}
+	return err ? 0 : n;
+}
+
+int sol_stream_setbuffer(sol_state_t *state, sol_object_t *stream, size_t size, int line) {
+	sol_streambody_t *io = stream->io;
+	_sol_stream_wflush(io);
+	if(io->niov) {
+		return -1;
+	}
+	free(io->wbuf);
+	io->wbuf = NULL;
+	io->wcap = size;
+	io->linebuf = line;
+	return 0;
+}
+
+size_t sol_stream_printf(sol_state_t *state, sol_object_t *stream, const char *fmt, ...) {
+	va_list va;
+	size_t res;
 	va_start(va, fmt);
-	//res = vfprintf(stream->stream, fmt, va);
-	res = vprintf(fmt, va);
+	res = sol_stream_vprintf(state, stream, fmt, va);
 	va_end(va);
 	return res;
 }
 
 size_t sol_stream_vprintf(sol_state_t *state, sol_object_t *stream, const char *fmt, va_list va) {
-	if(!(stream->modes & MODE_WRITE)) {
+	char buf[SOL_FORMAT_SIZE * 4], *out = buf;
+	va_list again;
+	int len;
+	size_t res;
+	if(!(stream->io->modes & MODE_WRITE)) {
 		if(state) {
 			sol_obj_free(sol_set_error_string(state, "Write to non-writable stream"));
 		}
 		return 0;
 	}
-	//return vfprintf(stream->stream, fmt, va);
-	return vprintf(fmt, va);
+	va_copy(again, va);
+	len = vsnprintf(buf, sizeof(buf), fmt, va);
+	if(len < 0) {
+		va_end(again);
+		return 0;
+	}
+	if((size_t) len >= sizeof(buf)) {
+		out = malloc(len + 1);
+		if(!out) {
+			va_end(again);
+			return 0;
+		}
+		vsnprintf(out, len + 1, fmt, again);
+	}
+	va_end(again);
+	res = sol_stream_write_bytes(state, stream, out, len, NULL);
+	if(out != buf) {
+		free(out);
+	}
+	return res;
 }
 
 size_t sol_stream_scanf(sol_state_t *state, sol_object_t *stream, const char *fmt, ...) {
 	va_list va;
 	size_t res;
-	if(!(stream->modes & MODE_READ)) {
+	if(!(stream->io->modes & MODE_READ)) {
 		if(state) {
 			sol_obj_free(sol_set_error_string(state, "Read from non-readable stream"));
 		}
 		return 0;
 	}
 	va_start(va, fmt);
-	res = vfscanf(stream->stream, fmt, va);
+	res = vfscanf(stream->io->stream, fmt, va);
 	va_end(va);
 	return res;
 }
 
+// Reads up to n bytes, stopping early only at the end of the file.
+static size_t _sol_stream_read(sol_state_t *state, sol_object_t *stream, char *buffer, size_t n) {
+	sol_streambody_t *io = stream->io;
+	size_t done = 0, part;
+	ssize_t got;
+	int fd = fileno(io->stream);
+	while(done < n) {
+		if(io->rend > io->rpos) {
+			part = io->rend - io->rpos;
+			if(part > n - done) {
+				part = n - done;
+			}
+			memcpy(buffer + done, ((char *) io->rbuf->mem->buffer) + io->rpos, part);
+			io->rpos += part;
+			done += part;
+		} else if(n - done >= SOL_STREAM_BUFSIZE && fd >= 0) {
+			// Large reads go straight into the destination
+			if(io->modes & MODE_WRITE) {
+				_sol_stream_wflush(io);
+			}
+			do {
+				got = read(fd, buffer + done, n - done);
+			} while(got < 0 && errno == EINTR);
+			if(got <= 0) {
+				io->reof = !got;
+				break;
+			}
+			done += got;
+		} else if(_sol_stream_fill(state, stream) <= 0) {
+			break;
+		}
+	}
+	return done;
+}
+
 size_t sol_stream_fread(sol_state_t *state, sol_object_t *stream, char *buffer, size_t sz, size_t memb) {
-	if(!(stream->modes & MODE_READ)) {
+	if(!(stream->io->modes & MODE_READ)) {
 		if(state) {
 			sol_obj_free(sol_set_error_string(state, "Read from non-readable stream"));
 		}
 		return 0;
 	}
-	return fread(buffer, sz, memb, stream->stream);
+	return _sol_stream_read(state, stream, buffer, sz * memb) / (sz ? sz : 1);
 }
 
 size_t sol_stream_fwrite(sol_state_t *state, sol_object_t *stream, char *buffer, size_t sz, size_t memb) {
-	if(!(stream->modes & MODE_WRITE)) {
+	if(!(stream->io->modes & MODE_WRITE)) {
 		if(state) {
 			sol_obj_free(sol_set_error_string(state, "Write to non-writable stream"));
 		}
 		return 0;
 	}
-	return fwrite(buffer, sz, memb, stream->stream);
+	return sol_stream_write_bytes(state, stream, buffer, sz * memb, NULL) / (sz ? sz : 1);
+}
+
+// Writes the string form of obj; numbers, strings and buffers are written
+// directly instead of through a string object.
+size_t sol_stream_write_obj(sol_state_t *state, sol_object_t *stream, sol_object_t *obj) {
+	char buf[SOL_FORMAT_SIZE];
+	sol_object_t *str;
+	size_t sz;
+	switch(obj->type) {
+		case SOL_INTEGER:
+			return sol_stream_fwrite(state, stream, buf, sizeof(char), sol_format_int(buf, obj->ival));
+
+		case SOL_FLOAT:
+			return sol_stream_fwrite(state, stream, buf, sizeof(char), sol_format_float(buf, obj->fval));
+
+		case SOL_STRING:
+			return sol_stream_write_bytes(state, stream, obj->str, obj->slen, obj);
+
+		case SOL_BUFFER:
+			// As its string form, stopping at any NUL
+			if(obj->mem->sz >= 0) {
+				return sol_stream_write_bytes(state, stream, obj->mem->buffer, strnlen(obj->mem->buffer, obj->mem->sz), obj->mem->flags & SOL_BUF_IMMUTABLE ? obj : NULL);
+			}
+			break;
+
+		default:
+			break;
+	}
+	str = sol_cast_string(state, obj);
+	sz = sol_stream_write_bytes(state, stream, str->str, str->slen, str);
+	sol_obj_free(str);
+	return sz;
 }
 
 char *sol_stream_fgets(sol_state_t *state, sol_object_t *stream, char *buffer, size_t sz) {
-	if(!(stream->modes & MODE_READ)) {
+	size_t i, part;
+	char *p, *nl;
+	if(!(stream->io->modes & MODE_READ)) {
 		if(state) {
 			sol_obj_free(sol_set_error_string(state, "Read from non-readable stream"));
 		}
 		return NULL;
 	}
-	return fgets(buffer, sz, stream->stream);
+	if(!sz) {
+		return NULL;
+	}
+	for(i = 0; i + 1 < sz; ) {
+		if(stream->io->rend == stream->io->rpos && _sol_stream_fill(state, stream) <= 0) {
+			break;
+		}
+		p = ((char *) stream->io->rbuf->mem->buffer) + stream->io->rpos;
+		part = stream->io->rend - stream->io->rpos;
+		if(part > sz - 1 - i) {
+			part = sz - 1 - i;
+		}
+		nl = memchr(p, '\n', part);
+		if(nl) {
+			part = nl - p + 1;
+		}
+		memcpy(buffer + i, p, part);
+		stream->io->rpos += part;
+		i += part;
+		if(nl) {
+			break;
+		}
+	}
+	buffer[i] = '\0';
+	return i ? buffer : NULL;
+}
+
+size_t sol_stream_readinto(sol_state_t *state, sol_object_t *stream, char *buffer, size_t n) {
+	sol_streambody_t *io = stream->io;
+	ssize_t got;
+	int fd = fileno(io->stream);
+	if(!(io->modes & MODE_READ)) {
+		if(state) {
+			sol_obj_free(sol_set_error_string(state, "Read from non-readable stream"));
+		}
+		return 0;
+	}
+	if(!n) {
+		return 0;
+	}
+	if(io->rend == io->rpos && n >= SOL_STREAM_BUFSIZE && fd >= 0) {
+		// Nothing is buffered, and this is large enough to read directly
+		if(io->modes & MODE_WRITE) {
+			_sol_stream_wflush(io);
+		}
+		do {
+			got = read(fd, buffer, n);
+		} while(got < 0 && errno == EINTR);
+		io->reof = !got;
+		return got > 0 ? got : 0;
+	}
+	if(io->rend == io->rpos && _sol_stream_fill(state, stream) <= 0) {
+		return 0;
+	}
+	if(n > io->rend - io->rpos) {
+		n = io->rend - io->rpos;
+	}
+	memcpy(buffer, ((char *) io->rbuf->mem->buffer) + io->rpos, n);
+	io->rpos += n;
+	return n;
+}
+
+sol_object_t *sol_stream_readline(sol_state_t *state, sol_object_t *stream) {
+	sol_streambody_t *io = stream->io;
+	size_t scanned = 0;
+	char *p, *nl;
+	sol_object_t *res;
+	if(!(io->modes & MODE_READ)) {
+		return sol_set_error_string(state, "Read from non-readable stream");
+	}
+	while(1) {
+		if(io->rend > io->rpos) {
+			p = ((char *) io->rbuf->mem->buffer) + io->rpos;
+			nl = memchr(p + scanned, '\n', io->rend - io->rpos - scanned);
+			if(nl) {
+				scanned = nl - p + 1;
+				break;
+			}
+			scanned = io->rend - io->rpos;
+		}
+		if(_sol_stream_fill(state, stream) <= 0) {
+			if(io->rend == io->rpos || (!io->reof && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+				// Nothing, or (from a non-blocking stream) only part of a line so far
+				return sol_incref(state->None);
+			}
+			break;
+		}
+	}
+	res = sol_buffer_slice(state, io->rbuf, io->rpos, scanned);
+	io->rpos += scanned;
+	// Lines from a memory stream refer to its contents, which it keeps anyway
+	if(!io->mem && sol_is_buffer(res)) {
+		if(io->nlines == SOL_STREAM_LINES) {
+			_sol_stream_release_lines(io);
+		}
+		io->lines[io->nlines++] = sol_incref(res);
+	}
+	return res;
 }
 
 int sol_stream_fputc(sol_state_t *state, sol_object_t *stream, int ch) {
-	if(!(stream->modes & MODE_WRITE)) {
+	if(!(stream->io->modes & MODE_WRITE)) {
 		if(state) {
 			sol_obj_free(sol_set_error_string(state, "Write to non-writable stream"));
 		}
 		return 0;
 	}
-	return fputc(ch, stream->stream);
+	char c = ch;
+	return sol_stream_write_bytes(state, stream, &c, 1, NULL) ? (unsigned char) c : EOF;
 }
 
 int sol_stream_feof(sol_state_t *state, sol_object_t *stream) {
-	return feof(stream->stream);
+	return (stream->io->reof || feof(stream->io->stream)) && stream->io->rend == stream->io->rpos;
 }
 
 int sol_stream_ferror(sol_state_t *state, sol_object_t *stream) {
-	return ferror(stream->stream);
+	return ferror(stream->io->stream);
 }
 
 int sol_stream_fseek(sol_state_t *state, sol_object_t *stream, long offset, int whence) {
-	return fseek(stream->stream, offset, whence);
+	_sol_stream_unread(stream);
+	clearerr(stream->io->stream);
+	return _sol_stream_lseek(stream->io, offset, whence) < 0 ? -1 : 0;
 }
 
 long sol_stream_ftell(sol_state_t *state, sol_object_t *stream) {
-	return ftell(stream->stream);
+	long pos = _sol_stream_lseek(stream->io, 0, SEEK_CUR);
+	return pos < 0 ? pos : pos - (long) (stream->io->rend - stream->io->rpos);
 }
 
 int sol_stream_fflush(sol_state_t *state, sol_object_t *stream) {
-	return fflush(stream->stream);
+	if(_sol_stream_wflush(stream->io) || stream->io->niov) {
+		return EOF;
+	}
+	return fflush(stream->io->stream);
+}
+
+size_t sol_stream_pending(sol_state_t *state, sol_object_t *stream) {
+	size_t i, sz = 0;
+	for(i = 0; i < stream->io->niov; i++) {
+		sz += stream->io->wiov[i].iov_len;
+	}
+	return sz;
+}
+
+/* Copies between streams move the data kernel-side where both have
+ * descriptors: sendfile(2) from regular files (which it needs), and splice(2)
+ * from anything else, through a pipe if neither end is one. Whatever a call
+ * won't do is copied through memory instead, a chunk at a time.
+ */
+
+// Splices up to n bytes from in to out; returns the number taken from in, 0
+// at its end, or -1. Anything left in the intermediate pipe when out isn't
+// ready is queued on dst, so it isn't lost.
+static ssize_t _sol_stream_splice(sol_state_t *state, sol_object_t *dst, int in, int out, loff_t *off, size_t n, int *pipefd) {
+	struct stat st;
+	ssize_t got, put;
+	size_t left;
+	char *rest;
+	if((!fstat(in, &st) && S_ISFIFO(st.st_mode)) || (!fstat(out, &st) && S_ISFIFO(st.st_mode))) {
+		return splice(in, off, out, NULL, n, SPLICE_F_MOVE);
+	}
+	if(pipefd[0] < 0 && pipe2(pipefd, O_CLOEXEC)) {
+		return -1;
+	}
+	// The pipe is empty, so this doesn't wait on it (only on in)
+	if(n > SOL_STREAM_BUFSIZE) {
+		n = SOL_STREAM_BUFSIZE;
+	}
+	got = splice(in, off, pipefd[1], NULL, n, SPLICE_F_MOVE);
+	for(left = got > 0 ? got : 0; left; left -= put) {
+		put = splice(pipefd[0], NULL, out, NULL, left, SPLICE_F_MOVE);
+		if(put > 0) {
+			continue;
+		}
+		if(put < 0 && errno == EINTR) {
+			put = 0;
+			continue;
+		}
+		rest = malloc(left);
+		put = rest ? read(pipefd[0], rest, left) : -1;
+		if(put > 0) {
+			sol_stream_write_bytes(state, dst, rest, put, NULL);
+		}
+		free(rest);
+		break;
+	}
+	return got;
+}
+
+// Sets the error for a copy that failed with errno.
+static void _sol_stream_copy_error(sol_state_t *state) {
+	char msg[128];
+	snprintf(msg, sizeof(msg), "Copy failed: %s", strerror(errno));
+	sol_obj_free(sol_set_error_string(state, msg));
+}
+
+size_t sol_stream_copy(sol_state_t *state, sol_object_t *src, sol_object_t *dst, long *offset, size_t count) {
+	sol_streambody_t *in = src->io, *out = dst->io;
+	int infd = fileno(in->stream), outfd = fileno(out->stream), pipefd[2] = {-1, -1}, usesend, err;
+	size_t done = 0, part;
+	ssize_t n = 1;
+	long pos = -1;
+	loff_t off;
+	struct stat st;
+	char *chunk;
+	if(!(in->modes & MODE_READ)) {
+		sol_obj_free(sol_set_error_string(state, "Read from non-readable stream"));
+		return 0;
+	}
+	if(!(out->modes & MODE_WRITE)) {
+		sol_obj_free(sol_set_error_string(state, "Write to non-writable stream"));
+		return 0;
+	}
+	if(src == dst) {
+		sol_obj_free(sol_set_error_string(state, "Copy from a stream to itself"));
+		return 0;
+	}
+	if(!offset && in->rend > in->rpos) {
+		// What's already read goes first
+		part = in->rend - in->rpos;
+		if(part > count) {
+			part = count;
+		}
+		if(sol_stream_write_bytes(state, dst, ((char *) in->rbuf->mem->buffer) + in->rpos, part, NULL) < part) {
+			_sol_stream_copy_error(state);
+			return 0;
+		}
+		in->rpos += part;
+		done += part;
+	}
+	_sol_stream_unread(dst);
+	if(_sol_stream_wflush(out)) {
+		_sol_stream_copy_error(state);
+		return done;
+	}
+	if(in->modes & MODE_WRITE) {
+		_sol_stream_wflush(in);
+	}
+	if(out->niov) {
+		// dst isn't ready for more
+		return done;
+	}
+	if(infd >= 0 && outfd >= 0) {
+		usesend = !fstat(infd, &st) && S_ISREG(st.st_mode);
+		off = offset ? *offset : 0;
+		while(done < count) {
+			part = count - done;
+			if(part > 1 << 30) {
+				part = 1 << 30;
+			}
+			if(usesend) {
+				n = sendfile(outfd, infd, offset ? &off : NULL, part);
+			} else {
+				n = _sol_stream_splice(state, dst, infd, outfd, offset ? &off : NULL, part, pipefd);
+			}
+			if(n < 0 && errno == EINTR) {
+				continue;
+			}
+			if(n <= 0) {
+				break;
+			}
+			done += n;
+			if(out->niov) {
+				// Some of it had to be queued, since dst isn't ready
+				break;
+			}
+		}
+		err = n < 0 ? errno : 0;
+		if(offset) {
+			*offset = off;
+		} else if(!n) {
+			in->reof = 1;
+		}
+		if(pipefd[0] >= 0) {
+			close(pipefd[0]);
+			close(pipefd[1]);
+		}
+		if(err != EINVAL && err != ENOSYS) {
+			if(err && err != EAGAIN && err != EWOULDBLOCK) {
+				errno = err;
+				_sol_stream_copy_error(state);
+			}
+			return done;
+		}
+		// Neither call works for these files
+	}
+	if(offset) {
+		pos = sol_stream_ftell(state, src);
+		if(pos < 0 || sol_stream_fseek(state, src, *offset, SEEK_SET)) {
+			sol_obj_free(sol_set_error_string(state, "Copy from an offset of a stream that can't seek"));
+			return done;
+		}
+	}
+	chunk = malloc(SOL_STREAM_BUFSIZE);
+	while(chunk && done < count) {
+		_sol_stream_wflush(out);
+		if(out->niov) {
+			break;
+		}
+		part = count - done;
+		if(part > SOL_STREAM_BUFSIZE) {
+			part = SOL_STREAM_BUFSIZE;
+		}
+		errno = 0;
+		part = sol_stream_readinto(state, src, chunk, part);
+		if(!part) {
+			if(errno && errno != EAGAIN && errno != EWOULDBLOCK && !sol_stream_feof(state, src)) {
+				_sol_stream_copy_error(state);
+			}
+			break;
+		}
+		// dst's queue is empty, so it takes all of this (copying whatever it can't write yet)
+		if(sol_stream_write_bytes(state, dst, chunk, part, NULL) < part) {
+			_sol_stream_copy_error(state);
+			break;
+		}
+		done += part;
+		if(offset) {
+			*offset += part;
+		}
+	}
+	if(!chunk) {
+		sol_obj_free(sol_set_error(state, state->OutOfMemory));
+	}
+	free(chunk);
+	if(_sol_stream_wflush(out) && !sol_has_error(state)) {
+		_sol_stream_copy_error(state);
+	}
+	if(offset) {
+		sol_stream_fseek(state, src, pos, SEEK_SET);
+	}
+	return done;
 }
 
 sol_object_t *sol_f_stream_free(sol_state_t *state, sol_object_t *stream) {
 	//printf("IO: Closing open file\n");
-	fclose(stream->stream);
+	_sol_stream_wflush(stream->io);
+	fclose(stream->io->stream);
+	_sol_stream_release_lines(stream->io);
+	if(stream->io->rbuf) {
+		sol_obj_free(stream->io->rbuf);
+	}
+	free(stream->io->wbuf);
+	free(stream->io);
 	return stream;
 }
@@ -0,0 +1,545 @@
+#include <stdint.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+
+/* Packing and unpacking records in buffers, as buffer:pack, buffer:unpack and
+ * buffer:unpack_iter.
+ *
+ * A pack format is an optional byte order character followed by fields, each
+ * an optional decimal count and a type character; whitespace is ignored:
+ *
+ *     @  native order, sizes and alignment (the default)
+ *     =  native order and sizes, no alignment
+ *     <  little-endian, standard sizes, no alignment
+ *     >  big-endian (as is !), standard sizes, no alignment
+ *
+ *     x  a pad byte (no value)       c  a char (a one-character string)
+ *     b  int8       B  uint8         h  int16      H  uint16
+ *     i  int        I  uint          l  long       L  ulong
+ *     q  int64      Q  uint64        f  float      d  double
+ *     s  a string of count bytes (one value; padded with NULs when packed)
+ *
+ * The types are those of `buffer.type`, with the sizes in `buffer.sizeof`;
+ * with standard sizes, int and long are 32 bits. Counts repeat a field, except
+ * for s. Unsigned 64-bit values past the range of an int unpack as floats.
+ * Buffers must have a size.
+ *
+ * Compiling a format resolves every field to a fixed-size type and an offset
+ * into the record, and is cached like format strings (see
+ * sol_fmtcache_lookup): literals by address, anything else by content.
+ */
+
+typedef struct {
+	sol_buftype_t type; // A fixed-size type, BUF_CHAR or BUF_CSTR (for s)
+	size_t size; // The size of one value (for s, of the string)
+	size_t off; // The offset of the first value in the record
+	size_t count; // The number of values (1 for s)
+} sol_packfield_t;
+
+typedef struct sol_packfmt_t {
+	sol_fmtsrc_t head; // A copy of the format string
+	size_t size; // The size of a record
+	size_t nvalues;
+	int swap; // Set if the byte order isn't the host's
+	size_t nfields;
+	sol_packfield_t fields[];
+} sol_packfmt_t;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SOL_HOST_BIG 1
+#else
+#define SOL_HOST_BIG 0
+#endif
+
+// Maps a type character to a buffer type, with native or standard sizes.
+static sol_buftype_t _sol_pack_type(char c, int native) {
+	switch(c) {
+		case 'c': return BUF_CHAR;
+		case 's': return BUF_CSTR;
+		case 'b': return BUF_INT8;
+		case 'B': return BUF_UINT8;
+		case 'h': return BUF_INT16;
+		case 'H': return BUF_UINT16;
+		case 'i': return native ? BUF_INT : BUF_INT32;
+		case 'I': return native ? BUF_UINT : BUF_UINT32;
+		case 'l': return native ? BUF_LONG : BUF_INT32;
+		case 'L': return native ? BUF_ULONG : BUF_UINT32;
+		case 'q': return BUF_INT64;
+		case 'Q': return BUF_UINT64;
+		case 'f': return BUF_FLOAT;
+		case 'd': return BUF_DOUBLE;
+	}
+	return BUF_NONE;
+}
+
+// Resolves the C types to the fixed-size type of the same size.
+static sol_buftype_t _sol_pack_fixed(sol_buftype_t type) {
+	switch(type) {
+		case BUF_INT:
+			return sizeof(int) == 4 ? BUF_INT32 : BUF_INT64;
+
+		case BUF_UINT:
+			return sizeof(unsigned int) == 4 ? BUF_UINT32 : BUF_UINT64;
+
+		case BUF_LONG:
+			return sizeof(long) == 4 ? BUF_INT32 : BUF_INT64;
+
+		case BUF_ULONG:
+			return sizeof(unsigned long) == 4 ? BUF_UINT32 : BUF_UINT64;
+
+		default:
+			return type;
+	}
+}
+
+static size_t _sol_pack_sizeof(sol_buftype_t type) {
+	switch(type) {
+		case BUF_CHAR: case BUF_INT8: case BUF_UINT8: return 1;
+		case BUF_INT16: case BUF_UINT16: return 2;
+		case BUF_INT32: case BUF_UINT32: return 4;
+		case BUF_INT64: case BUF_UINT64: return 8;
+		case BUF_FLOAT: return sizeof(float);
+		case BUF_DOUBLE: return sizeof(double);
+		default: return 0;
+	}
+}
+
+static sol_fmtsrc_t *_sol_pack_compile(const char *fmt, size_t len, const char **err) {
+	sol_packfmt_t *spec;
+	sol_packfield_t *f;
+	size_t i = 0, n = 0, off = 0, count;
+	int native = 1, align = 1, big = SOL_HOST_BIG, digits;
+	sol_buftype_t type;
+	// Every field takes at least one character, which bounds their number
+	spec = malloc(sizeof(sol_packfmt_t) + (len ? len : 1) * sizeof(sol_packfield_t));
+	if(!spec) {
+		*err = "Out of memory";
+		return NULL;
+	}
+	spec->head.src = malloc(len ? len : 1);
+	if(!spec->head.src) {
+		free(spec);
+		*err = "Out of memory";
+		return NULL;
+	}
+	memcpy(spec->head.src, fmt, len);
+	spec->head.len = len;
+	spec->nvalues = 0;
+	if(len) {
+		switch(fmt[0]) {
+			case '@': i = 1; break;
+			case '=': i = 1; align = 0; break;
+			case '<': i = 1; align = 0; native = 0; big = 0; break;
+			case '>': case '!': i = 1; align = 0; native = 0; big = 1; break;
+		}
+	}
+	spec->swap = big != SOL_HOST_BIG;
+	while(i < len) {
+		if(fmt[i] == ' ' || fmt[i] == '\t' || fmt[i] == '\n' || fmt[i] == '\r') {
+			i++;
+			continue;
+		}
+		count = 0;
+		digits = 0;
+		while(i < len && fmt[i] >= '0' && fmt[i] <= '9') {
+			if(count > (SSIZE_MAX - 9) / 10) {
+				*err = "Pack count too large";
+				goto fail;
+			}
+			count = count * 10 + (fmt[i++] - '0');
+			digits = 1;
+		}
+		if(i >= len) {
+			*err = "Pack format ends with a count";
+			goto fail;
+		}
+		if(!digits) {
+			count = 1;
+		}
+		if(fmt[i] == 'x') {
+			if(count > SSIZE_MAX - off) {
+				*err = "Pack format too large";
+				goto fail;
+			}
+			off += count;
+			i++;
+			continue;
+		}
+		type = _sol_pack_type(fmt[i], native);
+		if(type == BUF_NONE) {
+			*err = "Bad type character in pack format";
+			goto fail;
+		}
+		i++;
+		if(!count && type != BUF_CSTR) {
+			continue;
+		}
+		f = spec->fields + n++;
+		f->type = _sol_pack_fixed(type);
+		if(type == BUF_CSTR) {
+			f->size = count;
+			f->count = 1;
+		} else {
+			f->size = _sol_pack_sizeof(f->type);
+			f->count = count;
+			if(align && off % f->size) {
+				if(off > SSIZE_MAX - f->size) {
+					*err = "Pack format too large";
+					goto fail;
+				}
+				off += f->size - off % f->size;
+			}
+		}
+		// Keep the record size (and every offset in it) within SSIZE_MAX
+		if(f->size && f->count > (SSIZE_MAX - off) / f->size) {
+			*err = "Pack format too large";
+			goto fail;
+		}
+		f->off = off;
+		off += f->size * f->count;
+		spec->nvalues += f->count;
+	}
+	spec->nfields = n;
+	spec->size = off;
+	return &spec->head;
+
+fail:
+	free(spec->head.src);
+	free(spec);
+	return NULL;
+}
+
+static void _sol_pack_free(sol_fmtsrc_t *head) {
+	sol_packfmt_t *spec = (sol_packfmt_t *) head;
+	free(spec->head.src);
+	free(spec);
+}
+
+void sol_pack_cache_clear(sol_state_t *state) {
+	sol_fmtcache_clear(state->packcache, _sol_pack_free);
+}
+
+static sol_packfmt_t *_sol_pack_lookup(sol_state_t *state, const char *fmt, size_t len, int literal, const char **err) {
+	return (sol_packfmt_t *) sol_fmtcache_lookup(state->packcache, fmt, len, literal, _sol_pack_compile, _sol_pack_free, err);
+}
+
+// Looks up the pack format given as a string or buffer, or sets the error.
+static sol_packfmt_t *_sol_pack_spec(sol_state_t *state, sol_object_t *fmt) {
+	const char *err = NULL;
+	sol_object_t *str;
+	sol_packfmt_t *spec;
+	if(sol_is_buffer(fmt) && fmt->mem->sz >= 0) {
+		spec = _sol_pack_lookup(state, fmt->mem->buffer, fmt->mem->sz, fmt->mem->flags & SOL_BUF_IMMUTABLE, &err);
+	} else {
+		str = sol_is_string(fmt) ? sol_incref(fmt) : sol_cast_string(state, fmt);
+		spec = _sol_pack_lookup(state, str->str, str->slen, 0, &err);
+		sol_obj_free(str);
+	}
+	if(!spec) {
+		sol_obj_free(sol_set_error_string(state, err));
+	}
+	return spec;
+}
+
+static uint64_t _sol_pack_load(const char *p, size_t size, int swap) {
+	uint8_t u8;
+	uint16_t u16;
+	uint32_t u32;
+	uint64_t u64;
+	switch(size) {
+		case 1:
+			memcpy(&u8, p, 1);
+			return u8;
+
+		case 2:
+			memcpy(&u16, p, 2);
+			return swap ? __builtin_bswap16(u16) : u16;
+
+		case 4:
+			memcpy(&u32, p, 4);
+			return swap ? __builtin_bswap32(u32) : u32;
+
+		default:
+			memcpy(&u64, p, 8);
+			return swap ? __builtin_bswap64(u64) : u64;
+	}
+}
+
+static void _sol_pack_store(char *p, size_t size, int swap, uint64_t u) {
+	uint8_t u8 = u;
+	uint16_t u16 = u;
+	uint32_t u32 = u;
+	switch(size) {
+		case 1:
+			memcpy(p, &u8, 1);
+			break;
+
+		case 2:
+			u16 = swap ? __builtin_bswap16(u16) : u16;
+			memcpy(p, &u16, 2);
+			break;
+
+		case 4:
+			u32 = swap ? __builtin_bswap32(u32) : u32;
+			memcpy(p, &u32, 4);
+			break;
+
+		default:
+			u = swap ? __builtin_bswap64(u) : u;
+			memcpy(p, &u, 8);
+			break;
+	}
+}
+
+static sol_object_t *_sol_pack_get(sol_state_t *state, sol_packfield_t *f, const char *p, int swap) {
+	char *s;
+	uint64_t u;
+	float fv;
+	double dv;
+	uint32_t u32;
+	if(f->type == BUF_CSTR || f->type == BUF_CHAR) {
+		if(f->type == BUF_CHAR) {
+			return sol_new_string_owned(state, strndup(p, 1), strnlen(p, 1));
+		}
+		s = malloc(f->size ? f->size : 1);
+		memcpy(s, p, f->size);
+		return sol_new_buffer(state, s, f->size, OWN_FREE, NULL, NULL);
+	}
+	u = _sol_pack_load(p, f->size, swap);
+	switch(f->type) {
+		case BUF_INT8: return sol_new_int(state, (int8_t) u);
+		case BUF_INT16: return sol_new_int(state, (int16_t) u);
+		case BUF_INT32: return sol_new_int(state, (int32_t) u);
+		case BUF_INT64: return sol_new_int(state, (int64_t) u);
+		case BUF_UINT8: case BUF_UINT16: case BUF_UINT32: return sol_new_int(state, (long) u);
+		// Past the range of an int, as a float (as typed arrays do)
+		case BUF_UINT64: return u > LONG_MAX ? sol_new_float(state, (double) u) : sol_new_int(state, (long) u);
+
+		case BUF_FLOAT:
+			u32 = u;
+			memcpy(&fv, &u32, sizeof(float));
+			return sol_new_float(state, fv);
+
+		case BUF_DOUBLE:
+			memcpy(&dv, &u, sizeof(double));
+			return sol_new_float(state, dv);
+
+		default:
+			return sol_incref(state->None);
+	}
+}
+
+static void _sol_pack_set(sol_state_t *state, sol_packfield_t *f, char *p, int swap, sol_object_t *obj) {
+	sol_object_t *tmp;
+	const char *s;
+	size_t len;
+	uint64_t u;
+	uint32_t u32;
+	float fv;
+	double dv;
+	if(f->type == BUF_CSTR || f->type == BUF_CHAR) {
+		if(sol_is_buffer(obj) && obj->mem->sz >= 0) {
+			tmp = NULL;
+			s = obj->mem->buffer;
+			len = obj->mem->sz;
+		} else {
+			tmp = sol_is_string(obj) ? sol_incref(obj) : sol_cast_string(state, obj);
+			s = tmp->str;
+			len = tmp->slen;
+		}
+		if(len > f->size) {
+			len = f->size;
+		}
+		memcpy(p, s, len);
+		memset(p + len, 0, f->size - len);
+		if(tmp) {
+			sol_obj_free(tmp);
+		}
+		return;
+	}
+	if(f->type == BUF_FLOAT || f->type == BUF_DOUBLE) {
+		if(sol_is_float(obj)) {
+			dv = obj->fval;
+		} else if(sol_is_int(obj)) {
+			dv = obj->ival;
+		} else {
+			tmp = sol_cast_float(state, obj);
+			dv = sol_is_float(tmp) ? tmp->fval : 0;
+			sol_obj_free(tmp);
+		}
+		if(f->type == BUF_FLOAT) {
+			fv = dv;
+			memcpy(&u32, &fv, sizeof(float));
+			u = u32;
+		} else {
+			memcpy(&u, &dv, sizeof(double));
+		}
+	} else if(sol_is_int(obj)) {
+		u = obj->ival;
+	} else if(sol_is_float(obj)) {
+		// Floats past the range of an int only fit uint64 (as unpacked above)
+		u = f->type == BUF_UINT64 && obj->fval >= 9223372036854775808.0 && obj->fval < 18446744073709551616.0 ? (uint64_t) obj->fval : (uint64_t) (long) obj->fval;
+	} else {
+		tmp = sol_cast_int(state, obj);
+		u = sol_is_int(tmp) ? tmp->ival : 0;
+		sol_obj_free(tmp);
+	}
+	_sol_pack_store(p, f->size, swap, u);
+}
+
+// Unpacks a record into a new list of its values.
+static sol_object_t *_sol_unpack_record(sol_state_t *state, sol_packfmt_t *spec, const char *rec) {
+	sol_object_t *res = sol_new_list(state), *val;
+	sol_packfield_t *f;
+	size_t i, j, n = 0;
+	for(i = 0; i < spec->nfields; i++) {
+		f = spec->fields + i;
+		for(j = 0; j < f->count; j++) {
+			val = _sol_pack_get(state, f, rec + f->off + j * f->size, spec->swap);
+			sol_list_insert(state, res, n++, val);
+			sol_obj_free(val);
+		}
+	}
+	return res;
+}
+
+// Reads an optional offset argument; returns nonzero (with the error set) if
+// a record of the given size doesn't fit in the buffer there, or if the buffer
+// has no size to check against.
+static int _sol_pack_offset(sol_state_t *state, sol_object_t *buf, sol_object_t *off, size_t size, size_t *res) {
+	sol_object_t *ioff;
+	long o = 0;
+	if(!sol_is_none(state, off)) {
+		ioff = sol_cast_int(state, off);
+		o = ioff->ival;
+		sol_obj_free(ioff);
+	}
+	if(buf->mem->sz < 0) {
+		sol_obj_free(sol_set_error_string(state, "Pack or unpack with unsized buffer"));
+		return 1;
+	}
+	if(o < 0 || (size_t) o + size > (size_t) buf->mem->sz) {
+		sol_obj_free(sol_set_error_string(state, "Record out of buffer range"));
+		return 1;
+	}
+	*res = o;
+	return 0;
+}
+
+sol_object_t *sol_f_buffer_unpack(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *fmt = sol_list_get_index(state, args, 1), *off = sol_list_get_index(state, args, 2), *res = NULL;
+	sol_packfmt_t *spec = _sol_pack_spec(state, fmt);
+	size_t o;
+	if(spec && !_sol_pack_offset(state, buf, off, spec->size, &o)) {
+		res = _sol_unpack_record(state, spec, ((char *) buf->mem->buffer) + o);
+	}
+	sol_obj_free(buf);
+	sol_obj_free(fmt);
+	sol_obj_free(off);
+	return res ? res : sol_incref(state->None);
+}
+
+sol_object_t *sol_f_buffer_pack(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *fmt = sol_list_get_index(state, args, 1), *off = sol_list_get_index(state, args, 2), *val, *res = NULL;
+	sol_packfmt_t *spec = _sol_pack_spec(state, fmt);
+	sol_packfield_t *f;
+	size_t o, i, j, n = 3;
+	char *rec;
+	if(spec) {
+		if(buf->mem->flags & SOL_BUF_IMMUTABLE) {
+			sol_obj_free(sol_set_error_string(state, "Set into immutable buffer"));
+		} else if(sol_list_len(state, args) < 3 + spec->nvalues) {
+			sol_obj_free(sol_set_error_string(state, "Too few values for pack format"));
+		} else if(!_sol_pack_offset(state, buf, off, spec->size, &o)) {
+			rec = ((char *) buf->mem->buffer) + o;
+			for(i = 0; i < spec->nfields; i++) {
+				f = spec->fields + i;
+				for(j = 0; j < f->count; j++) {
+					val = sol_list_get_index(state, args, n++);
+					_sol_pack_set(state, f, rec + f->off + j * f->size, spec->swap, val);
+					sol_obj_free(val);
+				}
+			}
+			res = sol_new_int(state, o + spec->size);
+		}
+	}
+	sol_obj_free(buf);
+	sol_obj_free(fmt);
+	sol_obj_free(off);
+	return res ? res : sol_incref(state->None);
+}
+
+sol_object_t *sol_f_buffer_calcsize(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *fmt = sol_list_get_index(state, args, 0);
+	sol_packfmt_t *spec = _sol_pack_spec(state, fmt);
+	sol_obj_free(fmt);
+	return spec ? sol_new_int(state, spec->size) : sol_incref(state->None);
+}
+
+// unpack_iter returns an iterator over consecutive records, which keeps its
+// own compiled format (the cached one may be replaced while it runs).
+
+typedef struct {
+	sol_object_t *buf;
+	sol_packfmt_t *spec;
+	size_t off;
+} _sol_unpackiter_t;
+
+sol_object_t *sol_f_buffer_unpack_iter(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *fmt = sol_list_get_index(state, args, 1), *off = sol_list_get_index(state, args, 2), *res = NULL;
+	sol_packfmt_t *cached = _sol_pack_spec(state, fmt);
+	_sol_unpackiter_t *body;
+	const char *err = NULL;
+	size_t o;
+	if(cached) {
+		if(buf->mem->sz < 0) {
+			sol_obj_free(sol_set_error_string(state, "Unpack records from unsized buffer"));
+		} else if(!cached->size) {
+			sol_obj_free(sol_set_error_string(state, "Unpack records of size 0"));
+		} else if(!_sol_pack_offset(state, buf, off, 0, &o)) {
+			body = malloc(sizeof(_sol_unpackiter_t));
+			if(body) {
+				body->spec = (sol_packfmt_t *) _sol_pack_compile(cached->head.src, cached->head.len, &err);
+			}
+			if(!body || !body->spec) {
+				free(body);
+				sol_obj_free(sol_set_error(state, state->OutOfMemory));
+			} else {
+				body->buf = sol_incref(buf);
+				body->off = o;
+				res = sol_new_cdata(state, body, &(state->UnpackIterOps));
+			}
+		}
+	}
+	sol_obj_free(buf);
+	sol_obj_free(fmt);
+	sol_obj_free(off);
+	return res ? res : sol_incref(state->None);
+}
+
+sol_object_t *sol_f_unpack_iter_call(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *iter = sol_list_get_index(state, args, 0), *res;
+	_sol_unpackiter_t *body = iter->cdata;
+	sol_obj_free(iter);
+	// The buffer may have been resized since
+	if(body->buf->mem->sz < 0 || body->off + body->spec->size > (size_t) body->buf->mem->sz) {
+		return sol_incref(state->None);
+	}
+	res = _sol_unpack_record(state, body->spec, ((char *) body->buf->mem->buffer) + body->off);
+	body->off += body->spec->size;
+	return res;
+}
+
+sol_object_t *sol_f_unpack_iter_iter(sol_state_t *state, sol_object_t *args) {
+	return sol_list_get_index(state, args, 0);
+}
+
+sol_object_t *sol_f_unpack_iter_free(sol_state_t *state, sol_object_t *iter) {
+	_sol_unpackiter_t *body = iter->cdata;
+	sol_obj_free(body->buf);
+	_sol_pack_free(&body->spec->head);
+	free(body);
+	return iter;
+}
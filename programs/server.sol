@@ -1,53 +1,33 @@
-http = {
-	ERRORS = {
-		[400] = "Bad Request",
-		[500] = "Server Error",
-	}
-}
-
-NL = '
-'
-CR = chr(13)
+MAX_HEAD = 8192
 
 func get_request()
-	result = {}
-
-	httpline = io.stdin:read(io.LINE)
-	httpline = httpline:split(NL)[0]
-	httpline = httpline:split(CR)[0]
-	parts = httpline:split(" ")
-
-	if (3 != (#parts)) || (parts[2] != "HTTP/1.1") then
-		error(400)
+	buf = buffer.new(MAX_HEAD)
+	have = 0
+	while 1 do
+		n = io.stdin:readinto(buf, have)
+		if n == 0 then error(400) end
+		prev = have
+		have += n
+		parsed = try(func() return http.parse_request(buf, 0, prev, have) end)
+		if parsed[0] == 0 then error(400) end
+		if parsed[1] != None then return parsed[1] end
+		if have == MAX_HEAD then error(400) end
 	end
-
-	result.method = parts[0]
-	result.path = parts[1]
-	result.protocol = parts[2]
-
-	return result
 end
 
 out = try(get_request)
 success = out[0]
 value = out[1]
+headers = [["Content-type", "text/plain"], ["Connection", "close"]]
 
 if success then
-	print('HTTP/1.1 200 OK
-Content-type: text/plain
-
-Hello from Sol! You sent in these values:', value)
+	http.write_response(io.stdout, 200, headers, 'Hello from Sol! You sent in these values: ' + tostring({method = tostring(value.method), path = tostring(value.path), minor_version = value.minor_version}))
 else
 	if type(value) == "int" then
-		print('HTTP/1.1 ' + tostring(value) + ' ' + (http.ERRORS[value]) + '
-Content-type: text/plain
-
-Error ' + tostring(value) + ': ' + (http.ERRORS[value]))
+		reason = http.reason(value)
+		http.write_response(io.stdout, value, headers, 'Error ' + tostring(value) + ': ' + reason)
 	else
-		print('HTTP/1.1 500 Server Error
-Content-type: text/plain
-
-Internal error: ' + tostring(value))
+		http.write_response(io.stdout, 500, headers, 'Internal error: ' + tostring(value))
 	end
 end
-
+io.stdout:flush()
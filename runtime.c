@@ -362,6 +362,7 @@ void ex_free(expr_node *expr) {
 	}
 	switch(expr->type) {
 		case EX_LIT:
+			sol_obj_free(expr->lit->obj);
 			if(expr->lit->type == LIT_STRING) {
 				free(expr->lit->str);
 			}
@@ -502,6 +503,40 @@ void pl_free(paramlist_node *list) {
 }
 
 #define ERR_CHECK(state) do { if(sol_has_error(state)) { sol_add_traceback(state, sol_new_exprnode(state, ex_copy(expr))); longjmp(jmp, 1); } } while(0)
+#define IS_ADD(expr) ((expr)->type == EX_BINOP && (expr)->binop->type == OP_ADD)
+sol_object_t *sol_eval_inner(sol_state_t *, expr_node *, jmp_buf);
+
+/* Evaluates the addition `expr`, whose result is about to be stored in `cont`
+ * at `key` (as in `x += y`, or `o.k += y`). When the left operand is a string
+ * or buffer held only by that slot, it is extended in place rather than copied
+ * into a new object, so appending in a loop takes amortized linear time.
+ */
+static sol_object_t *sol_eval_add_to(sol_state_t *state, expr_node *expr, sol_object_t *cont, sol_object_t *key, jmp_buf jmp) {
+	sol_object_t *left, *right, *cur = NULL, *list, *res;
+	left = sol_eval_inner(state, expr->binop->left, jmp);
+	ERR_CHECK(state);
+	right = sol_eval_inner(state, expr->binop->right, jmp);
+	ERR_CHECK(state);
+	if(sol_is_map(cont) && cont->mtable->refcnt == 1) {
+		cur = sol_map_get(state, cont, key);
+	}
+	// One reference each from the slot, left and cur
+	if(cur == left && left->refcnt == 3 && sol_concat_inplace(state, left, right)) {
+		res = sol_incref(left);
+	} else {
+		list = sol_new_list(state);
+		sol_list_insert(state, list, 0, left);
+		sol_list_insert(state, list, 1, right);
+		res = CALL_METHOD(state, left, add, list);
+		sol_obj_free(list);
+	}
+	sol_obj_free(cur);
+	sol_obj_free(left);
+	sol_obj_free(right);
+	ERR_CHECK(state);
+	return res;
+}
+
 sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 	sol_object_t *res = NULL, *left = NULL, *right = NULL, *lint = NULL, *rint = NULL, *value = NULL, *list = NULL, *vint = NULL, *iter = NULL, *item = NULL;
 	exprlist_node *cure = NULL;
@@ -524,13 +559,24 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 					break;
 
 				case LIT_STRING:
-					return sol_new_string(state, expr->lit->str);
+					if(!expr->lit->obj) {
+						expr->lit->obj = sol_new_string(state, expr->lit->str);
+					}
+					return sol_incref(expr->lit->obj);
 					break;
 
 				case LIT_BUFFER:
-					buf = malloc(LENGTH_OF(expr->lit->buf));
-					memcpy(buf, BYTES_OF(expr->lit->buf), LENGTH_OF(expr->lit->buf));
-					return sol_new_buffer(state, buf, LENGTH_OF(expr->lit->buf), OWN_FREE, NULL, NULL);
+					if(!expr->lit->obj) {
+						// The constant has its own copy of the bytes, since it can outlive the node.
+						buf = malloc(LENGTH_OF(expr->lit->buf) + 1);
+						if(!buf) {
+							return sol_set_error(state, state->OutOfMemory);
+						}
+						memcpy(buf, BYTES_OF(expr->lit->buf), LENGTH_OF(expr->lit->buf));
+						expr->lit->obj = sol_new_buffer(state, buf, LENGTH_OF(expr->lit->buf), OWN_FREE, NULL, NULL);
+						expr->lit->obj->mem->flags |= SOL_BUF_IMMUTABLE;
+					}
+					return sol_incref(expr->lit->obj);
 
 				case LIT_NONE:
 					return sol_incref(state->None);
@@ -543,7 +589,9 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 			cure = expr->listgen->list;
 			while(cure) {
 				if(cure->expr) {
-					sol_list_insert(state, res, sol_list_len(state, res), sol_eval_inner(state, cure->expr, jmp));
+					item = sol_eval_inner(state, cure->expr, jmp);
+					sol_list_insert(state, res, sol_list_len(state, res), item);
+					sol_obj_free(item);
 				}
 				ERR_CHECK(state);
 				cure = cure->next;
@@ -556,7 +604,11 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 			cura = expr->mapgen->map;
 			while(cura) {
 				if(cura->item) {
-					sol_map_set(state, res, sol_eval(state, cura->item->key), sol_eval_inner(state, cura->item->value, jmp));
+					left = sol_eval(state, cura->item->key);
+					right = sol_eval_inner(state, cura->item->value, jmp);
+					sol_map_set(state, res, left, right);
+					sol_obj_free(left);
+					sol_obj_free(right);
 				}
 				ERR_CHECK(state);
 				cura = cura->next;
@@ -754,7 +806,11 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 			ERR_CHECK(state);
 			right = sol_eval_inner(state, expr->setindex->index, jmp);
 			ERR_CHECK(state);
-			value = sol_eval_inner(state, expr->setindex->value, jmp);
+			if(IS_ADD(expr->setindex->value)) {
+				value = sol_eval_add_to(state, expr->setindex->value, left, right, jmp);
+			} else {
+				value = sol_eval_inner(state, expr->setindex->value, jmp);
+			}
 			ERR_CHECK(state);
 			list = sol_new_list(state);
 			ERR_CHECK(state);
@@ -771,7 +827,14 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 			break;
 
 		case EX_ASSIGN:
-			value = sol_eval_inner(state, expr->assign->value, jmp);
+			if(IS_ADD(expr->assign->value)) {
+				list = sol_list_get_index(state, state->scopes, 0);
+				right = sol_intern(state, expr->assign->ident);
+				value = sol_eval_add_to(state, expr->assign->value, list, right, jmp);
+				sol_obj_free(list);
+			} else {
+				value = sol_eval_inner(state, expr->assign->value, jmp);
+			}
 			sol_state_assign_l_name(state, expr->assign->ident, value);
 			ERR_CHECK(state);
 			return value;
@@ -789,7 +852,7 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 			if(expr->call->method) {
 				left = sol_incref(value);
 				sol_list_insert(state, list, 0, value);
-				right = sol_new_string(state, expr->call->method);
+				right = sol_intern(state, expr->call->method);
 				sol_list_insert(state, list, 1, right);
 				sol_obj_free(right);
 				res = CALL_METHOD(state, value, index, list);
@@ -809,10 +872,12 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 			while(cure) {
 				if(cure->expr) {
 					if(value->ops->tflags & SOL_TF_NO_EVAL_CALL_ARGS) {
-						sol_list_insert(state, list, sol_list_len(state, list), sol_new_exprnode(state, cure->expr));
+						item = sol_new_exprnode(state, cure->expr);
 					} else {
-						sol_list_insert(state, list, sol_list_len(state, list), sol_eval_inner(state, cure->expr, jmp));
+						item = sol_eval_inner(state, cure->expr, jmp);
 					}
+					sol_list_insert(state, list, sol_list_len(state, list), item);
+					sol_obj_free(item);
 				}
 				ERR_CHECK(state);
 				cure = cure->next;
@@ -875,7 +940,7 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 			sol_obj_free(vint);
 			res = state->loopvalue;
 			state->loopvalue = left;
-			return sol_incref(res);
+			return res;
 			break;
 
 		case EX_ITER:
@@ -891,13 +956,17 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 				iter = sol_incref(value);
 			}
 			if(!iter->ops->call || iter->ops->call == sol_f_not_impl) {
-				sol_obj_free(sol_set_error_string(state, "Iterate over non-iterable"));
-				return sol_incref(state->None);
+				sol_obj_free(res);
+				sol_obj_free(iter);
+				sol_obj_free(value);
+				return sol_set_error_string(state, "Iterate over non-iterable");
 			}
 			list = sol_new_list(state);
 			sol_list_insert(state, list, 0, iter);
 			sol_list_insert(state, list, 1, value);
-			sol_list_insert(state, list, 2, sol_new_map(state));
+			item = sol_new_map(state);
+			sol_list_insert(state, list, 2, item);
+			sol_obj_free(item);
 			item = CALL_METHOD(state, iter, call, list);
 			while(item != state->None) {
 				sol_state_assign_l_name(state, expr->iter->var, item);
@@ -920,7 +989,7 @@ sol_object_t *sol_eval_inner(sol_state_t *state, expr_node *expr, jmp_buf jmp) {
 			sol_obj_free(list);
 			sol_obj_free(item);
 			state->loopvalue = left;
-			return sol_incref(res);
+			return res;
 			break;
 	}
 	printf("WARNING: Unhandled expression (type %d) returning None\n", expr->type);
@@ -946,9 +1015,15 @@ void sol_exec(sol_state_t *state, stmt_node *stmt) {
 	}
 	switch(stmt->type) {
 		case ST_EXPR:
-			vint = value;
-			value = state->lastvalue;
-			state->lastvalue = sol_eval(state, stmt->expr);
+			// Let go of the previous value first so it doesn't pin the objects
+			// this statement may update in place (see sol_eval_add_to).
+			vint = state->lastvalue;
+			state->lastvalue = sol_incref(state->None);
+			sol_obj_free(vint);
+			// Evaluation may run other statements, replacing lastvalue.
+			value = sol_eval(state, stmt->expr);
+			vint = state->lastvalue;
+			state->lastvalue = value;
 			sol_obj_free(vint);
 			if(sol_has_error(state)) {
 				sol_add_traceback(state, sol_new_stmtnode(state, st_copy(stmt)));
@@ -976,7 +1051,7 @@ void sol_exec(sol_state_t *state, stmt_node *stmt) {
 					if(stmt->ret->ret->call->method) {
 						list = sol_new_list(state);
 						sol_list_insert(state, list, 0, value);
-						item = sol_new_string(state, stmt->ret->ret->call->method);
+						item = sol_intern(state, stmt->ret->ret->call->method);
 						sol_list_insert(state, list, 1, item);
 						sol_obj_free(item);
 						item = CALL_METHOD(state, value, index, list);
@@ -988,10 +1063,12 @@ void sol_exec(sol_state_t *state, stmt_node *stmt) {
 					while(cure) {
 						if(cure->expr) {
 							if(value->ops->tflags & SOL_TF_NO_EVAL_CALL_ARGS) {
-								sol_list_insert(state, iter, sol_list_len(state, iter), sol_new_exprnode(state, cure->expr));
+								item = sol_new_exprnode(state, cure->expr);
 							} else {
-								sol_list_insert(state, iter, sol_list_len(state, iter), sol_eval(state, cure->expr));
+								item = sol_eval(state, cure->expr);
 							}
+							sol_list_insert(state, iter, sol_list_len(state, iter), item);
+							sol_obj_free(item);
 						}
 						cure = cure->next;
 					}
@@ -1035,7 +1112,7 @@ void sol_exec(sol_state_t *state, stmt_node *stmt) {
 				value = sol_incref(state->None);
 			}
 			vint = state->loopvalue;
-			state->loopvalue = sol_incref(value);
+			state->loopvalue = value;
 			sol_obj_free(vint);
 			state->sflag = SF_BREAKING;
 			break;
@@ -1059,24 +1136,24 @@ sol_object_t *sol_f_func_call(sol_state_t *state, sol_object_t *args) {
 	}
 	iter = dsl_new_seq_iter(args->seq);
 	if(!args || dsl_seq_iter_is_invalid(iter) || sol_is_none(state, args)) {
-		printf("WARNING: No parameters to function call (expecting function)\n");
+		ob_printf(state, "WARNING: No parameters to function call (expecting function)\n");
 		return sol_incref(state->None);
 	}
 	value = dsl_seq_iter_at(iter);
 	if(!value || !(sol_is_func(value) || sol_is_macro(value))) {
-		printf("WARNING: Function call without function as first parameter\n");
-		ob_print(value);
+		ob_printf(state, "WARNING: Function call without function as first parameter\n");
+		ob_print(state, value);
 		return sol_incref(state->None);
 	}
-	if(!value->func) {
+	if(!value->fn->func) {
 		return sol_incref(state->None);
 	}
 	dsl_seq_iter_next(iter);
-	scope = sol_map_copy(state, value->closure);
-	curi = AS(value->args, identlist_node);
+	scope = sol_map_copy(state, value->fn->closure);
+	curi = AS(value->fn->args, identlist_node);
 	while(curi) {
 		if(curi->ident) {
-			key = sol_new_string(state, curi->ident);
+			key = sol_intern(state, curi->ident);
 			if(dsl_seq_iter_is_invalid(iter)) {
 				sol_map_set(state, scope, key, sol_incref(state->None));
 			} else {
@@ -1088,27 +1165,31 @@ sol_object_t *sol_f_func_call(sol_state_t *state, sol_object_t *args) {
 			argcnt++;
 		}
 	}
-	if(value->rest) {
+	if(value->fn->rest) {
+		key = sol_intern(state, value->fn->rest);
 		if(argcnt < sol_list_len(state, args) - 1) {
-			sol_map_borrow_name(state, scope, value->rest, sol_list_sublist(state, args, argcnt + 1));
+			sol_map_borrow(state, scope, key, sol_list_sublist(state, args, argcnt + 1));
 		} else {
-			sol_map_borrow_name(state, scope, value->rest, sol_new_list(state));
+			sol_map_borrow(state, scope, key, sol_new_list(state));
 		}
+		sol_obj_free(key);
 	}
-	if(value->fname) {
-		key = sol_new_string(state, value->fname);
+	if(value->fn->fname) {
+		key = sol_intern(state, value->fn->fname);
 		sol_map_set(state, scope, key, value);
 		sol_obj_free(key);
 	}
 	sol_state_push_scope(state, scope);
 	sol_list_insert(state, state->fnstack, 0, value);
-	sol_exec(state, AS(value->func, stmt_node));
+	sol_exec(state, AS(value->fn->func, stmt_node));
+	dsl_free_seq_iter(iter);
 	key = sol_list_remove(state, state->fnstack, 0);
 	if(key != value) {
 		printf("ERROR: Function stack imbalanced\n");
 	}
-	sol_state_pop_scope(state);
-	sol_map_merge_existing(state, value->closure, scope);
+	sol_obj_free(key);
+	sol_obj_free(sol_state_pop_scope(state));
+	sol_map_merge_existing(state, value->fn->closure, scope);
 	if(state->ret) {
 		res = state->ret;
 		state->ret = NULL;
@@ -1122,22 +1203,23 @@ sol_object_t *sol_f_func_call(sol_state_t *state, sol_object_t *args) {
 sol_object_t *sol_new_func(sol_state_t *state, identlist_node *identlist, stmt_node *body, char *name, paramlist_node *params, expr_node *func_anno, unsigned short flags) {
 	identlist_node *cura;
 	exprlist_node *cure;
-	sol_object_t *obj = sol_alloc_object(state);
-	obj->func = st_copy(body);
-	obj->args = idl_copy(identlist);
-	obj->fname = (name ? strdup(name) : NULL);
-	obj->closure = sol_new_map(state);
-	obj->udata = sol_new_map(state);
-	obj->rest = NULL;
-	obj->annos = sol_new_map(state);
+	sol_object_t *obj = sol_alloc_container(state);
+	obj->fn = malloc(sizeof(sol_funcbody_t));
+	obj->fn->func = st_copy(body);
+	obj->fn->args = idl_copy(identlist);
+	obj->fn->fname = (name ? strdup(name) : NULL);
+	obj->fn->closure = sol_new_map(state);
+	obj->fn->udata = sol_new_map(state);
+	obj->fn->rest = NULL;
+	obj->fn->annos = sol_new_map(state);
 	obj->type = (flags & FUNC_IS_MACRO ? SOL_MACRO : SOL_FUNCTION);
 	obj->ops = (flags & FUNC_IS_MACRO ? &(state->MacroOps) : &(state->FuncOps));
 	if(params) {
-		obj->rest = params->rest ? strdup(params->rest) : NULL;
+		obj->fn->rest = params->rest ? strdup(params->rest) : NULL;
 		cura = params->clkeys;
 		cure = params->clvalues;
 		while(cura) {
-			sol_map_borrow_name(state, obj->closure, cura->ident, sol_eval(state, cure->expr));
+			sol_map_borrow_name(state, obj->fn->closure, cura->ident, sol_eval(state, cure->expr));
 			if(sol_has_error(state)) {
 				sol_obj_free(obj);
 				return sol_incref(state->None);
@@ -1149,24 +1231,28 @@ sol_object_t *sol_new_func(sol_state_t *state, identlist_node *identlist, stmt_n
 		cure = params->annos;
 		while(cura) {
 			if(cure->expr) {
-				sol_map_borrow_name(state, obj->annos, cura->ident, sol_eval(state, cure->expr));
+				sol_map_borrow_name(state, obj->fn->annos, cura->ident, sol_eval(state, cure->expr));
 			}
 			cura = cura->next;
 			cure = cure->next;
 		}
 	}
 	if(func_anno) {
-		sol_map_borrow(state, obj->annos, obj, sol_eval(state, func_anno));
+		sol_map_borrow(state, obj->fn->annos, obj, sol_eval(state, func_anno));
 	}
+	sol_gc_track(state, obj);
 	return obj;
 }
 
 sol_object_t *sol_f_func_free(sol_state_t *state, sol_object_t *func) {
-	st_free((stmt_node *) func->func);
-	idl_free((identlist_node *) func->args);
-	if(func->fname) free(func->fname);
-	sol_obj_free(func->closure);
-	sol_obj_free(func->udata);
+	st_free((stmt_node *) func->fn->func);
+	idl_free((identlist_node *) func->fn->args);
+	if(func->fn->fname) free(func->fn->fname);
+	if(func->fn->rest) free(func->fn->rest);
+	sol_obj_free(func->fn->closure);
+	sol_obj_free(func->fn->udata);
+	sol_obj_free(func->fn->annos);
+	free(func->fn);
 	return func;
 }
 
@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include "sol.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Byte search primitives shared by the string and buffer methods.
+ *
+ * Single bytes go to memchr, and long needles to memmem; glibc vectorizes the
+ * former and uses the two-way algorithm for the latter, so both are linear.
+ * Short needles, the common case for separators, are matched 16 positions at
+ * a time by comparing the first and last needle bytes with SSE2, and only the
+ * candidates that pass both are checked with memcmp.
+ */
+
+/** Needles up to this length take the SSE2 path, whose verification cost is
+ * bounded by it. */
+#define SOL_SEARCH_SHORT 32
+
+#ifdef __SSE2__
+static const char *_sol_memfind_short(const char *hay, size_t hlen, const char *needle, size_t nlen) {
+	const __m128i first = _mm_set1_epi8(needle[0]), last = _mm_set1_epi8(needle[nlen - 1]);
+	__m128i bfirst, blast;
+	unsigned int mask, bit;
+	size_t i = 0;
+	for(; i + nlen - 1 + 16 <= hlen; i += 16) {
+		bfirst = _mm_loadu_si128((const __m128i *) (hay + i));
+		blast = _mm_loadu_si128((const __m128i *) (hay + i + nlen - 1));
+		mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bfirst, first), _mm_cmpeq_epi8(blast, last)));
+		while(mask) {
+			bit = __builtin_ctz(mask);
+			if(!memcmp(hay + i + bit + 1, needle + 1, nlen - 2)) {
+				return hay + i + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+	for(; i + nlen <= hlen; i++) {
+		if(hay[i] == needle[0] && !memcmp(hay + i, needle, nlen)) {
+			return hay + i;
+		}
+	}
+	return NULL;
+}
+
+static size_t _sol_memcount_byte(const char *hay, size_t hlen, char c) {
+	const __m128i needle = _mm_set1_epi8(c);
+	size_t i = 0, count = 0;
+	for(; i + 16 <= hlen; i += 16) {
+		count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (hay + i)), needle)));
+	}
+	for(; i < hlen; i++) {
+		count += (hay[i] == c);
+	}
+	return count;
+}
+#else
+static size_t _sol_memcount_byte(const char *hay, size_t hlen, char c) {
+	const char *end = hay + hlen;
+	size_t count = 0;
+	while(hay < end && (hay = memchr(hay, c, end - hay))) {
+		count++;
+		hay++;
+	}
+	return count;
+}
+#endif
+
+const char *sol_memfind(const char *hay, size_t hlen, const char *needle, size_t nlen) {
+	if(!nlen) {
+		return hay;
+	}
+	if(nlen > hlen) {
+		return NULL;
+	}
+	if(nlen == 1) {
+		return memchr(hay, needle[0], hlen);
+	}
+#ifdef __SSE2__
+	if(nlen <= SOL_SEARCH_SHORT) {
+		return _sol_memfind_short(hay, hlen, needle, nlen);
+	}
+#endif
+	return memmem(hay, hlen, needle, nlen);
+}
+
+size_t sol_memcount(const char *hay, size_t hlen, const char *needle, size_t nlen) {
+	const char *end = hay + hlen;
+	size_t count = 0;
+	if(!nlen) {
+		return hlen + 1;
+	}
+	if(nlen == 1) {
+		return _sol_memcount_byte(hay, hlen, needle[0]);
+	}
+	while((hay = sol_memfind(hay, end - hay, needle, nlen))) {
+		count++;
+		hay += nlen;
+	}
+	return count;
+}
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <setjmp.h>
+#include <sys/uio.h>
 #include "dsl/dsl.h"
 
 /** The version of the project, as made available through `debug.version`. */
@@ -44,6 +45,46 @@
 
 #define SOL_BUILD_ID "sol " SOL_VERSION "-" SOL_BUILD_REV " " __DATE__ " " __TIME__ " on " SOL_BUILD_HOST " " SOL_BUILD_KERNEL " " SOL_BUILD_ARCH
 
+#ifndef SOL_GC_THRESHOLD
+/** The default number of container allocations between cycle collections (0 disables them). */
+#define SOL_GC_THRESHOLD 10000
+#endif
+
+#ifndef SOL_FORMAT_CACHE
+/** The number of compiled format strings (and of pack formats) each state keeps (see `sol_format`). */
+#define SOL_FORMAT_CACHE 64
+#endif
+
+#ifndef SOL_BUFFER_POOL
+/** The number of freed regions the buffer pool keeps for each size class (see `sol_new_pooled_buffer`). */
+#define SOL_BUFFER_POOL 4
+#endif
+
+#ifndef SOL_BUFFER_POOL_MAX
+/** The largest size class of the buffer pool, as a power of two (64 KiB, so that a state's pool holds at most about half a megabyte); larger buffers aren't pooled. */
+#define SOL_BUFFER_POOL_MAX 16
+#endif
+
+#ifndef SOL_STREAM_BUFSIZE
+/** The initial size of a stream's read buffer; it grows to hold longer lines. */
+#define SOL_STREAM_BUFSIZE 65536
+#endif
+
+#ifndef SOL_STREAM_LINES
+/** The number of lines a stream tracks before checking which of them are still kept (see `sol_stream_readline`). */
+#define SOL_STREAM_LINES 64
+#endif
+
+#ifndef SOL_STREAM_IOV
+/** The number of pieces of output a stream queues before flushing them with one writev. */
+#define SOL_STREAM_IOV 16
+#endif
+
+#ifndef SOL_STREAM_ZEROCOPY
+/** The size from which immutable strings and buffers are queued for writing instead of copied into the write buffer. */
+#define SOL_STREAM_ZEROCOPY 512
+#endif
+
 #ifndef SOL_ICACHE_MIN
 /** The smallest integer to cache. */
 #define SOL_ICACHE_MIN -128
@@ -197,9 +238,9 @@ typedef enum {
 	SOL_STRING,
 	/** The list type, implemented as a DSL sequence of object pointers. */
 	SOL_LIST,
-	/** The map type, implemented as a DSL sequence of MCELL object pointers arranged as an associative array.. */
+	/** The map type, implemented as a hashed table of associations kept in insertion order (see `sol_mtable_t`). */
 	SOL_MAP,
-	/** The mcell type, a simple key-value pair only to be found in a map. */
+	/** The mcell type, a simple key-value pair describing an association in a map (see `sol_map_mcell`). */
 	SOL_MCELL,
 	/** The function type, the type of all user-defined functions in Sol. */
 	SOL_FUNCTION,
@@ -327,11 +368,183 @@ typedef void (*sol_freefunc_t)(void *, size_t);
 
 typedef void *(*sol_movefunc_t)(void *, size_t);
 
+/** Map entry.
+ *
+ * Maps store their associations inline as these triples, rather than as
+ * separate `SOL_MCELL` objects. A NULL key marks an entry that has been
+ * deleted but not yet compacted away.
+ */
+
+typedef struct {
+	/** The key of the association (owned), or NULL if deleted. */
+	sol_object_t *key;
+	/** The value of the association (owned). */
+	sol_object_t *val;
+	/** The hash of the key, as computed by `sol_map_hash`. */
+	unsigned long hash;
+} sol_mentry_t;
+
+/** Map table.
+ *
+ * The storage behind a `SOL_MAP`. Entries are kept densely in insertion order
+ * in `entries`, which is the order maps iterate in: a new key goes last, and
+ * setting an existing key keeps its place. Once the table grows past a handful
+ * of entries, `index` is an open-addressed hash index (of size `mask + 1`) of
+ * positions into `entries`. Tables are shared copy-on-write between copies of
+ * a map, counted by `refcnt`.
+ */
+
+typedef struct sol_tag_mtable_t {
+	/** The number of maps sharing this table. */
+	size_t refcnt;
+	/** The number of live associations. */
+	size_t len;
+	/** The number of entries used, including deleted ones. */
+	size_t used;
+	/** The number of index slots left behind by deleted entries (`SOL_MTABLE_DUMMY`), which still take up room in the index until it's rebuilt. */
+	size_t dummies;
+	/** The number of entries allocated. */
+	size_t cap;
+	/** The size of `index` minus one, or 0 if there is no index. */
+	size_t mask;
+	/** The hash index, or NULL for small tables (which are searched linearly). */
+	long *index;
+	/** The entries themselves. */
+	sol_mentry_t *entries;
+} sol_mtable_t;
+
+/** Function body.
+ *
+ * The payload of a `SOL_FUNCTION` or `SOL_MACRO`, allocated separately from
+ * the object (see `sol_object_t`).
+ */
+
+typedef struct {
+	/** The `stmt_node` pointer representing the function's body. */
+	void *func; // Actually a stmt_node *
+	/** The `identlist_node` pointer representing the list of the functions argument names. */
+	void *args; // Actually an identlist_node *
+	/** A map representing the closure (initial scope, updated on exit) of the function. */
+	sol_object_t *closure;
+	/** A map of data defined by the user on this function object. */
+	sol_object_t *udata;
+	/** The name of the function if it was not declared anonymously (otherwise NULL). */
+	char *fname;
+	/** The name of an argument that receives extra parameters as a list (otherwise NULL). */
+	char *rest;
+	/** The map of annotations, with arguments by name, and the function itself by object. */
+	sol_object_t *annos;
+} sol_funcbody_t;
+
+/** Buffer body.
+ *
+ * The payload of a `SOL_BUFFER`, allocated separately from the object.
+ */
+
+typedef struct {
+	/** The memory region referred to by this buffer. */
+	void *buffer;
+	/** The size of this memory region. Negative values indicate no or unknown size. */
+	ssize_t sz;
+	/** The ownership type of this buffer's region. */
+	sol_owntype_t own;
+	/** The freeing function if own == `OWN_CALLF` */
+	sol_freefunc_t freef;
+	/** The moving function if own == `OWN_CALLF` */
+	sol_movefunc_t movef;
+	/** A flag field; see `SOL_BUF_IMMUTABLE`. */
+	unsigned short flags;
+	/** For slices (see `sol_buffer_slice`), the buffer owning the region, kept alive by this reference; otherwise NULL. */
+	struct sol_tag_object_t *owner;
+} sol_bufbody_t;
+
+/** The buffer's region may not be written through the buffer API (e.g., a literal constant). */
+#define SOL_BUF_IMMUTABLE 0x0001
+
+/** Dynamic symbol body.
+ *
+ * The payload of a `SOL_DYSYM`, allocated separately from the object.
+ */
+
+typedef struct {
+	/** The symbol as resolved by `dlsym`. */
+	void *dlsym;
+	/** A sequence of the types of the arguments (a set of `sol_buftype_t` cast to void *, the native type of DSL), if the symbol is a function. */
+	dsl_seq *argtp;
+	/** The return type of the symbol if it is a function; otherwise, the type of the symbol if it is a variable. */
+	sol_buftype_t rettp;
+} sol_symbody_t;
+
+/** Memory stream contents.
+ *
+ * The storage behind a stream from `sol_new_memstream`. The stream's file
+ * reads and writes it through fopencookie, so it has no descriptor.
+ */
+
+typedef struct {
+	/** The state, for allocating storage. */
+	sol_state_t *state;
+	/** The buffer holding the contents (its size is the capacity), or NULL while there is none. While anything else refers to it (a result of `sol_stream_getbuffer`, a line, or the buffer the stream was made from), writes copy it first. */
+	struct sol_tag_object_t *buf;
+	/** The length of the contents. */
+	size_t len;
+	/** The position of the file. */
+	size_t pos;
+} sol_memstream_t;
+
+/** Stream body.
+ *
+ * The payload of a `SOL_STREAM`, allocated separately from the object.
+ */
+
+typedef struct {
+	/** The actual file object. */
+	FILE *stream;
+	/** The modes for which this stream is open. */
+	sol_modes_t modes;
+	/** The read buffer, or NULL before the first read. It is a buffer object so that lines sliced from it keep it alive (see `sol_stream_readline`). */
+	struct sol_tag_object_t *rbuf;
+	/** References to the lines most recently sliced from the read buffer, so that any still kept elsewhere can be copied out of it before it is refilled or dropped. */
+	struct sol_tag_object_t *lines[SOL_STREAM_LINES];
+	/** The number of entries in `lines`. */
+	size_t nlines;
+	/** The offset of the first unread byte in the read buffer. */
+	size_t rpos;
+	/** The end of the bytes read into the read buffer. */
+	size_t rend;
+	/** Set once a read hits the end of the file. */
+	char reof;
+	/** Set once the file turns out not to be seekable (a pipe, socket or terminal), so that writes leave the read buffer alone. */
+	char nonseek;
+	/** The write buffer, or NULL before the first buffered write. */
+	char *wbuf;
+	/** The size of the write buffer, or 0 to write unbuffered (see `stream:setbuffer`). */
+	size_t wcap;
+	/** The number of bytes in the write buffer. */
+	size_t wlen;
+	/** The output waiting to be written, in order: parts of the write buffer, and large immutable strings and buffers queued without being copied. */
+	struct iovec wiov[SOL_STREAM_IOV];
+	/** The number of entries in `wiov`. */
+	size_t niov;
+	/** References to the objects queued in `wiov`, which keep their memory alive until the flush. */
+	struct sol_tag_object_t *wobjs[SOL_STREAM_IOV];
+	/** The number of entries in `wobjs`. */
+	size_t nobjs;
+	/** Set to flush after every write containing a newline (for terminals and stderr). */
+	char linebuf;
+	/** For memory streams, their contents; otherwise NULL. */
+	sol_memstream_t *mem;
+} sol_streambody_t;
+
 /** Object structure.
  *
  * This structure defines the interface of every Sol object. Just as well (and
  * as an implementation detail), it contains the operative members of every
  * built-in type.
+ *
+ * Types whose state doesn't fit in two words (functions, buffers, dynamic
+ * symbols and streams) keep it in a separately allocated body instead, so
+ * that the common scalar objects stay small.
  */
 
 typedef struct sol_tag_object_t {
@@ -346,32 +559,28 @@ typedef struct sol_tag_object_t {
 		long ival;
 		/** For `SOL_FLOAT`, the value of the floating point number. */
 		double fval;
-		/** For `SOL_STRING`, the C string pointer. For `SOL_SINGLET`, the name of this singlet. */
-		char *str;
-		/** For `SOL_LIST` and `SOL_MAP`, the DSL sequence that contains the items or pairs. */
-		dsl_seq *seq;
+		struct {
+			/** For `SOL_STRING`, the C string pointer. For `SOL_SINGLET`, the name of this singlet. */
+			char *str;
+			/** For `SOL_STRING`, the length of `str`, not including its terminator. */
+			size_t slen;
+		};
+		struct {
+			/** For `SOL_LIST`, the DSL sequence that contains the items. */
+			dsl_seq *seq;
+			/** For `SOL_LIST`, the count of objects sharing `seq` (copy-on-write), or NULL if this object owns it alone. */
+			size_t *seqref;
+		};
+		/** For `SOL_MAP`, the table of associations. */
+		sol_mtable_t *mtable;
 		struct {
 			/** For `SOL_MCELL`, the key of the pair. */
 			struct sol_tag_object_t *key;
 			/** For `SOL_MCELL`, the value of the pair. */
 			struct sol_tag_object_t *val;
 		};
-		struct {
-			/** For `SOL_FUNCTION`, the `stmt_node` pointer representing the function's body. */
-			void *func; // Actually a stmt_node *
-			/** For `SOL_FUNCTION`, the `identlist_node` pointer representing the list of the functions argument names. */
-			void *args; // Actually an identlist_node *
-			/** For `SOL_FUNCTION`, a map representing the closure (initial scope, updated on exit) of the function. */
-			struct sol_tag_object_t *closure;
-			/** For `SOL_FUNCTION`, a map of data defined by the user on this function object. */
-			struct sol_tag_object_t *udata;
-			/** For `SOL_FUNCTION`, the name of the function if it was not declared anonymously (otherwise NULL). */
-			char *fname;
-			/** For `SOL_FUNCTION`, the name of an argument that receives extra parameters as a list (otherwise NULL). */
-			char *rest;
-			/** For `SOL_FUNCTION`, the map of annotations, with arguments by name, and the function itself by object. */
-			struct sol_tag_object_t *annos;
-		};
+		/** For `SOL_FUNCTION` and `SOL_MACRO`, the function's body and environment. */
+		sol_funcbody_t *fn;
 		struct {
 			/** For `SOL_CFUNCTION`, the C function pointer. */
 			sol_cfunc_t cfunc;
@@ -380,39 +589,49 @@ typedef struct sol_tag_object_t {
 		};
 		/** For `SOL_STMT` and `SOL_EXPR`, the `stmt_node` or `expr_node` pointer, respectively. */
 		void *node;
-		struct {
-			/** For `SOL_BUFFER`, the memory region referred to by this buffer. */
-			void *buffer;
-			/** For `SOL_BUFFER`, the size of this memory region. Negative values indicate no or unknown size. */
-			ssize_t sz;
-			/** For `SOL_BUFFER`, the ownership type of this buffer's region. */
-			sol_owntype_t own;
-			/** For `SOL_BUFFER`, the freeing function if own == `OWN_CALLF` */
-			sol_freefunc_t freef;
-			/** For `SOL_BUFFER`, the moving function if own == `OWN_CALLF` */
-			sol_movefunc_t movef;
-		};
+		/** For `SOL_BUFFER`, the memory region and its ownership. */
+		sol_bufbody_t *mem;
 		/** For `SOL_DYLIB`, the handle as returned by `dlopen`. */
 		void *dlhandle;
-		struct {
-			/** For `SOL_DYSYM`, the symbol as resolved by `dlsym`. */
-			void *dlsym;
-			/** For `SOL_DYSYM`, a sequence of the types of the arguments (a set of `sol_buftype_t` cast to void *, the native type of DSL), if the symbol is a function. */
-			dsl_seq *argtp;
-			/** For `SOL_DYSYM`, the return type of the symbol if it is a function; otherwise, the type of the symbol if it is a variable. */
-			sol_buftype_t rettp;
-		};
-		struct {
-			/** For `SOL_STREAM`, the actual file object. */
-			FILE *stream;
-			/** For `SOL_STREAM`, the modes for which this stream is open. */
-			sol_modes_t modes;
-		};
+		/** For `SOL_DYSYM`, the symbol and its type. */
+		sol_symbody_t *sym;
+		/** For `SOL_STREAM`, the file and its modes. */
+		sol_streambody_t *io;
 		/** For `SOL_CDATA`, an arbitrary, user-defined pointer. */
 		void *cdata;
 	};
 } sol_object_t;
 
+/** Cycle collector header.
+ *
+ * Containers (lists, maps, MCELLs, functions and macros) are allocated with
+ * one of these immediately before the object, by which they are linked into
+ * their state's list of tracked objects (see `sol_gc_collect`). Unlinking
+ * needs no state, so objects can still be freed with `sol_obj_free`.
+ */
+
+typedef struct sol_tag_gchead_t {
+	/** The next tracked object, or this header if untracked. */
+	struct sol_tag_gchead_t *next;
+	/** The previous tracked object, or this header if untracked. */
+	struct sol_tag_gchead_t *prev;
+	/** Scratch space for the collector: references not accounted for by other tracked objects. */
+	long refs;
+} sol_gchead_t;
+
+/** Buffer pool size class.
+ *
+ * The freed regions of one power-of-two size a state keeps for reuse (see
+ * `sol_new_pooled_buffer`).
+ */
+
+typedef struct {
+	/** The number of entries in `free`. */
+	size_t count;
+	/** The freed regions, each from the start of its header. */
+	void *free[SOL_BUFFER_POOL];
+} sol_poolclass_t;
+
 /** State flags.
  *
  * These flags get set during execution and indicate an altered state of
@@ -453,6 +672,10 @@ typedef struct sol_tag_state_t {
 	sol_ops_t DyLibOps; ///< Operations on dynamic library objects
 	sol_ops_t DySymOps; ///< Operations on dynamic symbol objects
 	sol_ops_t StreamOps; ///< Operations on streams
+	sol_ops_t IterOps; ///< Operations on lazy iterators (see `sol_new_iter`)
+	sol_ops_t ArrayOps; ///< Operations on typed arrays (see `sol_new_array`)
+	sol_ops_t UnpackIterOps; ///< Operations on the record iterators returned by buffer:unpack_iter
+	sol_ops_t EventLoopOps; ///< Operations on event loops (see `sol_new_event_loop`)
 	sol_object_t *modules; ///< A map of modules, string name to contents, resolved at "super-global" scope (and thus overrideable)
 	sol_object_t *methods; ///< A map of string names to methods (like "list" -> {insert=<CFunction>, remove=<CFunction>, ...}) free for private use by extension developers
 	dsl_object_funcs obfuncs; ///< The set of object functions that allows DSL to integrate with Sol's reference counting
@@ -462,6 +685,20 @@ typedef struct sol_tag_state_t {
 	sol_object_t *icache[SOL_ICACHE_MAX - SOL_ICACHE_MIN + 1]; ///< The integer cache (holds integers from `SOL_ICACHE_MIN` to `SOL_ICACHE_MAX` indexed by `[i - SOL_ICACHE_MIN]`)
 	char icache_bypass; ///< Set to true to bypass caching--needed to avoid infinite recursion when initially populating the cache
 #endif
+	dsl_seq *immortals; ///< Every immortal object belonging to this state (see `sol_immortalize`), released last by `sol_state_cleanup`
+	sol_object_t *interned; ///< A map from each interned string to itself (see `sol_intern`)
+	char immortal_init; ///< Set while `sol_state_init` creates the builtins, so that the C functions it creates are immortal
+	sol_gchead_t gc_tracked; ///< The head of the list of containers tracked by the cycle collector
+	size_t gc_count; ///< The number of containers tracked since the last collection
+	size_t gc_live; ///< The number of containers that survived the last collection
+	size_t gc_work; ///< The number of containers and references the last collection visited, which paces the next
+	size_t gc_threshold; ///< The value of `gc_count` that triggers a collection, or 0 to never collect automatically
+	size_t gc_collections; ///< The number of collections so far
+	size_t gc_collected; ///< The number of containers freed by collections so far
+	char gc_collecting; ///< Set while a collection is running
+	struct sol_tag_fmtsrc_t *fmtcache[SOL_FORMAT_CACHE]; ///< Compiled format strings, hashed by address or contents (see `sol_fmtcache_lookup`)
+	struct sol_tag_fmtsrc_t *packcache[SOL_FORMAT_CACHE]; ///< Compiled pack formats, cached like `fmtcache` (see pack.c)
+	sol_poolclass_t pool[SOL_BUFFER_POOL_MAX + 1]; ///< Freed regions kept for reuse, by size class (see `sol_new_pooled_buffer`)
 	sol_object_t *lastvalue; ///< Holds the value of the last expression evaluated, returned by an `if` expression
 	sol_object_t *loopvalue; ///< Holds an initially-empty list appended to by `continue <expr>` or set to another object by `break <expr>`
 	unsigned short features; ///< A flag field used to control the Sol initialization processs
@@ -471,6 +708,9 @@ typedef struct sol_tag_state_t {
 #define SOL_FT_NO_USR_INIT 0x0001
 /** Be noisy in the language runtime. */
 #define SOL_FT_DEBUG       0x0002
+/** Ignore SIGPIPE (for the whole process), so that writing to a closed pipe or
+ * connection fails with EPIPE instead of killing the process. */
+#define SOL_FT_IGNORE_SIGPIPE 0x0004
 
 // state.c
 
@@ -740,6 +980,8 @@ sol_object_t *sol_f_tofloat(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_tostring(sol_state_t *, sol_object_t *);
 /// Built-in function tobuffer
 sol_object_t *sol_f_tobuffer(sol_state_t *, sol_object_t *);
+/// Built-in function format; also string.format and buffer.format
+sol_object_t *sol_f_format(sol_state_t *, sol_object_t *);
 /// Built-in function try
 sol_object_t *sol_f_try(sol_state_t *, sol_object_t *);
 /// Built-in function apply
@@ -779,11 +1021,22 @@ sol_object_t *sol_f_debug_locals(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_debug_scopes(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_debug_getops(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_debug_fnstack(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_debug_gc_collect(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_debug_gc_stats(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_debug_gc_threshold(sol_state_t *, sol_object_t *);
 
 sol_object_t *sol_f_iter_str(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_iter_buffer(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_iter_list(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_iter_stream(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_iter_keys(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_iter_map(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_iter_filter(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_iter_zip(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_iter_enumerate(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_iter_take(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_iter_chain(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_iter_collect(sol_state_t *, sol_object_t *);
 
 sol_object_t *sol_f_readline_readline(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_readline_add_history(sol_state_t *, sol_object_t *);
@@ -835,6 +1088,7 @@ sol_object_t *sol_f_str_repr(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_str_sub(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_str_split(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_str_find(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_str_count(sol_state_t *, sol_object_t *);
 
 sol_object_t *sol_f_list_add(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_list_mul(sol_state_t *, sol_object_t *);
@@ -852,6 +1106,7 @@ sol_object_t *sol_f_list_truncate(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_list_map(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_list_filter(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_list_reduce(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_list_sort(sol_state_t *, sol_object_t *);
 
 sol_object_t *sol_f_map_add(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_map_index(sol_state_t *, sol_object_t *);
@@ -896,6 +1151,8 @@ sol_object_t *sol_f_buffer_size(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_buffer_sub(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_buffer_split(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_buffer_find(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_buffer_count(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_buffer_madvise(sol_state_t *, sol_object_t *);
 
 sol_object_t *sol_f_buffer_new(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_buffer_fromstring(sol_state_t *, sol_object_t *);
@@ -918,18 +1175,28 @@ sol_object_t *sol_f_dysym_set(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_blsh(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_brsh(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_index(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_stream_iter(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_tostring(sol_state_t *, sol_object_t *);
 
 sol_object_t *sol_f_stream_write(sol_state_t *, sol_object_t *);
 /*sol_object_t *sol_f_stream_read(sol_state_t *, sol_object_t *);*/
 sol_object_t *sol_f_stream_read_buffer(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_stream_readinto(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_seek(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_tell(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_flush(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_stream_setbuffer(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_stream_pending(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_stream_sendfile(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_stream_getbuffer(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_eof(sol_state_t *, sol_object_t *);
 sol_object_t *sol_f_stream_ioctl(sol_state_t *, sol_object_t *);
 
 sol_object_t *sol_f_stream_open(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_io_mmap(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_io_copy(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_io_memstream(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_io_frombuffer(sol_state_t *, sol_object_t *);
 
 // object.c
 
@@ -949,6 +1216,9 @@ sol_object_t *sol_f_stream_open(sol_state_t *, sol_object_t *);
 #define sol_is_astnode(obj) (sol_is_aststmt(obj) || sol_is_astexpr(obj))
 #define sol_is_buffer(obj) ((obj)->type == SOL_BUFFER)
 #define sol_is_cdata(obj) ((obj)->type == SOL_CDATA)
+#define sol_is_stream(obj) ((obj)->type == SOL_STREAM)
+/** Containers may be part of a reference cycle, and must be allocated with `sol_alloc_container`. */
+#define sol_is_container(obj) (sol_is_list(obj) || sol_is_map(obj) || sol_is_func(obj) || sol_is_macro(obj))
 
 #define sol_is_name(obj) (sol_is_string(obj) || sol_is_buffer(obj))
 #define sol_name_eq(state, obj, cstr) (sol_is_string(obj) ? sol_string_eq((state), (obj), (cstr)) : (sol_is_buffer(obj) ? sol_buffer_eq((state), (obj), (cstr)) : 0))
@@ -975,6 +1245,23 @@ sol_object_t *sol_new_float(sol_state_t *, double);
 
 /** Creates a new string object with the specified value. */
 sol_object_t *sol_new_string(sol_state_t *, const char *);
+/** Creates a new string object from the given number of bytes (which should
+ *   not contain NUL). */
+sol_object_t *sol_new_string_len(sol_state_t *, const char *, size_t);
+/** Creates a new string object that takes ownership of the given allocated,
+ *   terminated bytes of the given length. */
+sol_object_t *sol_new_string_owned(sol_state_t *, char *, size_t);
+/** Returns the interned string object with the specified value.
+ *
+ * There is only one interned string per value in a state, and it is
+ * immortal, so this is much cheaper than `sol_new_string` for names that
+ * are used over and over (identifiers, method names, and so forth). The
+ * result is a reference like any other, and may be freed (to no effect).
+ *
+ * Interned strings last as long as the state, so only intern names from
+ * source code and builtins, never strings from data.
+ */
+sol_object_t *sol_intern(sol_state_t *, const char *);
 /** Utility function to compare a Sol string and a C string, used often in
  *   builtin and extension code. */
 int sol_string_cmp(sol_state_t *, sol_object_t *, const char *);
@@ -986,6 +1273,15 @@ sol_object_t *sol_string_concat(sol_state_t *, sol_object_t *, sol_object_t *);
 /** Utility function for conveniently concatenating a Sol string and a C string
  *   (and returning a Sol string). */
 sol_object_t *sol_string_concat_cstr(sol_state_t *, sol_object_t *, char *);
+/** Internal routine that appends the second object to the first in place, if
+ *   it is a string or a buffer whose region may be grown and the second is a
+ *   string or a sized buffer.
+ *   Returns 1 on success, or 0 if the caller should concatenate instead. The
+ *   caller must make sure nothing else can observe the first object. */
+int sol_concat_inplace(sol_state_t *, sol_object_t *, sol_object_t *);
+/** Internal routine that returns a new Sol string consisting of a Sol string
+ *   repeated the given number of times (none, if it is negative). */
+sol_object_t *sol_string_repeat(sol_state_t *, sol_object_t *, long);
 
 /** Creates a new empty Sol list. */
 sol_object_t *sol_new_list(sol_state_t *);
@@ -1016,13 +1312,22 @@ sol_object_t *sol_list_remove(sol_state_t *, sol_object_t *, int);
  *
  * Note that this performs a "shallow" copy, in that while the new list is a
  * different reference, the references inside the list are the same.
+ *
+ * The copy shares its sequence with the original until either is written to
+ * (see `sol_list_unshare`), so this is constant-time.
  */
 sol_object_t *sol_list_copy(sol_state_t *, sol_object_t *);
+/** Internal routine to give a Sol list its own sequence, copying it if it is
+ *   currently shared with other lists. Called before any write. */
+void sol_list_unshare(sol_state_t *, sol_object_t *);
 /** Internal routine to return a new Sol list equivalent to its input up to the
  *   first n elements. */
 sol_object_t *sol_list_truncate(sol_state_t *, sol_object_t *, int);
 /** Utility routine to concatenate Sol lists. */
 void sol_list_append(sol_state_t *, sol_object_t *, sol_object_t *);
+/** Internal routine that returns a new Sol list holding the elements of a Sol
+ *   list repeated the given number of times (none, if it is negative). */
+sol_object_t *sol_list_repeat(sol_state_t *, sol_object_t *, long);
 /** Utility macro to insert an object at the beginning of a Sol list. */
 #define sol_list_push(st, ls, obj) sol_list_insert(st, ls, 0, obj);
 /** Utility macro to remove and return the object at the beginning of a Sol
@@ -1033,16 +1338,34 @@ void sol_list_append(sol_state_t *, sol_object_t *, sol_object_t *);
 sol_object_t *sol_new_map(sol_state_t *);
 /** Internal routine to get the length (number of associations) in a Sol map. */
 int sol_map_len(sol_state_t *, sol_object_t *);
+/** Internal routine to compute the hash of a key.
+ *
+ * Keys which compare equal hash equally: integers, floats, strings and sized
+ * buffers hash by value (strings and buffers by their content up to the first
+ * NUL, as they compare equal to each other that way), and objects compared by
+ * identity by address. Other keys, including lists (which can change while
+ * they're keys), all share one hash, and are found by comparison alone.
+ */
+unsigned long sol_map_hash(sol_state_t *, sol_object_t *);
+/** Internal routine to iterate over the associations in a map.
+ *
+ * `pos` should point to a zero-initialized cursor; on each call which returns
+ * nonzero, `key` and `val` (if not NULL) receive borrowed references to the
+ * next association, in insertion order. Returns 0 when there are no more.
+ */
+int sol_map_next(sol_state_t *, sol_object_t *, size_t *, sol_object_t **, sol_object_t **);
 /** Internal routine to get an MCELL by index.
  *
- * This is most typically used to iterate over the associations in a map in an
- * arbitrary order.
+ * This is most typically used to iterate over the associations in a map, in
+ * insertion order. The MCELL is created on demand and is a snapshot; changing
+ * it does not change the map. (Maps used to be lists of MCELLs, which were
+ * live and ordered most recently inserted first.)
  */
 sol_object_t *sol_map_mcell_index(sol_state_t *, sol_object_t *, int);
 /** Internal routine to get an MCELL with key equal to `key`, or `None`.
  *
- * This does most of the work of association lookup; many other functions in
- * the map internal API are built upon this one.
+ * Maps do not store MCELLs; this creates one on demand holding the key and
+ * value found. As with `sol_map_mcell_index`, it is a snapshot.
  */
 sol_object_t *sol_map_mcell(sol_state_t *, sol_object_t *, sol_object_t *);
 /** Internal routine to determine if a key is in a map. */
@@ -1058,6 +1381,11 @@ sol_object_t *sol_map_get_name(sol_state_t *, sol_object_t *, char *);
  * If the key had a previous association, it is lost. If the value is `None`,
  * any existing association is deleted; this is consistent with a return of
  * `None` for any map get for which no association exists.
+ *
+ * A new association with a mutable buffer as its key stores an immutable copy
+ * of it, so changing the buffer later doesn't strand the association under a
+ * stale hash. If comparing keys raises an error, the map is left unchanged
+ * with the error set.
  */
 void sol_map_set(sol_state_t *, sol_object_t *, sol_object_t *, sol_object_t *);
 /** Internal routine to set an association, borrowing a reference to the value
@@ -1075,7 +1403,11 @@ void sol_map_set(sol_state_t *, sol_object_t *, sol_object_t *, sol_object_t *);
 	sol_map_set((state), (map), (key), __obj);\
 	sol_obj_free(__obj);\
 } while(0)
-/** Internal routine to set a map association with a C-string key. */
+/** Internal routine to set a map association with a C-string key.
+ *
+ * A new key is the interned string for the name if there is one (see
+ * `sol_intern`), or else a new string; it doesn't intern the name.
+ */
 void sol_map_set_name(sol_state_t *, sol_object_t *, char *, sol_object_t *);
 /** Internal routine to set a map association with a C-string key, and
  *   borrowing a reference to the value. */
@@ -1088,10 +1420,23 @@ void sol_map_set_name(sol_state_t *, sol_object_t *, char *, sol_object_t *);
  *   was associated with a value (other than `None`) previously.
  *
  * This is mostly used in the end of `sol_f_func_call` to update the closure.
+ *   Setting a key to the value it already has leaves the map untouched, so a
+ *   closure still sharing its storage isn't copied by a call that changed
+ *   nothing.
  */
 void sol_map_set_existing(sol_state_t *, sol_object_t *, sol_object_t *, sol_object_t *);
-/** Creates a new copy of an existing Sol map. */
+/** Creates a new copy of an existing Sol map.
+ *
+ * As with `sol_list_copy`, the pairs are shared copy-on-write until either map
+ * is written to.
+ */
 sol_object_t *sol_map_copy(sol_state_t *, sol_object_t *);
+/** Internal routine to give a Sol map its own table, copying it if it is
+ *   currently shared with other maps. Called before any write. */
+void sol_map_unshare(sol_state_t *, sol_object_t *);
+/** Internal routine to make room in a Sol map for the given number of
+ *   associations, so that adding up to that many doesn't grow its table. */
+void sol_map_reserve(sol_state_t *, sol_object_t *, size_t);
 /** Merges the associations of the source map into the destination map.
  *
  * Associations in the source map take precedence if the same key exists in
@@ -1105,6 +1450,20 @@ void sol_map_merge_existing(sol_state_t *, sol_object_t *, sol_object_t *);
  *   value already within. */
 void sol_map_invert(sol_state_t *, sol_object_t *);
 
+/** Visitor type for `sol_obj_traverse`. */
+typedef void (*sol_visitfunc_t)(sol_object_t *, void *);
+/** Calls the visitor (with the given argument) on every object a container
+ *   refers to.
+ *
+ * If the shared flag is false, storage shared copy-on-write with other
+ * containers is skipped, since the references in it aren't held by this
+ * container alone. This is used by the cycle collector.
+ */
+void sol_obj_traverse(sol_object_t *, int, sol_visitfunc_t, void *);
+/** Drops every reference a container holds, leaving it empty; this is how the
+ *   cycle collector breaks cycles. */
+void sol_obj_clear(sol_state_t *, sol_object_t *);
+
 // Defined in ast.h
 // sol_object_t *sol_new_func(sol_state_t *, identlist_node *, stmt_node *, char *);
 // sol_object_t *sol_new_stmtnode(sol_state_t *, stmt_node *);
@@ -1119,19 +1478,85 @@ int sol_buffer_cmp(sol_state_t *, sol_object_t *, const char *);
 #define sol_buffer_eq(state, buffer, cstr) (sol_buffer_cmp((state), (buffer), (cstr)) == 0)
 sol_object_t *sol_buffer_concat(sol_state_t *, sol_object_t *, sol_object_t *);
 sol_object_t *sol_buffer_concat_cstr(sol_state_t *, sol_object_t *, char *);
+sol_object_t *sol_buffer_repeat(sol_state_t *, sol_object_t *, long);
+sol_object_t *sol_buffer_slice(sol_state_t *, sol_object_t *, size_t, ssize_t);
 char *sol_buffer_strdup(sol_object_t *);
+/** Creates a buffer of the given size whose region comes from, and returns
+ *   to, a pool of freed regions of the same size class.
+ *
+ * Code that repeatedly allocates and drops same-sized buffers (like a read
+ * loop with `stream:readinto`) then reuses the same few regions instead of
+ * calling malloc and free each time. The region isn't cleared.
+ */
+sol_object_t *sol_new_pooled_buffer(sol_state_t *, size_t);
+/** Frees every region held in the state's buffer pool. */
+void sol_buffer_pool_clear(sol_state_t *);
 
 sol_object_t *sol_new_dylib(sol_state_t *, void *);
 
 sol_object_t *sol_new_dysym(sol_state_t *, void *, dsl_seq *, sol_buftype_t);
 
 sol_object_t *sol_new_stream(sol_state_t *, FILE *, sol_modes_t);
+/** Returns a new readable and writable stream in memory, starting with the
+ *   contents of the given buffer (or empty, if NULL), which it doesn't copy
+ *   until written. */
+sol_object_t *sol_new_memstream(sol_state_t *, sol_object_t *);
+/** Returns the contents of a memory stream as an immutable buffer, without
+ *   copying them (or sets an error for other streams). */
+sol_object_t *sol_stream_getbuffer(sol_state_t *, sol_object_t *);
 size_t sol_stream_printf(sol_state_t *, sol_object_t *, const char *, ...);
 size_t sol_stream_vprintf(sol_state_t *, sol_object_t *, const char *, va_list);
 size_t sol_stream_scanf(sol_state_t *, sol_object_t *, const char *, ...);
 size_t sol_stream_fread(sol_state_t *, sol_object_t *, char *, size_t, size_t);
 size_t sol_stream_fwrite(sol_state_t *, sol_object_t *, char *, size_t, size_t);
+/** Writes bytes that belong to an object (or NULL) to a stream, and returns
+ *   the number written.
+ *
+ * Writes go to the stream's write buffer, and out in one writev when it
+ * fills, on `sol_stream_fflush`, or (for line-buffered streams) at a
+ * newline. Large writes from immutable objects (strings, and buffers flagged
+ * `SOL_BUF_IMMUTABLE`) are queued by reference instead of copied.
+ */
+size_t sol_stream_write_bytes(sol_state_t *, sol_object_t *, const char *, size_t, sol_object_t *);
+/** Sets the size of a stream's write buffer (0 to write unbuffered), and
+ *   whether it flushes at every newline; flushes what was buffered first, and
+ *   returns nonzero (changing nothing) if it couldn't all be written. */
+int sol_stream_setbuffer(sol_state_t *, sol_object_t *, size_t, int);
+/** Returns the number of bytes written to a stream but not yet sent to the
+ *   file (for a non-blocking socket, those waiting for it to be writable). */
+size_t sol_stream_pending(sol_state_t *, sol_object_t *);
+size_t sol_stream_write_obj(sol_state_t *, sol_object_t *, sol_object_t *);
+/** Copies up to the given number of bytes (SIZE_MAX for all of them) from the
+ *   first stream to the second, and returns the number copied.
+ *
+ * With a NULL offset this reads from the first stream's position, starting
+ * with what its read buffer holds; otherwise it reads from the offset (which
+ * it advances) without moving the stream. Between descriptors the data moves
+ * kernel-side, by sendfile(2) or splice(2), falling back to a buffered copy
+ * for files those don't support. It stops short at the end of the file, or
+ * when a non-blocking stream isn't ready; anything already read then waits on
+ * the second stream (see `sol_stream_pending`). If reading or writing fails
+ * (with EPIPE, say), it sets an error, and returns the number copied before
+ * that.
+ */
+size_t sol_stream_copy(sol_state_t *, sol_object_t *, sol_object_t *, long *, size_t);
 char *sol_stream_fgets(sol_state_t *, sol_object_t *, char *, size_t);
+/** Reads up to the given number of bytes into memory, and returns how many
+ *   were read (0 at the end of the file).
+ *
+ * Unlike `sol_stream_fread`, this makes at most one read from the file, so it
+ * returns what is available from a pipe or terminal without waiting for more.
+ */
+size_t sol_stream_readinto(sol_state_t *, sol_object_t *, char *, size_t);
+/** Reads a line, up to and including its newline (or the end of the file),
+ *   and returns it as a buffer, or None at the end of the file.
+ *
+ * The line is a slice of the stream's read buffer, so reading it copies
+ * nothing. Before the read buffer is refilled or dropped, lines that are still
+ * kept are copied into regions of their own, so that each doesn't keep the
+ * whole read buffer alive; the buffer is then reused if no line refers to it.
+ */
+sol_object_t *sol_stream_readline(sol_state_t *, sol_object_t *);
 int sol_stream_fputc(sol_state_t *, sol_object_t *, int);
 #define _sol_io_on(state, op, strname, ...) do {\
 	sol_object_t *__str = sol_get_##strname(state);\
@@ -1172,12 +1597,263 @@ sol_object_t *sol_f_stream_free(sol_state_t *, sol_object_t *);
 int sol_validate_list(sol_state_t *, sol_object_t *);
 int sol_validate_map(sol_state_t *, sol_object_t *);
 
+// format.c
+
+/** The buffer size sufficient for `sol_format_int` and `sol_format_float`. */
+#define SOL_FORMAT_SIZE 32
+
+/** Writes the decimal form of an integer, terminated, into a buffer of at
+ *   least `SOL_FORMAT_SIZE` bytes, and returns its length. */
+size_t sol_format_int(char *, long);
+/** Writes a float with the fewest significant digits that read back as the
+ *   same value, terminated, into a buffer of at least `SOL_FORMAT_SIZE`
+ *   bytes, and returns its length. */
+size_t sol_format_float(char *, double);
+/** Renders a format string (of the given length) with the arguments in the
+ *   list from the given index on, and returns the resulting string.
+ *
+ * The compiled form of the format string is cached in the state; literals
+ * (immutable buffers, indicated by the int argument) are cached by address.
+ * See format.c for the syntax.
+ */
+sol_object_t *sol_format(sol_state_t *, const char *, size_t, int, sol_object_t *, size_t);
+/** Frees every compiled format string cached in the state. */
+void sol_format_cache_clear(sol_state_t *);
+
+/** The start of every compiled format kept in a cache (see
+ *   `sol_fmtcache_lookup`): a copy of the text it was compiled from. */
+typedef struct sol_tag_fmtsrc_t {
+	/** The text, not terminated. */
+	char *src;
+	/** The length of the text. */
+	size_t len;
+} sol_fmtsrc_t;
+
+/** Compiles a format of the given length, or returns NULL and sets the error
+ *   message. */
+typedef sol_fmtsrc_t *(*sol_fmtcompile_t)(const char *, size_t, const char **);
+/** Frees a compiled format. */
+typedef void (*sol_fmtfree_t)(sol_fmtsrc_t *);
+
+/** Looks up a format of the given length in a cache of `SOL_FORMAT_CACHE`
+ *   compiled formats, compiling and caching it (with the given functions) if
+ *   it isn't there; returns NULL, with the error message set, if it doesn't
+ *   compile.
+ *
+ * Literals (immutable buffers, indicated by the int argument) are hashed by
+ * address, so they aren't read twice; anything else is hashed by content. A
+ * hit is always confirmed against the cached copy of the text. Each slot holds
+ * one format, and a miss replaces it.
+ */
+sol_fmtsrc_t *sol_fmtcache_lookup(sol_fmtsrc_t **, const char *, size_t, int, sol_fmtcompile_t, sol_fmtfree_t, const char **);
+/** Frees every compiled format in a cache. */
+void sol_fmtcache_clear(sol_fmtsrc_t **, sol_fmtfree_t);
+
+// iter.c
+
+/** Lazy iterator kinds, one for each combinator in the iter module. */
+typedef enum {
+	/** Yields func(item) for each item of the source. */
+	SOL_IT_MAP,
+	/** Yields the items of the source for which func(item) is true. */
+	SOL_IT_FILTER,
+	/** Yields a list of one item from each source, until any runs out. */
+	SOL_IT_ZIP,
+	/** Yields [index, item] for each item of the source, counting from count. */
+	SOL_IT_ENUMERATE,
+	/** Yields the first count items of the source. */
+	SOL_IT_TAKE,
+	/** Yields the items of each source in turn. */
+	SOL_IT_CHAIN
+} sol_iterkind_t;
+
+/** Creates a lazy iterator of the given kind over the iterables in the list,
+ *   with the given function (or NULL) and count.
+ *
+ * The iterator is its own iter function, and so may be looped over (once),
+ * or passed as a source to another.
+ */
+sol_object_t *sol_new_iter(sol_state_t *, sol_iterkind_t, sol_object_t *, sol_object_t *, long);
+/** Returns the next item of a lazy iterator, or None at its end. */
+sol_object_t *sol_iter_next(sol_state_t *, sol_object_t *);
+/** Returns a new list of every item of an iterable. */
+sol_object_t *sol_iter_collect(sol_state_t *, sol_object_t *);
+
+sol_object_t *sol_f_lazy_iter_call(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_lazy_iter_iter(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_lazy_iter_free(sol_state_t *, sol_object_t *);
+
+// sort.c
+
+/** Sorts a list in place, stably, and returns nonzero if that failed (with the
+ *   error set).
+ *
+ * If the key function isn't NULL, it is called once per item, and the results
+ * are compared instead of the items. If the cmp function isn't NULL, it is
+ * called with two keys and returns a negative int if the first goes before the
+ * second; otherwise, keys that are all numbers or all strings (or sized
+ * buffers) are compared natively, and any others through their cmp methods.
+ */
+int sol_list_sort(sol_state_t *, sol_object_t *, sol_object_t *, sol_object_t *);
+
+// pack.c
+
+/** Frees every compiled pack format cached in the state. */
+void sol_pack_cache_clear(sol_state_t *);
+
+sol_object_t *sol_f_buffer_pack(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_buffer_unpack(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_buffer_unpack_iter(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_buffer_calcsize(sol_state_t *, sol_object_t *);
+
+sol_object_t *sol_f_unpack_iter_call(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_unpack_iter_iter(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_unpack_iter_free(sol_state_t *, sol_object_t *);
+
+// typedarray.c
+
+/** Creates a typed array over a sized buffer, with elements of the given
+ *   buffer type.
+ *
+ * The type must be numeric; `BUF_BYTE` and the C types (`BUF_INT`,
+ * `BUF_LONG`, ...) are stored as the fixed-size type of the same size. The
+ * array holds a reference to the buffer, and its length is the number of
+ * whole elements that fit in it.
+ */
+sol_object_t *sol_new_array(sol_state_t *, sol_object_t *, long);
+/** Returns the number of elements in an array. */
+size_t sol_array_len(sol_state_t *, sol_object_t *);
+/** Returns the element at an index of an array, as an int or float. */
+sol_object_t *sol_array_get(sol_state_t *, sol_object_t *, size_t);
+/** Stores a number at an index of an array, converting it to the element
+ *   type; returns nonzero if that failed (with the error set). */
+int sol_array_set(sol_state_t *, sol_object_t *, size_t, sol_object_t *);
+/** Compares two arrays of the same type element by element, and then by
+ *   length; returns -1, 0 or 1. */
+int sol_array_compare(sol_state_t *, sol_object_t *, sol_object_t *);
+
+sol_object_t *sol_f_array_new(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_frombuffer(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_fromlist(sol_state_t *, sol_object_t *);
+
+sol_object_t *sol_f_array_add(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_mul(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_min(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_max(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_sum(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_dot(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_fill(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_copy(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_compare(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_tolist(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_buffer(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_dtype(sol_state_t *, sol_object_t *);
+
+sol_object_t *sol_f_iter_array(sol_state_t *, sol_object_t *);
+
+sol_object_t *sol_f_array_index(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_setindex(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_len(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_iter(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_cmp(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_tostring(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_array_free(sol_state_t *, sol_object_t *);
+
+// net.c
+
+sol_object_t *sol_f_net_listen(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_listen_unix(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_connect(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_connect_unix(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_accept(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_address(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_peer(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_shutdown(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_setblocking(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_nodelay(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_net_error(sol_state_t *, sol_object_t *);
+
+// http.c
+
+sol_object_t *sol_f_http_parse_request(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_http_parse_response(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_http_header(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_http_reason(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_http_write_response(sol_state_t *, sol_object_t *);
+
+// json.c
+
+sol_object_t *sol_f_json_decode(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_json_encode(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_json_dump(sol_state_t *, sol_object_t *);
+
+// marshal.c
+
+sol_object_t *sol_f_marshal_dumps(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_marshal_loads(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_marshal_dump(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_marshal_load(sol_state_t *, sol_object_t *);
+
+// event.c
+
+/** Creates an event loop, which calls Sol functions when watched streams
+ *   become readable or writable, and when timers fire. */
+sol_object_t *sol_new_event_loop(sol_state_t *);
+/** Waits for events, up to the given number of milliseconds (or, if
+ *   negative, until the next timer or watched event), and calls their
+ *   functions.
+ *
+ * Returns the number of functions called, or -1 if one raised an error (which
+ * is left set). Returns 0 at once if there are no watches or timers, since
+ * nothing could happen.
+ */
+int sol_event_run_once(sol_state_t *, sol_object_t *, long);
+
+sol_object_t *sol_f_event_loop(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_now(sol_state_t *, sol_object_t *);
+
+sol_object_t *sol_f_event_loop_watch(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_loop_unwatch(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_loop_timer(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_loop_cancel(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_loop_run_once(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_loop_run(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_loop_stop(sol_state_t *, sol_object_t *);
+
+sol_object_t *sol_f_event_loop_index(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_loop_tostring(sol_state_t *, sol_object_t *);
+sol_object_t *sol_f_event_loop_free(sol_state_t *, sol_object_t *);
+
+// search.c
+
+/** Returns a pointer to the first occurrence of the needle (of the given
+ *   length) in the haystack (of the given length), or NULL if there is none.
+ *   An empty needle is found at the start. */
+const char *sol_memfind(const char *, size_t, const char *, size_t);
+/** Returns the number of non-overlapping occurrences of the needle in the
+ *   haystack (arguments as for `sol_memfind`). An empty needle is counted at
+ *   every position, including the end. */
+size_t sol_memcount(const char *, size_t, const char *, size_t);
+
 // util.c
 
 sol_object_t *sol_util_call(sol_state_t *, sol_object_t *, int *, int, ...);
 
 // gc.c
 
+/** The reference count given to immortal objects.
+ *
+ * Objects at or above this count are never freed by `sol_obj_free`, and
+ * `sol_incref` and `sol_decref` skip writing to them entirely; this saves a
+ * great deal of traffic on the objects nearly every operation touches, like
+ * `None` and the cached integers. Immortal objects belong to the state, and
+ * are released in `sol_state_cleanup`.
+ */
+#define SOL_REF_IMMORTAL (1 << 30)
+
+/** Returns true iff the object is immortal (see `SOL_REF_IMMORTAL`). */
+#define sol_is_immortal(obj) ((obj)->refcnt >= SOL_REF_IMMORTAL)
+
 #ifdef DEBUG_GC
 
 sol_object_t *_int_sol_incref(const char *, sol_object_t *);
@@ -1186,22 +1862,42 @@ sol_object_t *_sol_gc_dsl_copier(sol_object_t *);
 void _sol_gc_dsl_destructor(sol_object_t *);
 
 sol_object_t *_int_sol_alloc_object(const char *, sol_state_t *);
+sol_object_t *_int_sol_alloc_container(const char *, sol_state_t *);
 
 #define sol_incref(obj) (_int_sol_incref(__func__, (obj)))
 #define sol_obj_free(obj) (_int_sol_obj_free(__func__, (obj)))
 
 #define sol_alloc_object(state) (_int_sol_alloc_object(__func__, (state)))
+#define sol_alloc_container(state) (_int_sol_alloc_container(__func__, (state)))
 
 #else
 
-#define sol_incref(obj) (++((obj)->refcnt), obj)
+/** Adds a reference to an object (unless it's immortal), and returns it. */
+static inline sol_object_t *sol_incref(sol_object_t *obj) {
+	if(!sol_is_immortal(obj)) {
+		++(obj->refcnt);
+	}
+	return obj;
+}
 void sol_obj_free(sol_object_t *);
 
 sol_object_t *sol_alloc_object(sol_state_t *);
+sol_object_t *sol_alloc_container(sol_state_t *);
 
 #endif
 
-#define sol_decref(obj) (--((obj)->refcnt))
+#define sol_decref(obj) (sol_is_immortal(obj) ? (obj)->refcnt : --((obj)->refcnt))
+
+sol_object_t *sol_immortalize(sol_state_t *, sol_object_t *);
+void sol_release_immortals(sol_state_t *);
+
+/** Returns the collector header of a container. */
+#define SOL_GC_HEAD(obj) (((sol_gchead_t *) (obj)) - 1)
+/** Returns the container following a collector header. */
+#define SOL_GC_OBJ(head) ((sol_object_t *) ((head) + 1))
+
+void sol_gc_track(sol_state_t *, sol_object_t *);
+size_t sol_gc_collect(sol_state_t *);
 
 sol_object_t *sol_obj_acquire(sol_object_t *);
 void sol_obj_release(sol_object_t *);
@@ -15,7 +15,8 @@ int main(int argc, char **argv) {
 	int result = 0, compile = 0, compiled = 0, html = 0;
 	unsigned i;
 
-	state.features = 0;
+	// Scripts see a closed pipe or connection as a write error
+	state.features = SOL_FT_IGNORE_SIGPIPE;
 
 	if(argc > 1) {
 		c = argv[1];
@@ -133,17 +134,17 @@ int main(int argc, char **argv) {
 
 out_results:
 
-	if(sol_has_error(&state)) {
-		printf("Error: ");
-		ob_print(state.error);
-		printf("\n");
+	if(clean && sol_has_error(&state)) {
+		ob_printf(&state, "Error: ");
+		ob_print(&state, state.error);
+		ob_printf(&state, "\n");
 		result = 1;
 	}
 
-	if(state.ret) {
-		printf("Toplevel return: ");
-		ob_print(state.ret);
-		printf("\n");
+	if(clean && state.ret) {
+		ob_printf(&state, "Toplevel return: ");
+		ob_print(&state, state.ret);
+		ob_printf(&state, "\n");
 		if(sol_is_int(state.ret)) {
 			result = state.ret->ival;
 		}
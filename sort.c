@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+
+/* The stable sort behind list:sort.
+ *
+ * This is a simplified TimSort: the list is cut into natural runs (strictly
+ * descending ones are reversed), short runs are extended to a minimum length
+ * with binary insertion sort, and runs are merged from a stack that keeps
+ * their lengths balanced. Before each merge, the prefix of the left run and
+ * the suffix of the right run that are already in place are found by binary
+ * search and skipped, so presorted and nearly sorted input is cheap.
+ *
+ * Only "less than" is ever asked, and an element is only taken from the right
+ * before an equal one from the left if it is strictly less, which is what
+ * makes the sort stable. When every key is a number, or every key a string or
+ * sized buffer, keys are compared natively (ints with ints and floats with
+ * floats without conversion); otherwise, each comparison calls the keys' cmp
+ * method or the cmp function given. Key functions are called once per item.
+ */
+
+typedef struct {
+	sol_object_t *key;
+	sol_object_t *item;
+} _sol_sortitem_t;
+
+typedef struct _sol_sort_t {
+	sol_state_t *state;
+	int (*lt)(struct _sol_sort_t *, sol_object_t *, sol_object_t *);
+	sol_object_t *cmp; // The cmp function, or NULL
+	sol_object_t *fargs; // Reused as the arguments to every call
+	int failed; // Set once a comparison raises an error
+	_sol_sortitem_t *tmp;
+} _sol_sort_t;
+
+/** The maximum number of pending runs; TimSort's invariants keep the stack
+ * logarithmic in the length of the list. */
+#define SOL_SORT_STACK 85
+
+static int _sol_sort_lt_int(_sol_sort_t *ctx, sol_object_t *a, sol_object_t *b) {
+	return a->ival < b->ival;
+}
+
+static int _sol_sort_lt_float(_sol_sort_t *ctx, sol_object_t *a, sol_object_t *b) {
+	return a->fval < b->fval;
+}
+
+static int _sol_sort_lt_number(_sol_sort_t *ctx, sol_object_t *a, sol_object_t *b) {
+	return (sol_is_int(a) ? (double) a->ival : a->fval) < (sol_is_int(b) ? (double) b->ival : b->fval);
+}
+
+// Strings compare as their bytes; sized buffers as their string form.
+static void _sol_sort_bytes(sol_object_t *obj, const char **s, size_t *len) {
+	if(sol_is_string(obj)) {
+		*s = obj->str;
+		*len = obj->slen;
+	} else {
+		*s = obj->mem->buffer;
+		*len = strnlen(*s, obj->mem->sz);
+	}
+}
+
+static int _sol_sort_lt_bytes(_sol_sort_t *ctx, sol_object_t *a, sol_object_t *b) {
+	const char *sa, *sb;
+	size_t la, lb;
+	int res;
+	_sol_sort_bytes(a, &sa, &la);
+	_sol_sort_bytes(b, &sb, &lb);
+	res = memcmp(sa, sb, la < lb ? la : lb);
+	return res ? res < 0 : la < lb;
+}
+
+static int _sol_sort_result(_sol_sort_t *ctx, sol_object_t *res) {
+	sol_object_t *ires;
+	int lt = 0;
+	if(sol_has_error(ctx->state)) {
+		ctx->failed = 1;
+	} else {
+		ires = sol_cast_int(ctx->state, res);
+		lt = sol_is_int(ires) && ires->ival < 0;
+		sol_obj_free(ires);
+	}
+	sol_obj_free(res);
+	return lt;
+}
+
+static int _sol_sort_lt_method(_sol_sort_t *ctx, sol_object_t *a, sol_object_t *b) {
+	if(ctx->failed) {
+		return 0;
+	}
+	sol_list_set_index(ctx->state, ctx->fargs, 0, a);
+	sol_list_set_index(ctx->state, ctx->fargs, 1, b);
+	return _sol_sort_result(ctx, CALL_METHOD(ctx->state, a, cmp, ctx->fargs));
+}
+
+static int _sol_sort_lt_func(_sol_sort_t *ctx, sol_object_t *a, sol_object_t *b) {
+	if(ctx->failed) {
+		return 0;
+	}
+	sol_list_set_index(ctx->state, ctx->fargs, 1, a);
+	sol_list_set_index(ctx->state, ctx->fargs, 2, b);
+	return _sol_sort_result(ctx, CALL_METHOD(ctx->state, ctx->cmp, call, ctx->fargs));
+}
+
+#define LT(a, b) (ctx->lt(ctx, (a).key, (b).key))
+
+// Sorts items[0:n], of which items[0:sorted] already are.
+static void _sol_sort_insertion(_sol_sort_t *ctx, _sol_sortitem_t *items, size_t sorted, size_t n) {
+	_sol_sortitem_t pivot;
+	size_t lo, hi, mid;
+	for(; sorted < n; sorted++) {
+		pivot = items[sorted];
+		lo = 0;
+		hi = sorted;
+		while(lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if(LT(pivot, items[mid])) {
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		memmove(items + lo + 1, items + lo, (sorted - lo) * sizeof(_sol_sortitem_t));
+		items[lo] = pivot;
+	}
+}
+
+// Returns the length of the run starting at items[0], made ascending.
+static size_t _sol_sort_run(_sol_sort_t *ctx, _sol_sortitem_t *items, size_t n) {
+	size_t len = 1, i;
+	_sol_sortitem_t t;
+	if(n < 2) {
+		return n;
+	}
+	if(LT(items[1], items[0])) {
+		while(len < n && LT(items[len], items[len - 1])) {
+			len++;
+		}
+		for(i = 0; i < len / 2; i++) {
+			t = items[i];
+			items[i] = items[len - 1 - i];
+			items[len - 1 - i] = t;
+		}
+	} else {
+		while(len < n && !LT(items[len], items[len - 1])) {
+			len++;
+		}
+	}
+	return len;
+}
+
+static size_t _sol_sort_minrun(size_t n) {
+	size_t r = 0;
+	while(n >= 64) {
+		r |= n & 1;
+		n >>= 1;
+	}
+	return n + r;
+}
+
+// Merges the adjacent sorted runs a[0:na] and a[na:na+nb].
+static void _sol_sort_merge(_sol_sort_t *ctx, _sol_sortitem_t *a, size_t na, size_t nb) {
+	_sol_sortitem_t *b = a + na, *out, *l, *lend, *r, *rend;
+	size_t lo, hi, mid;
+	// Skip the prefix of a that no element of b goes before...
+	lo = 0;
+	hi = na;
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(LT(b[0], a[mid])) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	a += lo;
+	na -= lo;
+	if(!na) {
+		return;
+	}
+	// ...and the suffix of b that no element of a goes after.
+	lo = 0;
+	hi = nb;
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(LT(b[mid], a[na - 1])) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	nb = lo;
+	memcpy(ctx->tmp, a, na * sizeof(_sol_sortitem_t));
+	out = a;
+	l = ctx->tmp;
+	lend = l + na;
+	r = b;
+	rend = b + nb;
+	while(l < lend && r < rend) {
+		if(LT(*r, *l)) {
+			*out++ = *r++;
+		} else {
+			*out++ = *l++;
+		}
+	}
+	memcpy(out, l, (lend - l) * sizeof(_sol_sortitem_t));
+}
+
+static void _sol_sort_items(_sol_sort_t *ctx, _sol_sortitem_t *items, size_t n) {
+	size_t base[SOL_SORT_STACK], len[SOL_SORT_STACK], sp = 0, lo = 0, run, force, minrun = _sol_sort_minrun(n), i;
+	while(lo < n) {
+		run = _sol_sort_run(ctx, items + lo, n - lo);
+		if(run < minrun) {
+			force = n - lo < minrun ? n - lo : minrun;
+			_sol_sort_insertion(ctx, items + lo, run, force);
+			run = force;
+		}
+		base[sp] = lo;
+		len[sp++] = run;
+		lo += run;
+		// Keep len[i - 2] > len[i - 1] + len[i] and len[i - 1] > len[i] for
+		// the runs on the stack, merging until they hold.
+		while(sp > 1) {
+			i = sp - 2;
+			if((i > 0 && len[i - 1] <= len[i] + len[i + 1]) || (i > 1 && len[i - 2] <= len[i - 1] + len[i])) {
+				if(len[i - 1] < len[i + 1]) {
+					i--;
+				}
+			} else if(len[i] > len[i + 1]) {
+				break;
+			}
+			_sol_sort_merge(ctx, items + base[i], len[i], len[i + 1]);
+			len[i] += len[i + 1];
+			memmove(base + i + 1, base + i + 2, (sp - i - 2) * sizeof(size_t));
+			memmove(len + i + 1, len + i + 2, (sp - i - 2) * sizeof(size_t));
+			sp--;
+		}
+	}
+	while(sp > 1) {
+		i = sp - 2;
+		if(i > 0 && len[i - 1] < len[i + 1]) {
+			i--;
+		}
+		_sol_sort_merge(ctx, items + base[i], len[i], len[i + 1]);
+		len[i] += len[i + 1];
+		memmove(base + i + 1, base + i + 2, (sp - i - 2) * sizeof(size_t));
+		memmove(len + i + 1, len + i + 2, (sp - i - 2) * sizeof(size_t));
+		sp--;
+	}
+}
+
+int sol_list_sort(sol_state_t *state, sol_object_t *list, sol_object_t *key, sol_object_t *cmp) {
+	_sol_sort_t ctx;
+	_sol_sortitem_t *items;
+	size_t n = sol_list_len(state, list), i;
+	int kinds = 0, res = 0;
+	items = malloc((n ? n : 1) * sizeof(_sol_sortitem_t));
+	ctx.tmp = malloc((n ? n : 1) * sizeof(_sol_sortitem_t));
+	if(!items || !ctx.tmp) {
+		free(items);
+		free(ctx.tmp);
+		sol_obj_free(sol_set_error(state, state->OutOfMemory));
+		return 1;
+	}
+	ctx.state = state;
+	ctx.cmp = cmp;
+	ctx.failed = 0;
+	ctx.fargs = sol_new_list(state);
+	sol_list_insert(state, ctx.fargs, 0, key ? key : state->None);
+	sol_list_insert(state, ctx.fargs, 1, state->None);
+	// Hold a reference to every item (and key), in case a key or cmp function
+	// changes the list while it's being sorted.
+	for(i = 0; i < n; i++) {
+		items[i].item = sol_list_get_index(state, list, i);
+		if(key && !ctx.failed) {
+			sol_list_set_index(state, ctx.fargs, 1, items[i].item);
+			items[i].key = CALL_METHOD(state, key, call, ctx.fargs);
+			ctx.failed = sol_has_error(state);
+		} else {
+			items[i].key = sol_incref(items[i].item);
+		}
+		if(sol_is_int(items[i].key)) {
+			kinds |= 1;
+		} else if(sol_is_float(items[i].key)) {
+			kinds |= 2;
+		} else if(sol_is_string(items[i].key) || (sol_is_buffer(items[i].key) && items[i].key->mem->sz >= 0)) {
+			kinds |= 4;
+		} else {
+			kinds |= 8;
+		}
+	}
+	if(!ctx.failed) {
+		if(cmp) {
+			sol_list_set_index(state, ctx.fargs, 0, cmp);
+			sol_list_insert(state, ctx.fargs, 2, state->None);
+			ctx.lt = _sol_sort_lt_func;
+		} else if(kinds == 1) {
+			ctx.lt = _sol_sort_lt_int;
+		} else if(kinds == 2) {
+			ctx.lt = _sol_sort_lt_float;
+		} else if(kinds == 3) {
+			ctx.lt = _sol_sort_lt_number;
+		} else if(kinds == 4) {
+			ctx.lt = _sol_sort_lt_bytes;
+		} else {
+			ctx.lt = _sol_sort_lt_method;
+		}
+		_sol_sort_items(&ctx, items, n);
+	}
+	if(ctx.failed) {
+		res = 1;
+	} else if(sol_list_len(state, list) != n) {
+		sol_obj_free(sol_set_error_string(state, "List changed size during sort"));
+		res = 1;
+	} else {
+		sol_list_unshare(state, list);
+		for(i = 0; i < n; i++) {
+			dsl_seq_set(list->seq, i, items[i].item);
+		}
+	}
+	for(i = 0; i < n; i++) {
+		sol_obj_free(items[i].key);
+		sol_obj_free(items[i].item);
+	}
+	sol_obj_free(ctx.fargs);
+	free(items);
+	free(ctx.tmp);
+	return res;
+}
@@ -2,8 +2,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 #include <termios.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include "ast.h"
 
 #define TMP_PATH_SZ 256
@@ -33,6 +36,8 @@ int sol_state_init(sol_state_t *state) {
 
 	state->None = NULL;
 	state->OutOfMemory = NULL;
+	state->interned = NULL;
+	state->immortal_init = 0;
 	state->scopes = NULL;
 	state->error = NULL;
 	state->traceback = NULL;
@@ -40,6 +45,9 @@ int sol_state_init(sol_state_t *state) {
 	state->sflag = SF_NORMAL;
 	state->lastvalue = NULL;
 	state->loopvalue = NULL;
+	memset(state->fmtcache, 0, sizeof(state->fmtcache));
+	memset(state->packcache, 0, sizeof(state->packcache));
+	memset(state->pool, 0, sizeof(state->pool));
 
 #ifdef DEBUG_GC
 	// This is necessary for DEBUG_GC's early allocation; it gets overwritten,
@@ -47,13 +55,21 @@ int sol_state_init(sol_state_t *state) {
 	state->SingletOps.tname = "singlet";
 #endif
 
+	state->immortals = dsl_seq_new_array(NULL, NULL);
+
+	if(state->features & SOL_FT_IGNORE_SIGPIPE) {
+		signal(SIGPIPE, SIG_IGN);
+	}
+
 	// If any of the following fail, some very weird things are happening.
 	if(!(state->None = sol_new_singlet(state, "None"))) {
 		goto cleanup;
 	}
+	sol_immortalize(state, state->None);
 	if(!(state->OutOfMemory = sol_new_singlet(state, "OutOfMemory"))) {
 		goto cleanup;
 	}
+	sol_immortalize(state, state->OutOfMemory);
 
 	// We can now use the normal error reporting mechanism, now
 	// that errors are distinguishable. Set that up now.
@@ -77,6 +93,10 @@ int sol_state_init(sol_state_t *state) {
 	state->DyLibOps = state->NullOps;
 	state->DySymOps = state->NullOps;
 	state->StreamOps = state->NullOps;
+	state->IterOps = state->NullOps;
+	state->ArrayOps = state->NullOps;
+	state->UnpackIterOps = state->NullOps;
+	state->EventLoopOps = state->NullOps;
 
 	state->SingletOps.tname = "singlet";
 	state->SingletOps.tostring = sol_f_singlet_tostring;
@@ -208,9 +228,34 @@ int sol_state_init(sol_state_t *state) {
 	state->StreamOps.blsh = sol_f_stream_blsh;
 	state->StreamOps.brsh = sol_f_stream_brsh;
 	state->StreamOps.index = sol_f_stream_index;
+	state->StreamOps.iter = sol_f_stream_iter;
 	state->StreamOps.free = sol_f_stream_free;
 	state->StreamOps.tostring = sol_f_stream_tostring;
 
+	state->IterOps.tname = "iterator";
+	state->IterOps.call = sol_f_lazy_iter_call;
+	state->IterOps.iter = sol_f_lazy_iter_iter;
+	state->IterOps.free = sol_f_lazy_iter_free;
+
+	state->ArrayOps.tname = "array";
+	state->ArrayOps.index = sol_f_array_index;
+	state->ArrayOps.setindex = sol_f_array_setindex;
+	state->ArrayOps.len = sol_f_array_len;
+	state->ArrayOps.iter = sol_f_array_iter;
+	state->ArrayOps.cmp = sol_f_array_cmp;
+	state->ArrayOps.tostring = sol_f_array_tostring;
+	state->ArrayOps.free = sol_f_array_free;
+
+	state->UnpackIterOps.tname = "unpack_iterator";
+	state->UnpackIterOps.call = sol_f_unpack_iter_call;
+	state->UnpackIterOps.iter = sol_f_unpack_iter_iter;
+	state->UnpackIterOps.free = sol_f_unpack_iter_free;
+
+	state->EventLoopOps.tname = "event_loop";
+	state->EventLoopOps.index = sol_f_event_loop_index;
+	state->EventLoopOps.tostring = sol_f_event_loop_tostring;
+	state->EventLoopOps.free = sol_f_event_loop_free;
+
 #ifdef DEBUG_GC
 	state->obfuncs.copy = (dsl_copier) _sol_gc_dsl_copier;
 	state->obfuncs.destr = (dsl_destructor) _sol_gc_dsl_destructor;
@@ -222,11 +267,15 @@ int sol_state_init(sol_state_t *state) {
 #ifdef SOL_ICACHE
 	state->icache_bypass = 1;
 	for(i = 0; i <= (SOL_ICACHE_MAX - SOL_ICACHE_MIN); i++) {
-		state->icache[i] = sol_new_int(state, ((long) i) + SOL_ICACHE_MIN);
+		state->icache[i] = sol_immortalize(state, sol_new_int(state, ((long) i) + SOL_ICACHE_MIN));
 	}
 	state->icache_bypass = 0;
 #endif
 
+	state->interned = sol_new_map(state);
+	// Builtins live as long as the state; see sol_new_cfunc.
+	state->immortal_init = 1;
+
 	state->calling_type = "(none)";
 	state->calling_meth = "(none)";
 
@@ -239,8 +288,9 @@ int sol_state_init(sol_state_t *state) {
 		goto cleanup;
 	}
 	globals = sol_new_map(state);
-	state->modules = sol_new_map(state);
-	state->methods = sol_new_map(state);
+	// These are immortal because the debug module refers back to them.
+	state->modules = sol_immortalize(state, sol_new_map(state));
+	state->methods = sol_immortalize(state, sol_new_map(state));
 	if(sol_has_error(state)) {
 		goto cleanup;
 	}
@@ -262,6 +312,7 @@ int sol_state_init(sol_state_t *state) {
 	sol_map_borrow_name(state, globals, "toint", sol_new_cfunc(state, sol_f_toint, "toint"));
 	sol_map_borrow_name(state, globals, "tofloat", sol_new_cfunc(state, sol_f_tofloat, "tofloat"));
 	sol_map_borrow_name(state, globals, "tostring", sol_new_cfunc(state, sol_f_tostring, "tostring"));
+	sol_map_borrow_name(state, globals, "format", sol_new_cfunc(state, sol_f_format, "format"));
 	sol_map_borrow_name(state, globals, "tobuffer", sol_new_cfunc(state, sol_f_tobuffer, "tobuffer"));
 	sol_map_borrow_name(state, globals, "try", sol_new_cfunc(state, sol_f_try, "try"));
 	sol_map_borrow_name(state, globals, "apply", sol_new_cfunc(state, sol_f_apply, "apply"));
@@ -296,6 +347,9 @@ int sol_state_init(sol_state_t *state) {
 	sol_map_borrow_name(state, mod, "modules", state->modules);
 	sol_map_borrow_name(state, mod, "methods", state->methods);
 	sol_map_borrow_name(state, mod, "getops", sol_new_cfunc(state, sol_f_debug_getops, "debug.getops"));
+	sol_map_borrow_name(state, mod, "gc_collect", sol_new_cfunc(state, sol_f_debug_gc_collect, "debug.gc_collect"));
+	sol_map_borrow_name(state, mod, "gc_stats", sol_new_cfunc(state, sol_f_debug_gc_stats, "debug.gc_stats"));
+	sol_map_borrow_name(state, mod, "gc_threshold", sol_new_cfunc(state, sol_f_debug_gc_threshold, "debug.gc_threshold"));
 	sol_register_module_name(state, "debug", mod);
 	sol_obj_free(mod);
 
@@ -303,7 +357,16 @@ int sol_state_init(sol_state_t *state) {
 	sol_map_borrow_name(state, mod, "str", sol_new_cfunc(state, sol_f_iter_str, "iter.str"));
 	sol_map_borrow_name(state, mod, "buffer", sol_new_cfunc(state, sol_f_iter_buffer, "iter.buffer"));
 	sol_map_borrow_name(state, mod, "list", sol_new_cfunc(state, sol_f_iter_list, "iter.list"));
+	sol_map_borrow_name(state, mod, "stream", sol_new_cfunc(state, sol_f_iter_stream, "iter.stream"));
+	sol_map_borrow_name(state, mod, "array", sol_new_cfunc(state, sol_f_iter_array, "iter.array"));
+	sol_map_borrow_name(state, mod, "keys", sol_new_cfunc(state, sol_f_iter_keys, "iter.keys"));
 	sol_map_borrow_name(state, mod, "map", sol_new_cfunc(state, sol_f_iter_map, "iter.map"));
+	sol_map_borrow_name(state, mod, "filter", sol_new_cfunc(state, sol_f_iter_filter, "iter.filter"));
+	sol_map_borrow_name(state, mod, "zip", sol_new_cfunc(state, sol_f_iter_zip, "iter.zip"));
+	sol_map_borrow_name(state, mod, "enumerate", sol_new_cfunc(state, sol_f_iter_enumerate, "iter.enumerate"));
+	sol_map_borrow_name(state, mod, "take", sol_new_cfunc(state, sol_f_iter_take, "iter.take"));
+	sol_map_borrow_name(state, mod, "chain", sol_new_cfunc(state, sol_f_iter_chain, "iter.chain"));
+	sol_map_borrow_name(state, mod, "collect", sol_new_cfunc(state, sol_f_iter_collect, "iter.collect"));
 	sol_register_module_name(state, "iter", mod);
 	sol_obj_free(mod);
 
@@ -434,6 +497,7 @@ int sol_state_init(sol_state_t *state) {
 	sol_map_borrow_name(state, mod, "fromstring", sol_new_cfunc(state, sol_f_buffer_fromstring, "buffer.fromstring"));
 	sol_map_borrow_name(state, mod, "fromobject", sol_new_cfunc(state, sol_f_buffer_fromobject, "buffer.fromobject"));
 	sol_map_borrow_name(state, mod, "fromaddress", sol_new_cfunc(state, sol_f_buffer_fromaddress, "buffer.fromaddress"));
+	sol_map_borrow_name(state, mod, "calcsize", sol_new_cfunc(state, sol_f_buffer_calcsize, "buffer.calcsize"));
 	sol_map_set_name(state, mod, "type", btype);
 	sol_map_set_name(state, mod, "sizeof", bsize);
 	sol_map_set_name(state, mod, "objtype", bobj);
@@ -443,6 +507,13 @@ int sol_state_init(sol_state_t *state) {
 	sol_obj_free(bsize);
 	sol_obj_free(btype);
 
+	mod = sol_new_map(state);
+	sol_map_borrow_name(state, mod, "new", sol_new_cfunc(state, sol_f_array_new, "array.new"));
+	sol_map_borrow_name(state, mod, "frombuffer", sol_new_cfunc(state, sol_f_array_frombuffer, "array.frombuffer"));
+	sol_map_borrow_name(state, mod, "fromlist", sol_new_cfunc(state, sol_f_array_fromlist, "array.fromlist"));
+	sol_register_module_name(state, "array", mod);
+	sol_obj_free(mod);
+
 	mod = sol_new_map(state);
 	sol_map_borrow_name(state, mod, "MODE_READ", sol_new_int(state, MODE_READ));
 	sol_map_borrow_name(state, mod, "MODE_WRITE", sol_new_int(state, MODE_WRITE));
@@ -456,12 +527,71 @@ int sol_state_init(sol_state_t *state) {
 	sol_map_borrow_name(state, mod, "LINE", sol_new_buffer(state, "LINE", 4, OWN_NONE, NULL, NULL));
 	sol_map_borrow_name(state, mod, "TIOCGWINSZ", sol_new_int(state, TIOCGWINSZ));
 	sol_map_borrow_name(state, mod, "TIOCSWINSZ", sol_new_int(state, TIOCSWINSZ));
+	sol_map_borrow_name(state, mod, "MADV_NORMAL", sol_new_int(state, MADV_NORMAL));
+	sol_map_borrow_name(state, mod, "MADV_RANDOM", sol_new_int(state, MADV_RANDOM));
+	sol_map_borrow_name(state, mod, "MADV_SEQUENTIAL", sol_new_int(state, MADV_SEQUENTIAL));
+	sol_map_borrow_name(state, mod, "MADV_WILLNEED", sol_new_int(state, MADV_WILLNEED));
+	sol_map_borrow_name(state, mod, "MADV_DONTNEED", sol_new_int(state, MADV_DONTNEED));
 	sol_map_borrow_name(state, mod, "open", sol_new_cfunc(state, sol_f_stream_open, "io.open"));
+	sol_map_borrow_name(state, mod, "mmap", sol_new_cfunc(state, sol_f_io_mmap, "io.mmap"));
+	sol_map_borrow_name(state, mod, "copy", sol_new_cfunc(state, sol_f_io_copy, "io.copy"));
+	sol_map_borrow_name(state, mod, "memstream", sol_new_cfunc(state, sol_f_io_memstream, "io.memstream"));
+	sol_map_borrow_name(state, mod, "frombuffer", sol_new_cfunc(state, sol_f_io_frombuffer, "io.frombuffer"));
 	sol_map_borrow_name(state, mod, "__setindex", sol_new_cfunc(state, sol_f_io_setindex, "io.__setindex"));
 	sol_map_borrow_name(state, mod, "__index", sol_new_cfunc(state, sol_f_io_index, "io.__index"));
 	sol_register_module_name(state, "io", mod);
 	sol_obj_free(mod);
 
+	mod = sol_new_map(state);
+	sol_map_borrow_name(state, mod, "SHUT_RD", sol_new_int(state, SHUT_RD));
+	sol_map_borrow_name(state, mod, "SHUT_WR", sol_new_int(state, SHUT_WR));
+	sol_map_borrow_name(state, mod, "SHUT_RDWR", sol_new_int(state, SHUT_RDWR));
+	sol_map_borrow_name(state, mod, "listen", sol_new_cfunc(state, sol_f_net_listen, "net.listen"));
+	sol_map_borrow_name(state, mod, "listen_unix", sol_new_cfunc(state, sol_f_net_listen_unix, "net.listen_unix"));
+	sol_map_borrow_name(state, mod, "connect", sol_new_cfunc(state, sol_f_net_connect, "net.connect"));
+	sol_map_borrow_name(state, mod, "connect_unix", sol_new_cfunc(state, sol_f_net_connect_unix, "net.connect_unix"));
+	sol_map_borrow_name(state, mod, "accept", sol_new_cfunc(state, sol_f_net_accept, "net.accept"));
+	sol_map_borrow_name(state, mod, "address", sol_new_cfunc(state, sol_f_net_address, "net.address"));
+	sol_map_borrow_name(state, mod, "peer", sol_new_cfunc(state, sol_f_net_peer, "net.peer"));
+	sol_map_borrow_name(state, mod, "shutdown", sol_new_cfunc(state, sol_f_net_shutdown, "net.shutdown"));
+	sol_map_borrow_name(state, mod, "setblocking", sol_new_cfunc(state, sol_f_net_setblocking, "net.setblocking"));
+	sol_map_borrow_name(state, mod, "nodelay", sol_new_cfunc(state, sol_f_net_nodelay, "net.nodelay"));
+	sol_map_borrow_name(state, mod, "error", sol_new_cfunc(state, sol_f_net_error, "net.error"));
+	sol_register_module_name(state, "net", mod);
+	sol_obj_free(mod);
+
+	mod = sol_new_map(state);
+	sol_map_borrow_name(state, mod, "READ", sol_new_int(state, 1));
+	sol_map_borrow_name(state, mod, "WRITE", sol_new_int(state, 2));
+	sol_map_borrow_name(state, mod, "loop", sol_new_cfunc(state, sol_f_event_loop, "event.loop"));
+	sol_map_borrow_name(state, mod, "now", sol_new_cfunc(state, sol_f_event_now, "event.now"));
+	sol_register_module_name(state, "event", mod);
+	sol_obj_free(mod);
+
+	mod = sol_new_map(state);
+	sol_map_borrow_name(state, mod, "parse_request", sol_new_cfunc(state, sol_f_http_parse_request, "http.parse_request"));
+	sol_map_borrow_name(state, mod, "parse_response", sol_new_cfunc(state, sol_f_http_parse_response, "http.parse_response"));
+	sol_map_borrow_name(state, mod, "header", sol_new_cfunc(state, sol_f_http_header, "http.header"));
+	sol_map_borrow_name(state, mod, "reason", sol_new_cfunc(state, sol_f_http_reason, "http.reason"));
+	sol_map_borrow_name(state, mod, "write_response", sol_new_cfunc(state, sol_f_http_write_response, "http.write_response"));
+	sol_register_module_name(state, "http", mod);
+	sol_obj_free(mod);
+
+	mod = sol_new_map(state);
+	sol_map_borrow_name(state, mod, "decode", sol_new_cfunc(state, sol_f_json_decode, "json.decode"));
+	sol_map_borrow_name(state, mod, "encode", sol_new_cfunc(state, sol_f_json_encode, "json.encode"));
+	sol_map_borrow_name(state, mod, "dump", sol_new_cfunc(state, sol_f_json_dump, "json.dump"));
+	sol_register_module_name(state, "json", mod);
+	sol_obj_free(mod);
+
+	mod = sol_new_map(state);
+	sol_map_borrow_name(state, mod, "dumps", sol_new_cfunc(state, sol_f_marshal_dumps, "marshal.dumps"));
+	sol_map_borrow_name(state, mod, "loads", sol_new_cfunc(state, sol_f_marshal_loads, "marshal.loads"));
+	sol_map_borrow_name(state, mod, "dump", sol_new_cfunc(state, sol_f_marshal_dump, "marshal.dump"));
+	sol_map_borrow_name(state, mod, "load", sol_new_cfunc(state, sol_f_marshal_load, "marshal.load"));
+	sol_register_module_name(state, "marshal", mod);
+	sol_obj_free(mod);
+
 	meths = sol_new_map(state);
 	sol_map_borrow_name(state, meths, "get", sol_new_cfunc(state, sol_f_buffer_get, "buffer.get"));
 	sol_map_borrow_name(state, meths, "set", sol_new_cfunc(state, sol_f_buffer_set, "buffer.set"));
@@ -470,6 +600,12 @@ int sol_state_init(sol_state_t *state) {
 	sol_map_borrow_name(state, meths, "sub", sol_new_cfunc(state, sol_f_buffer_sub, "buffer.sub"));
 	sol_map_borrow_name(state, meths, "split", sol_new_cfunc(state, sol_f_buffer_split, "buffer.split"));
 	sol_map_borrow_name(state, meths, "find", sol_new_cfunc(state, sol_f_buffer_find, "buffer.find"));
+	sol_map_borrow_name(state, meths, "format", sol_new_cfunc(state, sol_f_format, "buffer.format"));
+	sol_map_borrow_name(state, meths, "count", sol_new_cfunc(state, sol_f_buffer_count, "buffer.count"));
+	sol_map_borrow_name(state, meths, "pack", sol_new_cfunc(state, sol_f_buffer_pack, "buffer.pack"));
+	sol_map_borrow_name(state, meths, "unpack", sol_new_cfunc(state, sol_f_buffer_unpack, "buffer.unpack"));
+	sol_map_borrow_name(state, meths, "unpack_iter", sol_new_cfunc(state, sol_f_buffer_unpack_iter, "buffer.unpack_iter"));
+	sol_map_borrow_name(state, meths, "madvise", sol_new_cfunc(state, sol_f_buffer_madvise, "buffer.madvise"));
 	sol_register_methods_name(state, "buffer", meths);
 	sol_obj_free(meths);
 
@@ -481,25 +617,60 @@ int sol_state_init(sol_state_t *state) {
 	sol_map_borrow_name(state, meths, "map", sol_new_cfunc(state, sol_f_list_map, "list.map"));
 	sol_map_borrow_name(state, meths, "filter", sol_new_cfunc(state, sol_f_list_filter, "list.filter"));
 	sol_map_borrow_name(state, meths, "reduce", sol_new_cfunc(state, sol_f_list_reduce, "list.reduce"));
+	sol_map_borrow_name(state, meths, "sort", sol_new_cfunc(state, sol_f_list_sort, "list.sort"));
 	sol_register_methods_name(state, "list", meths);
 	sol_obj_free(meths);
 
+	meths = sol_new_map(state);
+	sol_map_borrow_name(state, meths, "add", sol_new_cfunc(state, sol_f_array_add, "array.add"));
+	sol_map_borrow_name(state, meths, "mul", sol_new_cfunc(state, sol_f_array_mul, "array.mul"));
+	sol_map_borrow_name(state, meths, "min", sol_new_cfunc(state, sol_f_array_min, "array.min"));
+	sol_map_borrow_name(state, meths, "max", sol_new_cfunc(state, sol_f_array_max, "array.max"));
+	sol_map_borrow_name(state, meths, "sum", sol_new_cfunc(state, sol_f_array_sum, "array.sum"));
+	sol_map_borrow_name(state, meths, "dot", sol_new_cfunc(state, sol_f_array_dot, "array.dot"));
+	sol_map_borrow_name(state, meths, "fill", sol_new_cfunc(state, sol_f_array_fill, "array.fill"));
+	sol_map_borrow_name(state, meths, "copy", sol_new_cfunc(state, sol_f_array_copy, "array.copy"));
+	sol_map_borrow_name(state, meths, "compare", sol_new_cfunc(state, sol_f_array_compare, "array.compare"));
+	sol_map_borrow_name(state, meths, "tolist", sol_new_cfunc(state, sol_f_array_tolist, "array.tolist"));
+	sol_map_borrow_name(state, meths, "buffer", sol_new_cfunc(state, sol_f_array_buffer, "array.buffer"));
+	sol_map_borrow_name(state, meths, "dtype", sol_new_cfunc(state, sol_f_array_dtype, "array.dtype"));
+	sol_register_methods_name(state, "array", meths);
+	sol_obj_free(meths);
+
 	meths = sol_new_map(state);
 	sol_map_borrow_name(state, meths, "read", sol_new_cfunc(state, sol_f_stream_read_buffer, "stream.read_buffer"));
 	sol_map_borrow_name(state, meths, "read_buffer", sol_new_cfunc(state, sol_f_stream_read_buffer, "stream.read_buffer"));
+	sol_map_borrow_name(state, meths, "readinto", sol_new_cfunc(state, sol_f_stream_readinto, "stream.readinto"));
 	sol_map_borrow_name(state, meths, "write", sol_new_cfunc(state, sol_f_stream_write, "stream.write"));
 	sol_map_borrow_name(state, meths, "seek", sol_new_cfunc(state, sol_f_stream_seek, "stream.seek"));
 	sol_map_borrow_name(state, meths, "tell", sol_new_cfunc(state, sol_f_stream_tell, "stream.tell"));
 	sol_map_borrow_name(state, meths, "flush", sol_new_cfunc(state, sol_f_stream_flush, "stream.flush"));
+	sol_map_borrow_name(state, meths, "setbuffer", sol_new_cfunc(state, sol_f_stream_setbuffer, "stream.setbuffer"));
+	sol_map_borrow_name(state, meths, "pending", sol_new_cfunc(state, sol_f_stream_pending, "stream.pending"));
+	sol_map_borrow_name(state, meths, "sendfile", sol_new_cfunc(state, sol_f_stream_sendfile, "stream.sendfile"));
+	sol_map_borrow_name(state, meths, "getbuffer", sol_new_cfunc(state, sol_f_stream_getbuffer, "stream.getbuffer"));
 	sol_map_borrow_name(state, meths, "eof", sol_new_cfunc(state, sol_f_stream_eof, "stream.eof"));
 	sol_map_borrow_name(state, meths, "ioctl", sol_new_cfunc(state, sol_f_stream_ioctl, "stream.ioctl"));
 	sol_register_methods_name(state, "stream", meths);
 	sol_obj_free(meths);
 
+	meths = sol_new_map(state);
+	sol_map_borrow_name(state, meths, "watch", sol_new_cfunc(state, sol_f_event_loop_watch, "event_loop.watch"));
+	sol_map_borrow_name(state, meths, "unwatch", sol_new_cfunc(state, sol_f_event_loop_unwatch, "event_loop.unwatch"));
+	sol_map_borrow_name(state, meths, "timer", sol_new_cfunc(state, sol_f_event_loop_timer, "event_loop.timer"));
+	sol_map_borrow_name(state, meths, "cancel", sol_new_cfunc(state, sol_f_event_loop_cancel, "event_loop.cancel"));
+	sol_map_borrow_name(state, meths, "run_once", sol_new_cfunc(state, sol_f_event_loop_run_once, "event_loop.run_once"));
+	sol_map_borrow_name(state, meths, "run", sol_new_cfunc(state, sol_f_event_loop_run, "event_loop.run"));
+	sol_map_borrow_name(state, meths, "stop", sol_new_cfunc(state, sol_f_event_loop_stop, "event_loop.stop"));
+	sol_register_methods_name(state, "event_loop", meths);
+	sol_obj_free(meths);
+
 	meths = sol_new_map(state);
 	sol_map_borrow_name(state, meths, "sub", sol_new_cfunc(state, sol_f_str_sub, "str.sub"));
 	sol_map_borrow_name(state, meths, "split", sol_new_cfunc(state, sol_f_str_split, "str.split"));
 	sol_map_borrow_name(state, meths, "find", sol_new_cfunc(state, sol_f_str_find, "str.find"));
+	sol_map_borrow_name(state, meths, "format", sol_new_cfunc(state, sol_f_format, "str.format"));
+	sol_map_borrow_name(state, meths, "count", sol_new_cfunc(state, sol_f_str_count, "str.count"));
 	sol_register_methods_name(state, "string", meths);
 	sol_obj_free(meths);
 
@@ -509,6 +680,8 @@ int sol_state_init(sol_state_t *state) {
 		goto cleanup;
 	}
 
+	state->immortal_init = 0;
+
 	// Perform initialization based on the user profile, if so requested.
 	
 	if(!(state->features & SOL_FT_NO_USR_INIT)) {
@@ -578,13 +751,19 @@ int sol_state_init(sol_state_t *state) {
 	return 1;
 
 cleanup:
-	sol_obj_free(state->None);
-	sol_obj_free(state->OutOfMemory);
+	state->immortal_init = 0;
+	sol_release_immortals(state);
 	return 0;
 }
 
 void sol_state_cleanup(sol_state_t *state) {
-	long i;
+	// Anything still buffered goes out even if something else keeps the streams alive
+	if(sol_is_stream(state->_stdout)) {
+		sol_stream_fflush(state, state->_stdout);
+	}
+	if(sol_is_stream(state->_stderr)) {
+		sol_stream_fflush(state, state->_stderr);
+	}
 	sol_obj_free(state->scopes);
 	sol_obj_free(state->error);
 	sol_obj_free(state->None);
@@ -595,14 +774,16 @@ void sol_state_cleanup(sol_state_t *state) {
 	if(state->ret) {
 		sol_obj_free(state->ret);
 	}
-#ifdef SOL_ICACHE
-	for(i = 0; i <= (SOL_ICACHE_MAX - SOL_ICACHE_MIN); i++) {
-		sol_obj_free(state->icache[i]);
-	}
-#endif
-	sol_obj_free(state->modules);
-	sol_obj_free(state->methods);
+	sol_obj_free(state->interned);
+	sol_format_cache_clear(state);
+	sol_pack_cache_clear(state);
+	// Reclaim any cycles left behind before the builtins go away.
+	sol_gc_collect(state);
+	// This includes the modules and methods, and so all the builtins.
+	sol_release_immortals(state);
 	sol_mm_finalize(state);
+	// Last, since freeing any of the above can return pooled buffers to it.
+	sol_buffer_pool_clear(state);
 }
 
 sol_object_t *sol_state_resolve(sol_state_t *state, sol_object_t *key) {
@@ -635,7 +816,7 @@ sol_object_t *sol_state_resolve(sol_state_t *state, sol_object_t *key) {
 }
 
 sol_object_t *sol_state_resolve_name(sol_state_t *state, const char *name) {
-	sol_object_t *key = sol_new_buffer(state, (char *) name, strlen(name), OWN_NONE, NULL, NULL), *temp;
+	sol_object_t *key = sol_intern(state, name), *temp;
 
 	if(sol_has_error(state)) {
 		return sol_incref(state->None);
@@ -670,7 +851,7 @@ void sol_state_assign(sol_state_t *state, sol_object_t *key, sol_object_t *val)
 }
 
 void sol_state_assign_name(sol_state_t *state, const char *name, sol_object_t *val) {
-	sol_object_t *key = sol_new_buffer(state, (char *) name, strlen(name), OWN_NONE, NULL, NULL);
+	sol_object_t *key = sol_intern(state, name);
 
 	if(sol_has_error(state)) {
 		return;
@@ -699,7 +880,7 @@ void sol_state_assign_l(sol_state_t *state, sol_object_t *key, sol_object_t *val
 }
 
 void sol_state_assign_l_name(sol_state_t *state, const char *name, sol_object_t *val) {
-	sol_object_t *key = sol_new_buffer(state, (char *) name, strlen(name), OWN_NONE, NULL, NULL);
+	sol_object_t *key = sol_intern(state, name);
 
 	if(sol_has_error(state)) {
 		return;
@@ -813,16 +994,19 @@ sol_object_t *sol_get_methods_name(sol_state_t *state, char *name) {
 sol_object_t *sol_f_io_index(sol_state_t *state, sol_object_t *args) {
 	sol_object_t *self = sol_list_get_index(state, args, 0), *name = sol_list_get_index(state, args, 1), *namestr = sol_cast_string(state, name), *res;
 	if(sol_string_eq(state, namestr, "stdin")) {
+		sol_obj_free(self);
 		sol_obj_free(name);
 		sol_obj_free(namestr);
 		return sol_incref(state->_stdin);
 	}
 	if(sol_string_eq(state, namestr, "stdout")) {
+		sol_obj_free(self);
 		sol_obj_free(name);
 		sol_obj_free(namestr);
 		return sol_incref(state->_stdout);
 	}
 	if(sol_string_eq(state, namestr, "stderr")) {
+		sol_obj_free(self);
 		sol_obj_free(name);
 		sol_obj_free(namestr);
 		return sol_incref(state->_stderr);
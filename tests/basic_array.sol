@@ -0,0 +1,83 @@
+execfile("tests/_lib.sol")
+
+a = array.new(buffer.type.double, 5)
+assert_eq(#a, 5, "length")
+assert_eq(a:tolist(), [0.0, 0.0, 0.0, 0.0, 0.0], "zeroed")
+a[2] = 1.5
+a[3] = 4
+assert_eq(a[2], 1.5, "get float")
+assert_eq(a[3], 4.0, "int stored as double")
+assert(try(func() return a[5] end)[0] == 0, "index out of range")
+
+a = array.fromlist([1, 2, 3, 4, 5, 6, 7], buffer.type.double)
+b = array.fromlist([7, 6, 5, 4, 3, 2, 1], buffer.type.double)
+assert_eq(a:sum(), 28.0, "double sum")
+assert_eq(a:dot(b), 84.0, "double dot")
+assert_eq(a:min(), 1.0, "double min reduce")
+assert_eq(a:max(), 7.0, "double max reduce")
+c = a:copy()
+c:add(b)
+assert_eq(c:tolist(), [8.0, 8.0, 8.0, 8.0, 8.0, 8.0, 8.0], "double add")
+assert_eq(a[0], 1.0, "copy is separate")
+c = a:copy()
+c:mul(2)
+assert_eq(c:tolist(), [2.0, 4.0, 6.0, 8.0, 10.0, 12.0, 14.0], "double mul scalar")
+c = a:copy()
+c:min(b)
+assert_eq(c:tolist(), [1.0, 2.0, 3.0, 4.0, 3.0, 2.0, 1.0], "double min")
+c = a:copy()
+c:max(4)
+assert_eq(c:tolist(), [4.0, 4.0, 4.0, 4.0, 5.0, 6.0, 7.0], "double max scalar")
+assert(try(func() a:add(array.new(buffer.type.double, 2)) end)[0] == 0, "length mismatch")
+assert(try(func() a:add(array.new(buffer.type.float, 7)) end)[0] == 0, "type mismatch")
+
+a = array.new(buffer.type.int32, 10)
+a:fill(3)
+assert_eq(a:sum(), 30, "fill and int32 sum")
+a[9] = 0 - 100
+assert_eq(a:sum(), 0 - 73, "negative int32 sum")
+assert_eq(a:min(), 0 - 100, "int32 min")
+a = array.fromlist([250, 10], buffer.type.uint8)
+a:add(10)
+assert_eq(a:tolist(), [4, 20], "uint8 wraps")
+a = array.new(buffer.type.uint8, 100)
+a:fill(255)
+assert_eq(a:sum(), 25500, "uint8 sum")
+a = array.fromlist([1, 2, 3], buffer.type.int16)
+assert_eq(a:dot(a), 14, "int16 dot")
+a = array.fromlist([0.5, 0.25], buffer.type.float)
+assert_eq(a:sum(), 0.75, "float sum")
+
+a = array.fromlist([1, 2, 3, 4], buffer.type.int64)
+b = array.fromlist([1, 2, 5, 0], buffer.type.int64)
+assert_eq(a:compare(b), 0 - 1, "compare less")
+assert_eq(b:compare(a), 1, "compare greater")
+assert_eq(a:compare(a:copy()), 0, "compare equal")
+assert_eq(a:compare(array.fromlist([1, 2, 3], buffer.type.int64)), 1, "compare longer")
+assert(a == a:copy(), "equal arrays")
+assert(a != b, "unequal arrays")
+
+buf = buffer.new(8)
+v = array.frombuffer(buf, buffer.type.uint16)
+assert_eq(#v, 4, "view length")
+v[0] = 258
+assert_eq(buf:get(buffer.type.uint8, 0), 2, "view shares buffer")
+assert_eq(buf:get(buffer.type.uint8, 1), 1, "view shares buffer")
+assert(try(func() return array.frombuffer(buf, buffer.type.cstr) end)[0] == 0, "non-numeric type")
+
+s = 0
+for x in array.fromlist([1, 2, 3], buffer.type.int8) do s += x end
+assert_eq(s, 6, "iterate")
+assert_eq(tostring(array.fromlist([1, 2], buffer.type.int8)), "array(int8, [1, 2])", "tostring")
+
+a = array.fromlist([1, 2], buffer.type.int32)
+assert(try(a.add, a, 0.5)[0] == 0, "non-integral scalar on an int array")
+assert_eq(a:tolist(), [1, 2], "refused scalar leaves the array alone")
+a:add(2.0)
+assert_eq(a:tolist(), [3, 4], "whole float scalar on an int array")
+assert(try(func() a[0] = 1.5 end)[0] == 0, "non-integral store into an int array")
+u = array.new(buffer.type.uint64, 2)
+u[0] = 0 - 1
+assert_eq(u[0], 18446744073709551615.0, "uint64 past the int range reads as a float")
+assert_eq(type(u:max()), "float", "uint64 max past the int range")
+assert_eq(u[1], 0, "small uint64 reads as an int")
@@ -0,0 +1,33 @@
+execfile("tests/_lib.sol")
+
+s = tostring(1)
+for i in range(100) do s += "2" end
+assert_eq(#s, 101, "string append in a loop")
+t = s
+s += "3"
+assert_eq(#t, 101, "append leaves an alias alone")
+assert_eq(#s, 102, "append after aliasing")
+
+b = "x" + ""
+for i in range(100) do b += "y" end
+assert_eq(#b, 101, "buffer append in a loop")
+c = b
+b += "z"
+assert_eq(#c, 101, "buffer append leaves an alias alone")
+
+lit = func() return "lit" end
+u = lit()
+u += "eral"
+assert_eq(lit(), "lit", "append leaves literals alone")
+
+g = tostring(5)
+func h() g += "6" return g end
+assert_eq(h(), "56", "append to an outer variable")
+assert_eq(g, "5", "append to an outer variable leaves it alone")
+
+m = {k = tostring(7)}
+m.k += "8"
+n = m + {}
+m.k += "9"
+assert_eq(m.k, "789", "append to a map value")
+assert_eq(n.k, "78", "append leaves map copies alone")
@@ -0,0 +1,25 @@
+execfile("tests/_lib.sol")
+
+func lit() return "constant" end
+assert_eq(lit():address(), lit():address(), "a literal evaluates to one shared constant")
+assert_eq(try(lit().set, lit(), buffer.type.char, "X")[0], 0, "literal buffers are immutable")
+assert_eq(try(lit()[2].set, lit()[2], buffer.type.char, "X")[0], 0, "views of literals are immutable")
+assert_eq(lit(), "constant", "a refused set leaves the literal intact")
+
+b = buffer.fromstring(lit())
+b:set(buffer.type.char, "C")
+assert_eq(b:get(buffer.type.cstr), "Constant", "copies of literals are mutable")
+assert_eq(lit(), "constant", "copies do not alias the literal")
+
+relit = lambda() "old" end
+e = relit.stmt.ret
+assert_eq(tostring(e()), "old", "literal node evaluates")
+e.str = "new"
+assert_eq(e(), "new", "setting a literal drops its cached constant")
+
+keep = lambda() "kept after its body" end
+k = keep()
+sub = k:sub(0, 4)
+keep.stmt = relit.stmt
+assert_eq(k, "kept after its body", "a literal outlives its node")
+assert_eq(sub, "kept", "a piece of a literal outlives its node")
@@ -0,0 +1,31 @@
+execfile("tests/_lib.sol")
+
+l = [1 2 3]
+c = l:copy()
+assert_eq(l, c, "list copy")
+c:insert(0, 0)
+assert_eq([1, 2, 3], l, "list copy insert leaves original")
+assert_eq([0, 1, 2, 3], c, "list copy insert")
+l[0] = 9
+assert_eq([9, 2, 3], l, "original setindex")
+assert_eq([0, 1, 2, 3], c, "original setindex leaves copy")
+
+d = l:copy()
+e = d:copy()
+d:remove(0)
+assert_eq([9, 2, 3], l, "copy of copy remove leaves original")
+assert_eq([2, 3], d, "copy of copy remove")
+assert_eq([9, 2, 3], e, "copy of copy remove leaves sibling")
+
+m = [1 2 3]:map(func(x) return x * 2 end)
+assert_eq([2, 4, 6], m, "list map")
+assert_eq([1, 2], [1] + [2], "list add")
+
+a = {x = 1}
+b = a + {}
+b.y = 2
+assert_none(a.y, "map copy setindex leaves original")
+assert_eq(2, b.y, "map copy setindex")
+b.x = None
+assert_eq(1, a.x, "map copy delete leaves original")
+assert_none(b.x, "map copy delete")
@@ -0,0 +1,33 @@
+execfile("tests/_lib.sol")
+
+assert_eq(format("a{}b{}c", 1, 2.5), "a1b2.5c", "automatic fields")
+assert_eq(format("{1}{0}{1}", "x", "y"), "yxy", "numbered fields")
+assert_eq(format("{{}} {}", 1), "{} 1", "escaped braces")
+assert_eq(format("no fields"), "no fields", "no fields")
+assert_eq("{} and {}":format(1, None), "1 and None", "buffer method")
+assert_eq(tostring("<{}>"):format("s"), "<s>", "string method")
+
+assert_eq(format("{:5d}|{:<6}|{:^7}|{:>4}|", 42, "hi", "mid", "r"), "   42|hi    |  mid  |   r|", "width and alignment")
+assert_eq(format("{:*^9}", "x"), "****x****", "fill")
+assert_eq(format("{:05d} {:+d} {:+d}", 0 - 42, 7, 0 - 7), "-0042 +7 -7", "sign and zero padding")
+assert_eq(format("{:x} {:X} {:o} {:b} {:x}", 255, 255, 8, 5, 0 - 255), "ff FF 10 101 -ff", "bases")
+assert_eq(format("{:.3f} {:08.2f} {:.2e}", 3.14159, 0.0 - 2.5, 12345.678), "3.142 -0002.50 1.23e+04", "precision")
+assert_eq(format("{} {:.1}", 0.1, 0.25), "0.1 0.2", "float defaults")
+assert_eq(format("{:.2}", "abcdef"), "ab", "string precision")
+assert_eq(format("{:r} {:r} {}", "q", [1, 2], [1, 2]), "'q' [1, 2] [1, 2]", "repr")
+assert_eq(format("{:d} {:.1f} {:.1f}", "12", 3, " 2.5"), "12 3.0 2.5", "conversion")
+
+for i in range(3) do s = format("{} of {}", i, 3) end
+assert_eq(s, "2 of 3", "cached in a loop")
+
+assert(try(format, "{")[0] == 0, "unterminated field")
+assert(try(format, "}")[0] == 0, "single close brace")
+assert(try(format, "{:q}", 1)[0] == 0, "unknown type")
+assert(try(format, "{}{}", 1)[0] == 0, "too few arguments")
+assert(try(format, "{0}{}", 1, 2)[0] == 0, "mixed fields")
+assert(try(format, "{:d}", "abc")[0] == 0, "non-numeric string as an integer")
+assert(try(format, "{:.2f}", "1.5x")[0] == 0, "non-numeric string as a float")
+assert(try(format, "{:d}", [1])[0] == 0, "list as an integer")
+assert(try(format, "{:.99999999999f}", 1.5)[0] == 0, "precision too large")
+assert(try(format, "{:99999999999}", 1)[0] == 0, "width too large")
+assert_eq(#format("{:1000}", 1), 1000, "large width within the cap")
@@ -0,0 +1,37 @@
+execfile("tests/_lib.sol")
+
+old = debug.gc_threshold(0)
+assert_eq(debug.gc_stats().threshold, 0, "automatic collection disabled")
+debug.gc_collect()
+before = debug.gc_stats().collected
+for i in range(100) do
+	l = []
+	l:insert(0, l)
+	m = {}
+	m.self = m
+	func f() return f end
+	f.closure.f = f
+end
+l = None
+m = None
+f = None
+n = debug.gc_collect()
+assert(n >= 300, "collected self-referencing list, map and function: " + tostring(n))
+assert_eq(debug.gc_stats().collected - before, n, "collection stats")
+
+a = {}
+b = [a]
+a.b = b
+a = None
+b = None
+assert(debug.gc_collect() >= 2, "collected two-object cycle")
+
+x = [1, 2, 3]
+y = {a = x}
+y.y = y
+debug.gc_collect()
+assert_eq(y.a[2], 3, "reachable cycle kept")
+assert_eq(y.y.y.a, x, "reachable cycle intact")
+
+assert_eq(debug.gc_threshold(old), 0, "threshold set")
+assert_eq(debug.gc_stats().threshold, old, "threshold restored")
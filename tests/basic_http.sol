@@ -0,0 +1,84 @@
+execfile("tests/_lib.sol")
+
+CRLF = chr(13) + "
+"
+func bytes(s)
+	b = buffer.fromstring(s)
+	n = #(b)
+	return b:sub(0, n - 1)
+end
+
+head = "GET /index.html?q=1 HTTP/1.1" + CRLF + "Host: example.com" + CRLF + "X-Long:   " + ("v" * 40) + " 	" + CRLF + "content-length: 5" + CRLF + CRLF
+req = http.parse_request(bytes(head + "hello"))
+assert_eq(tostring(req.method), "GET", "method")
+assert_eq(tostring(req.path), "/index.html?q=1", "path")
+assert_eq(req.minor_version, 1, "minor version")
+assert_eq(#(req.headers), 3, "header count")
+assert_eq(tostring(req.headers[0][0]), "Host", "header name")
+assert_eq(tostring(req.headers[0][1]), "example.com", "header value")
+assert_eq(tostring(req.headers[1][1]), "v" * 40, "header value trimmed")
+assert_eq(req.content_length, 5, "content length")
+assert_eq(req.keep_alive, 1, "HTTP/1.1 keeps alive")
+assert_eq(req.length, #head, "head length")
+assert_eq(tostring(http.header(req.headers, "HOST")), "example.com", "header lookup ignores case")
+assert_eq(http.header(req.headers, "Cookie"), None, "missing header")
+
+buf = bytes(head)
+for n in range(#head) do
+	assert(None == http.parse_request(buf:sub(0, n)), "incomplete at " + tostring(n))
+end
+hlen = #head
+req = http.parse_request(buf, 0, hlen - 1)
+assert_eq(req.length, hlen, "resume after a partial head")
+assert(None == http.parse_request(buf:sub(0, 40), 0, 20), "still incomplete")
+assert(None == http.parse_request(buf, 0, 20, 40), "incomplete within a length")
+assert_eq(http.parse_request(buf + "extra", 0, None, hlen).length, hlen, "parse within a length")
+assert(try(func() return http.parse_request(buf, 0, None, hlen + 1) end)[0] == 0, "length past the buffer")
+
+two = bytes("junk" + head + "POST /a HTTP/1.0" + CRLF + "Connection: Keep-Alive" + CRLF + CRLF)
+req = http.parse_request(two, 4)
+assert_eq(req.length, #head, "parse from an offset")
+next = req.length
+req = http.parse_request(two, 4 + next)
+assert_eq(tostring(req.method), "POST", "pipelined request")
+assert_eq(req.minor_version, 0, "HTTP/1.0")
+assert_eq(req.keep_alive, 1, "HTTP/1.0 asked to keep alive")
+assert_eq(req.content_length, None, "no content length")
+req = http.parse_request(bytes("GET / HTTP/1.1" + CRLF + "Connection: close" + CRLF + CRLF))
+assert_eq(req.keep_alive, 0, "close")
+
+func bad(s) return try(func() return http.parse_request(bytes(s)) end)[0] == 0 end
+assert(bad("GET  / HTTP/1.1" + CRLF + CRLF), "empty path")
+assert(bad("GET / HTTP/2.0" + CRLF + CRLF), "bad version")
+assert(bad("GET / HTTP/1.1" + CRLF + " folded" + CRLF + CRLF), "continuation line")
+assert(bad("GET / HTTP/1.1" + CRLF + "A: b" + chr(1) + CRLF + CRLF), "control character")
+assert(bad("GET / HTTP/1.1" + CRLF + "Content-Length: 1x" + CRLF + CRLF), "bad content length")
+assert(bad("POST / HTTP/1.1" + CRLF + "Content-Length: 4" + CRLF + "Transfer-Encoding: chunked" + CRLF + CRLF), "both framings")
+assert(bad("POST / HTTP/1.1" + CRLF + "Content-Length: 4" + CRLF + "Content-Length: 5" + CRLF + CRLF), "conflicting content lengths")
+assert(bad("POST / HTTP/1.1" + CRLF + "Transfer-Encoding: chunked, gzip" + CRLF + CRLF), "chunked not last")
+req = http.parse_request(bytes("POST / HTTP/1.1" + CRLF + "Transfer-Encoding: gzip, Chunked" + CRLF + CRLF))
+assert_eq(req.chunked, 1, "chunked body")
+assert_eq(req.content_length, None, "no content length with chunks")
+req = http.parse_request(bytes("POST / HTTP/1.1" + CRLF + "Content-Length: 4" + CRLF + "Content-Length: 4" + CRLF + CRLF))
+assert_eq(req.content_length, 4, "repeated equal content length")
+assert_eq(req.chunked, 0, "not chunked")
+
+res = http.parse_response(bytes("HTTP/1.1 404 Not Found" + CRLF + "Content-Length: 0" + CRLF + CRLF))
+assert_eq(res.status, 404, "status")
+assert_eq(tostring(res.reason), "Not Found", "reason")
+assert_eq(res.content_length, 0, "response content length")
+assert_eq(http.reason(503), "Service Unavailable", "reason for a status")
+
+out = io.memstream()
+n = http.write_response(out, 200, [["Content-Type", "text/plain"], ["X-Count", 3]], "hi there")
+want = "HTTP/1.1 200 OK" + CRLF + "Content-Type: text/plain" + CRLF + "X-Count: 3" + CRLF + "Content-Length: 8" + CRLF + CRLF + "hi there"
+assert_eq(tostring(out:getbuffer()), want, "write a response")
+assert_eq(n, #want, "bytes written")
+res = http.parse_response(out:getbuffer())
+hlen = res.length
+blen = res.content_length
+assert_eq(hlen + blen, #want, "response parses back")
+
+out = io.memstream()
+http.write_response(out, 304, {["Content-Length"] = 10})
+assert_eq(tostring(out:getbuffer()), "HTTP/1.1 304 Not Modified" + CRLF + "Content-Length: 10" + CRLF + CRLF, "headers from a map, no body")
@@ -0,0 +1,26 @@
+execfile("tests/_lib.sol")
+
+n = debug.getref(None)
+p = debug.getref(print)
+x = debug.getref(5)
+held = []
+for i in range(100) do held:insert(0, [None, print, 5]) end
+assert_eq(debug.getref(None), n, "holding None doesn't count references")
+assert_eq(debug.getref(print), p, "holding builtins doesn't count references")
+assert_eq(debug.getref(5), x, "holding cached ints doesn't count references")
+held = None
+assert_eq(debug.getref(None), n, "releasing None doesn't count references")
+assert_eq(debug.getref(print), p, "releasing builtins doesn't count references")
+assert_eq(debug.getref(5), x, "releasing cached ints doesn't count references")
+
+o = {}
+r = debug.getref(o)
+held = [o, o, o]
+assert_eq(debug.getref(o), r + 3, "ordinary objects count references")
+held = None
+assert_eq(debug.getref(o), r, "ordinary objects release references")
+
+m = {}
+m.name = 1
+m["name"] += 1
+assert_eq(m.name, 2, "interned and uninterned keys agree")
@@ -0,0 +1,27 @@
+execfile("tests/_lib.sol")
+
+l = [1, 2, 3, 4, 5, 6]
+assert_eq(iter.collect(iter.map(func(x) return x * 10 end, l)), [10, 20, 30, 40, 50, 60], "map")
+assert_eq(iter.collect(iter.filter(func(x) return x % 2 end, l)), [1, 3, 5], "filter")
+assert_eq(iter.collect(iter.zip(l, [7, 8, 9])), [[1, 7], [2, 8], [3, 9]], "zip stops at the shortest")
+assert_eq(iter.collect(iter.enumerate([7, 8])), [[0, 7], [1, 8]], "enumerate")
+assert_eq(iter.collect(iter.enumerate([7, 8], 1)), [[1, 7], [2, 8]], "enumerate with start")
+assert_eq(iter.collect(iter.take(l, 2)), [1, 2], "take")
+assert_eq(iter.collect(iter.take(l, 10)), l, "take more than there are")
+assert_eq(iter.collect(iter.chain([1, 2], [], [3])), [1, 2, 3], "chain")
+assert_eq(#iter.collect("hey"), 3, "collect a string")
+assert_eq(#iter.collect({a = 1, b = 2}), 2, "collect a map")
+
+calls = [0]
+squares = iter.map(func(x) calls[0] += 1 return x * x end, range(1000))
+assert_eq(iter.collect(iter.take(squares, 3)), [0, 1, 4], "pipeline")
+assert_eq(calls[0], 3, "lazy")
+assert_eq(iter.collect(iter.take(squares, 1)), [9], "resumes where it stopped")
+
+total = 0
+for p in iter.enumerate(iter.filter(func(x) return x > 3 end, l)) do i = p[1] total += p[0] * i end
+assert_eq(total, 0 * 4 + 1 * 5 + 2 * 6, "for loop")
+
+assert(try(iter.collect, 5)[0] == 0, "non-iterable")
+assert(try(iter.map, 5, l)[0] == 0, "non-callable")
+assert(try(iter.collect, iter.map(func(x) error("boom") end, l))[0] == 0, "error in function")
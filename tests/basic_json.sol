@@ -0,0 +1,91 @@
+execfile("tests/_lib.sol")
+
+NL = "
+"
+func bytes(s)
+	b = buffer.fromstring(s)
+	n = #(b)
+	return b:sub(0, n - 1)
+end
+
+doc = json.decode('{"name": "sol", "tags": ["a", "b"], "n": 3, "f": 2.5, "big": 1e3, "t": true, "no": false, "nil": null, "e": {}, "l": []}')
+assert_eq(doc.name, "sol", "string member")
+assert_eq(#(doc.tags), 2, "list member")
+assert_eq(doc.tags[1], "b", "list item")
+assert_eq(doc.n, 3, "int member")
+assert_eq(type(doc.n), "int", "ints stay ints")
+assert_eq(doc.f, 2.5, "float member")
+assert_eq(type(doc.big), "float", "exponents make floats")
+assert_eq(doc.t, 1, "true")
+assert_eq(doc.no, 0, "false")
+assert_eq(doc.nil, None, "null")
+assert_eq(#(doc.e), 0, "empty map")
+assert_eq(#(doc.l), 0, "empty list")
+assert_eq(json.decode(" 	-12 " + NL), 0 - 12, "top-level scalar with whitespace")
+assert_eq(type(json.decode("99999999999999999999")), "float", "ints too big for an int")
+assert_eq(json.decode(bytes('[1, [2, [3]]]'))[1][1][0], 3, "decode a buffer")
+
+s = json.decode('"a\"b\\c\/\n\t\u00e9\ud83d\ude00"')
+assert_eq(#s, 14, "escapes decode to UTF-8")
+assert_eq(s:sub(0, 6), 'a"b\c/', "simple escapes")
+assert_eq(ord(s:sub(6, 7)), 10, "newline escape")
+assert_eq(s:sub(8, 10), chr(195) + chr(169), "two-byte escape")
+assert_eq(s:sub(10, 14), chr(240) + chr(159) + chr(152) + chr(128), "surrogate pair")
+
+rows = json.decode('[{"id": 1}, {"id": 2}, {"id": 3}]')
+assert_eq(rows[2].id, 3, "list of maps")
+
+bad = ['', '[', '[1,]', '{"a" 1}', '{a: 1}', '01', '1.', '-', 'tru', '"abc', '"\x"', '"\ud800"', '"\u0000"', '[1] 2', '{"a": 1,}']
+for text in bad do
+	r = try(json.decode, text)
+	assert(r[0] == 0, "rejects " + text)
+end
+r = try(json.decode, "[1, 2, x]")
+assert(r[1]:find("offset 7") >= 0, "errors give the offset")
+assert(try(json.decode, "[" * 1000)[0] == 0, "deep nesting is an error")
+
+events = []
+func on_event(event, value)
+	events:insert(#events, [event, value])
+end
+assert_eq(json.decode('{"a": [1, "x"], "b": null}', on_event), None, "callback mode returns None")
+kinds = []
+for e in events do kinds:insert(#kinds, e[0]) end
+assert_eq(kinds, ["start_map", "key", "start_list", "value", "value", "end_list", "key", "value", "end_map"], "events")
+assert_eq(events[1][1], "a", "key event")
+assert_eq(events[4][1], "x", "value event")
+func stop(event, value)
+	if event == "value" then error("stopped") end
+end
+r = try(json.decode, "[1, 2]", stop)
+assert_eq(r[1], "stopped", "callback errors propagate")
+
+assert_eq(json.encode(None), "null", "encode null")
+assert_eq(json.encode([1, 2.5, 3.0, "x"]), '[1,2.5,3.0,"x"]', "encode list")
+assert_eq(json.encode({a = 1}), '{"a":1}', "encode map")
+assert_eq(json.encode({[5] = "five"}), '{"5":"five"}', "int keys are quoted")
+assert_eq(json.encode('a"b\c' + NL + chr(1)), '"a\"b\\c\n\u0001"', "encode escapes")
+assert_eq(json.encode(bytes("raw")), '"raw"', "encode a buffer")
+assert(try(json.encode, json.decode("1e999"))[0] == 0, "inf is an error")
+assert(try(json.encode, [print])[0] == 0, "functions are an error")
+cyc = []
+cyc:insert(0, cyc)
+assert(try(json.encode, cyc)[0] == 0, "cycles are an error")
+
+value = {list = [1, [2, {k = "v"}]], s = "t" + NL, n = None, f = 0.1}
+again = json.decode(json.encode(value))
+assert_eq(again.list[1][1].k, "v", "round trip nested")
+assert_eq(again.s, "t" + NL, "round trip string")
+assert_eq(again.f, 0.1, "round trip float")
+
+m = io.memstream()
+big = []
+for i in range(2000) do big:insert(i, {id = i, name = "item" + tostring(i)}) end
+n = json.dump(big, m)
+m:seek(0, io.SEEK_SET)
+text = m:read(io.ALL)
+assert_eq(n, #text, "dump returns the bytes written")
+assert(text == json.encode(big), "dump writes what encode returns")
+back = json.decode(text)
+assert_eq(#back, 2000, "dump round trip")
+assert_eq(back[1999].name, "item1999", "dump round trip item")
@@ -0,0 +1,60 @@
+execfile("tests/_lib.sol")
+
+m = {}
+for i in range(1000) do m[i] = i * 2 end
+assert_eq(#m, 1000, "large map len")
+assert_eq(m[999], 1998, "large map get")
+
+for i in range(500) do m[i] = None end
+assert_eq(#m, 500, "large map delete")
+assert_none(m[3], "deleted key")
+assert_eq(m[700], 1400, "key after deletions")
+
+s = 0
+for k in m do s += k end
+assert_eq(s, 374750, "iterate over keys")
+
+n = {x = 1}
+assert_eq(n["x"], 1, "string key")
+n[1.5] = 2
+assert_eq(n[1.5], 2, "float key")
+assert_none(n[1], "int key differs from float")
+n[[1, 2]] = 3
+assert_eq(n[[1, 2]], 3, "list key")
+n[print] = 4
+assert_eq(n[print], 4, "identity key")
+
+c = {}
+for i in range(10) do c[i] = i end
+i = 100
+while i < 5000 do
+	c[i] = 1
+	c[i] = None
+	i += 1
+end
+assert_none(c[99999], "lookup after churning keys")
+assert_eq(#c, 10, "churned keys are gone")
+assert_eq(c[9], 9, "live keys survive churn")
+
+o = {}
+o.c = 1
+o.a = 2
+o.b = 3
+o.a = 4
+ks = []
+for k in o do ks:insert(#ks, k) end
+assert_eq(ks, ["c", "a", "b"], "maps iterate in insertion order")
+
+lk = [1, 2]
+l = {}
+l[lk] = "list"
+lk:insert(#lk, 3)
+assert_eq(l[lk], "list", "list key found after it changes")
+assert_none(l[[1, 2]], "list key no longer matches its old value")
+
+bk = buffer.fromstring("key"):sub(0, 3)
+b = {}
+b[bk] = 1
+bk:set(buffer.type.char, "K", 0)
+assert_eq(b["key"], 1, "buffer key keeps the value it was stored with")
+assert_none(b[bk], "changed buffer is a different key")
@@ -0,0 +1,79 @@
+execfile("tests/_lib.sol")
+
+NL = "
+"
+func bytes(s)
+	b = buffer.fromstring(s)
+	n = #(b)
+	return b:sub(0, n - 1)
+end
+
+func roundtrip(v)
+	return marshal.loads(marshal.dumps(v))
+end
+
+assert_eq(roundtrip(None), None, "None")
+assert_eq(roundtrip(0), 0, "zero")
+assert_eq(roundtrip(0 - 1), 0 - 1, "negative int")
+assert_eq(roundtrip(123456789012), 123456789012, "big int")
+assert_eq(roundtrip(0.1), 0.1, "float")
+assert_eq(type(roundtrip(3.0)), "float", "floats stay floats")
+assert_eq(roundtrip("text" + NL), "text" + NL, "string")
+assert_eq(roundtrip(""), "", "empty string")
+b = roundtrip(bytes("raw"))
+assert_eq(type(b), "buffer", "buffer")
+assert_eq(tostring(b), "raw", "buffer contents")
+v = roundtrip([1, "two", [3.5, None], {a = 1, [2] = "b"}])
+assert_eq(v[1], "two", "list item")
+assert_eq(v[2][0], 3.5, "nested list")
+assert_eq(v[3].a, 1, "map string key")
+assert_eq(v[3][2], "b", "map int key")
+assert_eq(#(roundtrip({})), 0, "empty map")
+assert_eq(#(roundtrip([])), 0, "empty list")
+
+d = marshal.dumps(1)
+assert_eq(type(d), "buffer", "dumps returns a buffer")
+assert_eq(#d, 7, "small values are small")
+
+shared = [1]
+v = roundtrip([shared, shared, {k = shared}])
+v[0]:insert(1, 2)
+assert_eq(#(v[1]), 2, "shared lists stay shared")
+assert_eq(#(v[2].k), 2, "shared through a map")
+cyc = [1]
+cyc:insert(1, cyc)
+c = roundtrip(cyc)
+assert_eq(c[1][1][1][0], 1, "cycles survive")
+c:insert(2, "x")
+assert_eq(#(c[1]), 3, "a cycle refers to itself")
+m = {}
+m.self = m
+m2 = roundtrip(m)
+m2.x = 5
+assert_eq(m2.self.self.x, 5, "map cycles survive")
+
+assert(try(marshal.dumps, [print])[0] == 0, "functions are an error")
+assert(try(marshal.loads, "nope")[0] == 0, "bad magic is an error")
+good = marshal.dumps([1, 2, "three"])
+n = #good
+for i in range(n) do
+	assert(try(marshal.loads, good:sub(0, i))[0] == 0, "truncated at " + tostring(i))
+end
+big = marshal.dumps(["x" * 1000])
+assert_eq(#big, 1011, "lengths are varints")
+
+s = io.memstream()
+n1 = marshal.dump({name = "first"}, s)
+n2 = marshal.dump([1, 2, 3], s)
+total = n1 + n2
+assert_eq(total, #(s:getbuffer()), "dump returns the bytes written")
+s:seek(0, io.SEEK_SET)
+assert_eq(marshal.load(s).name, "first", "load the first value")
+assert_eq(marshal.load(s)[2], 3, "load the second value")
+assert_eq(marshal.load(s), None, "load at the end")
+
+rows = []
+for i in range(2000) do rows:insert(i, {id = i, name = "row" + tostring(i)}) end
+back = marshal.loads(marshal.dumps(rows))
+assert_eq(#back, 2000, "many rows")
+assert_eq(back[1999].name, "row1999", "last row")
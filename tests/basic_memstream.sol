@@ -0,0 +1,56 @@
+execfile("tests/_lib.sol")
+
+NL = "
+"
+m = io.memstream()
+assert_eq(#(m:getbuffer()), 0, "empty")
+assert_eq(m:write("HTTP/1.1 ", 200, " OK", NL), 16, "write")
+m:write("x" * 1000)
+b = m:getbuffer()
+assert_eq(#b, 1016, "getbuffer has everything written")
+assert_eq(tostring(b:sub(0, 16)), "HTTP/1.1 200 OK" + NL, "contents")
+assert(try(func() b:set(buffer.type.uint8, 0, 65) end)[0] == 0, "getbuffer is immutable")
+m:write("tail")
+assert_eq(#b, 1016, "earlier getbuffer keeps its contents")
+assert_eq(#(m:getbuffer()), 1020, "later getbuffer sees more")
+assert_eq(m:tell(), 1020, "tell")
+
+m:seek(0, io.SEEK_SET)
+assert_eq(tostring(m:read(io.LINE)), "HTTP/1.1 200 OK" + NL, "read a line back")
+assert_eq(#(m:read(io.ALL)), 1004, "read the rest")
+assert_eq(#(m:read(io.LINE)), 0, "nothing more")
+assert(m:eof(), "eof")
+m:seek(4, io.SEEK_SET)
+m:write("/2.0")
+m:seek(0, io.SEEK_SET)
+assert_eq(tostring(m:read(io.LINE)), "HTTP/2.0 200 OK" + NL, "overwrite")
+m:seek(1030, io.SEEK_SET)
+m:write("!")
+assert_eq(#(m:getbuffer()), 1031, "write past the end")
+
+func bytes(s)
+	b = buffer.fromstring(s)
+	n = #(b)
+	return b:sub(0, n - 1)
+end
+
+src = bytes("one" + NL + "two" + NL)
+f = io.frombuffer(src)
+lines = []
+for line in f do lines:insert(#lines, tostring(line)) end
+assert_eq(lines, ["one" + NL, "two" + NL], "iterate lines of a buffer")
+f:seek(0, io.SEEK_SET)
+f:write("ONE")
+assert_eq(tostring(src:sub(0, 3)), "one", "writes don't change the source buffer")
+assert_eq(tostring(f:getbuffer():sub(0, 7)), "ONE" + NL + "two", "writes change the stream")
+
+prog = io.memstream()
+prog:write("parsed = 6 * 7")
+parse(prog:getbuffer())()
+assert_eq(parsed, 42, "parse from a memory stream")
+
+out = io.memstream()
+assert_eq(io.copy(io.frombuffer(bytes("copied")), out), 6, "copy between memory streams")
+assert_eq(tostring(out:getbuffer()), "copied", "copied contents")
+assert(try(func() return io.stdout:getbuffer() end)[0] == 0, "getbuffer of a file")
+assert(try(func() return io.frombuffer(3) end)[0] == 0, "frombuffer needs a buffer")
@@ -0,0 +1,31 @@
+execfile("tests/_lib.sol")
+
+path = "/tmp/sol_mmap_test.txt"
+f = io.open(path, io.MODE_WRITE | io.MODE_TRUNCATE)
+f:write("hello mapped world|second line|")
+f:flush()
+f = None
+
+m = io.mmap(path)
+assert_eq(m:size(), 31, "maps the whole file")
+assert_eq(m:find("world"), 13, "find")
+assert_eq(tostring(m:sub(6, 12)), "mapped", "sub")
+assert_eq(m:get(buffer.type.char, 0), "h", "get")
+assert_eq(m:split("|")[1], "second line", "split")
+assert(try(func() m:set(buffer.type.char, "j", 0) end)[0] == 0, "read-only map is immutable")
+m:madvise(io.MADV_SEQUENTIAL)
+part = m:sub(0, 5)
+m = None
+assert_eq(tostring(part), "hello", "a part keeps the mapping alive")
+
+m = io.mmap(path, io.MODE_READ, 6, 6)
+assert_eq(tostring(m), "mapped", "unaligned offset and length")
+m:madvise(io.MADV_WILLNEED)
+assert(try(func() return io.mmap(path, io.MODE_READ, 0, 100) end)[0] == 0, "map past end")
+assert(try(func() return io.mmap(path, io.MODE_READ, 8, 9223372036854775807) end)[0] == 0, "map whose end overflows")
+assert(try(func() buffer.new(8):madvise(io.MADV_DONTNEED) end)[0] == 0, "madvise on unmapped buffer")
+
+m = io.mmap(path, io.MODE_READ | io.MODE_WRITE)
+m:set(buffer.type.char, "j", 0)
+m = None
+assert_eq(tostring(io.mmap(path):sub(0, 5)), "jello", "writable map writes through")
@@ -0,0 +1,108 @@
+execfile("tests/_lib.sol")
+
+NL = "
+"
+loop = event.loop()
+srv = net.listen("127.0.0.1", 0)
+port = net.address(srv)[1]
+assert(port > 0, "listening on an ephemeral port")
+assert_eq(net.accept(srv), None, "accept with nothing waiting")
+
+-- An echo server: each line comes back quoted
+served = [0]
+func on_client(l, conn, ev)
+	while 1 do
+		line = conn:read(io.LINE)
+		if None == line then break end
+		if 0 == (#line) then break end
+		conn:write("> ", line)
+	end
+	conn:flush()
+	if conn:eof() then
+		net.shutdown(conn)
+		l:unwatch(conn)
+		served[0] += 1
+	end
+end
+loop:watch(srv, event.READ, func(l, s, ev)
+	c = net.accept(s)
+	while None != c do
+		l:watch(c, event.READ, on_client)
+		c = net.accept(s)
+	end
+end)
+
+replies = []
+clients = []
+func on_reply(l, c, ev)
+	for client in clients do
+		if client[0] == c then
+			client[1] += tostring(c:read(4096))
+			if c:eof() then
+				l:unwatch(c)
+				replies:insert(#replies, client[1])
+			end
+		end
+	end
+end
+func on_connect(l, c, ev)
+	assert_eq(net.error(c), None, "connected")
+	for client in clients do
+		if client[0] == c then
+			c:write(client[2], NL, "second", NL)
+		end
+	end
+	c:flush()
+	net.shutdown(c, net.SHUT_WR)
+	l:watch(c, event.READ, on_reply)
+end
+func start_client(text)
+	cli = net.connect("127.0.0.1", port)
+	clients:insert(#clients, [cli, "", text])
+	loop:watch(cli, event.WRITE, on_connect)
+end
+start_client("hello")
+start_client("world")
+
+ticks = [0]
+tick = loop:timer(1, func(l, id) ticks[0] += 1 end, 1)
+loop:timer(5000, func(l, id) l:stop() end)
+loop:timer(1, func(l, id)
+	n = served[0]
+	if n + (#replies) == 4 then
+		l:stop()
+	end
+end, 1)
+loop:run()
+
+replies:sort()
+assert_eq(replies, ["> hello" + NL + "> second" + NL, "> world" + NL + "> second" + NL], "echoed over loopback")
+assert_eq(served[0], 2, "server saw both connections close")
+assert(ticks[0] > 0, "repeating timer fired")
+assert_eq(loop:cancel(tick), 1, "cancel a timer")
+assert_eq(loop:cancel(tick), 0, "cancel twice")
+
+fired = []
+loop = event.loop()
+loop:timer(20, func(l, id) fired:insert(#fired, "b") end)
+loop:timer(10, func(l, id) fired:insert(#fired, "a") end)
+t0 = event.now()
+loop:run()
+assert_eq(fired, ["a", "b"], "timers fire in order")
+assert(event.now() - t0 >= 20, "timers wait")
+assert_eq(loop:run_once(0), 0, "nothing left to do")
+
+path = "/tmp/sol_net_test_" + tostring(event.now()) + ".sock"
+usrv = net.listen_unix(path)
+ucli = net.connect_unix(path)
+uconn = net.accept(usrv)
+ucli:write("ping")
+ucli:flush()
+loop:watch(uconn, event.READ, func(l, c, ev)
+	assert_eq(ev, event.READ, "readable")
+	assert_eq(tostring(c:read(4)), "ping", "unix socket")
+	l:unwatch(c)
+end)
+assert_eq(loop:run_once(1000), 1, "one callback")
+assert_eq(net.address(usrv)[0], path, "unix address")
+assert(try(func() return net.connect_unix("/tmp/sol_no_such.sock") end)[0] == 0, "connect failure")
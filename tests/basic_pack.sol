@@ -0,0 +1,58 @@
+execfile("tests/_lib.sol")
+
+b = buffer.new(32)
+assert_eq(buffer.calcsize("<hHi"), 8, "standard size")
+assert_eq(buffer.calcsize("@bi"), 8, "native alignment")
+assert_eq(buffer.calcsize("=bi"), 5, "no alignment")
+assert_eq(buffer.calcsize("<3xq"), 11, "padding")
+
+assert_eq(b:pack("<hHi", 0, 0 - 2, 65535, 0 - 100000), 8, "pack returns end offset")
+assert_eq(b:unpack("<hHi"), [0 - 2, 65535, 0 - 100000], "roundtrip little-endian")
+assert_eq(b:get(buffer.type.uint8, 0), 254, "little-endian low byte first")
+
+b:pack(">IH", 0, 16909060, 258)
+assert_eq(b:get(buffer.type.uint8, 0), 1, "big-endian high byte first")
+assert_eq(b:get(buffer.type.uint8, 3), 4, "big-endian low byte last")
+assert_eq(b:unpack(">IH"), [16909060, 258], "roundtrip big-endian")
+assert_eq(b:unpack(">H", 4), [258], "offset")
+
+b:pack("<dfq", 8, 1.5, 0.25, 0 - 1)
+assert_eq(b:unpack("<dfq", 8), [1.5, 0.25, 0 - 1], "floats and int64")
+b:pack("3B", 0, 1, 2, 3)
+assert_eq(b:unpack("3B"), [1, 2, 3], "counts")
+
+b:pack("<4sc", 0, "abcdef", "z")
+r = b:unpack("<4sc")
+assert_eq(tostring(r[0]), "abcd", "string truncated to its count")
+assert_eq(r[1], "z", "char")
+b:pack("<4s", 0, "ab")
+assert_eq(b:get(buffer.type.uint8, 2), 0, "string padded with NULs")
+
+assert(try(func() return b:unpack("<q", 30) end)[0] == 0, "unpack past end")
+assert(try(func() return b:pack("<hh", 0, 1) end)[0] == 0, "too few values")
+assert(try(func() return b:unpack("<hz") end)[0] == 0, "bad format")
+
+recs = buffer.new(12)
+for i in range(3) do recs:pack("<HH", i * 4, i, i * 10) end
+got = []
+for rec in recs:unpack_iter("<HH") do got:insert(#got, rec) end
+assert_eq(got, [[0, 0], [1, 10], [2, 20]], "unpack_iter")
+assert_eq(iter.collect(recs:unpack_iter("<HH", 8)), [[2, 20]], "unpack_iter from offset")
+assert_eq(iter.collect(iter.map(func(r) return r[1] end, recs:unpack_iter("<HH"))), [0, 10, 20], "unpack_iter in pipeline")
+
+big = buffer.new(16)
+r = try(func() return big:unpack("2305843009213693952Q") end)
+assert(r[0] == 0, "count times size past the size range")
+assert_eq(r[1], "Pack format too large", "overflowing format is refused")
+assert(try(func() return buffer.calcsize("99999999999999999999b") end)[0] == 0, "count past the size range")
+assert(try(func() return buffer.calcsize("9223372036854775807xb") end)[0] == 0, "offset past the size range")
+
+big:pack("<QQ", 0, 0 - 4096, 9223372036854775807)
+r = big:unpack("<QQ")
+assert_eq(r[0], 18446744073709547520.0, "uint64 past the int range unpacks as a float")
+assert_eq(r[1], 9223372036854775807, "uint64 within the int range unpacks as an int")
+big:pack("<Q", 0, r[0])
+assert_eq(big:unpack("<Q")[0], r[0], "uint64 floats pack back")
+unsized = buffer.fromaddress(big:address(), 0 - 1)
+assert(try(func() return unsized:unpack("<Q") end)[0] == 0, "unpack from unsized buffer")
+assert(try(func() return unsized:pack("<Q", 0, 1) end)[0] == 0, "pack into unsized buffer")
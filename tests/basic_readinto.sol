@@ -0,0 +1,42 @@
+execfile("tests/_lib.sol")
+
+path = "/tmp/sol_readinto_test.txt"
+f = io.open(path, io.MODE_WRITE | io.MODE_TRUNCATE)
+f:write("0123456789abcdef")
+f = None
+
+f = io.open(path, io.MODE_READ)
+b = buffer.new(8)
+assert_eq(f:readinto(b), 8, "fills the buffer")
+assert_eq(tostring(b), "01234567", "contents")
+assert_eq(f:readinto(b, 2, 3), 3, "offset and count")
+assert_eq(tostring(b), "0189a567", "read at the offset")
+assert_eq(tostring(f:read(2)), "bc", "read continues after readinto")
+assert_eq(f:readinto(b), 3, "short read at the end")
+assert_eq(f:readinto(b), 0, "0 at the end of the file")
+assert(try(func() return f:readinto(b, 6, 4) end)[0] == 0, "past the end of the buffer")
+assert(try(func() return f:readinto("literal") end)[0] == 0, "immutable buffer")
+
+p = buffer.new(100, 1)
+assert_eq(p:size(), 100, "pooled buffer size")
+assert_eq(buffer.new(100, 0):size(), 100, "unpooled buffer")
+addr = p:address()
+p = None
+p = buffer.new(120, 1)
+assert_eq(p:address(), addr, "pooled region reused")
+p:set(buffer.type.uint8, 7, 119)
+assert_eq(p:get(buffer.type.uint8, 119), 7, "pooled buffer is usable")
+big = buffer.new(1048576, 1)
+big:set(buffer.type.uint8, 9, 1048575)
+assert_eq(big:get(buffer.type.uint8, 1048575), 9, "a buffer too large to pool")
+big = None
+
+total = 0
+f = io.open(path, io.MODE_READ)
+chunk = buffer.new(5, 1)
+while 1 do
+	n = f:readinto(chunk)
+	if n == 0 then break end
+	total += n
+end
+assert_eq(total, 16, "read loop")
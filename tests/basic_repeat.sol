@@ -0,0 +1,17 @@
+execfile("tests/_lib.sol")
+
+assert_eq(tostring("ab") * 3, "ababab", "string repeat")
+assert_eq(tostring("ab") * "2", "abab", "string repeat by a cast count")
+assert_eq(#(tostring("xyz") * 1000), 3000, "long string repeat")
+assert_eq(tostring("ab") * 0, "", "string repeat zero times")
+assert_eq(tostring("ab") * -1, "", "string repeat negative times")
+
+assert_eq([1, 2] * 3, [1, 2, 1, 2, 1, 2], "list repeat")
+assert_eq(#([0] * 4016), 4016, "long list repeat")
+assert_eq([1] * 0, [], "list repeat zero times")
+assert_eq([1, 2] * 1, [1, 2], "list repeat once")
+assert_eq(try(func() return [1, 2] * 4611686018427387904 end)[0], 0, "list repeat too large")
+
+assert_eq("ab" * 3, "ababab", "buffer repeat")
+assert_eq(#("abcde" * 1001), 5005, "long buffer repeat")
+assert_eq("ab" * 0, "", "buffer repeat zero times")
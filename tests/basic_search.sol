@@ -0,0 +1,24 @@
+execfile("tests/_lib.sol")
+
+s = "a,b,,c"
+assert_eq(s:split(","), ["a", "b", "", "c"], "split keeps empty fields")
+assert_eq(s:split(",", 1), ["a", "b,,c"], "split with a max count")
+assert_eq(s:split(",,"), ["a,b", "c"], "split on a multi-byte separator")
+assert_eq(s:split(";"), ["a,b,,c"], "split without a match")
+assert_eq("  a  b ":split(), ["a", "b"], "split on whitespace")
+assert_eq("  a  b ":split(None, 1), ["a", "b "], "split on whitespace with a max count")
+assert_eq(tostring(12321):split("2"), ["1", "3", "1"], "string split")
+assert_eq(try(s.split, s, "")[0], 0, "split on an empty separator")
+
+parts = s:split(",")
+s = None
+assert_eq(parts[3], "c", "split parts outlive their source")
+
+x = "the quick brown fox jumps over the lazy dog, the end"
+assert_eq(x:find("lazy dog"), 35, "find")
+assert_eq(x:find("the end"), 45, "find near the end")
+assert_eq(x:find("cat"), -1, "find without a match")
+assert_eq(tostring(x):find("fox"), 16, "string find")
+assert_eq(x:count("the"), 3, "count")
+assert_eq("aaaa":count("aa"), 2, "count is non-overlapping")
+assert_eq(tostring(1211):count("1"), 3, "string count")
@@ -0,0 +1,67 @@
+execfile("tests/_lib.sol")
+
+src = "/tmp/sol_sendfile_src.txt"
+dst = "/tmp/sol_sendfile_dst.txt"
+NL = "
+"
+body = "0123456789" * 10000
+f = io.open(src, io.MODE_WRITE | io.MODE_TRUNCATE)
+f:write("header", NL, body)
+f = None
+
+func contents(path) return tostring(io.open(path, io.MODE_READ):read(io.ALL)) end
+
+f = io.open(src, io.MODE_READ)
+out = io.open(dst, io.MODE_WRITE | io.MODE_TRUNCATE)
+assert_eq(f:sendfile(out), 100007, "sendfile everything")
+assert(contents(dst) == "header" + NL + body, "sendfile contents")
+assert_eq(f:tell(), 100007, "sendfile moves the position")
+
+out = io.open(dst, io.MODE_WRITE | io.MODE_TRUNCATE)
+f:seek(0, io.SEEK_SET)
+out:write("[")
+assert_eq(f:sendfile(out, 7, 5), 5, "sendfile from an offset")
+out:write("]")
+out:flush()
+assert_eq(contents(dst), "[01234]", "sendfile keeps order with buffered writes")
+assert_eq(f:tell(), 0, "sendfile from an offset leaves the position")
+
+out = io.open(dst, io.MODE_WRITE | io.MODE_TRUNCATE)
+f = io.open(src, io.MODE_READ)
+assert_eq(tostring(f:read(io.LINE)), "header" + NL, "read a line first")
+assert_eq(io.copy(f, out, 12), 12, "copy a count")
+assert_eq(io.copy(f, out), 99988, "copy the rest")
+assert_eq(io.copy(f, out), 0, "copy at the end")
+assert(f:eof(), "copy reaches the end")
+assert(contents(dst) == body, "copy starts with what was already read")
+
+-- Appending files can't be written by sendfile, so this copies through memory
+out = io.open(dst, io.MODE_WRITE | io.MODE_APPEND)
+assert_eq(io.open(src, io.MODE_READ):sendfile(out, 0, 6), 6, "fallback copy")
+assert(contents(dst) == body + "header", "fallback contents")
+
+-- Over loopback: a file into a socket, and the socket into a file
+srv = net.listen("127.0.0.1", 0)
+port = net.address(srv)[1]
+cli = net.setblocking(net.connect("127.0.0.1", port), 1)
+conn = None
+while None == conn do conn = net.accept(srv) end
+net.setblocking(conn, 1)
+out = io.open(dst, io.MODE_WRITE | io.MODE_TRUNCATE)
+sent = io.open(src, io.MODE_READ):sendfile(cli, 7, 50000)
+net.shutdown(cli, net.SHUT_WR)
+assert_eq(sent, 50000, "sendfile to a socket")
+assert_eq(io.copy(conn, out), 50000, "copy from a socket")
+assert(contents(dst) == "01234567890123456789" * 2500, "socket contents")
+net.shutdown(conn)
+cli = None
+
+-- A socket shut for writing fails with EPIPE, which is an error, not a short count
+cli = net.setblocking(net.connect("127.0.0.1", port), 1)
+net.shutdown(cli, net.SHUT_WR)
+assert(try(func() return io.open(src, io.MODE_READ):sendfile(cli) end)[0] == 0, "sendfile to a closed socket")
+assert(try(func() return io.copy(io.open(src, io.MODE_READ), cli) end)[0] == 0, "copy to a closed socket")
+cli = None
+
+assert(try(func() return io.copy(f, f) end)[0] == 0, "copy to itself")
+assert(try(func() return io.copy(f, 3) end)[0] == 0, "copy to a non-stream")
@@ -0,0 +1,56 @@
+execfile("tests/_lib.sol")
+
+l = [5, 3, 9, 1, 3, 7]
+l:sort()
+assert_eq(l, [1, 3, 3, 5, 7, 9], "ints")
+l = [2.5, 0.5, 1.5]
+l:sort()
+assert_eq(l, [0.5, 1.5, 2.5], "floats")
+l = [3, 1.5, 2]
+l:sort()
+assert_eq(l, [1.5, 2, 3], "mixed numbers")
+l = ["pear", "apple", "fig", tostring("banana"), "ban"]
+l:sort()
+assert_eq(tostring(l), tostring(["apple", "ban", tostring("banana"), "fig", "pear"]), "strings and buffers")
+l = []
+l:sort()
+assert_eq(l, [], "empty")
+
+l = [[2, "b"], [1, "a"], [2, "a"], [1, "b"]]
+l:sort(func(x) return x[0] end)
+assert_eq(tostring(l), tostring([[1, "a"], [1, "b"], [2, "b"], [2, "a"]]), "key is stable")
+l = [1, 2, 3, 4, 5]
+l:sort(None, func(a, b) return b - a end)
+assert_eq(l, [5, 4, 3, 2, 1], "cmp")
+calls = [0]
+l = [3, 1, 2]
+l:sort(func(x) calls[0] += 1 return 0 - x end)
+assert_eq(l, [3, 2, 1], "key")
+assert_eq(calls[0], 3, "key called once per item")
+
+seed = 12345
+func rnd(n)
+	seed = (seed * 1103515245 + 12345) % 2147483648
+	return seed % n
+end
+sorted = 1
+for trial in range(20) do
+	l = []
+	for i in range(rnd(200)) do l:insert(#l, [rnd(10), i]) end
+	l:sort(func(x) return x[0] end)
+	for i in range((#l) - 1) do
+		if l[i][0] > l[i + 1][0] then sorted = 0 end
+		if l[i][0] == l[i + 1][0] then if l[i][1] > l[i + 1][1] then sorted = 0 end end
+	end
+end
+assert_eq(sorted, 1, "random keys, sorted and stable")
+l = []
+for i in range(1000) do l:insert(#l, rnd(100000)) end
+l:sort()
+sorted = 1
+for i in range((#l) - 1) do if l[i] > l[i + 1] then sorted = 0 end end
+assert_eq(sorted, 1, "random ints")
+
+l = [1, 2, 3]
+assert(try(func() l:sort(func(x) error("boom") end) end)[0] == 0, "key error")
+assert_eq(l, [1, 2, 3], "list untouched after error")
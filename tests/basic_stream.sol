@@ -0,0 +1,44 @@
+execfile("tests/_lib.sol")
+
+NL = "
+"
+path = "/tmp/sol_stream_test.txt"
+long = "x" * 200000
+f = io.open(path, io.MODE_WRITE | io.MODE_TRUNCATE)
+f:write("first" + NL + "second" + NL + long + NL + "last")
+f = None
+
+lines = []
+for line in io.open(path, io.MODE_READ) do lines:insert(#lines, line) end
+assert_eq(#lines, 4, "line count")
+assert_eq(tostring(lines[0]), "first" + NL, "lines keep their newline")
+assert_eq(#(lines[2]), 200001, "a line longer than the read buffer")
+assert_eq(tostring(lines[3]), "last", "a last line without a newline")
+assert_eq(tostring(lines[1]), "second" + NL, "kept lines stay valid")
+
+f = io.open(path, io.MODE_READ)
+assert_eq(tostring(f:read(io.LINE)), "first" + NL, "read LINE")
+assert_eq(tostring(f:read(3)), "sec", "read mixes with lines")
+assert_eq(f:tell(), 9, "tell accounts for the read buffer")
+assert_eq(tostring(f:read(io.LINE)), "ond" + NL, "rest of the line")
+f:seek(0, io.SEEK_SET)
+assert_eq(tostring(f:read(5)), "first", "seek drops the read buffer")
+f:seek(long:size() + 9, io.SEEK_CUR)
+assert_eq(tostring(f:read(io.ALL)), "last", "read ALL after buffered reads")
+assert_eq(f:read(io.LINE):size(), 0, "read LINE at the end")
+assert(f:eof(), "eof")
+
+f = io.open(path, io.MODE_WRITE | io.MODE_TRUNCATE)
+for i in range(200) do f:write(tostring(i) + NL) end
+f:write(long + NL + "end")
+f = None
+kept = []
+i = 0
+for line in io.open(path, io.MODE_READ) do
+	if i % 50 == 0 then kept:insert(#kept, line) end
+	i += 1
+end
+assert_eq(#kept, 5, "kept every fiftieth line")
+assert_eq(tostring(kept[0]), "0" + NL, "a kept line outlives its read buffer")
+assert_eq(tostring(kept[3]), "150" + NL, "a kept line copied out of the read buffer")
+assert_eq(#(kept[4]), 200001, "a kept long line")
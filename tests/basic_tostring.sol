@@ -0,0 +1,16 @@
+execfile("tests/_lib.sol")
+
+assert_eq(tostring(0), "0", "int zero")
+assert_eq(tostring(1234567), "1234567", "int")
+assert_eq(tostring(0 - 1234567), "-1234567", "negative int")
+assert_eq(tostring(-9223372036854775807 - 1), "-9223372036854775808", "smallest int")
+assert_eq(tostring(1234567890123), "1234567890123", "int past 32 bits")
+
+assert_eq(tostring(42.0), "42.0", "integral float")
+assert_eq(tostring(0.1), "0.1", "shortest float")
+assert_eq(tostring(1.0 / 3), "0.3333333333333333", "float needing 16 digits")
+assert_eq(tostring(0.1 + 0.2), "0.30000000000000004", "float needing 17 digits")
+assert_eq(tofloat(tostring(1.0 / 7)), 1.0 / 7, "float round trip")
+assert_eq(tostring(tofloat("5e-324")), "5e-324", "shortest subnormal")
+assert_eq(tostring(tofloat("1.5e-310")), "1.5e-310", "short subnormal")
+assert_eq(tostring(0.0 * -1), "-0.0", "negative zero")
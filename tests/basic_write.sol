@@ -0,0 +1,41 @@
+execfile("tests/_lib.sol")
+
+path = "/tmp/sol_write_test.txt"
+NL = "
+"
+f = io.open(path, io.MODE_WRITE | io.MODE_TRUNCATE)
+assert_eq(f:write("a", 1, "b", 2.5), 6, "write returns the total of all arguments")
+assert_eq(#(io.open(path, io.MODE_READ):read(io.ALL)), 0, "buffered until flushed")
+assert_eq(f:tell(), 6, "tell counts buffered bytes")
+f:flush()
+assert_eq(tostring(io.open(path, io.MODE_READ):read(io.ALL)), "a1b2.5", "flushed in order")
+
+big = "xy" * 400
+f:write("<", big, ">", "buf")
+f:write(big)
+f:flush()
+assert_eq(tostring(io.open(path, io.MODE_READ):read(io.ALL)), "a1b2.5<" + big + ">buf" + big, "large strings queued in order")
+
+f:setbuffer(0)
+f:write("now")
+assert_eq(tostring(io.open(path, io.MODE_READ):read(io.ALL)), "a1b2.5<" + big + ">buf" + big + "now", "unbuffered")
+f:setbuffer(4)
+f:write("ab")
+f:write("cdef")
+assert_eq(#(io.open(path, io.MODE_READ):read(io.ALL)), 1620, "write larger than the buffer goes out")
+f = None
+
+f = io.open(path, io.MODE_WRITE | io.MODE_TRUNCATE)
+old = io.stdout
+io.stdout = f
+print("p", 1)
+prepr(12)
+io.stdout = old
+f:flush()
+assert_eq(tostring(io.open(path, io.MODE_READ):read(io.ALL)), "p 1 " + NL + "12 " + NL + NL, "print and prepr follow io.stdout")
+
+f = io.open(path, io.MODE_READ | io.MODE_WRITE | io.MODE_TRUNCATE)
+f:write("line one", NL, "line two", NL)
+f:seek(0, io.SEEK_SET)
+assert_eq(tostring(f:read(io.LINE)), "line one" + NL, "read after write")
+assert(try(func() return io.open(path, io.MODE_READ):write("x") end)[0] == 0, "write to non-writable stream")
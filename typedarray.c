@@ -0,0 +1,853 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+/* Typed numeric arrays.
+ *
+ * An array is a SOL_CDATA object with ArrayOps, viewing a buffer as a packed
+ * sequence of one of the numeric buffer types (see `buffer.type`). Indexing
+ * reads and writes the element in place, without a method call; the array
+ * methods are kernels over whole arrays, which run in C instead of as a
+ * loop in the interpreter.
+ *
+ * The kernels are plain loops over each element type, written so that every
+ * type shares them. The ones most used on double arrays (elementwise
+ * arithmetic, sum, dot and min/max) are also written with SSE2 (and AVX,
+ * when compiled for it), as are the int32 sums, uint8 sums and the search for
+ * the first differing element in compare. Integer arithmetic wraps around;
+ * a float stored into (or combined with) an integer array must be a whole
+ * number, and uint64 elements past the range of an int read back as floats.
+ */
+
+typedef struct {
+	sol_object_t *buf; // The buffer holding the elements
+	sol_buftype_t dtype; // One of the types in _SOL_ARRAY_TYPES
+	size_t size; // The size of an element
+	size_t len; // The number of elements
+} _sol_arraybody_t;
+
+#define ARRAY(obj) ((_sol_arraybody_t *) (obj)->cdata)
+#define DATA(obj) (ARRAY(obj)->buf->mem->buffer)
+
+#define _SOL_ARRAY_INTS(X) \
+	X(BUF_INT8, int8_t, "int8") \
+	X(BUF_INT16, int16_t, "int16") \
+	X(BUF_INT32, int32_t, "int32") \
+	X(BUF_INT64, int64_t, "int64") \
+	X(BUF_UINT8, uint8_t, "uint8") \
+	X(BUF_UINT16, uint16_t, "uint16") \
+	X(BUF_UINT32, uint32_t, "uint32") \
+	X(BUF_UINT64, uint64_t, "uint64")
+
+#define _SOL_ARRAY_FLOATS(X) \
+	X(BUF_FLOAT, float, "float") \
+	X(BUF_DOUBLE, double, "double")
+
+#define _SOL_ARRAY_TYPES(X) _SOL_ARRAY_INTS(X) _SOL_ARRAY_FLOATS(X)
+
+enum {
+	_SOL_ARRAY_ADD,
+	_SOL_ARRAY_MUL,
+	_SOL_ARRAY_MIN,
+	_SOL_ARRAY_MAX
+};
+
+#define sol_is_array(state, obj) ((obj)->ops == &((state)->ArrayOps))
+
+// Maps a buffer type to the fixed-size type arrays use for it, or BUF_NONE.
+static sol_buftype_t _sol_array_dtype(long tp) {
+	switch(tp) {
+#define X(tag, T, name) case tag:
+		_SOL_ARRAY_TYPES(X)
+#undef X
+			return tp;
+
+		case BUF_BYTE:
+			return BUF_UINT8;
+
+		case BUF_INT:
+			return sizeof(int) == 4 ? BUF_INT32 : BUF_INT64;
+
+		case BUF_UINT:
+			return sizeof(unsigned int) == 4 ? BUF_UINT32 : BUF_UINT64;
+
+		case BUF_LONG:
+			return sizeof(long) == 4 ? BUF_INT32 : BUF_INT64;
+
+		case BUF_ULONG:
+			return sizeof(unsigned long) == 4 ? BUF_UINT32 : BUF_UINT64;
+	}
+	return BUF_NONE;
+}
+
+static size_t _sol_array_size(sol_buftype_t dtype) {
+	switch(dtype) {
+#define X(tag, T, name) case tag: return sizeof(T);
+		_SOL_ARRAY_TYPES(X)
+#undef X
+		default:
+			return 0;
+	}
+}
+
+static const char *_sol_array_name(sol_buftype_t dtype) {
+	switch(dtype) {
+#define X(tag, T, name) case tag: return name;
+		_SOL_ARRAY_TYPES(X)
+#undef X
+		default:
+			return "none";
+	}
+}
+
+static int _sol_array_isfloat(sol_buftype_t dtype) {
+	return dtype == BUF_FLOAT || dtype == BUF_DOUBLE;
+}
+
+// Reads a number to store into an array, as both an int and a float; for
+// integer arrays, it must be a whole number that fits in an int. Returns 0
+// (having set an error) if it isn't.
+static int _sol_array_scalar(sol_state_t *state, sol_buftype_t dtype, sol_object_t *obj, long *l, double *d) {
+	sol_object_t *tmp;
+	if(sol_is_int(obj)) {
+		*l = obj->ival;
+		*d = obj->ival;
+		return 1;
+	}
+	if(sol_is_float(obj)) {
+		*d = obj->fval;
+	} else {
+		tmp = sol_cast_float(state, obj);
+		*d = sol_is_float(tmp) ? tmp->fval : 0;
+		sol_obj_free(tmp);
+	}
+	if(_sol_array_isfloat(dtype)) {
+		*l = 0;
+		return 1;
+	}
+	// -2^63 <= d < 2^63, and d is whole (which NaN isn't)
+	if(!(*d >= -9223372036854775808.0 && *d < 9223372036854775808.0) || *d != (double) (long) *d) {
+		sol_obj_free(sol_set_error_string(state, "Store non-integral or out-of-range value in integer array"));
+		return 0;
+	}
+	*l = (long) *d;
+	return 1;
+}
+
+// Returns an element (or a reduction) as a Sol number: a float for float
+// arrays, and an int otherwise, except for uint64 values past the range of an
+// int, which become floats.
+static sol_object_t *_sol_array_number(sol_state_t *state, sol_buftype_t dtype, long l, double d) {
+	if(_sol_array_isfloat(dtype)) {
+		return sol_new_float(state, d);
+	}
+	if(dtype == BUF_UINT64 && l < 0) {
+		return sol_new_float(state, (double) (unsigned long) l);
+	}
+	return sol_new_int(state, l);
+}
+
+sol_object_t *sol_new_array(sol_state_t *state, sol_object_t *buf, long tp) {
+	_sol_arraybody_t *body;
+	sol_buftype_t dtype = _sol_array_dtype(tp);
+	if(dtype == BUF_NONE) {
+		return sol_set_error_string(state, "Create array of non-numeric type");
+	}
+	if(!sol_is_buffer(buf) || buf->mem->sz < 0) {
+		return sol_set_error_string(state, "Create array over unsized buffer");
+	}
+	body = malloc(sizeof(_sol_arraybody_t));
+	if(!body) {
+		return sol_set_error(state, state->OutOfMemory);
+	}
+	body->buf = sol_incref(buf);
+	body->dtype = dtype;
+	body->size = _sol_array_size(dtype);
+	body->len = buf->mem->sz / body->size;
+	return sol_new_cdata(state, body, &(state->ArrayOps));
+}
+
+size_t sol_array_len(sol_state_t *state, sol_object_t *arr) {
+	return ARRAY(arr)->len;
+}
+
+sol_object_t *sol_array_get(sol_state_t *state, sol_object_t *arr, size_t idx) {
+	void *data = DATA(arr);
+	if(idx >= ARRAY(arr)->len) {
+		return sol_set_error_string(state, "Array index out of range");
+	}
+	switch(ARRAY(arr)->dtype) {
+#define X(tag, T, name) case tag: return _sol_array_number(state, tag, (long) ((T *) data)[idx], 0);
+		_SOL_ARRAY_INTS(X)
+#undef X
+#define X(tag, T, name) case tag: return sol_new_float(state, ((T *) data)[idx]);
+		_SOL_ARRAY_FLOATS(X)
+#undef X
+		default:
+			return sol_incref(state->None);
+	}
+}
+
+int sol_array_set(sol_state_t *state, sol_object_t *arr, size_t idx, sol_object_t *obj) {
+	void *data = DATA(arr);
+	long l;
+	double d;
+	if(idx >= ARRAY(arr)->len) {
+		sol_obj_free(sol_set_error_string(state, "Array index out of range"));
+		return 1;
+	}
+	if(ARRAY(arr)->buf->mem->flags & SOL_BUF_IMMUTABLE) {
+		sol_obj_free(sol_set_error_string(state, "Set into immutable buffer"));
+		return 1;
+	}
+	if(!_sol_array_scalar(state, ARRAY(arr)->dtype, obj, &l, &d)) {
+		return 1;
+	}
+	switch(ARRAY(arr)->dtype) {
+#define X(tag, T, name) case tag: ((T *) data)[idx] = (T) l; break;
+		_SOL_ARRAY_INTS(X)
+#undef X
+#define X(tag, T, name) case tag: ((T *) data)[idx] = (T) d; break;
+		_SOL_ARRAY_FLOATS(X)
+#undef X
+		default:
+			break;
+	}
+	return 0;
+}
+
+// Kernels
+
+#define _SOL_BINOP_LOOP(T, EXPR) \
+	for(; i < n; i++) { \
+		T a = x[i], b = y ? y[i] : s; \
+		x[i] = (EXPR); \
+	}
+
+#define _SOL_VBINOP_LOOP(W, LOAD, STORE, OP, VS) \
+	for(; i + (W) <= n; i += (W)) { \
+		STORE(x + i, OP(LOAD(x + i), y ? LOAD(y + i) : (VS))); \
+	}
+
+static void _sol_array_binop_f64(int op, double *x, const double *y, double s, size_t n) {
+	size_t i = 0;
+#ifdef __AVX__
+	__m256d vs4 = _mm256_set1_pd(s);
+	switch(op) {
+		case _SOL_ARRAY_ADD: _SOL_VBINOP_LOOP(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, vs4); break;
+		case _SOL_ARRAY_MUL: _SOL_VBINOP_LOOP(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_mul_pd, vs4); break;
+		case _SOL_ARRAY_MIN: _SOL_VBINOP_LOOP(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_min_pd, vs4); break;
+		case _SOL_ARRAY_MAX: _SOL_VBINOP_LOOP(4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_max_pd, vs4); break;
+	}
+#endif
+#ifdef __SSE2__
+	__m128d vs2 = _mm_set1_pd(s);
+	switch(op) {
+		case _SOL_ARRAY_ADD: _SOL_VBINOP_LOOP(2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, vs2); break;
+		case _SOL_ARRAY_MUL: _SOL_VBINOP_LOOP(2, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd, vs2); break;
+		case _SOL_ARRAY_MIN: _SOL_VBINOP_LOOP(2, _mm_loadu_pd, _mm_storeu_pd, _mm_min_pd, vs2); break;
+		case _SOL_ARRAY_MAX: _SOL_VBINOP_LOOP(2, _mm_loadu_pd, _mm_storeu_pd, _mm_max_pd, vs2); break;
+	}
+#endif
+	// The vector min and max return their second operand if either is NaN,
+	// and so do these.
+	switch(op) {
+		case _SOL_ARRAY_ADD: _SOL_BINOP_LOOP(double, a + b); break;
+		case _SOL_ARRAY_MUL: _SOL_BINOP_LOOP(double, a * b); break;
+		case _SOL_ARRAY_MIN: _SOL_BINOP_LOOP(double, a < b ? a : b); break;
+		case _SOL_ARRAY_MAX: _SOL_BINOP_LOOP(double, a > b ? a : b); break;
+	}
+}
+
+// Applies the operation elementwise to x, with the elements of y or else s.
+static void _sol_array_binop(sol_buftype_t dtype, int op, void *xp, const void *yp, long l, double d, size_t n) {
+	size_t i = 0;
+	if(dtype == BUF_DOUBLE) {
+		_sol_array_binop_f64(op, xp, yp, d, n);
+		return;
+	}
+	switch(dtype) {
+#define X(tag, T, name) \
+		case tag: { \
+			T *x = xp, s = (T) l; \
+			const T *y = yp; \
+			switch(op) { \
+				case _SOL_ARRAY_ADD: _SOL_BINOP_LOOP(T, (T) ((unsigned long) a + (unsigned long) b)); break; \
+				case _SOL_ARRAY_MUL: _SOL_BINOP_LOOP(T, (T) ((unsigned long) a * (unsigned long) b)); break; \
+				case _SOL_ARRAY_MIN: _SOL_BINOP_LOOP(T, a < b ? a : b); break; \
+				case _SOL_ARRAY_MAX: _SOL_BINOP_LOOP(T, a > b ? a : b); break; \
+			} \
+			break; \
+		}
+		_SOL_ARRAY_INTS(X)
+#undef X
+		case BUF_FLOAT: {
+			float *x = xp, s = (float) d;
+			const float *y = yp;
+			switch(op) {
+				case _SOL_ARRAY_ADD: _SOL_BINOP_LOOP(float, a + b); break;
+				case _SOL_ARRAY_MUL: _SOL_BINOP_LOOP(float, a * b); break;
+				case _SOL_ARRAY_MIN: _SOL_BINOP_LOOP(float, a < b ? a : b); break;
+				case _SOL_ARRAY_MAX: _SOL_BINOP_LOOP(float, a > b ? a : b); break;
+			}
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+static double _sol_array_sum_f64(const double *x, size_t n) {
+	size_t i = 0;
+	double res = 0, lanes[4];
+#ifdef __AVX__
+	__m256d acc4 = _mm256_setzero_pd();
+	for(; i + 4 <= n; i += 4) {
+		acc4 = _mm256_add_pd(acc4, _mm256_loadu_pd(x + i));
+	}
+	_mm256_storeu_pd(lanes, acc4);
+	res += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+#ifdef __SSE2__
+	__m128d acc2 = _mm_setzero_pd();
+	for(; i + 2 <= n; i += 2) {
+		acc2 = _mm_add_pd(acc2, _mm_loadu_pd(x + i));
+	}
+	_mm_storeu_pd(lanes, acc2);
+	res += lanes[0] + lanes[1];
+#endif
+	for(; i < n; i++) {
+		res += x[i];
+	}
+	return res;
+}
+
+static double _sol_array_dot_f64(const double *x, const double *y, size_t n) {
+	size_t i = 0;
+	double res = 0, lanes[4];
+#ifdef __AVX__
+	__m256d acc4 = _mm256_setzero_pd();
+	for(; i + 4 <= n; i += 4) {
+		acc4 = _mm256_add_pd(acc4, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+	}
+	_mm256_storeu_pd(lanes, acc4);
+	res += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+#ifdef __SSE2__
+	__m128d acc2 = _mm_setzero_pd();
+	for(; i + 2 <= n; i += 2) {
+		acc2 = _mm_add_pd(acc2, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+	}
+	_mm_storeu_pd(lanes, acc2);
+	res += lanes[0] + lanes[1];
+#endif
+	for(; i < n; i++) {
+		res += x[i] * y[i];
+	}
+	return res;
+}
+
+static long _sol_array_sum_u8(const uint8_t *x, size_t n) {
+	size_t i = 0;
+	unsigned long res = 0;
+#ifdef __SSE2__
+	__m128i acc = _mm_setzero_si128(), zero = _mm_setzero_si128();
+	for(; i + 16 <= n; i += 16) {
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (x + i)), zero));
+	}
+	res = (unsigned long) _mm_cvtsi128_si64(acc) + (unsigned long) _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+#endif
+	for(; i < n; i++) {
+		res += x[i];
+	}
+	return res;
+}
+
+static long _sol_array_sum_i32(const int32_t *x, size_t n) {
+	size_t i = 0;
+	long res = 0;
+	int64_t lanes[2];
+#ifdef __SSE2__
+	// Sign-extend each half to 64 bits, so that the sum can't overflow
+	__m128i acc = _mm_setzero_si128(), v, sign;
+	for(; i + 4 <= n; i += 4) {
+		v = _mm_loadu_si128((const __m128i *) (x + i));
+		sign = _mm_srai_epi32(v, 31);
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, sign));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, sign));
+	}
+	_mm_storeu_si128((__m128i *) lanes, acc);
+	res = lanes[0] + lanes[1];
+#endif
+	for(; i < n; i++) {
+		res += x[i];
+	}
+	return res;
+}
+
+// Sums the array, or with y, sums the elementwise product; ints into *l,
+// floats into *d.
+static void _sol_array_reduce_sum(sol_buftype_t dtype, const void *xp, const void *yp, size_t n, long *l, double *d) {
+	unsigned long ul = 0;
+	double acc = 0;
+	size_t i;
+	if(dtype == BUF_DOUBLE) {
+		*d = yp ? _sol_array_dot_f64(xp, yp, n) : _sol_array_sum_f64(xp, n);
+		return;
+	}
+	if(!yp && dtype == BUF_UINT8) {
+		*l = _sol_array_sum_u8(xp, n);
+		return;
+	}
+	if(!yp && dtype == BUF_INT32) {
+		*l = _sol_array_sum_i32(xp, n);
+		return;
+	}
+	switch(dtype) {
+#define X(tag, T, name) \
+		case tag: { \
+			const T *x = xp, *y = yp; \
+			if(y) { \
+				for(i = 0; i < n; i++) ul += (unsigned long) x[i] * (unsigned long) y[i]; \
+			} else { \
+				for(i = 0; i < n; i++) ul += (unsigned long) x[i]; \
+			} \
+			*l = (long) ul; \
+			break; \
+		}
+		_SOL_ARRAY_INTS(X)
+#undef X
+		case BUF_FLOAT: {
+			const float *x = xp, *y = yp;
+			if(y) {
+				for(i = 0; i < n; i++) acc += (double) x[i] * y[i];
+			} else {
+				for(i = 0; i < n; i++) acc += x[i];
+			}
+			*d = acc;
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+static double _sol_array_minmax_f64(const double *x, size_t n, int max) {
+	size_t i = 1;
+	double res = x[0], lanes[2];
+#ifdef __SSE2__
+	__m128d acc;
+	if(n >= 2) {
+		acc = _mm_loadu_pd(x);
+		for(i = 2; i + 2 <= n; i += 2) {
+			acc = max ? _mm_max_pd(acc, _mm_loadu_pd(x + i)) : _mm_min_pd(acc, _mm_loadu_pd(x + i));
+		}
+		_mm_storeu_pd(lanes, acc);
+		res = max ? (lanes[0] > lanes[1] ? lanes[0] : lanes[1]) : (lanes[0] < lanes[1] ? lanes[0] : lanes[1]);
+	}
+#endif
+	for(; i < n; i++) {
+		res = max ? (res > x[i] ? res : x[i]) : (res < x[i] ? res : x[i]);
+	}
+	return res;
+}
+
+// Finds the smallest (or largest) element of a nonempty array.
+static void _sol_array_reduce_minmax(sol_buftype_t dtype, const void *xp, size_t n, int max, long *l, double *d) {
+	size_t i;
+	if(dtype == BUF_DOUBLE) {
+		*d = _sol_array_minmax_f64(xp, n, max);
+		return;
+	}
+	switch(dtype) {
+#define X(tag, T, name) \
+		case tag: { \
+			const T *x = xp; \
+			T res = x[0]; \
+			for(i = 1; i < n; i++) { \
+				if(max ? x[i] > res : x[i] < res) res = x[i]; \
+			} \
+			*l = (long) res; \
+			*d = (double) res; \
+			break; \
+		}
+		_SOL_ARRAY_TYPES(X)
+#undef X
+		default:
+			break;
+	}
+}
+
+// Returns the offset of the first byte at which two regions differ, or n.
+static size_t _sol_array_mismatch(const char *a, const char *b, size_t n) {
+	size_t i = 0;
+#ifdef __SSE2__
+	unsigned int mask;
+	for(; i + 16 <= n; i += 16) {
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)), _mm_loadu_si128((const __m128i *) (b + i))));
+		if(mask != 0xffff) {
+			return i + __builtin_ctz(~mask);
+		}
+	}
+#endif
+	for(; i < n; i++) {
+		if(a[i] != b[i]) {
+			return i;
+		}
+	}
+	return n;
+}
+
+static int _sol_array_cmp_elem(sol_buftype_t dtype, const void *xp, const void *yp, size_t idx) {
+	switch(dtype) {
+#define X(tag, T, name) case tag: return ((const T *) xp)[idx] < ((const T *) yp)[idx] ? -1 : (((const T *) xp)[idx] > ((const T *) yp)[idx] ? 1 : 0);
+		_SOL_ARRAY_TYPES(X)
+#undef X
+		default:
+			return 0;
+	}
+}
+
+/** Compares two arrays of the same type element by element, then by length.
+ *
+ * Equal elements have equal bytes (but for -0.0 and 0.0, which are checked
+ * as values), so the search for the first unequal element is a byte search.
+ */
+int sol_array_compare(sol_state_t *state, sol_object_t *a, sol_object_t *b) {
+	const char *x = DATA(a), *y = DATA(b);
+	size_t size = ARRAY(a)->size, n = ARRAY(a)->len < ARRAY(b)->len ? ARRAY(a)->len : ARRAY(b)->len, off = 0, idx;
+	int res;
+	while(off < n * size) {
+		off += _sol_array_mismatch(x + off, y + off, n * size - off);
+		if(off >= n * size) {
+			break;
+		}
+		idx = off / size;
+		res = _sol_array_cmp_elem(ARRAY(a)->dtype, x, y, idx);
+		if(res) {
+			return res;
+		}
+		off = (idx + 1) * size;
+	}
+	return ARRAY(a)->len < ARRAY(b)->len ? -1 : (ARRAY(a)->len > ARRAY(b)->len ? 1 : 0);
+}
+
+// Methods
+
+// Checks that an array is writable.
+static int _sol_array_writable(sol_state_t *state, sol_object_t *arr) {
+	if(ARRAY(arr)->buf->mem->flags & SOL_BUF_IMMUTABLE) {
+		sol_obj_free(sol_set_error_string(state, "Set into immutable buffer"));
+		return 0;
+	}
+	return 1;
+}
+
+// Checks that another array has the same type and length as an array.
+static int _sol_array_match(sol_state_t *state, sol_object_t *a, sol_object_t *b) {
+	if(!sol_is_array(state, b) || ARRAY(b)->dtype != ARRAY(a)->dtype || ARRAY(b)->len != ARRAY(a)->len) {
+		sol_obj_free(sol_set_error_string(state, "Array operands differ in type or length"));
+		return 0;
+	}
+	return 1;
+}
+
+// Implements add, mul, min and max: in place with an array or a number, or,
+// for min and max without an argument, as reductions.
+static sol_object_t *_sol_array_binop_method(sol_state_t *state, sol_object_t *args, int op) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1), *res = NULL;
+	long l = 0;
+	double d = 0;
+	if(sol_is_none(state, b) && (op == _SOL_ARRAY_MIN || op == _SOL_ARRAY_MAX)) {
+		if(!ARRAY(a)->len) {
+			res = sol_set_error_string(state, "Reduce empty array");
+		} else {
+			_sol_array_reduce_minmax(ARRAY(a)->dtype, DATA(a), ARRAY(a)->len, op == _SOL_ARRAY_MAX, &l, &d);
+			res = _sol_array_number(state, ARRAY(a)->dtype, l, d);
+		}
+	} else if(_sol_array_writable(state, a)) {
+		if(sol_is_int(b) || sol_is_float(b)) {
+			if(_sol_array_scalar(state, ARRAY(a)->dtype, b, &l, &d)) {
+				_sol_array_binop(ARRAY(a)->dtype, op, DATA(a), NULL, l, d, ARRAY(a)->len);
+			}
+		} else if(_sol_array_match(state, a, b)) {
+			_sol_array_binop(ARRAY(a)->dtype, op, DATA(a), DATA(b), 0, 0, ARRAY(a)->len);
+		}
+	}
+	sol_obj_free(a);
+	sol_obj_free(b);
+	return res ? res : sol_incref(state->None);
+}
+
+sol_object_t *sol_f_array_add(sol_state_t *state, sol_object_t *args) {
+	return _sol_array_binop_method(state, args, _SOL_ARRAY_ADD);
+}
+
+sol_object_t *sol_f_array_mul(sol_state_t *state, sol_object_t *args) {
+	return _sol_array_binop_method(state, args, _SOL_ARRAY_MUL);
+}
+
+sol_object_t *sol_f_array_min(sol_state_t *state, sol_object_t *args) {
+	return _sol_array_binop_method(state, args, _SOL_ARRAY_MIN);
+}
+
+sol_object_t *sol_f_array_max(sol_state_t *state, sol_object_t *args) {
+	return _sol_array_binop_method(state, args, _SOL_ARRAY_MAX);
+}
+
+// Implements sum() and dot(other).
+static sol_object_t *_sol_array_sum_method(sol_state_t *state, sol_object_t *args, int dot) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *b = NULL, *res = NULL;
+	long l = 0;
+	double d = 0;
+	if(dot) {
+		b = sol_list_get_index(state, args, 1);
+		if(!_sol_array_match(state, a, b)) {
+			res = sol_incref(state->None);
+		}
+	}
+	if(!res) {
+		_sol_array_reduce_sum(ARRAY(a)->dtype, DATA(a), b ? DATA(b) : NULL, ARRAY(a)->len, &l, &d);
+		res = _sol_array_number(state, ARRAY(a)->dtype, l, d);
+	}
+	sol_obj_free(a);
+	if(b) {
+		sol_obj_free(b);
+	}
+	return res;
+}
+
+sol_object_t *sol_f_array_sum(sol_state_t *state, sol_object_t *args) {
+	return _sol_array_sum_method(state, args, 0);
+}
+
+sol_object_t *sol_f_array_dot(sol_state_t *state, sol_object_t *args) {
+	return _sol_array_sum_method(state, args, 1);
+}
+
+sol_object_t *sol_f_array_fill(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *v = sol_list_get_index(state, args, 1);
+	size_t size = ARRAY(a)->size, total = ARRAY(a)->len * size, done;
+	char *data = DATA(a);
+	// Store the first element, then double the filled region by copying it
+	if(ARRAY(a)->len && !sol_array_set(state, a, 0, v)) {
+		for(done = size; done < total; done *= 2) {
+			memcpy(data + done, data, (total - done < done) ? total - done : done);
+		}
+	}
+	sol_obj_free(a);
+	sol_obj_free(v);
+	return sol_incref(state->None);
+}
+
+sol_object_t *sol_f_array_copy(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *buf, *res;
+	size_t total = ARRAY(a)->len * ARRAY(a)->size;
+	char *data = malloc(total ? total : 1);
+	if(!data) {
+		sol_obj_free(a);
+		return sol_set_error(state, state->OutOfMemory);
+	}
+	memcpy(data, DATA(a), total);
+	buf = sol_new_buffer(state, data, total, OWN_FREE, NULL, NULL);
+	res = sol_new_array(state, buf, ARRAY(a)->dtype);
+	sol_obj_free(buf);
+	sol_obj_free(a);
+	return res;
+}
+
+sol_object_t *sol_f_array_compare(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1), *res;
+	if(!sol_is_array(state, b) || ARRAY(b)->dtype != ARRAY(a)->dtype) {
+		res = sol_set_error_string(state, "Compare arrays of different types");
+	} else {
+		res = sol_new_int(state, sol_array_compare(state, a, b));
+	}
+	sol_obj_free(a);
+	sol_obj_free(b);
+	return res;
+}
+
+sol_object_t *sol_f_array_tolist(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *res = sol_new_list(state), *item;
+	size_t i;
+	for(i = 0; i < ARRAY(a)->len; i++) {
+		item = sol_array_get(state, a, i);
+		sol_list_insert(state, res, i, item);
+		sol_obj_free(item);
+	}
+	sol_obj_free(a);
+	return res;
+}
+
+sol_object_t *sol_f_array_buffer(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *res = sol_incref(ARRAY(a)->buf);
+	sol_obj_free(a);
+	return res;
+}
+
+sol_object_t *sol_f_array_dtype(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *res = sol_new_int(state, ARRAY(a)->dtype);
+	sol_obj_free(a);
+	return res;
+}
+
+// Module functions
+
+// Creates a zeroed array of n elements of the given type.
+static sol_object_t *_sol_array_new(sol_state_t *state, long type, long n) {
+	size_t size = _sol_array_size(_sol_array_dtype(type));
+	sol_object_t *buf, *res;
+	char *data;
+	if(!size || n < 0) {
+		return sol_set_error_string(state, "Create array of non-numeric type or negative length");
+	}
+	data = (size_t) n <= SIZE_MAX / size ? calloc(n ? n : 1, size) : NULL;
+	if(!data) {
+		return sol_set_error(state, state->OutOfMemory);
+	}
+	buf = sol_new_buffer(state, data, n * size, OWN_FREE, NULL, NULL);
+	res = sol_new_array(state, buf, type);
+	sol_obj_free(buf);
+	return res;
+}
+
+sol_object_t *sol_f_array_new(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *tp = sol_list_get_index(state, args, 0), *n = sol_list_get_index(state, args, 1), *itp = sol_cast_int(state, tp), *in = sol_cast_int(state, n), *res;
+	sol_obj_free(tp);
+	sol_obj_free(n);
+	res = _sol_array_new(state, itp->ival, in->ival);
+	sol_obj_free(itp);
+	sol_obj_free(in);
+	return res;
+}
+
+sol_object_t *sol_f_array_frombuffer(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *buf = sol_list_get_index(state, args, 0), *tp = sol_list_get_index(state, args, 1), *itp = sol_cast_int(state, tp);
+	sol_object_t *res = sol_new_array(state, buf, itp->ival);
+	sol_obj_free(buf);
+	sol_obj_free(tp);
+	sol_obj_free(itp);
+	return res;
+}
+
+sol_object_t *sol_f_array_fromlist(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *list = sol_list_get_index(state, args, 0), *tp = sol_list_get_index(state, args, 1), *itp = sol_cast_int(state, tp), *res, *item;
+	size_t i, len = sol_list_len(state, list);
+	sol_obj_free(tp);
+	res = _sol_array_new(state, itp->ival, len);
+	sol_obj_free(itp);
+	for(i = 0; i < len && !sol_is_none(state, res) && !sol_has_error(state); i++) {
+		item = sol_list_get_index(state, list, i);
+		sol_array_set(state, res, i, item);
+		sol_obj_free(item);
+	}
+	sol_obj_free(list);
+	return res;
+}
+
+// Operations
+
+sol_object_t *sol_f_array_index(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *key = sol_list_get_index(state, args, 1), *funcs, *ikey, *res;
+	if(sol_is_int(key)) {
+		res = key->ival < 0 ? sol_set_error_string(state, "Array index out of range") : sol_array_get(state, a, key->ival);
+	} else if(sol_is_name(key)) {
+		funcs = sol_get_methods_name(state, "array");
+		res = sol_map_get(state, funcs, key);
+		sol_obj_free(funcs);
+	} else {
+		ikey = sol_cast_int(state, key);
+		res = ikey->ival < 0 ? sol_set_error_string(state, "Array index out of range") : sol_array_get(state, a, ikey->ival);
+		sol_obj_free(ikey);
+	}
+	sol_obj_free(a);
+	sol_obj_free(key);
+	return res;
+}
+
+sol_object_t *sol_f_array_setindex(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *key = sol_list_get_index(state, args, 1), *val = sol_list_get_index(state, args, 2);
+	sol_object_t *ikey = sol_cast_int(state, key);
+	if(ikey->ival < 0) {
+		sol_obj_free(sol_set_error_string(state, "Array index out of range"));
+	} else {
+		sol_array_set(state, a, ikey->ival, val);
+	}
+	sol_obj_free(a);
+	sol_obj_free(key);
+	sol_obj_free(ikey);
+	sol_obj_free(val);
+	return sol_incref(state->None);
+}
+
+sol_object_t *sol_f_array_len(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *res = sol_new_int(state, ARRAY(a)->len);
+	sol_obj_free(a);
+	return res;
+}
+
+sol_object_t *sol_f_array_cmp(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *b = sol_list_get_index(state, args, 1);
+	sol_object_t *res = sol_new_int(state, (sol_is_array(state, b) && ARRAY(b)->dtype == ARRAY(a)->dtype) ? sol_array_compare(state, a, b) : 1);
+	sol_obj_free(a);
+	sol_obj_free(b);
+	return res;
+}
+
+sol_object_t *sol_f_iter_array(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *local = sol_list_get_index(state, args, 1);
+	sol_object_t *index = sol_map_get_name(state, local, "idx"), *res;
+	size_t pos = 0;
+	if(sol_is_int(index)) {
+		pos = index->ival;
+	}
+	sol_obj_free(index);
+	if(pos >= ARRAY(a)->len) {
+		res = sol_incref(state->None);
+	} else {
+		res = sol_array_get(state, a, pos);
+		index = sol_new_int(state, pos + 1);
+		sol_map_set_name(state, local, "idx", index);
+		sol_obj_free(index);
+	}
+	sol_obj_free(a);
+	sol_obj_free(local);
+	return res;
+}
+
+sol_object_t *sol_f_array_iter(sol_state_t *state, sol_object_t *args) {
+	return sol_new_cfunc(state, sol_f_iter_array, "iter.array");
+}
+
+sol_object_t *sol_f_array_tostring(sol_state_t *state, sol_object_t *args) {
+	sol_object_t *a = sol_list_get_index(state, args, 0), *list, *lstr, *res;
+	char *s;
+	size_t len;
+	list = sol_f_array_tolist(state, args);
+	lstr = sol_cast_string(state, list);
+	len = strlen(_sol_array_name(ARRAY(a)->dtype)) + lstr->slen + 10;
+	s = malloc(len);
+	len = snprintf(s, len, "array(%s, %s)", _sol_array_name(ARRAY(a)->dtype), lstr->str);
+	res = sol_new_string_owned(state, s, len);
+	sol_obj_free(list);
+	sol_obj_free(lstr);
+	sol_obj_free(a);
+	return res;
+}
+
+sol_object_t *sol_f_array_free(sol_state_t *state, sol_object_t *arr) {
+	sol_obj_free(ARRAY(arr)->buf);
+	free(arr->cdata);
+	return arr;
+}